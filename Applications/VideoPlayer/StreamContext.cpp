@@ -3,6 +3,7 @@
 #include <Lemon/Core/Logger.h>
 #include <Lemon/Graphics/Surface.h>
 #include <Lemon/System/ABI/Audio.h>
+#include <Lemon/System/Util.h>
 
 #include <assert.h>
 #include <errno.h>
@@ -46,6 +47,11 @@ extern "C" {
 
 // Repsonible for sending samples to the audio driver
 void StreamContext::PlayAudio() {
+    // Keep the audio device fed even when the system is busy
+    if (Lemon::SetScheduler(0, LEMON_SCHED_RR, LEMON_SCHED_RT_PRIORITY_MIN + 49)) {
+        Lemon::Logger::Warning("Failed to set real-time scheduling policy: {}", strerror(errno));
+    }
+
     // The audio file to be played
     int fd = m_pcmOut;
 
@@ -3,6 +3,7 @@
 #include <Fs/FsVolume.h>
 #include <Hash.h>
 #include <Lock.h>
+#include <Objects/Process.h>
 #include <String.h>
 #include <Vector.h>
 
@@ -45,12 +46,87 @@
 #define EXT2_DOUBLY_INDIRECT_INDEX 13
 #define EXT2_TRIPLY_INDIRECT_INDEX 14
 
+// Inode flags
+#define EXT2_INDEX_FL 0x1000    // Directory is indexed with a hashed B-tree (htree)
+#define EXT4_EXTENTS_FL 0x80000 // Blocks are mapped with an extent tree instead of block pointers
+
+// Superblock flags, whether directory hashes treat names as signed or unsigned chars
+#define EXT2_FLAGS_SIGNED_HASH 0x1
+#define EXT2_FLAGS_UNSIGNED_HASH 0x2
+
+// Directory hash versions, the unsigned variants are selected by EXT2_FLAGS_UNSIGNED_HASH
+#define EXT2_DX_HASH_LEGACY 0
+#define EXT2_DX_HASH_HALF_MD4 1
+#define EXT2_DX_HASH_TEA 2
+#define EXT2_DX_HASH_LEGACY_UNSIGNED 3
+#define EXT2_DX_HASH_HALF_MD4_UNSIGNED 4
+#define EXT2_DX_HASH_TEA_UNSIGNED 5
+
+// Without the largedir feature htrees have at most one level of index nodes below the root
+#define EXT2_DX_MAX_INDIRECT_LEVELS 1
+
+#define EXT4_EXTENT_MAGIC 0xF30A
+// Extents longer than this are uninitialized (allocated but never written),
+// their length is the length field minus EXT4_EXTENT_INIT_MAX_LEN
+#define EXT4_EXTENT_INIT_MAX_LEN 32768
+#define EXT4_EXTENT_MAX_DEPTH 5
+
 // When block cache reaches 96MB, use existing cached blocks
 #define EXT2_BLOCKCACHE_LIMIT 96 * 1024 * 1024
+#define EXT2_BLOCKCACHE_BUCKETS 2048
+
+// Dirty blocks are written back by the flusher thread at least this often (in microseconds)
+#define EXT2_FLUSH_INTERVAL 5000000
+// Wake the flusher early once this much block data is dirty
+#define EXT2_DIRTY_BACKGROUND_LIMIT 8 * 1024 * 1024
+// Past this writers flush dirty blocks themselves
+#define EXT2_DIRTY_LIMIT 32 * 1024 * 1024
+// Maximum size of a single write when flushing contiguous dirty blocks
+#define EXT2_FLUSH_BATCH_SIZE 128 * 1024
+
+// Maximum amount of blocks read ahead with a single request
+#define EXT2_PREFETCH_MAX_BLOCKS 32
+// Maximum amount of inode table blocks gathered by a directory batch before they are read ahead
+#define EXT2_BATCH_PREFETCH_BLOCKS 128
+
+// Amount of blocks preallocated for files being appended to
+#define EXT2_PREALLOC_BLOCKS 16
 
 //#define EXT2_NO_CACHE
 
 namespace fs {
+// Heapsort, no allocations and no recursion
+template <typename T, typename Less> static inline void HeapSort(T* items, long count, Less less) {
+    auto siftDown = [items, &less](long root, long end) {
+        while (2 * root + 1 < end) {
+            long child = 2 * root + 1;
+            if (child + 1 < end && less(items[child], items[child + 1])) {
+                child++;
+            }
+
+            if (!less(items[root], items[child])) {
+                return;
+            }
+
+            T temp = items[root];
+            items[root] = items[child];
+            items[child] = temp;
+            root = child;
+        }
+    };
+
+    for (long i = count / 2 - 1; i >= 0; i--) {
+        siftDown(i, count);
+    }
+
+    for (long end = count - 1; end > 0; end--) {
+        T temp = items[0];
+        items[0] = items[end];
+        items[end] = temp;
+        siftDown(0, end);
+    }
+}
+
 class Ext2 : public fs::FsDriver {
 public:
     enum ErrorAction {
@@ -83,12 +159,20 @@ public:
         Recover = 0x4,       // Ext3
         JournalDevice = 0x8, // Ext3
         MetaBg = 0x10,
+        Extents = 0x40,          // Ext4 extent trees
+        Bit64 = 0x80,            // Ext4 64-bit block numbers and larger group descriptors
+        FlexBlockGroups = 0x200, // Ext4 group metadata may be placed in other groups
     };
 
     enum ReadonlyFeatures {
         Sparse = 0x1,     // Sparse Superblock (not stored in all block groups)
         LargeFiles = 0x2, // 64-bit file size support
         BinaryTree = 0x4, // Binary tree directory structure
+        HugeFile = 0x8,
+        GroupDescriptorChecksum = 0x10,
+        DirectoryNlink = 0x20,
+        ExtraInodeSize = 0x40,
+        MetadataChecksum = 0x400,
     };
 
     enum CreatorOS {
@@ -110,7 +194,9 @@ public:
     };
 
 #define EXT2_READONLY_FEATURE_SUPPORT (ReadonlyFeatures::Sparse | ReadonlyFeatures::LargeFiles)
-#define EXT2_INCOMPAT_FEATURE_SUPPORT (IncompatibleFeatures::Filetype)
+#define EXT2_INCOMPAT_FEATURE_SUPPORT                                                                                  \
+    (IncompatibleFeatures::Filetype | IncompatibleFeatures::Extents | IncompatibleFeatures::Bit64 |                    \
+     IncompatibleFeatures::FlexBlockGroups)
 
     typedef struct {
         uint32_t inodeCount;     // Number of inodes (used + free) in the file system
@@ -156,6 +242,24 @@ public:
         uint8_t preallocatedBlocks; // Blocks to preallocate when a file is created
         uint8_t preallocdDirBlocks; // Blocks to preallocate when a directory is created
         uint16_t align;
+        uint8_t journalUUID[16];      // UUID of the journal superblock (Ext3)
+        uint32_t journalInode;        // Inode of the journal file (Ext3)
+        uint32_t journalDevice;       // Device of the journal file (Ext3)
+        uint32_t lastOrphan;          // Start of the list of inodes to delete
+        uint32_t hashSeed[4];         // Seed for directory index hashes
+        uint8_t defaultHashVersion;   // Hash version used for new directory indexes
+        uint8_t journalBackupType;    //
+        uint16_t descriptorSize;      // Ext4
+        uint32_t defaultMountOptions; //
+        uint32_t firstMetaBg;         // First metablock block group
+        uint32_t mkfsTime;            // UNIX timestamp of when the filesystem was created
+        uint32_t journalBlocks[17];   // Backup of the journal inode blocks
+        uint32_t blockCountHigh;      // Ext4 64-bit fields
+        uint32_t resvBlockCountHigh;  //
+        uint32_t freeBlockCountHigh;  //
+        uint16_t minExtraInodeSize;   //
+        uint16_t wantExtraInodeSize;  //
+        uint32_t flags;               // Miscellaneous flags (e.g. EXT2_FLAGS_UNSIGNED_HASH)
     } __attribute__((packed)) ext2_superblock_extended_t; // Ext2 extended superblock
 
     typedef struct {
@@ -203,6 +307,58 @@ public:
         char name[];
     } __attribute__((packed)) ext2_directory_entry_t;
 
+    // Hashed directory index (htree)
+    //
+    // The first block of an indexed directory holds the '.' and '..' entries, with the '..' record
+    // covering the rest of the block. The index root lives in the space of that record.
+    // Index nodes are blocks containing one empty directory entry covering the whole block.
+    // Both are ignored by implementations without htree support, which only need to clear EXT2_INDEX_FL.
+    typedef struct {
+        uint32_t reserved;
+        uint8_t hashVersion;
+        uint8_t infoLength; // Length of this structure (8)
+        uint8_t indirectLevels;
+        uint8_t flags;
+    } __attribute__((packed)) ext2_dx_root_info_t;
+
+    typedef struct {
+        uint32_t hash;  // Lowest hash in block, bit 0 is set if the previous block has entries with the same hash
+        uint32_t block; // Logical block of the directory
+    } __attribute__((packed)) ext2_dx_entry_t;
+
+    // Overlaps the hash of the first entry of an index node, which covers all hashes lower than the second entry
+    typedef struct {
+        uint16_t limit; // Maximum amount of entries
+        uint16_t count;
+    } __attribute__((packed)) ext2_dx_countlimit_t;
+
+    // Ext4 extent trees
+    //
+    // The root node lives in the block pointers of the inode, with room for 4 entries.
+    // Every node starts with a header followed by index entries, or extents in leaves (depth 0).
+    // Entries are sorted by logical block, an index entry covers the blocks up to the next entry.
+    typedef struct {
+        uint16_t magic;   // EXT4_EXTENT_MAGIC
+        uint16_t entries; // Amount of entries in use
+        uint16_t max;     // Capacity of the node
+        uint16_t depth;   // Levels below this node, 0 if the entries are extents
+        uint32_t generation;
+    } __attribute__((packed)) ext4_extent_header_t;
+
+    typedef struct {
+        uint32_t block;     // First logical block
+        uint16_t length;    // Amount of blocks, see EXT4_EXTENT_INIT_MAX_LEN
+        uint16_t startHigh; // Upper 16 bits of the first physical block
+        uint32_t start;     // Lower 32 bits of the first physical block
+    } __attribute__((packed)) ext4_extent_t;
+
+    typedef struct {
+        uint32_t block;    // First logical block covered by the child
+        uint32_t leaf;     // Lower 32 bits of the child node block
+        uint16_t leafHigh; // Upper 16 bits of the child node block
+        uint16_t unused;
+    } __attribute__((packed)) ext4_extent_idx_t;
+
     class Ext2Volume;
 
     class Ext2Node : public FsNode {
@@ -217,12 +373,19 @@ public:
         // Cache directory entries
         HashMap<String, uint32_t> directoryCache;
 
+        bool inodeDirty = false; // e2inode has changes not yet written to the inode table
+
+        // Blocks marked used in the bitmap for future appends, given back when the node is closed
+        uint32_t preallocBlock = 0;
+        uint32_t preallocCount = 0;
+
     public:
         Ext2Node(Ext2Volume* vol, ext2_inode_t& ino, ino_t inode);
 
         ssize_t Read(size_t, size_t, uint8_t*);
         ssize_t Write(size_t, size_t, uint8_t*);
         int ReadDir(DirectoryEntry*, uint32_t);
+        int ReadDirBatch(off_t& cursor, DirectoryFiller filler, void* context);
         FsNode* FindDir(const char* name);
         int Create(DirectoryEntry*, uint32_t);
         int CreateDirectory(DirectoryEntry*, uint32_t);
@@ -257,17 +420,31 @@ public:
         bool readOnly = false;
 
         bool sparse, largeFiles, filetype;
+        bool dirIndex = false; // Create and maintain htree directory indexes
+        bool extents = false;  // Map new inodes with extent trees
+        uint32_t descriptorSize = sizeof(ext2_blockgrp_desc_t); // Size of block group descriptors on disk
         uint32_t inodeSize = 128;
 
         lock_t m_inodesLock = 0;
-        lock_t m_blocksLock = 0;
         HashMap<uint32_t, Ext2Node*> inodeCache;
+        // Nodes with inodeDirty set, protected by m_inodesLock
+        Vector<Ext2Node*> m_dirtyNodes;
+        // Serializes writing inodes back to the inode table,
+        // a copy taken by one writer must not land on top of a newer one
+        ReadWriteLock m_inodeWriteBackLock;
 
         struct CachedBlock {
             // When last accessed
             uint64_t timestamp = 0;
             uint32_t block = 0;
 
+            int refCount = 0;               // Pinned blocks cannot be reused
+            volatile bool upToDate = false; // Set once the block has been read in
+            volatile bool error = false;    // Failed to read block
+            bool valid = false;             // False if the block is free to be reused
+            bool dirty = false;             // Modified and not yet written back, dirty blocks cannot be reused
+            uint32_t owner = 0;             // Inode the dirty data belongs to, 0 for metadata shared by the volume
+
             CachedBlock* prev = nullptr;
             CachedBlock* next = nullptr;
 
@@ -275,6 +452,15 @@ public:
             uint8_t data[];
         };
 
+        // Every block maps to one bucket, each bucket has its own lock
+        // so lookups and disk reads of unrelated blocks do not contend.
+        struct BlockCacheBucket {
+            lock_t lock = 0;
+            // Cached blocks of the bucket, least recently used at the front
+            FastList<CachedBlock*> blocks;
+            unsigned memoryUsage = 0;
+        };
+
         CachedBlock* AllocateCachedBlock() {
             CachedBlock* cb = (CachedBlock*)kmalloc(sizeof(CachedBlock) + blocksize);
             
@@ -282,20 +468,43 @@ public:
             return cb;
         }
 
-        HashMap<uint32_t, CachedBlock*> blockCache = HashMap<uint32_t, CachedBlock*>(1024);
-        FastList<CachedBlock*> cachedBlockList;
-        HashMap<uint32_t, uint8_t*> bitmapCache = HashMap<uint32_t, uint8_t*>(256);
-        unsigned blockCacheMemoryUsage = 0;
+        // In memory allocation hints of each block group
+        struct GroupAllocInfo {
+            uint32_t firstFreeBlock = 0; // There are no free blocks before this bit of the block bitmap
+            uint32_t firstFreeInode = 0; // There are no free inodes before this bit of the inode bitmap
+            // Upper bound on the longest run of free blocks in the group, UINT32_MAX if unknown
+            uint32_t largestFreeExtent = UINT32_MAX;
+        };
+
+        GroupAllocInfo* groupAllocInfo = nullptr;
+        // Protects the bitmaps and free counts, only ever taken for writing.
+        // Bitmap blocks may need to be read in, so this has to be a blocking lock.
+        ReadWriteLock m_allocatorLock;
+
+        ALWAYS_INLINE BlockCacheBucket& GetBlockCacheBucket(uint32_t block) {
+            return blockCache[HashU(block) % EXT2_BLOCKCACHE_BUCKETS];
+        }
+
+        BlockCacheBucket blockCache[EXT2_BLOCKCACHE_BUCKETS];
 
         inline uint32_t LocationToBlock(uint64_t l) { return (l >> super.logBlockSize) >> 10; }
-        inline uint32_t BlockToLocation(uint64_t b) { return (b << super.logBlockSize) << 10; }
+        inline uint64_t BlockToLocation(uint64_t b) { return (b << super.logBlockSize) << 10; }
+
+        inline uint32_t GroupFirstBlock(uint32_t group) {
+            return group * super.blocksPerGroup + super.firstDataBlock;
+        }
+        // The last block group may be smaller than blocksPerGroup
+        inline uint32_t GroupBlockCount(uint32_t group) {
+            uint32_t remaining = super.blockCount - GroupFirstBlock(group);
+            return remaining < super.blocksPerGroup ? remaining : super.blocksPerGroup;
+        }
 
         inline uint32_t ResolveInodeBlockGroup(uint32_t inode) { return (inode - 1) / super.inodesPerGroup; }
         inline uint32_t ResolveInodeBlockGroupIndex(uint32_t inode) { return (inode - 1) % super.inodesPerGroup; }
 
         inline uint64_t InodeOffset(uint32_t inode) {
             uint32_t block = blockGroups[ResolveInodeBlockGroup(inode)].inodeTable;
-            return (block * blocksize + (ResolveInodeBlockGroupIndex(inode) * inodeSize));
+            return BlockToLocation(block) + static_cast<uint64_t>(ResolveInodeBlockGroupIndex(inode)) * inodeSize;
         }
 
         void WriteSuperblock();
@@ -309,22 +518,171 @@ public:
         int WriteInode(uint32_t num, ext2_inode_t& inode);
 
         int ReadBlock(uint32_t block, void* buffer);
+        // Read count physically contiguous blocks with one device request, bypassing the block cache
+        int ReadBlocks(uint32_t block, uint32_t count, void* buffer);
         int ReadBlockCached(uint32_t block, void* buffer);
 
+        // Get a pinned block from the block cache, returns nullptr on disk error.
+        // The block data must not be modified, use WriteBlockCached or ModifyCachedBlock.
+        // If readIn is false a missing block is not read from disk,
+        // the caller must fill the whole block and set upToDate.
+        CachedBlock* GetCachedBlock(uint32_t block, bool readIn = true);
+        void ReleaseCachedBlock(CachedBlock* block);
+        // Drop block from the block cache (e.g. it has been freed), discarding any dirty data
+        void InvalidateCachedBlock(uint32_t block);
+        // Drop and release a pinned block which could not be read in
+        void DropCachedBlock(CachedBlock* cachedBlock);
+        // Read any of the (sorted) blocks which are not cached into the block cache,
+        // contiguous blocks are read with a single request
+        void PrefetchBlocks(const uint32_t* blocks, unsigned count);
+        // Read ahead the inode table blocks of the entries in a directory block
+        void PrefetchInodeTables(const uint8_t* directoryBlock);
+        // Sort blocks, drop duplicates and read ahead any which are not cached
+        void PrefetchBlockList(uint32_t* blocks, unsigned count);
+        // Copy any cached blocks in the range over buffer,
+        // used by uncached reads so they never see data older than the block cache
+        void OverlayCachedBlocks(uint32_t block, uint32_t count, uint8_t* buffer);
+
         int WriteBlock(uint32_t block, void* buffer);
-        int WriteBlockCached(uint32_t block, void* buffer);
+        // Write a block into the block cache, it is written back to disk later by the flusher.
+        // owner is the inode the block belongs to, used by Flush to only write back the blocks of one file.
+        int WriteBlockCached(uint32_t block, void* buffer, uint32_t owner = 0);
+        // Modify part of a cached block in place and mark it dirty
+        int ModifyCachedBlock(uint32_t block, uint32_t offset, const void* data, uint32_t size, uint32_t owner = 0);
+        // Bucket lock must be held
+        void MarkBlockDirty(CachedBlock* cachedBlock, uint32_t owner);
+
+        unsigned m_dirtyBlocks = 0;       // Amount of dirty blocks in the block cache
+        volatile bool m_flushing = false; // Set while blocks are being written back
+        Semaphore m_flushLock = Semaphore(1);
 
         Ext2Node* CreateNode();
         int EraseInode(ext2_inode_t& e2inode, uint32_t inode);
         void SyncInode(ext2_inode_t& e2ino, uint32_t inode);
 
         uint32_t AllocateBlock();
+        // Allocate a block filled with zeros, used for indirect block lists
+        uint32_t AllocateZeroedBlock();
+        // Allocate up to count contiguous blocks, preferably starting at goal.
+        // Returns the first block and sets count to the amount allocated, 0 if there are no free blocks.
+        uint32_t AllocateBlocks(uint32_t goal, uint32_t& count);
+        // Allocate the block at index of node, count is the amount of blocks about to be appended.
+        // Allocates after the previous block of the file, using the preallocation window if possible.
+        uint32_t AllocateNodeBlock(Ext2Node* node, uint32_t index, uint32_t count);
+        void DiscardPreallocation(Ext2Node* node);
         int FreeBlock(uint32_t block);
+        // Free count contiguous blocks
+        int FreeBlocks(uint32_t block, uint32_t count);
 
-        int ListDir(Ext2Node* node, List<DirectoryEntry>& entries);
-        int WriteDir(Ext2Node* node, List<DirectoryEntry>& entries);
-        int InsertDir(Ext2Node* node, List<DirectoryEntry>& entries);
-        int InsertDir(Ext2Node* node, DirectoryEntry& ent);
+        uint32_t AllocateInode();
+        int FreeInode(uint32_t inode);
+
+        // Directories are always a whole number of blocks
+        ALWAYS_INLINE uint32_t DirectoryBlockCount(Ext2Node* dir) { return dir->e2inode.size / blocksize; }
+
+        // Size of a directory entry with a name of length, records are 4 byte aligned
+        static ALWAYS_INLINE uint32_t DirectoryRecordLength(size_t length) {
+            return (sizeof(ext2_directory_entry_t) + length + 3) & ~3U;
+        }
+
+        ALWAYS_INLINE bool IsValidDirectoryEntry(const uint8_t* buffer, uint32_t offset) {
+            const ext2_directory_entry_t* e2dirent = reinterpret_cast<const ext2_directory_entry_t*>(buffer + offset);
+            return offset + sizeof(ext2_directory_entry_t) <= blocksize &&
+                   e2dirent->recordLength >= sizeof(ext2_directory_entry_t) && !(e2dirent->recordLength % 4) &&
+                   offset + e2dirent->recordLength <= blocksize &&
+                   e2dirent->nameLength + sizeof(ext2_directory_entry_t) <= e2dirent->recordLength;
+        }
+
+        // Find the entry name in a directory block,
+        // previousOffset is set to the entry before it or offset if it is the first entry
+        bool SearchDirectoryBlock(const uint8_t* buffer, const char* name, size_t length, uint32_t& offset,
+                                  uint32_t& previousOffset);
+        // Add an entry to a directory block if there is room
+        bool InsertIntoDirectoryBlock(uint8_t* buffer, const char* name, size_t length, uint32_t inode,
+                                      uint8_t fileType);
+
+        // Write the '.' and '..' entries of a new directory
+        int InitializeDirectory(Ext2Node* dir, uint32_t parent);
+        // Append a block to a directory, returning its logical index and the block
+        int AppendDirectoryBlock(Ext2Node* dir, uint32_t& index, uint32_t& block);
+
+        // Find name in dir, read into buffer the directory block (logical index) containing the entry.
+        // Returns -ENOENT if name does not exist.
+        int FindDirectoryEntry(Ext2Node* dir, const char* name, uint32_t& index, uint8_t* buffer,
+                               uint32_t& offset, uint32_t& previousOffset);
+        // Add an entry to dir in place, the caller makes sure it does not exist
+        int AddDirectoryEntry(Ext2Node* dir, const char* name, uint32_t inode, uint8_t fileType);
+        // Remove an entry found with FindDirectoryEntry
+        int RemoveDirectoryEntry(Ext2Node* dir, uint32_t index, uint8_t* buffer, uint32_t offset,
+                                 uint32_t previousOffset);
+
+        // Directory index (HTree.cpp)
+        struct DxFrame {
+            uint32_t block; // Logical block of the index node
+            uint8_t* data;
+            ext2_dx_entry_t* entries;
+            ext2_dx_entry_t* at; // Entry followed down the tree
+        };
+
+        ALWAYS_INLINE ext2_dx_countlimit_t* DxCountLimit(DxFrame& frame) {
+            return reinterpret_cast<ext2_dx_countlimit_t*>(frame.entries);
+        }
+
+        // Whether dir has an index which can be used
+        ALWAYS_INLINE bool IsIndexed(Ext2Node* dir) { return dirIndex && (dir->e2inode.flags & EXT2_INDEX_FL); }
+
+        uint32_t DirectoryHash(const char* name, size_t length, int version);
+        // Hash version of an index root, adjusted for unsigned hashes
+        int DxHashVersion(const ext2_dx_root_info_t* info);
+        // Walk down the index of dir to the leaf which may contain hash.
+        // frames must have room for EXT2_DX_MAX_INDIRECT_LEVELS + 1 frames of one block each.
+        // Returns -EINVAL if the index is corrupt or unsupported.
+        int DxProbe(Ext2Node* dir, const char* name, DxFrame* frames, int& levels, uint32_t& hash, uint32_t& leaf);
+        // Move to the next leaf if it may contain entries with the same hash
+        int DxNextLeaf(Ext2Node* dir, DxFrame* frames, int levels, uint32_t hash, uint32_t& leaf);
+        int DxFindEntry(Ext2Node* dir, const char* name, uint32_t& index, uint8_t* buffer, uint32_t& offset,
+                        uint32_t& previousOffset);
+        int DxAddEntry(Ext2Node* dir, const char* name, uint32_t inode, uint8_t fileType);
+        // Insert an entry into an index node after the entry followed by the lookup
+        static void DxInsertIndexEntry(DxFrame& frame, uint32_t hash, uint32_t block);
+        // Convert a full single block directory to an indexed directory
+        int MakeIndexedDirectory(Ext2Node* dir);
+        // The directory index is unusable, clear the index flag and fall back to linear directories
+        void DropDirectoryIndex(Ext2Node* dir);
+
+        // Extent trees (Extent.cpp)
+        struct ExtentPath {
+            uint32_t block; // Block holding the node, 0 for the root in the inode
+            ext4_extent_header_t* header;
+            int at; // Entry followed down the tree, in leaves the extent before the block (-1 if none)
+        };
+
+        ALWAYS_INLINE static bool IsExtentMapped(const ext2_inode_t& ino) { return ino.flags & EXT4_EXTENTS_FL; }
+        ALWAYS_INLINE uint16_t ExtentNodeCapacity() const {
+            return (blocksize - sizeof(ext4_extent_header_t)) / sizeof(ext4_extent_t);
+        }
+
+        // Give a new inode an extent tree mapping block (if non zero) at index 0
+        void InitializeExtentTree(ext2_inode_t& ino, uint32_t block);
+        // Find the physical block of index, 0 for holes and uninitialized extents.
+        // length is set to the amount of blocks from index mapped the same way (at least 1).
+        int ExtentLookup(ext2_inode_t& ino, uint32_t index, uint32_t& block, uint32_t& length,
+                         bool* uninitialized = nullptr);
+        // Walk down to the leaf which would contain index.
+        // buffers must have room for EXT4_EXTENT_MAX_DEPTH blocks, it holds a copy of every node below the root.
+        int ExtentFindPath(ext2_inode_t& ino, uint32_t index, ExtentPath* path, uint8_t* buffers, int& depth);
+        int ExtentWriteNode(ExtentPath& node);
+        // Map the unmapped block at index to block
+        int ExtentMapBlock(ext2_inode_t& ino, uint32_t index, uint32_t block);
+        // Make room in the full leaf of path, splitting nodes or adding a level to the tree
+        int ExtentSplit(ext2_inode_t& ino, ExtentPath* path, int depth, uint32_t goal);
+        // Zero the blocks of the uninitialized extent containing index and mark it initialized
+        int ExtentInitialize(ext2_inode_t& ino, uint32_t index);
+        // Allocate blocks for any holes and uninitialized extents in count blocks from index,
+        // changed is set if the inode was modified
+        int AllocateExtentBlocks(Ext2Node* node, uint32_t index, uint32_t count, bool& changed);
+        // Free every block mapped by the extent tree and the tree itself
+        int FreeExtentTree(ext2_inode_t& ino);
 
     public:
         Ext2Volume(FsNode* device, const char* name);
@@ -332,6 +690,7 @@ public:
         ssize_t Read(Ext2Node* node, size_t offset, size_t size, uint8_t* buffer);
         ssize_t Write(Ext2Node* node, size_t offset, size_t size, uint8_t* buffer);
         int ReadDir(Ext2Node* node, DirectoryEntry* dirent, uint32_t index);
+        int ReadDirBatch(Ext2Node* node, off_t& cursor, DirectoryFiller filler, void* context);
         FsNode* FindDir(Ext2Node* node, const char* name);
         int Create(Ext2Node* node, DirectoryEntry* ent, uint32_t mode);
         int CreateDirectory(Ext2Node* node, DirectoryEntry* ent, uint32_t mode);
@@ -340,9 +699,30 @@ public:
         int Unlink(Ext2Node* dir, DirectoryEntry* ent, bool unlinkDirectories = false);
         int Truncate(Ext2Node* node, off_t length);
 
+        // Mark the inode of node dirty, it is written to the inode table on the next flush
         void SyncNode(Ext2Node* node);
+        // Write the inode of node to the inode table now if it is dirty
+        void WriteBackNode(Ext2Node* node);
+        // Write all dirty inodes to the inode table, batching inodes which share a table block
+        void WriteDirtyInodes();
         void CleanNode(Ext2Node* node);
 
+        /////////////////////////////
+        /// \brief Write back dirty blocks
+        ///
+        /// Dirty blocks are sorted by block number and contiguous runs
+        /// are written with a single device request.
+        ///
+        /// \param inode Only write back the data blocks of inode (and any volume metadata), 0 for all blocks
+        /////////////////////////////
+        void Flush(uint32_t inode = 0);
+
+        ALWAYS_INLINE size_t DirtyBytes() const {
+            return static_cast<size_t>(__atomic_load_n(&m_dirtyBlocks, __ATOMIC_RELAXED)) * blocksize;
+        }
+
+        ALWAYS_INLINE size_t DirtyInodeCount() const { return m_dirtyNodes.size(); }
+
         int Error() { return error; }
     };
 
@@ -360,9 +740,22 @@ public:
 
     static Ext2& Instance();
 
+    // Wake the flusher thread before the next flush interval
+    void WakeFlusher();
+
 private:
+    static void FlusherThread();
+
+    // Flush every volume, used when the driver is going away
+    void FlushVolumes();
+
+    ReadWriteLock m_volumesLock; // Protects m_extVolumes
     List<FsVolume*> m_extVolumes;
 
+    FancyRefPtr<Process> m_flusher;
+    Semaphore m_flusherSemaphore = Semaphore(0);
+    volatile bool m_stopFlusher = false;
+
     static lock_t m_instanceLock;
     static Ext2* m_instance;
 };
@@ -0,0 +1,520 @@
+#include "Ext2.h"
+
+#include <Errno.h>
+#include <Logging.h>
+#include <Math.h>
+
+#include <Debug.h>
+
+// Entries which fit in the block pointers of the inode
+#define EXT4_EXTENT_ROOT_CAPACITY                                                                                      \
+    ((sizeof(Ext2::ext2_inode_t::blocks) - sizeof(Ext2::ext4_extent_header_t)) / sizeof(Ext2::ext4_extent_t))
+
+namespace fs {
+
+static_assert(sizeof(Ext2::ext4_extent_t) == sizeof(Ext2::ext4_extent_idx_t));
+
+static ALWAYS_INLINE uint32_t ExtentLength(const Ext2::ext4_extent_t& extent) {
+    return (extent.length > EXT4_EXTENT_INIT_MAX_LEN) ? extent.length - EXT4_EXTENT_INIT_MAX_LEN : extent.length;
+}
+
+static ALWAYS_INLINE bool IsUninitialized(const Ext2::ext4_extent_t& extent) {
+    return extent.length > EXT4_EXTENT_INIT_MAX_LEN;
+}
+
+// 48-bit physical block numbers
+static ALWAYS_INLINE uint64_t ExtentStart(const Ext2::ext4_extent_t& extent) {
+    return (static_cast<uint64_t>(extent.startHigh) << 32) | extent.start;
+}
+
+static ALWAYS_INLINE uint64_t ExtentLeaf(const Ext2::ext4_extent_idx_t& entry) {
+    return (static_cast<uint64_t>(entry.leafHigh) << 32) | entry.leaf;
+}
+
+// Index of the last entry starting at or before index, -1 if there is none
+template <typename T> static int ExtentSearch(const T* entries, int count, uint32_t index) {
+    int low = 0;
+    int high = count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (entries[middle].block > index) {
+            high = middle - 1;
+        } else {
+            low = middle + 1;
+        }
+    }
+
+    return low - 1;
+}
+
+// depth is -1 if any depth is acceptable
+static bool IsValidExtentHeader(const Ext2::ext4_extent_header_t* header, uint16_t capacity, int depth) {
+    return header->magic == EXT4_EXTENT_MAGIC && header->entries <= header->max && header->max <= capacity &&
+           (depth < 0 || header->depth == depth) && header->depth <= EXT4_EXTENT_MAX_DEPTH;
+}
+
+template <typename T> static ALWAYS_INLINE T* ExtentEntries(Ext2::ext4_extent_header_t* header) {
+    return reinterpret_cast<T*>(header + 1);
+}
+
+void Ext2::Ext2Volume::InitializeExtentTree(ext2_inode_t& ino, uint32_t block) {
+    memset(ino.blocks, 0, sizeof(ino.blocks));
+
+    ext4_extent_header_t* header = reinterpret_cast<ext4_extent_header_t*>(ino.blocks);
+    header->magic = EXT4_EXTENT_MAGIC;
+    header->max = EXT4_EXTENT_ROOT_CAPACITY;
+    header->depth = 0;
+
+    if (block) {
+        ext4_extent_t* extent = ExtentEntries<ext4_extent_t>(header);
+        extent->block = 0;
+        extent->length = 1;
+        extent->start = block;
+        header->entries = 1;
+    }
+
+    ino.flags |= EXT4_EXTENTS_FL;
+}
+
+int Ext2::Ext2Volume::ExtentLookup(ext2_inode_t& ino, uint32_t index, uint32_t& block, uint32_t& length,
+                                   bool* uninitialized) {
+    block = 0;
+    length = 1;
+    if (uninitialized) {
+        *uninitialized = false;
+    }
+
+    ext4_extent_header_t* header = reinterpret_cast<ext4_extent_header_t*>(ino.blocks);
+    if (!IsValidExtentHeader(header, EXT4_EXTENT_ROOT_CAPACITY, -1)) {
+        Log::Warning("[Ext2] Invalid extent tree root");
+        return -EIO;
+    }
+
+    // Walk down through the block cache without copying the nodes
+    CachedBlock* node = nullptr;
+    for (int depth = header->depth; depth > 0; depth--) {
+        ext4_extent_idx_t* entries = ExtentEntries<ext4_extent_idx_t>(header);
+
+        int at = ExtentSearch(entries, header->entries, index);
+        if (!header->entries || ExtentLeaf(entries[MAX(at, 0)]) >= super.blockCount) {
+            Log::Warning("[Ext2] Invalid extent index node");
+            if (node) {
+                ReleaseCachedBlock(node);
+            }
+            return -EIO;
+        }
+
+        uint32_t child = entries[MAX(at, 0)].leaf;
+        if (node) {
+            ReleaseCachedBlock(node);
+        }
+
+        node = GetCachedBlock(child);
+        if (!node) {
+            error = DiskReadError;
+            return -EIO;
+        }
+
+        header = reinterpret_cast<ext4_extent_header_t*>(node->data);
+        if (!IsValidExtentHeader(header, ExtentNodeCapacity(), depth - 1)) {
+            Log::Warning("[Ext2] Invalid extent tree node %u", child);
+            ReleaseCachedBlock(node);
+            return -EIO;
+        }
+    }
+
+    ext4_extent_t* extents = ExtentEntries<ext4_extent_t>(header);
+    int at = ExtentSearch(extents, header->entries, index);
+
+    int e = 0;
+    if (at >= 0 && index - extents[at].block < ExtentLength(extents[at])) {
+        const ext4_extent_t& extent = extents[at];
+        uint32_t offset = index - extent.block;
+
+        length = ExtentLength(extent) - offset;
+        // The volume is at most 2^32 blocks (see Ext2Volume constructor),
+        // so a valid extent always fits in a 32-bit block number
+        uint64_t start = ExtentStart(extent) + offset;
+        if (start + length > super.blockCount) {
+            Log::Warning("[Ext2] Extent block %u beyond end of volume", start);
+            e = -EIO;
+        } else if (IsUninitialized(extent)) {
+            if (uninitialized) {
+                *uninitialized = true;
+            }
+        } else {
+            block = static_cast<uint32_t>(start);
+        }
+    } else if (at + 1 < header->entries) {
+        length = extents[at + 1].block - index; // Hole up to the next extent
+    }
+
+    if (node) {
+        ReleaseCachedBlock(node);
+    }
+
+    return e;
+}
+
+int Ext2::Ext2Volume::ExtentFindPath(ext2_inode_t& ino, uint32_t index, ExtentPath* path, uint8_t* buffers,
+                                     int& depth) {
+    ext4_extent_header_t* header = reinterpret_cast<ext4_extent_header_t*>(ino.blocks);
+    if (!IsValidExtentHeader(header, EXT4_EXTENT_ROOT_CAPACITY, -1)) {
+        Log::Warning("[Ext2] Invalid extent tree root");
+        return -EIO;
+    }
+
+    depth = header->depth;
+    path[0].block = 0;
+    path[0].header = header;
+
+    for (int level = 0; level < depth; level++) {
+        ext4_extent_idx_t* entries = ExtentEntries<ext4_extent_idx_t>(header);
+
+        // Blocks before the first index entry belong to the first child
+        int at = MAX(ExtentSearch(entries, header->entries, index), 0);
+        if (!header->entries || ExtentLeaf(entries[at]) >= super.blockCount) {
+            Log::Warning("[Ext2] Invalid extent index node");
+            return -EIO;
+        }
+
+        path[level].at = at;
+
+        uint8_t* data = buffers + static_cast<size_t>(level) * blocksize;
+        if (int e = ReadBlockCached(entries[at].leaf, data)) {
+            return (e == -EINTR) ? -EINTR : -EIO;
+        }
+
+        header = reinterpret_cast<ext4_extent_header_t*>(data);
+        if (!IsValidExtentHeader(header, ExtentNodeCapacity(), depth - level - 1)) {
+            Log::Warning("[Ext2] Invalid extent tree node %u", entries[at].leaf);
+            return -EIO;
+        }
+
+        path[level + 1].block = entries[at].leaf;
+        path[level + 1].header = header;
+    }
+
+    path[depth].at = ExtentSearch(ExtentEntries<ext4_extent_t>(header), header->entries, index);
+    return 0;
+}
+
+int Ext2::Ext2Volume::ExtentWriteNode(ExtentPath& node) {
+    if (!node.block) {
+        return 0; // The root is written back with the inode
+    }
+
+    return WriteBlockCached(node.block, node.header);
+}
+
+int Ext2::Ext2Volume::ExtentMapBlock(ext2_inode_t& ino, uint32_t index, uint32_t block) {
+    uint8_t* buffers = reinterpret_cast<uint8_t*>(kmalloc(blocksize * EXT4_EXTENT_MAX_DEPTH));
+    ExtentPath path[EXT4_EXTENT_MAX_DEPTH + 1];
+    bool dirty[EXT4_EXTENT_MAX_DEPTH + 1];
+
+    // The first entry of the leaf now starts at index, lower the keys of the index entries leading to it
+    auto updateKeys = [&path, &dirty](int depth, uint32_t index) {
+        for (int level = depth - 1; level >= 0; level--) {
+            ext4_extent_idx_t& entry = ExtentEntries<ext4_extent_idx_t>(path[level].header)[path[level].at];
+            if (entry.block <= index) {
+                break;
+            }
+
+            entry.block = index;
+            dirty[level] = true;
+        }
+    };
+
+    int e;
+    for (;;) {
+        int depth;
+        if ((e = ExtentFindPath(ino, index, path, buffers, depth))) {
+            break;
+        }
+
+        ExtentPath& leaf = path[depth];
+        ext4_extent_t* extents = ExtentEntries<ext4_extent_t>(leaf.header);
+        int at = leaf.at;
+        memset(dirty, 0, sizeof(dirty));
+
+        if (at >= 0 && index - extents[at].block < ExtentLength(extents[at])) {
+            e = -EEXIST;
+            break;
+        }
+
+        if (at >= 0 && extents[at].length < EXT4_EXTENT_INIT_MAX_LEN &&
+            extents[at].block + extents[at].length == index && ExtentStart(extents[at]) + extents[at].length == block) {
+            // Grow the extent before us
+            extents[at].length++;
+        } else if (at + 1 < leaf.header->entries && extents[at + 1].length < EXT4_EXTENT_INIT_MAX_LEN &&
+                   extents[at + 1].block == index + 1 && ExtentStart(extents[at + 1]) == block + 1ULL) {
+            // Grow the extent after us downwards
+            extents[at + 1].block--;
+            extents[at + 1].start--;
+            extents[at + 1].length++;
+
+            updateKeys(depth, index);
+        } else if (leaf.header->entries < leaf.header->max) {
+            for (int i = leaf.header->entries; i > at + 1; i--) {
+                extents[i] = extents[i - 1];
+            }
+
+            extents[at + 1].block = index;
+            extents[at + 1].length = 1;
+            extents[at + 1].startHigh = 0;
+            extents[at + 1].start = block;
+            leaf.header->entries++;
+
+            updateKeys(depth, index);
+        } else {
+            // Make room and look up the leaf again
+            if ((e = ExtentSplit(ino, path, depth, block))) {
+                break;
+            }
+            continue;
+        }
+
+        dirty[depth] = true;
+        for (int level = 0; level <= depth && !e; level++) {
+            if (dirty[level]) {
+                e = ExtentWriteNode(path[level]);
+            }
+        }
+        break;
+    }
+
+    kfree(buffers);
+    return e;
+}
+
+int Ext2::Ext2Volume::ExtentSplit(ext2_inode_t& ino, ExtentPath* path, int depth, uint32_t goal) {
+    // Find the highest node which is full along with every node below it,
+    // its parent has room for another entry
+    int level = depth;
+    while (level > 0 && path[level - 1].header->entries >= path[level - 1].header->max) {
+        level--;
+    }
+
+    if (level == 0 && depth >= EXT4_EXTENT_MAX_DEPTH) {
+        Log::Warning("[Ext2] Extent tree is too deep");
+        return -ENOSPC;
+    }
+
+    uint32_t count = 1;
+    uint32_t block = AllocateBlocks(goal, count);
+    if (!block) {
+        return -ENOSPC;
+    }
+
+    uint8_t data[blocksize];
+    memset(data, 0, blocksize);
+
+    ext4_extent_header_t* header = reinterpret_cast<ext4_extent_header_t*>(data);
+    ext4_extent_header_t* full = path[level].header;
+    header->magic = EXT4_EXTENT_MAGIC;
+    header->max = ExtentNodeCapacity();
+    header->depth = full->depth;
+
+    int e;
+    if (level == 0) {
+        // Every node up to the root is full, move the root into the new block and add a level to the tree
+        header->entries = full->entries;
+        memcpy(header + 1, full + 1, full->entries * sizeof(ext4_extent_t));
+
+        if ((e = WriteBlockCached(block, data))) {
+            FreeBlock(block);
+            return e;
+        }
+
+        ext4_extent_idx_t* entry = ExtentEntries<ext4_extent_idx_t>(full);
+        entry->block = full->entries ? ExtentEntries<ext4_extent_t>(full)->block : 0;
+        entry->leaf = block;
+        entry->leafHigh = 0;
+        entry->unused = 0;
+
+        full->entries = 1;
+        full->depth++;
+    } else {
+        // Move the upper half of the node into the new block
+        uint16_t keep = full->entries / 2;
+        header->entries = full->entries - keep;
+        memcpy(header + 1, ExtentEntries<ext4_extent_t>(full) + keep, header->entries * sizeof(ext4_extent_t));
+        full->entries = keep;
+
+        if ((e = WriteBlockCached(block, data)) || (e = ExtentWriteNode(path[level]))) {
+            FreeBlock(block);
+            return e;
+        }
+
+        // Both index entries and extents start with their logical block
+        ExtentPath& parent = path[level - 1];
+        ext4_extent_idx_t* entries = ExtentEntries<ext4_extent_idx_t>(parent.header);
+        for (int i = parent.header->entries; i > parent.at + 1; i--) {
+            entries[i] = entries[i - 1];
+        }
+
+        ext4_extent_idx_t& entry = entries[parent.at + 1];
+        entry.block = ExtentEntries<ext4_extent_t>(header)->block;
+        entry.leaf = block;
+        entry.leafHigh = 0;
+        entry.unused = 0;
+        parent.header->entries++;
+
+        if ((e = ExtentWriteNode(parent))) {
+            return e;
+        }
+    }
+
+    ino.blockCount += blocksize / 512;
+    return 0;
+}
+
+int Ext2::Ext2Volume::ExtentInitialize(ext2_inode_t& ino, uint32_t index) {
+    uint8_t* buffers = reinterpret_cast<uint8_t*>(kmalloc(blocksize * EXT4_EXTENT_MAX_DEPTH));
+    ExtentPath path[EXT4_EXTENT_MAX_DEPTH + 1];
+
+    int depth;
+    int e = ExtentFindPath(ino, index, path, buffers, depth);
+    if (e) {
+        kfree(buffers);
+        return e;
+    }
+
+    ExtentPath& leaf = path[depth];
+    ext4_extent_t* extent = ExtentEntries<ext4_extent_t>(leaf.header) + leaf.at;
+    if (leaf.at < 0 || !IsUninitialized(*extent) || index - extent->block >= ExtentLength(*extent)) {
+        kfree(buffers);
+        return -EINVAL;
+    }
+
+    // Rather than splitting the extent, zero all of it on disk
+    uint32_t zeroBlocks = EXT2_FLUSH_BATCH_SIZE / blocksize;
+    uint8_t* zero = reinterpret_cast<uint8_t*>(kmalloc(zeroBlocks * blocksize));
+    memset(zero, 0, zeroBlocks * blocksize);
+
+    uint32_t length = ExtentLength(*extent);
+    for (uint32_t i = 0; i < length && !e; i += zeroBlocks) {
+        uint32_t count = MIN(zeroBlocks, length - i);
+
+        ssize_t size = static_cast<ssize_t>(count) * blocksize;
+        if (m_device->Write(BlockToLocation(extent->start + i), size, zero) != size) {
+            Log::Error("[Ext2] Disk error zeroing blocks %u-%u", extent->start + i, extent->start + i + count - 1);
+            error = DiskWriteError;
+            e = -EIO;
+        }
+    }
+    kfree(zero);
+
+    if (!e) {
+        extent->length = length;
+        e = ExtentWriteNode(leaf);
+    }
+
+    kfree(buffers);
+    return e;
+}
+
+int Ext2::Ext2Volume::AllocateExtentBlocks(Ext2Node* node, uint32_t index, uint32_t count, bool& changed) {
+    uint32_t end = index + count;
+    while (index < end) {
+        uint32_t block, length;
+        bool uninitialized;
+        if (int e = ExtentLookup(node->e2inode, index, block, length, &uninitialized)) {
+            return e;
+        }
+
+        if (uninitialized) {
+            if (int e = ExtentInitialize(node->e2inode, index)) {
+                return e;
+            }
+
+            changed = true;
+            continue;
+        } else if (block) {
+            index += MIN(length, end - index);
+            continue;
+        }
+
+        block = AllocateNodeBlock(node, index, end - index);
+        if (!block) {
+            return -ENOSPC;
+        }
+
+        if (int e = ExtentMapBlock(node->e2inode, index, block)) {
+            FreeBlock(block);
+            changed = true; // The tree may have grown before failing
+            return e;
+        }
+
+        node->e2inode.blockCount += blocksize / 512;
+        changed = true;
+        index++;
+    }
+
+    return 0;
+}
+
+int Ext2::Ext2Volume::FreeExtentTree(ext2_inode_t& ino) {
+    ext4_extent_header_t* root = reinterpret_cast<ext4_extent_header_t*>(ino.blocks);
+    if (!IsValidExtentHeader(root, EXT4_EXTENT_ROOT_CAPACITY, -1)) {
+        Log::Warning("[Ext2] Invalid extent tree root, will not free blocks");
+        return -EIO;
+    }
+
+    uint8_t* buffers = reinterpret_cast<uint8_t*>(kmalloc(blocksize * EXT4_EXTENT_MAX_DEPTH));
+
+    // Depth first walk, next[level] is the next entry to visit in the node at level
+    ext4_extent_header_t* nodes[EXT4_EXTENT_MAX_DEPTH + 1];
+    uint32_t blocks[EXT4_EXTENT_MAX_DEPTH + 1];
+    int next[EXT4_EXTENT_MAX_DEPTH + 1];
+
+    int e = 0;
+    int level = 0;
+    nodes[0] = root;
+    blocks[0] = 0;
+    next[0] = 0;
+
+    while (level >= 0) {
+        ext4_extent_header_t* header = nodes[level];
+        if (!header->depth) {
+            // Leaf, free the extents
+            ext4_extent_t* extents = ExtentEntries<ext4_extent_t>(header);
+            for (unsigned i = 0; i < header->entries; i++) {
+                if (ExtentStart(extents[i]) + ExtentLength(extents[i]) <= super.blockCount) {
+                    FreeBlocks(extents[i].start, ExtentLength(extents[i]));
+                }
+            }
+        } else if (next[level] < header->entries) {
+            ext4_extent_idx_t& entry = ExtentEntries<ext4_extent_idx_t>(header)[next[level]++];
+
+            uint8_t* data = buffers + static_cast<size_t>(level) * blocksize;
+            if (ExtentLeaf(entry) >= super.blockCount || (e = ReadBlockCached(entry.leaf, data)) ||
+                !IsValidExtentHeader(reinterpret_cast<ext4_extent_header_t*>(data), ExtentNodeCapacity(),
+                                     header->depth - 1)) {
+                Log::Warning("[Ext2] Invalid extent tree node %u, will not free blocks", entry.leaf);
+                e = -EIO;
+                continue;
+            }
+
+            level++;
+            nodes[level] = reinterpret_cast<ext4_extent_header_t*>(data);
+            blocks[level] = entry.leaf;
+            next[level] = 0;
+            continue;
+        }
+
+        // Done with the node
+        if (blocks[level]) {
+            FreeBlock(blocks[level]);
+        }
+        level--;
+    }
+
+    kfree(buffers);
+
+    // Leave an empty tree
+    InitializeExtentTree(ino, 0);
+    return e;
+}
+
+} // namespace fs
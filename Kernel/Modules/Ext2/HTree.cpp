@@ -0,0 +1,692 @@
+#include "Ext2.h"
+
+#include <Errno.h>
+#include <Logging.h>
+
+#include <Debug.h>
+
+// Only the lower 24 bits of index entries hold the block, the rest is reserved
+#define EXT2_DX_BLOCK_MASK 0x00FFFFFF
+
+// Size of the fake '.' and '..' entries at the start of the index root
+#define EXT2_DX_ROOT_INFO_OFFSET 24
+// Size of the empty directory entry at the start of an index node
+#define EXT2_DX_NODE_ENTRIES_OFFSET 8
+
+// Hashes are compatible with Linux and e2fsprogs, see the ext4 disk layout documentation
+namespace fs {
+
+static ALWAYS_INLINE uint32_t RotateLeft(uint32_t value, unsigned shift) {
+    return (value << shift) | (value >> (32 - shift));
+}
+
+static void TEATransform(uint32_t buffer[4], const uint32_t input[4]) {
+    uint32_t sum = 0;
+    uint32_t b0 = buffer[0], b1 = buffer[1];
+    uint32_t a = input[0], b = input[1], c = input[2], d = input[3];
+
+    for (int i = 0; i < 16; i++) {
+        sum += 0x9E3779B9;
+        b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+        b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    }
+
+    buffer[0] += b0;
+    buffer[1] += b1;
+}
+
+// MD4 with the last round removed and input of 8 words
+static void HalfMD4Transform(uint32_t buffer[4], const uint32_t input[8]) {
+    uint32_t a = buffer[0], b = buffer[1], c = buffer[2], d = buffer[3];
+
+    auto f = [](uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); };
+    auto g = [](uint32_t x, uint32_t y, uint32_t z) { return (x & y) + ((x ^ y) & z); };
+    auto h = [](uint32_t x, uint32_t y, uint32_t z) { return x ^ y ^ z; };
+
+    constexpr uint32_t k2 = 013240474631U;
+    constexpr uint32_t k3 = 015666365641U;
+
+#define ROUND(fn, a, b, c, d, x, s) (a += fn(b, c, d) + (x), a = RotateLeft(a, s))
+    ROUND(f, a, b, c, d, input[0], 3);
+    ROUND(f, d, a, b, c, input[1], 7);
+    ROUND(f, c, d, a, b, input[2], 11);
+    ROUND(f, b, c, d, a, input[3], 19);
+    ROUND(f, a, b, c, d, input[4], 3);
+    ROUND(f, d, a, b, c, input[5], 7);
+    ROUND(f, c, d, a, b, input[6], 11);
+    ROUND(f, b, c, d, a, input[7], 19);
+
+    ROUND(g, a, b, c, d, input[1] + k2, 3);
+    ROUND(g, d, a, b, c, input[3] + k2, 5);
+    ROUND(g, c, d, a, b, input[5] + k2, 9);
+    ROUND(g, b, c, d, a, input[7] + k2, 13);
+    ROUND(g, a, b, c, d, input[0] + k2, 3);
+    ROUND(g, d, a, b, c, input[2] + k2, 5);
+    ROUND(g, c, d, a, b, input[4] + k2, 9);
+    ROUND(g, b, c, d, a, input[6] + k2, 13);
+
+    ROUND(h, a, b, c, d, input[3] + k3, 3);
+    ROUND(h, d, a, b, c, input[7] + k3, 9);
+    ROUND(h, c, d, a, b, input[2] + k3, 11);
+    ROUND(h, b, c, d, a, input[6] + k3, 15);
+    ROUND(h, a, b, c, d, input[1] + k3, 3);
+    ROUND(h, d, a, b, c, input[5] + k3, 9);
+    ROUND(h, c, d, a, b, input[0] + k3, 11);
+    ROUND(h, b, c, d, a, input[4] + k3, 15);
+#undef ROUND
+
+    buffer[0] += a;
+    buffer[1] += b;
+    buffer[2] += c;
+    buffer[3] += d;
+}
+
+// Char is signed char or unsigned char depending on the hash version
+template <typename Char> static uint32_t LegacyHash(const char* name, int length) {
+    uint32_t hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+
+    const Char* p = reinterpret_cast<const Char*>(name);
+    while (length--) {
+        uint32_t hash = hash1 + (hash0 ^ (static_cast<int>(*p++) * 7152373));
+        if (hash & 0x80000000) {
+            hash -= 0x7FFFFFFF;
+        }
+
+        hash1 = hash0;
+        hash0 = hash;
+    }
+
+    return hash0 << 1;
+}
+
+// Pack a name into num words of hash input, padded with the length
+template <typename Char> static void StringToHashBuffer(const char* name, int length, uint32_t* buffer, int num) {
+    uint32_t pad = static_cast<uint32_t>(length) | (static_cast<uint32_t>(length) << 8);
+    pad |= pad << 16;
+
+    uint32_t value = pad;
+    if (length > num * 4) {
+        length = num * 4;
+    }
+
+    const Char* p = reinterpret_cast<const Char*>(name);
+    for (int i = 0; i < length; i++) {
+        value = static_cast<int>(p[i]) + (value << 8);
+        if ((i % 4) == 3) {
+            *buffer++ = value;
+            value = pad;
+            num--;
+        }
+    }
+
+    if (--num >= 0) {
+        *buffer++ = value;
+    }
+
+    while (--num >= 0) {
+        *buffer++ = pad;
+    }
+}
+
+template <typename Char> static uint32_t HalfMD4Hash(const char* name, int length, uint32_t buffer[4]) {
+    uint32_t input[8];
+    while (length > 0) {
+        StringToHashBuffer<Char>(name, length, input, 8);
+        HalfMD4Transform(buffer, input);
+
+        length -= 32;
+        name += 32;
+    }
+
+    return buffer[1];
+}
+
+template <typename Char> static uint32_t TEAHash(const char* name, int length, uint32_t buffer[4]) {
+    uint32_t input[4];
+    while (length > 0) {
+        StringToHashBuffer<Char>(name, length, input, 4);
+        TEATransform(buffer, input);
+
+        length -= 16;
+        name += 16;
+    }
+
+    return buffer[0];
+}
+
+uint32_t Ext2::Ext2Volume::DirectoryHash(const char* name, size_t length, int version) {
+    uint32_t buffer[4] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476};
+    for (int i = 0; i < 4; i++) {
+        if (superext.hashSeed[i]) {
+            memcpy(buffer, superext.hashSeed, sizeof(buffer));
+            break;
+        }
+    }
+
+    uint32_t hash;
+    switch (version) {
+    case EXT2_DX_HASH_LEGACY:
+        hash = LegacyHash<signed char>(name, length);
+        break;
+    case EXT2_DX_HASH_LEGACY_UNSIGNED:
+        hash = LegacyHash<unsigned char>(name, length);
+        break;
+    case EXT2_DX_HASH_HALF_MD4:
+        hash = HalfMD4Hash<signed char>(name, length, buffer);
+        break;
+    case EXT2_DX_HASH_HALF_MD4_UNSIGNED:
+        hash = HalfMD4Hash<unsigned char>(name, length, buffer);
+        break;
+    case EXT2_DX_HASH_TEA:
+        hash = TEAHash<signed char>(name, length, buffer);
+        break;
+    case EXT2_DX_HASH_TEA_UNSIGNED:
+    default:
+        hash = TEAHash<unsigned char>(name, length, buffer);
+        break;
+    }
+
+    // Bit 0 is used to mark hash collisions spanning leaves, 0xFFFFFFFE marks the end of a directory
+    hash &= ~1U;
+    if (hash == (0x7FFFFFFFU << 1)) {
+        hash = (0x7FFFFFFFU - 1) << 1;
+    }
+
+    return hash;
+}
+
+int Ext2::Ext2Volume::DxHashVersion(const ext2_dx_root_info_t* info) {
+    int version = info->hashVersion;
+    if (version <= EXT2_DX_HASH_TEA && (superext.flags & EXT2_FLAGS_UNSIGNED_HASH)) {
+        version += EXT2_DX_HASH_LEGACY_UNSIGNED;
+    }
+
+    return version;
+}
+
+void Ext2::Ext2Volume::DropDirectoryIndex(Ext2Node* dir) {
+    Log::Warning("[Ext2] Directory index of inode %d is invalid, clearing it", dir->inode);
+
+    dir->e2inode.flags &= ~EXT2_INDEX_FL;
+    SyncNode(dir);
+}
+
+int Ext2::Ext2Volume::DxProbe(Ext2Node* dir, const char* name, DxFrame* frames, int& levels, uint32_t& hash,
+                              uint32_t& leaf) {
+    DxFrame* frame = frames;
+    frame->block = 0;
+    if (int e = ReadBlockCached(GetInodeBlock(0, dir->e2inode), frame->data)) {
+        return (e == -EINTR) ? -EINTR : -EIO;
+    }
+
+    ext2_dx_root_info_t* info = reinterpret_cast<ext2_dx_root_info_t*>(frame->data + EXT2_DX_ROOT_INFO_OFFSET);
+    if (info->reserved || info->hashVersion > EXT2_DX_HASH_TEA || info->infoLength != sizeof(ext2_dx_root_info_t) ||
+        info->indirectLevels > EXT2_DX_MAX_INDIRECT_LEVELS) {
+        IF_DEBUG(debugLevelExt2 >= DebugLevelNormal, {
+            Log::Warning("[Ext2] Unsupported directory index (inode %d, hash version %d, levels %d)", dir->inode,
+                         info->hashVersion, info->indirectLevels);
+        });
+        return -EINVAL;
+    }
+
+    levels = info->indirectLevels;
+    hash = DirectoryHash(name, strlen(name), DxHashVersion(info));
+
+    uint32_t entriesOffset = EXT2_DX_ROOT_INFO_OFFSET + info->infoLength;
+    uint32_t blockCount = DirectoryBlockCount(dir);
+    for (int level = 0;; level++) {
+        frame->entries = reinterpret_cast<ext2_dx_entry_t*>(frame->data + entriesOffset);
+
+        ext2_dx_countlimit_t* countLimit = DxCountLimit(*frame);
+        if (countLimit->limit != (blocksize - entriesOffset) / sizeof(ext2_dx_entry_t) || !countLimit->count ||
+            countLimit->count > countLimit->limit) {
+            return -EINVAL;
+        }
+
+        // Find the last entry with a hash not greater than ours, the first entry covers all lower hashes
+        ext2_dx_entry_t* p = frame->entries + 1;
+        ext2_dx_entry_t* q = frame->entries + countLimit->count - 1;
+        while (p <= q) {
+            ext2_dx_entry_t* m = p + (q - p) / 2;
+            if (m->hash > hash) {
+                q = m - 1;
+            } else {
+                p = m + 1;
+            }
+        }
+        frame->at = p - 1;
+
+        uint32_t block = frame->at->block & EXT2_DX_BLOCK_MASK;
+        if (block >= blockCount) {
+            return -EINVAL;
+        }
+
+        if (level == levels) {
+            leaf = block;
+            return 0;
+        }
+
+        frame++;
+        frame->block = block;
+        if (int e = ReadBlockCached(GetInodeBlock(block, dir->e2inode), frame->data)) {
+            return (e == -EINTR) ? -EINTR : -EIO;
+        }
+
+        const ext2_directory_entry_t* empty = reinterpret_cast<const ext2_directory_entry_t*>(frame->data);
+        if (empty->inode || empty->recordLength != blocksize) {
+            return -EINVAL;
+        }
+
+        entriesOffset = EXT2_DX_NODE_ENTRIES_OFFSET;
+    }
+}
+
+int Ext2::Ext2Volume::DxNextLeaf(Ext2Node* dir, DxFrame* frames, int levels, uint32_t hash, uint32_t& leaf) {
+    // Find the lowest index node which has more entries
+    int level = levels;
+    for (;;) {
+        DxFrame& frame = frames[level];
+        if (++frame.at < frame.entries + DxCountLimit(frame)->count) {
+            break;
+        }
+
+        if (level == 0) {
+            return 0; // End of the directory
+        }
+        level--;
+    }
+
+    // Entries with our hash only continue into the next leaf if it starts with the same hash
+    if ((frames[level].at->hash & ~1U) != hash) {
+        return 0;
+    }
+
+    while (level < levels) {
+        uint32_t block = frames[level].at->block & EXT2_DX_BLOCK_MASK;
+        if (block >= DirectoryBlockCount(dir)) {
+            return -EINVAL;
+        }
+
+        level++;
+        DxFrame& frame = frames[level];
+        frame.block = block;
+        if (int e = ReadBlockCached(GetInodeBlock(block, dir->e2inode), frame.data)) {
+            return (e == -EINTR) ? -EINTR : -EIO;
+        }
+
+        frame.entries = reinterpret_cast<ext2_dx_entry_t*>(frame.data + EXT2_DX_NODE_ENTRIES_OFFSET);
+        frame.at = frame.entries;
+    }
+
+    leaf = frames[levels].at->block & EXT2_DX_BLOCK_MASK;
+    if (leaf >= DirectoryBlockCount(dir)) {
+        return -EINVAL;
+    }
+
+    return 1;
+}
+
+int Ext2::Ext2Volume::DxFindEntry(Ext2Node* dir, const char* name, uint32_t& index, uint8_t* buffer, uint32_t& offset,
+                                  uint32_t& previousOffset) {
+    uint8_t* blocks = reinterpret_cast<uint8_t*>(kmalloc(blocksize * (EXT2_DX_MAX_INDIRECT_LEVELS + 1)));
+
+    DxFrame frames[EXT2_DX_MAX_INDIRECT_LEVELS + 1];
+    for (int i = 0; i <= EXT2_DX_MAX_INDIRECT_LEVELS; i++) {
+        frames[i].data = blocks + i * blocksize;
+    }
+
+    int levels;
+    uint32_t hash, leaf;
+    int e = DxProbe(dir, name, frames, levels, hash, leaf);
+
+    size_t length = strlen(name);
+    while (!e) {
+        if (int readError = ReadBlockCached(GetInodeBlock(leaf, dir->e2inode), buffer)) {
+            e = (readError == -EINTR) ? -EINTR : -EIO;
+            break;
+        }
+
+        if (SearchDirectoryBlock(buffer, name, length, offset, previousOffset)) {
+            index = leaf;
+            break;
+        }
+
+        e = DxNextLeaf(dir, frames, levels, hash, leaf);
+        if (e == 0) {
+            e = -ENOENT;
+        } else if (e > 0) {
+            e = 0;
+        }
+    }
+
+    kfree(blocks);
+    return e;
+}
+
+void Ext2::Ext2Volume::DxInsertIndexEntry(DxFrame& frame, uint32_t hash, uint32_t block) {
+    ext2_dx_countlimit_t* countLimit = reinterpret_cast<ext2_dx_countlimit_t*>(frame.entries);
+    ext2_dx_entry_t* next = frame.at + 1;
+
+    for (ext2_dx_entry_t* entry = frame.entries + countLimit->count; entry > next; entry--) {
+        *entry = *(entry - 1);
+    }
+
+    next->hash = hash;
+    next->block = block;
+    countLimit->count++;
+}
+
+int Ext2::Ext2Volume::DxAddEntry(Ext2Node* dir, const char* name, uint32_t inode, uint8_t fileType) {
+    struct MapEntry {
+        uint32_t hash;
+        uint16_t offset;
+        uint16_t size;
+    };
+
+    // Index frames, the leaf, the new leaf, a new index node and a scratch block
+    uint8_t* blocks = reinterpret_cast<uint8_t*>(kmalloc(blocksize * (EXT2_DX_MAX_INDIRECT_LEVELS + 5)));
+    uint8_t* leafData = blocks + blocksize * (EXT2_DX_MAX_INDIRECT_LEVELS + 1);
+    uint8_t* newLeafData = leafData + blocksize;
+    uint8_t* newNodeData = newLeafData + blocksize;
+    uint8_t* scratch = newNodeData + blocksize;
+
+    MapEntry* map = nullptr;
+
+    DxFrame frames[EXT2_DX_MAX_INDIRECT_LEVELS + 1];
+    for (int i = 0; i <= EXT2_DX_MAX_INDIRECT_LEVELS; i++) {
+        frames[i].data = blocks + i * blocksize;
+    }
+
+    size_t length = strlen(name);
+    ext2_dx_root_info_t* info = reinterpret_cast<ext2_dx_root_info_t*>(frames[0].data + EXT2_DX_ROOT_INFO_OFFSET);
+
+    int levels;
+    uint32_t hash, leaf;
+    int e = DxProbe(dir, name, frames, levels, hash, leaf);
+    if (e) {
+        goto done;
+    }
+
+    if ((e = ReadBlockCached(GetInodeBlock(leaf, dir->e2inode), leafData))) {
+        e = (e == -EINTR) ? -EINTR : -EIO;
+        goto done;
+    }
+
+    if (InsertIntoDirectoryBlock(leafData, name, length, inode, fileType)) {
+        e = WriteBlockCached(GetInodeBlock(leaf, dir->e2inode), leafData);
+        goto done;
+    }
+
+    // The leaf is full and has to be split, make sure the index node above it has room for another entry
+    if (DxCountLimit(frames[levels])->count >= DxCountLimit(frames[levels])->limit) {
+        uint32_t nodeIndex, nodeBlock;
+        if (levels == 0) {
+            // Move the entries of the root into a new index node, adding a level to the tree
+            if ((e = AppendDirectoryBlock(dir, nodeIndex, nodeBlock))) {
+                goto done;
+            }
+
+            DxFrame& root = frames[0];
+            ext2_dx_countlimit_t* rootCountLimit = DxCountLimit(root);
+
+            memset(newNodeData, 0, EXT2_DX_NODE_ENTRIES_OFFSET);
+            reinterpret_cast<ext2_directory_entry_t*>(newNodeData)->recordLength = blocksize;
+
+            ext2_dx_entry_t* nodeEntries = reinterpret_cast<ext2_dx_entry_t*>(newNodeData + EXT2_DX_NODE_ENTRIES_OFFSET);
+            memcpy(nodeEntries, root.entries, rootCountLimit->count * sizeof(ext2_dx_entry_t));
+
+            ext2_dx_countlimit_t* nodeCountLimit = reinterpret_cast<ext2_dx_countlimit_t*>(nodeEntries);
+            nodeCountLimit->limit = (blocksize - EXT2_DX_NODE_ENTRIES_OFFSET) / sizeof(ext2_dx_entry_t);
+
+            DxFrame& node = frames[1];
+            node.block = nodeIndex;
+            node.data = newNodeData;
+            node.entries = nodeEntries;
+            node.at = nodeEntries + (root.at - root.entries);
+
+            rootCountLimit->count = 1;
+            root.entries[0].block = nodeIndex;
+            root.at = root.entries;
+            info->indirectLevels = 1;
+            levels = 1;
+
+            if ((e = WriteBlockCached(nodeBlock, newNodeData)) ||
+                (e = WriteBlockCached(GetInodeBlock(0, dir->e2inode), root.data))) {
+                goto done;
+            }
+        } else {
+            // Split the index node in two
+            DxFrame& root = frames[0];
+            DxFrame& node = frames[1];
+            if (DxCountLimit(root)->count >= DxCountLimit(root)->limit) {
+                Log::Warning("[Ext2] Directory index of inode %d is full", dir->inode);
+                e = -ENOSPC;
+                goto done;
+            }
+
+            if ((e = AppendDirectoryBlock(dir, nodeIndex, nodeBlock))) {
+                goto done;
+            }
+
+            ext2_dx_countlimit_t* countLimit = DxCountLimit(node);
+            unsigned count = countLimit->count;
+            unsigned half = count / 2;
+            uint32_t splitHash = node.entries[half].hash;
+
+            memset(newNodeData, 0, EXT2_DX_NODE_ENTRIES_OFFSET);
+            reinterpret_cast<ext2_directory_entry_t*>(newNodeData)->recordLength = blocksize;
+
+            ext2_dx_entry_t* nodeEntries = reinterpret_cast<ext2_dx_entry_t*>(newNodeData + EXT2_DX_NODE_ENTRIES_OFFSET);
+            memcpy(nodeEntries, node.entries + half, (count - half) * sizeof(ext2_dx_entry_t));
+
+            ext2_dx_countlimit_t* nodeCountLimit = reinterpret_cast<ext2_dx_countlimit_t*>(nodeEntries);
+            nodeCountLimit->limit = countLimit->limit;
+            nodeCountLimit->count = count - half;
+            countLimit->count = half;
+
+            DxInsertIndexEntry(root, splitHash, nodeIndex);
+
+            if ((e = WriteBlockCached(nodeBlock, newNodeData)) ||
+                (e = WriteBlockCached(GetInodeBlock(node.block, dir->e2inode), node.data)) ||
+                (e = WriteBlockCached(GetInodeBlock(0, dir->e2inode), root.data))) {
+                goto done;
+            }
+
+            if (node.at >= node.entries + half) {
+                node.at = nodeEntries + (node.at - (node.entries + half));
+                node.block = nodeIndex;
+                node.data = newNodeData;
+                node.entries = nodeEntries;
+            }
+        }
+    }
+
+    {
+        // Sort the entries of the leaf by hash and move the upper half to a new leaf
+        map = reinterpret_cast<MapEntry*>(kmalloc(sizeof(MapEntry) * (blocksize / DirectoryRecordLength(1) + 1)));
+
+        int version = DxHashVersion(info);
+        unsigned count = 0;
+        for (uint32_t offset = 0; offset < blocksize && IsValidDirectoryEntry(leafData, offset);) {
+            const ext2_directory_entry_t* e2dirent = reinterpret_cast<const ext2_directory_entry_t*>(leafData + offset);
+            if (e2dirent->inode) {
+                map[count++] = {DirectoryHash(e2dirent->name, e2dirent->nameLength, version),
+                                static_cast<uint16_t>(offset),
+                                static_cast<uint16_t>(DirectoryRecordLength(e2dirent->nameLength))};
+            }
+
+            offset += e2dirent->recordLength;
+        }
+
+        if (count < 2) {
+            e = -ENOSPC;
+            goto done;
+        }
+
+        HeapSort(map, count, [](const MapEntry& l, const MapEntry& r) { return l.hash < r.hash; });
+
+        unsigned move = 0;
+        uint32_t moveSize = 0;
+        for (long i = count - 1; i > 0; i--) {
+            if (moveSize + map[i].size / 2 > blocksize / 2) {
+                break;
+            }
+
+            moveSize += map[i].size;
+            move++;
+        }
+
+        if (!move) {
+            move = 1;
+        }
+
+        unsigned split = count - move;
+        uint32_t splitHash = map[split].hash;
+        // Entries with the same hash are kept together, mark the new leaf as continuing the hash
+        bool continued = splitHash == map[split - 1].hash;
+
+        uint32_t newLeafIndex, newLeafBlock;
+        if ((e = AppendDirectoryBlock(dir, newLeafIndex, newLeafBlock))) {
+            goto done;
+        }
+
+        auto compact = [this](uint8_t* dest, const uint8_t* src, const MapEntry* entries, unsigned count) {
+            memset(dest, 0, blocksize);
+
+            uint32_t offset = 0;
+            ext2_directory_entry_t* last = nullptr;
+            for (unsigned i = 0; i < count; i++) {
+                const ext2_directory_entry_t* e2dirent =
+                    reinterpret_cast<const ext2_directory_entry_t*>(src + entries[i].offset);
+
+                last = reinterpret_cast<ext2_directory_entry_t*>(dest + offset);
+                memcpy(last, e2dirent, sizeof(ext2_directory_entry_t) + e2dirent->nameLength);
+                last->recordLength = entries[i].size;
+                offset += entries[i].size;
+            }
+
+            last->recordLength += blocksize - offset;
+        };
+
+        compact(newLeafData, leafData, map + split, move);
+        compact(scratch, leafData, map, split);
+        memcpy(leafData, scratch, blocksize);
+
+        DxInsertIndexEntry(frames[levels], splitHash + continued, newLeafIndex);
+
+        uint8_t* target = (hash >= splitHash) ? newLeafData : leafData;
+        bool inserted = InsertIntoDirectoryBlock(target, name, length, inode, fileType);
+
+        // Write the split out even if the entry did not fit so the index covers the new leaf
+        if ((e = WriteBlockCached(newLeafBlock, newLeafData)) ||
+            (e = WriteBlockCached(GetInodeBlock(leaf, dir->e2inode), leafData)) ||
+            (e = WriteBlockCached(GetInodeBlock(frames[levels].block, dir->e2inode), frames[levels].data))) {
+            goto done;
+        }
+
+        if (!inserted) {
+            e = -ENOSPC;
+        }
+    }
+
+done:
+    if (map) {
+        kfree(map);
+    }
+
+    kfree(blocks);
+    return e;
+}
+
+int Ext2::Ext2Volume::MakeIndexedDirectory(Ext2Node* dir) {
+    if (DirectoryBlockCount(dir) != 1) {
+        return -EINVAL;
+    }
+
+    uint8_t* root = reinterpret_cast<uint8_t*>(kmalloc(blocksize * 2));
+    uint8_t* leaf = root + blocksize;
+
+    uint32_t rootBlock = GetInodeBlock(0, dir->e2inode);
+    if (int e = ReadBlockCached(rootBlock, root)) {
+        kfree(root);
+        return (e == -EINTR) ? -EINTR : -EIO;
+    }
+
+    ext2_directory_entry_t* current = reinterpret_cast<ext2_directory_entry_t*>(root);
+    ext2_directory_entry_t* parent = reinterpret_cast<ext2_directory_entry_t*>(root + current->recordLength);
+    if (!IsValidDirectoryEntry(root, 0) || current->nameLength != 1 || current->name[0] != '.' ||
+        !IsValidDirectoryEntry(root, current->recordLength) || parent->nameLength != 2 ||
+        strncmp(parent->name, "..", 2)) {
+        kfree(root);
+        return -EINVAL; // Stay linear
+    }
+
+    // Move everything but '.' and '..' into the first leaf
+    memset(leaf, 0, blocksize);
+
+    uint32_t leafOffset = 0;
+    ext2_directory_entry_t* last = nullptr;
+    for (uint32_t offset = current->recordLength + parent->recordLength;
+         offset < blocksize && IsValidDirectoryEntry(root, offset);) {
+        const ext2_directory_entry_t* e2dirent = reinterpret_cast<const ext2_directory_entry_t*>(root + offset);
+        if (e2dirent->inode) {
+            last = reinterpret_cast<ext2_directory_entry_t*>(leaf + leafOffset);
+            memcpy(last, e2dirent, sizeof(ext2_directory_entry_t) + e2dirent->nameLength);
+            last->recordLength = DirectoryRecordLength(e2dirent->nameLength);
+            leafOffset += last->recordLength;
+        }
+
+        offset += e2dirent->recordLength;
+    }
+
+    if (last) {
+        last->recordLength += blocksize - leafOffset;
+    } else {
+        reinterpret_cast<ext2_directory_entry_t*>(leaf)->recordLength = blocksize;
+    }
+
+    uint32_t leafIndex, leafBlock;
+    if (int e = AppendDirectoryBlock(dir, leafIndex, leafBlock)) {
+        kfree(root);
+        return e;
+    }
+
+    // Rebuild the first block as the index root
+    uint8_t parentEntry[DirectoryRecordLength(2)];
+    memcpy(parentEntry, parent, DirectoryRecordLength(2));
+
+    current->recordLength = DirectoryRecordLength(1);
+    parent = reinterpret_cast<ext2_directory_entry_t*>(root + current->recordLength);
+    memcpy(parent, parentEntry, DirectoryRecordLength(2));
+    parent->recordLength = blocksize - current->recordLength;
+    memset(root + EXT2_DX_ROOT_INFO_OFFSET, 0, blocksize - EXT2_DX_ROOT_INFO_OFFSET);
+
+    ext2_dx_root_info_t* info = reinterpret_cast<ext2_dx_root_info_t*>(root + EXT2_DX_ROOT_INFO_OFFSET);
+    info->hashVersion = (superext.defaultHashVersion <= EXT2_DX_HASH_TEA) ? superext.defaultHashVersion
+                                                                          : EXT2_DX_HASH_HALF_MD4;
+    info->infoLength = sizeof(ext2_dx_root_info_t);
+
+    uint32_t entriesOffset = EXT2_DX_ROOT_INFO_OFFSET + sizeof(ext2_dx_root_info_t);
+    ext2_dx_entry_t* entries = reinterpret_cast<ext2_dx_entry_t*>(root + entriesOffset);
+    ext2_dx_countlimit_t* countLimit = reinterpret_cast<ext2_dx_countlimit_t*>(entries);
+    countLimit->limit = (blocksize - entriesOffset) / sizeof(ext2_dx_entry_t);
+    countLimit->count = 1;
+    entries[0].block = leafIndex;
+
+    int e = WriteBlockCached(leafBlock, leaf);
+    if (!e) {
+        e = WriteBlockCached(rootBlock, root);
+    }
+
+    kfree(root);
+    if (e) {
+        return e;
+    }
+
+    dir->e2inode.flags |= EXT2_INDEX_FL;
+    SyncNode(dir);
+
+    return 0;
+}
+
+} // namespace fs
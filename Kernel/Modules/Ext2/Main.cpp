@@ -5,6 +5,7 @@
 #include <Logging.h>
 #include <Math.h>
 #include <Module.h>
+#include <Scheduler.h>
 
 #include <Debug.h>
 
@@ -32,7 +33,20 @@ lock_t Ext2::m_instanceLock = 0;
 Ext2* Ext2::m_instance = nullptr;
 
 Ext2::Ext2() { fs::RegisterDriver(this); }
-Ext2::~Ext2() { fs::UnregisterDriver(this); }
+Ext2::~Ext2() {
+    if (m_flusher) {
+        m_stopFlusher = true;
+        WakeFlusher();
+
+        while (!m_flusher->IsDead()) {
+            Scheduler::Yield(); // Wait for the flusher to finish its last pass
+        }
+        m_flusher = nullptr;
+    }
+
+    FlushVolumes();
+    fs::UnregisterDriver(this);
+}
 
 Ext2& Ext2::Instance() {
     if (m_instance) {
@@ -55,11 +69,34 @@ FsVolume* Ext2::Mount(FsNode* device, const char* name) {
         return nullptr; // Error mounting volume
     }
 
+    m_volumesLock.AcquireWrite();
     m_extVolumes.add_back(vol);
+    m_volumesLock.ReleaseWrite();
+
+    if (!m_flusher) {
+        m_flusher = Process::CreateKernelProcess((void*)FlusherThread, "Ext2 Flusher", nullptr);
+        m_flusher->Start();
+    }
+
     return vol;
 }
 
-FsVolume* Ext2::Unmount(FsVolume* volume) { assert(!"Ext2::Unmount is a stub!"); }
+FsVolume* Ext2::Unmount(FsVolume* volume) {
+    m_volumesLock.AcquireWrite();
+    for (auto it = m_extVolumes.begin(); it != m_extVolumes.end(); it++) {
+        if (*it == volume) {
+            m_extVolumes.remove(it);
+            m_volumesLock.ReleaseWrite();
+
+            // The flusher can no longer see the volume, write back everything it still has
+            static_cast<Ext2Volume*>(volume)->Flush();
+            return volume;
+        }
+    }
+    m_volumesLock.ReleaseWrite();
+
+    return nullptr; // Not one of our volumes
+}
 
 int Ext2::Identify(FsNode* device) {
     struct {
@@ -76,6 +113,36 @@ int Ext2::Identify(FsNode* device) {
 
 const char* Ext2::ID() const { return "ext2"; }
 
+void Ext2::WakeFlusher() { m_flusherSemaphore.Signal(); }
+
+void Ext2::FlushVolumes() {
+    m_volumesLock.AcquireRead();
+    for (FsVolume* vol : m_extVolumes) {
+        Ext2Volume* e2vol = static_cast<Ext2Volume*>(vol);
+        if (e2vol->DirtyBytes() || e2vol->DirtyInodeCount()) {
+            e2vol->Flush();
+        }
+    }
+    m_volumesLock.ReleaseRead();
+}
+
+void Ext2::FlusherThread() {
+    Ext2& ext2 = Instance();
+
+    while (!ext2.m_stopFlusher) {
+        long timeout = EXT2_FLUSH_INTERVAL;
+        (void)ext2.m_flusherSemaphore.WaitTimeout(timeout);
+        // WaitTimeout does not give back the count when timing out,
+        // any wakeups queued while flushing are covered by this pass anyway.
+        ext2.m_flusherSemaphore.SetValue(0);
+
+        ext2.FlushVolumes();
+    }
+
+    acquireLock(&Thread::Current()->kernelLock);
+    Process::Current()->Die();
+}
+
 Ext2::Ext2Volume::Ext2Volume(FsNode* device, const char* name) {
     m_device = device;
     assert(device->IsCharDevice() || device->IsBlockDevice());
@@ -94,16 +161,33 @@ Ext2::Ext2Volume::Ext2Volume(FsNode* device, const char* name) {
             return; // Disk Error
         }
 
-        if ((superext.featuresIncompat & (~EXT2_INCOMPAT_FEATURE_SUPPORT)) != 0 ||
-            (superext.featuresRoCompat & (~EXT2_READONLY_FEATURE_SUPPORT)) !=
-                0) { // Check support for incompatible/read-only compatible features
-            Log::Error(
-                "[Ext2] Incompatible Ext2 features present (Incompt: %x, Read-only Compt: %x). Will not mount volume.",
-                superext.featuresIncompat, superext.featuresRoCompat);
+        if ((superext.featuresIncompat & (~EXT2_INCOMPAT_FEATURE_SUPPORT)) !=
+            0) { // Check support for incompatible features
+            Log::Error("[Ext2] Incompatible Ext2 features present (Incompt: %x). Will not mount volume.",
+                       superext.featuresIncompat);
             error = IncompatibleError;
             return;
         }
 
+        if ((superext.featuresRoCompat & (~EXT2_READONLY_FEATURE_SUPPORT)) != 0) {
+            // We can read the volume but writing to it would leave it inconsistent (e.g. stale metadata checksums)
+            Log::Warning("[Ext2] Unsupported read-only compatible features present (%x), mounting read-only.",
+                         superext.featuresRoCompat);
+            readOnly = true;
+        }
+
+        if (superext.featuresIncompat & IncompatibleFeatures::Bit64) {
+            if (superext.blockCountHigh || superext.descriptorSize < sizeof(ext2_blockgrp_desc_t)) {
+                Log::Error("[Ext2] Unsupported 64-bit volume (block count high: %u, descriptor size: %u).",
+                           superext.blockCountHigh, superext.descriptorSize);
+                error = IncompatibleError;
+                return;
+            }
+
+            // Only the lower halves of the larger descriptors are used, the upper halves stay zero
+            descriptorSize = superext.descriptorSize;
+        }
+
         if (superext.featuresIncompat & IncompatibleFeatures::Filetype)
             filetype = true;
         else
@@ -118,6 +202,9 @@ Ext2::Ext2Volume::Ext2Volume(FsNode* device, const char* name) {
             sparse = true;
         else
             sparse = false;
+
+        dirIndex = (superext.featuresCompat & CompatibleFeatures::DirectoryIndexing);
+        extents = (superext.featuresIncompat & IncompatibleFeatures::Extents);
     } else {
         memset(&superext, 0, sizeof(ext2_superblock_extended_t));
     }
@@ -150,22 +237,32 @@ Ext2::Ext2Volume::Ext2Volume(FsNode* device, const char* name) {
     if (debugLevelExt2 >= DebugLevelNormal) {
         Log::Info("[Ext2] Block Group Count: %d, Inodes Per Block Group: %d, Inode Size: %d", blockGroupCount,
                   super.inodesPerGroup, inodeSize);
-        Log::Info("[Ext2] Sparse Superblock? %s Large Files? %s, Filetype Extension? %s", (sparse ? "Yes" : "No"),
-                  (largeFiles ? "Yes" : "No"), (filetype ? "Yes" : "No"));
+        Log::Info("[Ext2] Sparse Superblock? %s Large Files? %s, Filetype Extension? %s, Directory Index? %s, "
+                  "Extents? %s",
+                  (sparse ? "Yes" : "No"), (largeFiles ? "Yes" : "No"), (filetype ? "Yes" : "No"),
+                  (dirIndex ? "Yes" : "No"), (extents ? "Yes" : "No"));
     }
 
     blockGroups = (ext2_blockgrp_desc_t*)kmalloc(blockGroupCount * sizeof(ext2_blockgrp_desc_t));
+    groupAllocInfo = new GroupAllocInfo[blockGroupCount];
 
     uint64_t blockGroupOffset =
         BlockToLocation(LocationToBlock(EXT2_SUPERBLOCK_LOCATION) + 1); // One block from the superblock
 
-    if (fs::Read(m_device, blockGroupOffset, blockGroupCount * sizeof(ext2_blockgrp_desc_t), blockGroups) !=
-        blockGroupCount * sizeof(ext2_blockgrp_desc_t)) {
+    size_t descriptorTableSize = blockGroupCount * descriptorSize;
+    uint8_t* descriptorTable = (uint8_t*)kmalloc(descriptorTableSize);
+    if (fs::Read(m_device, blockGroupOffset, descriptorTableSize, descriptorTable) != descriptorTableSize) {
         Log::Error("[Ext2] Disk Error Initializing Volume");
+        kfree(descriptorTable);
         error = DiskReadError;
         return; // Disk Error
     }
 
+    for (uint32_t i = 0; i < blockGroupCount; i++) {
+        memcpy(&blockGroups[i], descriptorTable + i * descriptorSize, sizeof(ext2_blockgrp_desc_t));
+    }
+    kfree(descriptorTable);
+
     ext2_inode_t root;
     if (ReadInode(EXT2_ROOT_INODE_INDEX, root)) {
         Log::Error("[Ext2] Disk Error Initializing Volume");
@@ -173,8 +270,6 @@ Ext2::Ext2Volume::Ext2Volume(FsNode* device, const char* name) {
         return;
     }
 
-    root.flags = EXT2_S_IFDIR;
-
     Ext2Node* e2mountPoint = new Ext2Node(this, root, EXT2_ROOT_INODE_INDEX);
     mountPoint = e2mountPoint;
 
@@ -184,18 +279,9 @@ Ext2::Ext2Volume::Ext2Volume(FsNode* device, const char* name) {
 }
 
 void Ext2::Ext2Volume::WriteSuperblock() {
-    uint8_t buffer[blocksize];
-
     uint32_t superindex = LocationToBlock(EXT2_SUPERBLOCK_LOCATION);
-    if (ReadBlockCached(superindex, buffer)) {
-        Log::Info("[Ext2] WriteBlock: Error reading block %d", superindex);
-        return;
-    }
-
-    memcpy(buffer + (EXT2_SUPERBLOCK_LOCATION % blocksize), &super,
-           sizeof(ext2_superblock_t) + sizeof(ext2_superblock_extended_t));
-
-    if (WriteBlockCached(superindex, buffer)) {
+    if (ModifyCachedBlock(superindex, EXT2_SUPERBLOCK_LOCATION % blocksize, &super,
+                          sizeof(ext2_superblock_t) + sizeof(ext2_superblock_extended_t))) {
         Log::Info("[Ext2] WriteBlock: Error writing block %d", superindex);
         return;
     }
@@ -203,24 +289,26 @@ void Ext2::Ext2Volume::WriteSuperblock() {
 
 void Ext2::Ext2Volume::WriteBlockGroupDescriptor(uint32_t index) {
     uint32_t firstBlockGroup = LocationToBlock(EXT2_SUPERBLOCK_LOCATION) + 1;
-    uint32_t block = firstBlockGroup + LocationToBlock(index * sizeof(ext2_blockgrp_desc_t));
-    uint8_t buffer[blocksize];
-
-    if (ReadBlockCached(block, buffer)) {
-        Log::Info("[Ext2] WriteBlock: Error reading block %d", block);
-        return;
-    }
+    uint32_t block = firstBlockGroup + LocationToBlock(index * descriptorSize);
 
-    memcpy(buffer + ((index * sizeof(ext2_blockgrp_desc_t)) % blocksize), &blockGroups[index],
-           sizeof(ext2_blockgrp_desc_t));
-
-    if (WriteBlockCached(block, buffer)) {
+    if (ModifyCachedBlock(block, (index * descriptorSize) % blocksize, &blockGroups[index],
+                          sizeof(ext2_blockgrp_desc_t))) {
         Log::Info("[Ext2] WriteBlock: Error writing block %d", block);
         return;
     }
 }
 
 uint32_t Ext2::Ext2Volume::GetInodeBlock(uint32_t index, ext2_inode_t& ino) {
+    if (IsExtentMapped(ino)) {
+        uint32_t block, length;
+        if (ExtentLookup(ino, index, block, length)) {
+            error = DiskReadError;
+            return 0;
+        }
+
+        return block;
+    }
+
     uint32_t blocksPerPointer = blocksize / sizeof(uint32_t); // Amount of blocks in a indirect block table
     uint32_t singlyIndirectStart = EXT2_DIRECT_BLOCK_COUNT;
     uint32_t doublyIndirectStart = singlyIndirectStart + blocksPerPointer;
@@ -234,35 +322,38 @@ uint32_t Ext2::Ext2Volume::GetInodeBlock(uint32_t index, ext2_inode_t& ino) {
         return ino.blocks[index];
     } else if (index < doublyIndirectStart) {
         // Index lies within the singly indirect blocklist
-        uint32_t buffer[blocksize / sizeof(uint32_t)];
-
-        if (int e = ReadBlockCached(ino.blocks[EXT2_SINGLY_INDIRECT_INDEX], buffer)) {
-            (void)e;
+        CachedBlock* blockList = GetCachedBlock(ino.blocks[EXT2_SINGLY_INDIRECT_INDEX]);
+        if (!blockList) {
             error = DiskReadError;
             return 0;
         }
 
-        return buffer[index - singlyIndirectStart];
+        uint32_t block = reinterpret_cast<uint32_t*>(blockList->data)[index - singlyIndirectStart];
+        ReleaseCachedBlock(blockList);
+
+        return block;
     } else if (index < triplyIndirectStart) {
         // Index lies within the doubly indirect blocklist
-        uint32_t blockPointers[blocksize / sizeof(uint32_t)];
-        uint32_t buffer[blocksize / sizeof(uint32_t)];
-
-        if (int e = ReadBlockCached(ino.blocks[EXT2_DOUBLY_INDIRECT_INDEX], blockPointers)) {
-            (void)e;
+        CachedBlock* blockPointers = GetCachedBlock(ino.blocks[EXT2_DOUBLY_INDIRECT_INDEX]);
+        if (!blockPointers) {
             error = DiskReadError;
             return 0;
         }
 
-        uint32_t blockPointer = blockPointers[(index - doublyIndirectStart) / blocksPerPointer];
+        uint32_t blockPointer =
+            reinterpret_cast<uint32_t*>(blockPointers->data)[(index - doublyIndirectStart) / blocksPerPointer];
+        ReleaseCachedBlock(blockPointers);
 
-        if (int e = ReadBlockCached(blockPointer, buffer)) {
-            (void)e;
+        CachedBlock* blockList = GetCachedBlock(blockPointer);
+        if (!blockList) {
             error = DiskReadError;
             return 0;
         }
 
-        return buffer[(index - doublyIndirectStart) % blocksPerPointer];
+        uint32_t block = reinterpret_cast<uint32_t*>(blockList->data)[(index - doublyIndirectStart) % blocksPerPointer];
+        ReleaseCachedBlock(blockList);
+
+        return block;
     } else {
         assert(!"Yet to support triply indirect");
         return 0;
@@ -270,6 +361,30 @@ uint32_t Ext2::Ext2Volume::GetInodeBlock(uint32_t index, ext2_inode_t& ino) {
 }
 
 Vector<uint32_t> Ext2::Ext2Volume::GetInodeBlocks(uint32_t index, uint32_t count, ext2_inode_t& ino) {
+    if (IsExtentMapped(ino)) {
+        Vector<uint32_t> blocks;
+        blocks.reserve(count);
+
+        // Each lookup covers the rest of an extent or hole
+        uint32_t i = index;
+        while (i < index + count) {
+            uint32_t block, length;
+            if (int e = ExtentLookup(ino, i, block, length); e) {
+                Log::Info("[Ext2] GetInodeBlocks: Error %d looking up block %u", e, i);
+                error = DiskReadError;
+
+                blocks.clear();
+                return blocks;
+            }
+
+            for (uint32_t j = 0; j < length && i < index + count; j++, i++) {
+                blocks.add_back(block ? block + j : 0);
+            }
+        }
+
+        return blocks;
+    }
+
     uint32_t blocksPerPointer = blocksize / sizeof(uint32_t); // Amount of blocks in a indirect block table
     uint32_t singlyIndirectStart = EXT2_DIRECT_BLOCK_COUNT;
     uint32_t doublyIndirectStart = singlyIndirectStart + blocksPerPointer;
@@ -290,10 +405,9 @@ Vector<uint32_t> Ext2::Ext2Volume::GetInodeBlocks(uint32_t index, uint32_t count
 
     if (i < doublyIndirectStart && i < index + count) {
         // Index lies within the singly indirect blocklist
-        uint32_t buffer[blocksize / sizeof(uint32_t)];
-
-        if (int e = ReadBlockCached(ino.blocks[EXT2_SINGLY_INDIRECT_INDEX], buffer)) {
-            Log::Info("[Ext2] GetInodeBlocks: Error %i reading block %u (singly indirect block)", e,
+        CachedBlock* blockList = GetCachedBlock(ino.blocks[EXT2_SINGLY_INDIRECT_INDEX]);
+        if (!blockList) {
+            Log::Info("[Ext2] GetInodeBlocks: Error reading block %u (singly indirect block)",
                       ino.blocks[EXT2_SINGLY_INDIRECT_INDEX]);
             error = DiskReadError;
 
@@ -301,6 +415,7 @@ Vector<uint32_t> Ext2::Ext2Volume::GetInodeBlocks(uint32_t index, uint32_t count
             return blocks;
         }
 
+        uint32_t* buffer = reinterpret_cast<uint32_t*>(blockList->data);
         while (i < doublyIndirectStart && i < index + count) {
             uint32_t block = buffer[(i++) - singlyIndirectStart];
             if (block >= super.blockCount) {
@@ -309,15 +424,15 @@ Vector<uint32_t> Ext2::Ext2Volume::GetInodeBlocks(uint32_t index, uint32_t count
             }
             blocks.add_back(block);
         }
+
+        ReleaseCachedBlock(blockList);
     }
 
     if (i < triplyIndirectStart && i < index + count) {
         // Index lies within the doubly indirect blocklist
-        uint32_t blockPointers[blocksize / sizeof(uint32_t)];
-        uint32_t buffer[blocksize / sizeof(uint32_t)];
-
-        if (int e = ReadBlockCached(ino.blocks[EXT2_DOUBLY_INDIRECT_INDEX], blockPointers)) {
-            Log::Info("[Ext2] GetInodeBlocks: Error %i reading block %u (doubly indirect block)", e,
+        CachedBlock* blockPointers = GetCachedBlock(ino.blocks[EXT2_DOUBLY_INDIRECT_INDEX]);
+        if (!blockPointers) {
+            Log::Info("[Ext2] GetInodeBlocks: Error reading block %u (doubly indirect block)",
                       ino.blocks[EXT2_DOUBLY_INDIRECT_INDEX]);
             error = DiskReadError;
 
@@ -326,17 +441,22 @@ Vector<uint32_t> Ext2::Ext2Volume::GetInodeBlocks(uint32_t index, uint32_t count
         }
 
         while (i < triplyIndirectStart && i < index + count) {
-            uint32_t blockPointer = blockPointers[(i - doublyIndirectStart) / blocksPerPointer];
+            uint32_t blockPointer =
+                reinterpret_cast<uint32_t*>(blockPointers->data)[(i - doublyIndirectStart) / blocksPerPointer];
 
-            if (int e = ReadBlockCached(blockPointer, buffer)) {
-                Log::Info("[Ext2] GetInodeBlocks: Error %i reading block %u (doubly indirect block pointer)", e,
+            CachedBlock* blockList = GetCachedBlock(blockPointer);
+            if (!blockList) {
+                Log::Info("[Ext2] GetInodeBlocks: Error reading block %u (doubly indirect block pointer)",
                           blockPointer);
                 error = DiskReadError;
 
+                ReleaseCachedBlock(blockPointers);
                 blocks.clear();
                 return blocks;
             }
 
+            uint32_t* buffer = reinterpret_cast<uint32_t*>(blockList->data);
+
             uint32_t blockPointerEnd = i + (blocksPerPointer - (i - doublyIndirectStart) % blocksPerPointer);
             while (i < blockPointerEnd && i < index + count) {
                 uint32_t block = buffer[(i - doublyIndirectStart) % blocksPerPointer];
@@ -347,7 +467,11 @@ Vector<uint32_t> Ext2::Ext2Volume::GetInodeBlocks(uint32_t index, uint32_t count
                 blocks.add_back(block);
                 i++;
             }
+
+            ReleaseCachedBlock(blockList);
         }
+
+        ReleaseCachedBlock(blockPointers);
     }
 
     if (i < index + count) {
@@ -361,6 +485,14 @@ Vector<uint32_t> Ext2::Ext2Volume::GetInodeBlocks(uint32_t index, uint32_t count
 }
 
 void Ext2::Ext2Volume::SetInodeBlock(uint32_t index, ext2_inode_t& ino, uint32_t block) {
+    if (IsExtentMapped(ino)) {
+        if (int e = ExtentMapBlock(ino, index, block); e) {
+            Log::Error("[Ext2] SetInodeBlock: Error %d mapping block %u", e, index);
+            error = DiskWriteError;
+        }
+        return;
+    }
+
     uint32_t blocksPerPointer = blocksize / sizeof(uint32_t); // Amount of blocks in a indirect block table
     uint32_t singlyIndirectStart = EXT2_DIRECT_BLOCK_COUNT;
     uint32_t doublyIndirectStart = singlyIndirectStart + blocksPerPointer;
@@ -377,7 +509,7 @@ void Ext2::Ext2Volume::SetInodeBlock(uint32_t index, ext2_inode_t& ino, uint32_t
         uint32_t buffer[blocksize / sizeof(uint32_t)];
 
         if (ino.blocks[EXT2_SINGLY_INDIRECT_INDEX] == 0) {
-            ino.blocks[EXT2_SINGLY_INDIRECT_INDEX] = AllocateBlock();
+            ino.blocks[EXT2_SINGLY_INDIRECT_INDEX] = AllocateZeroedBlock();
         }
 
         if (int e = ReadBlockCached(ino.blocks[EXT2_SINGLY_INDIRECT_INDEX], buffer)) {
@@ -399,6 +531,10 @@ void Ext2::Ext2Volume::SetInodeBlock(uint32_t index, ext2_inode_t& ino, uint32_t
         uint32_t blockPointers[blocksize / sizeof(uint32_t)];
         uint32_t buffer[blocksize / sizeof(uint32_t)];
 
+        if (ino.blocks[EXT2_DOUBLY_INDIRECT_INDEX] == 0) {
+            ino.blocks[EXT2_DOUBLY_INDIRECT_INDEX] = AllocateZeroedBlock();
+        }
+
         if (int e = ReadBlockCached(ino.blocks[EXT2_DOUBLY_INDIRECT_INDEX],
                                     blockPointers)) { // Read indirect block pointer list
             (void)e;
@@ -406,7 +542,14 @@ void Ext2::Ext2Volume::SetInodeBlock(uint32_t index, ext2_inode_t& ino, uint32_t
             return;
         }
 
-        uint32_t blockPointer = blockPointers[(index - doublyIndirectStart) / blocksPerPointer];
+        uint32_t& blockPointer = blockPointers[(index - doublyIndirectStart) / blocksPerPointer];
+        if (blockPointer == 0) {
+            blockPointer = AllocateZeroedBlock();
+            if (WriteBlockCached(ino.blocks[EXT2_DOUBLY_INDIRECT_INDEX], blockPointers)) {
+                error = DiskWriteError;
+                return;
+            }
+        }
 
         if (int e = ReadBlockCached(blockPointer, buffer)) { // Read blocklist
             (void)e;
@@ -429,15 +572,29 @@ void Ext2::Ext2Volume::SetInodeBlock(uint32_t index, ext2_inode_t& ino, uint32_t
 }
 
 int Ext2::Ext2Volume::ReadInode(uint32_t num, ext2_inode_t& inode) {
-    uint8_t buf[512];
+    // Inodes are read through the block cache as it may hold inode table blocks not yet written back
+    uint64_t off = InodeOffset(num);
+
+#ifndef EXT2_NO_CACHE
+    CachedBlock* table = GetCachedBlock(LocationToBlock(off));
+    if (!table) {
+        Log::Error("[Ext2] Disk Error Reading Inode %d", num);
+        error = DiskReadError;
+        return -EIO;
+    }
 
-    if (int e = fs::Read(m_device, InodeOffset(num) & (~511U), 512, buf); e != 512) {
+    inode = *(ext2_inode_t*)(table->data + (off & (blocksize - 1)));
+    ReleaseCachedBlock(table);
+#else
+    uint8_t buf[blocksize];
+    if (int e = ReadBlock(LocationToBlock(off), buf); e) {
         Log::Error("[Ext2] Disk Error (%d) Reading Inode %d", e, num);
         error = DiskReadError;
         return e;
     }
 
-    inode = *(ext2_inode_t*)(buf + ((ResolveInodeBlockGroupIndex(num) * inodeSize) & (512 - 1)));
+    inode = *(ext2_inode_t*)(buf + (off & (blocksize - 1)));
+#endif
     return 0;
 }
 
@@ -445,11 +602,27 @@ int Ext2::Ext2Volume::ReadBlock(uint32_t block, void* buffer) {
     if (block > super.blockCount)
         return 1;
 
-    if (int e = fs::Read(m_device, BlockToLocation(block), blocksize, buffer); e != blocksize) {
+    if (int e = m_device->Read(BlockToLocation(block), blocksize, reinterpret_cast<uint8_t*>(buffer));
+        e != blocksize) {
         Log::Error("[Ext2] Disk error (%d) reading block %d (blocksize: %d)", e, block, blocksize);
         return e;
     }
 
+    OverlayCachedBlocks(block, 1, reinterpret_cast<uint8_t*>(buffer));
+    return 0;
+}
+
+int Ext2::Ext2Volume::ReadBlocks(uint32_t block, uint32_t count, void* buffer) {
+    if (block + count - 1 > super.blockCount)
+        return 1;
+
+    ssize_t size = static_cast<ssize_t>(count) * blocksize;
+    if (ssize_t e = m_device->Read(BlockToLocation(block), size, reinterpret_cast<uint8_t*>(buffer)); e != size) {
+        Log::Error("[Ext2] Disk error (%d) reading %u blocks from %d (blocksize: %d)", e, count, block, blocksize);
+        return e < 0 ? e : -EIO;
+    }
+
+    OverlayCachedBlocks(block, count, reinterpret_cast<uint8_t*>(buffer));
     return 0;
 }
 
@@ -457,7 +630,8 @@ int Ext2::Ext2Volume::WriteBlock(uint32_t block, void* buffer) {
     if (block > super.blockCount)
         return 1;
 
-    if (int e = fs::Write(m_device, BlockToLocation(block), blocksize, buffer); e != blocksize) {
+    if (int e = m_device->Write(BlockToLocation(block), blocksize, reinterpret_cast<uint8_t*>(buffer));
+        e != blocksize) {
         Log::Error("[Ext2] Disk error (%e) reading block %d (blocksize: %d)", e, block, blocksize);
         return e;
     }
@@ -465,537 +639,1172 @@ int Ext2::Ext2Volume::WriteBlock(uint32_t block, void* buffer) {
     return 0;
 }
 
-int Ext2::Ext2Volume::ReadBlockCached(uint32_t block, void* buffer) {
+Ext2::Ext2Volume::CachedBlock* Ext2::Ext2Volume::GetCachedBlock(uint32_t block, bool readIn) {
     if (block > super.blockCount)
-        return -EINVAL;
+        return nullptr;
 
-#ifndef EXT2_NO_CACHE
-    ScopedSpinLock lockBlockCache(m_blocksLock);
+    BlockCacheBucket& bucket = GetBlockCacheBucket(block);
+    acquireLock(&bucket.lock);
 
-    CachedBlock* cachedBlock;
-    if (blockCache.get(block, cachedBlock)) {
+    // Most recently used blocks are at the back
+    CachedBlock* cachedBlock = bucket.blocks.get_back();
+    while (cachedBlock && !(cachedBlock->valid && cachedBlock->block == block)) {
+        cachedBlock = bucket.blocks.prev(cachedBlock);
+    }
+
+    if (cachedBlock) {
+        cachedBlock->refCount++;
         cachedBlock->timestamp = Timer::UsecondsSinceBoot();
-        memcpy(buffer, cachedBlock->data, blocksize);
 
         // Move block to the end of the list
-        cachedBlockList.remove(cachedBlock);
-        cachedBlockList.add_back(cachedBlock);
-    } else {
-        if(blockCacheMemoryUsage >= EXT2_BLOCKCACHE_LIMIT) {
-            // Remove cached blocks until we are at the trim value
-            cachedBlock = cachedBlockList.remove_at(0);
+        bucket.blocks.remove(cachedBlock);
+        bucket.blocks.add_back(cachedBlock);
+        releaseLock(&bucket.lock);
 
-            assert(blockCache.find(cachedBlock->block));
-            blockCache.remove(cachedBlock->block);
-        } else {
-            cachedBlock = AllocateCachedBlock();
+        // Another thread may still be reading the block in
+        while (!cachedBlock->upToDate && !cachedBlock->error) {
+            Scheduler::Yield();
+        }
 
-            blockCacheMemoryUsage += blocksize;
-            Ext2::Instance().totalBlockCacheMemoryUsage += blocksize;
+        if (cachedBlock->error) {
+            ReleaseCachedBlock(cachedBlock);
+            return nullptr;
         }
 
-        cachedBlock->block = block;
-        cachedBlock->timestamp = Timer::UsecondsSinceBoot();
+        return cachedBlock;
+    }
 
-        if (int e = fs::Read(m_device, BlockToLocation(block), blocksize, cachedBlock->data); e != blocksize) {
-            Log::Error("[Ext2] Disk error (%d) reading block %d (blocksize: %d)", e, block, blocksize);
-            
-            // Since we didnt end up using this block, place it at the front of the list
-            // so it gets reused first
-            cachedBlockList.add_front(cachedBlock);
-            return e;
+    if (bucket.memoryUsage >= EXT2_BLOCKCACHE_LIMIT / EXT2_BLOCKCACHE_BUCKETS) {
+        // Reuse the least recently used block that is not pinned or waiting to be written back
+        cachedBlock = bucket.blocks.get_front();
+        while (cachedBlock && (cachedBlock->refCount || cachedBlock->dirty)) {
+            cachedBlock = bucket.blocks.next(cachedBlock);
         }
-        
-        cachedBlockList.add_back(cachedBlock);
-        blockCache.insert(block, cachedBlock);
-
-        memcpy(buffer, cachedBlock->data, blocksize);
     }
-#else
-    if (int e = fs::Read(m_device, BlockToLocation(block), blocksize, buffer); e != blocksize) {
-        Log::Error("[Ext2] Disk error (%d) reading block %d (blocksize: %d)", e, block, blocksize);
-        return e;
+
+    if (cachedBlock) {
+        bucket.blocks.remove(cachedBlock);
+    } else {
+        cachedBlock = AllocateCachedBlock();
+
+        bucket.memoryUsage += blocksize;
+        __atomic_add_fetch(&Ext2::Instance().totalBlockCacheMemoryUsage, blocksize, __ATOMIC_RELAXED);
     }
-#endif
-    return 0;
-}
 
-int Ext2::Ext2Volume::WriteBlockCached(uint32_t block, void* buffer) {
-    if (block > super.blockCount)
-        return -EINVAL;
+    cachedBlock->block = block;
+    cachedBlock->timestamp = Timer::UsecondsSinceBoot();
+    cachedBlock->refCount = 1;
+    cachedBlock->upToDate = false;
+    cachedBlock->error = false;
+    cachedBlock->valid = true;
+    cachedBlock->dirty = false;
+    cachedBlock->owner = 0;
 
-#ifndef EXT2_NO_CACHE
-    ScopedSpinLock lockBlockCache(m_blocksLock);
-    
-    CachedBlock* cachedBlock;
-    if ((blockCache.get(block, cachedBlock))) {
-        memcpy(cachedBlock->data, buffer, blocksize);
-        cachedBlock->timestamp = Timer::UsecondsSinceBoot();
+    bucket.blocks.add_back(cachedBlock);
+    releaseLock(&bucket.lock);
+
+    if (!readIn) {
+        return cachedBlock; // Caller is overwriting the whole block
     }
-#endif
 
-    if (int e = fs::Write(m_device, BlockToLocation(block), blocksize, buffer); e != blocksize) {
+    // Read the block without holding the bucket lock,
+    // anyone else looking for this block will wait for us
+    if (int e = m_device->Read(BlockToLocation(block), blocksize, cachedBlock->data); e != blocksize) {
         Log::Error("[Ext2] Disk error (%d) reading block %d (blocksize: %d)", e, block, blocksize);
-        return e;
+
+        DropCachedBlock(cachedBlock);
+        return nullptr;
     }
 
-    return 0;
+    cachedBlock->upToDate = true;
+    return cachedBlock;
 }
 
-uint32_t Ext2::Ext2Volume::AllocateBlock() {
-    for (unsigned i = 0; i < blockGroupCount; i++) {
-        ext2_blockgrp_desc_t& group = blockGroups[i];
-
-        if (group.freeBlockCount <= 0)
-            continue; // No free blocks in this blockgroup
+void Ext2::Ext2Volume::DropCachedBlock(CachedBlock* cachedBlock) {
+    BlockCacheBucket& bucket = GetBlockCacheBucket(cachedBlock->block);
 
-        uint8_t bitmap[blocksize / sizeof(uint8_t)];
+    acquireLock(&bucket.lock);
+    cachedBlock->error = true;
+    cachedBlock->valid = false;
 
-        if (uint8_t * cachedBitmap; bitmapCache.get(group.blockBitmap, cachedBitmap)) {
-            memcpy(bitmap, cachedBitmap, blocksize);
-        } else {
-            if (int e = ReadBlockCached(group.blockBitmap, bitmap)) {
-                Log::Error("[Ext2] Disk error (%d) reading block bitmap (group %d)", e, i);
-                error = DiskReadError;
-                return 0;
-            }
-        }
+    // Since we didnt end up using this block, place it at the front of the list
+    // so it gets reused first
+    bucket.blocks.remove(cachedBlock);
+    bucket.blocks.add_front(cachedBlock);
+    releaseLock(&bucket.lock);
 
-        uint32_t block = 0;
-        unsigned e = 0;
-        for (; e < blocksize / sizeof(uint8_t); e++) {
-            if (bitmap[e] == UINT8_MAX)
-                continue; // Full
+    ReleaseCachedBlock(cachedBlock);
+}
 
-            for (uint8_t b = 0; b < sizeof(uint8_t) * 8; b++) { // Iterate through all bits in the entry
-                if (((bitmap[e] >> b) & 0x1) == 0) {
-                    bitmap[e] |= (1U << b);
-                    block = (i * super.blocksPerGroup) + e * (sizeof(uint8_t) * 8) +
-                            b; // Block Number = (Group number * blocks per group) + (bitmap entry * 8 (8 bits per
-                               // byte)) + bit (block 0 is least significant bit, block 7 is most significant)
-                    break;
-                }
+void Ext2::Ext2Volume::PrefetchBlocks(const uint32_t* blocks, unsigned count) {
+#ifndef EXT2_NO_CACHE
+    CachedBlock* run[EXT2_PREFETCH_MAX_BLOCKS];
+    uint8_t* buffer = nullptr;
+
+    unsigned i = 0;
+    while (i < count) {
+        // Gather a run of contiguous blocks which are not cached yet
+        unsigned runLength = 0;
+        for (; i < count && runLength < EXT2_PREFETCH_MAX_BLOCKS; i++) {
+            if (runLength && blocks[i] != run[0]->block + runLength) {
+                break;
             }
 
-            if (block)
+            // Without readIn we get back either a cached block or a new block for us to read in
+            CachedBlock* cachedBlock = GetCachedBlock(blocks[i], false);
+            if (!cachedBlock) {
+                continue;
+            } else if (cachedBlock->upToDate) {
+                ReleaseCachedBlock(cachedBlock);
+                i++;
                 break;
-        }
+            }
 
-        if (!block) {
-            continue;
+            run[runLength++] = cachedBlock;
         }
 
-        if (uint8_t * cachedBitmap; bitmapCache.get(group.blockBitmap, cachedBitmap)) {
-            memcpy(cachedBitmap, bitmap, blocksize);
+        if (!runLength) {
+            continue;
         }
 
-        if (int e = WriteBlockCached(group.blockBitmap, bitmap)) {
-            Log::Error("[Ext2] Disk error (%d) write block bitmap (group %d)", e, i);
-            error = DiskWriteError;
-            return 0;
+        if (!buffer) {
+            buffer = (uint8_t*)kmalloc(EXT2_PREFETCH_MAX_BLOCKS * blocksize);
         }
 
-        super.freeBlockCount--;
-        blockGroups[i].freeBlockCount--;
+        ssize_t size = static_cast<ssize_t>(runLength) * blocksize;
+        ssize_t e = m_device->Read(BlockToLocation(run[0]->block), size, buffer);
+        for (unsigned j = 0; j < runLength; j++) {
+            if (e != size) {
+                DropCachedBlock(run[j]);
+                continue;
+            }
 
-        WriteBlockGroupDescriptor(i);
-        WriteSuperblock();
+            memcpy(run[j]->data, buffer + static_cast<size_t>(j) * blocksize, blocksize);
+            run[j]->upToDate = true;
+            ReleaseCachedBlock(run[j]);
+        }
 
-        return block;
+        if (e != size) {
+            Log::Error("[Ext2] Disk error (%d) reading %u blocks from %u", e, runLength, run[0]->block);
+        }
     }
 
-    Log::Error("[Ext2] No space left on filesystem!");
-    return 0;
+    if (buffer) {
+        kfree(buffer);
+    }
+#endif
 }
 
-int Ext2::Ext2Volume::FreeBlock(uint32_t block) {
-    if (block > super.blockCount)
-        return -1;
+void Ext2::Ext2Volume::PrefetchInodeTables(const uint8_t* directoryBlock) {
+    uint32_t tableBlocks[EXT2_PREFETCH_MAX_BLOCKS];
+    unsigned count = 0;
 
-    ext2_blockgrp_desc_t& group = blockGroups[block / super.blocksPerGroup];
+    uint32_t offset = 0;
+    while (offset + sizeof(ext2_directory_entry_t) <= blocksize && count < EXT2_PREFETCH_MAX_BLOCKS) {
+        auto* e2dirent = (const ext2_directory_entry_t*)(directoryBlock + offset);
+        if (e2dirent->recordLength < 8) {
+            break;
+        }
 
-    uint8_t bitmap[blocksize / sizeof(uint8_t)];
+        if (e2dirent->inode > 0 && e2dirent->inode <= super.inodeCount) {
+            uint32_t block = LocationToBlock(InodeOffset(e2dirent->inode));
 
-    if (uint8_t * cachedBitmap; bitmapCache.get(group.blockBitmap, cachedBitmap)) {
-        memcpy(bitmap, cachedBitmap, blocksize);
-    } else {
-        if (int e = ReadBlockCached(group.blockBitmap, bitmap)) {
-            if (e == -EINTR) {
-                return -EINTR;
+            bool found = false;
+            for (unsigned i = 0; i < count && !found; i++) {
+                found = (tableBlocks[i] == block);
             }
 
-            Log::Error("[Ext2] Disk error (%d) reading block bitmap (group %d)", e, block / super.blocksPerGroup);
-            error = DiskReadError;
-            return -1;
+            if (!found) {
+                tableBlocks[count++] = block;
+            }
         }
-    }
 
-    int bmapIndex = (block % super.blocksPerGroup) / (sizeof(uint8_t) * 8);
-    int bitmask = ~(1 << (block % 8));
-    bitmap[bmapIndex] &= bitmask;
-
-    if (uint8_t * cachedBitmap; bitmapCache.get(group.blockBitmap, cachedBitmap)) {
-        memcpy(cachedBitmap, bitmap, blocksize);
-    }
-
-    if (int e = WriteBlockCached(group.blockBitmap, bitmap)) {
-        Log::Error("[Ext2] Disk error (%d) write block bitmap (group %d)", e, block / super.blocksPerGroup);
-        error = DiskWriteError;
-        return -1;
+        offset += e2dirent->recordLength;
     }
 
-    super.freeBlockCount++;
-    blockGroups[block / super.blocksPerGroup].freeBlockCount++;
-
-    WriteBlockGroupDescriptor(block / super.blocksPerGroup);
-    WriteSuperblock();
-
-    return 0;
+    HeapSort(tableBlocks, count, [](uint32_t l, uint32_t r) -> bool { return l < r; });
+    PrefetchBlocks(tableBlocks, count);
 }
 
-Ext2::Ext2Node* Ext2::Ext2Volume::CreateNode() {
-    ScopedSpinLock lockInodes(m_inodesLock);
-    for (unsigned i = 0; i < blockGroupCount; i++) {
-        ext2_blockgrp_desc_t& group = blockGroups[i];
-
-        if (group.freeInodeCount <= 0)
-            continue; // No free inodes in this blockgroup
-
-        uint8_t bitmap[blocksize / sizeof(uint8_t)];
+void Ext2::Ext2Volume::PrefetchBlockList(uint32_t* blocks, unsigned count) {
+    HeapSort(blocks, count, [](uint32_t l, uint32_t r) -> bool { return l < r; });
 
-        if (int e = ReadBlockCached(group.inodeBitmap, bitmap)) {
-            Log::Error("[Ext2] Disk error (%d) reading inode bitmap (group %d)", e, i);
-            error = DiskReadError;
-            return nullptr;
+    // Remove duplicates so runs of contiguous blocks are not broken up
+    unsigned unique = 0;
+    for (unsigned i = 0; i < count; i++) {
+        if (!unique || blocks[unique - 1] != blocks[i]) {
+            blocks[unique++] = blocks[i];
         }
+    }
 
-        uint32_t inode = 0;
+    PrefetchBlocks(blocks, unique);
+}
 
-        for (unsigned e = 0; e < blocksize / sizeof(uint8_t); e++) {
-            if (bitmap[e] == UINT8_MAX)
-                continue; // Full
+void Ext2::Ext2Volume::ReleaseCachedBlock(CachedBlock* cachedBlock) {
+    BlockCacheBucket& bucket = GetBlockCacheBucket(cachedBlock->block);
 
-            for (uint8_t b = 0; b < sizeof(uint8_t) * 8; b++) { // Iterate through all bits in the entry
-                if (((bitmap[e] >> b) & 0x1) == 0) {
-                    inode = (i * super.inodesPerGroup) + e * (sizeof(uint8_t) * 8) + b +
-                            1; // Inode Number = (Group number * inodes per group) + (bitmap entry * 8 (8 bits per
-                               // byte)) + bit (inode 1 is least significant bit, block 8 is most significant) + 1
-                               // (inodes start at 1)
+    ScopedSpinLock lockBucket(bucket.lock);
+    assert(cachedBlock->refCount > 0);
+    cachedBlock->refCount--;
+}
 
-                    if ((inode > superext.firstInode || super.revLevel == 0) && inode > 11) {
-                        bitmap[e] |= (1U << b);
-                        break;
-                    }
-                }
+void Ext2::Ext2Volume::InvalidateCachedBlock(uint32_t block) {
+    BlockCacheBucket& bucket = GetBlockCacheBucket(block);
+
+    ScopedSpinLock lockBucket(bucket.lock);
+    for (CachedBlock* cachedBlock = bucket.blocks.get_front(); cachedBlock;
+         cachedBlock = bucket.blocks.next(cachedBlock)) {
+        if (cachedBlock->valid && cachedBlock->block == block) {
+            cachedBlock->valid = false;
+            if (cachedBlock->dirty) {
+                cachedBlock->dirty = false;
+                __atomic_sub_fetch(&m_dirtyBlocks, 1, __ATOMIC_RELAXED);
             }
 
-            if (inode)
-                break;
+            bucket.blocks.remove(cachedBlock);
+            bucket.blocks.add_front(cachedBlock);
+            return;
         }
+    }
+}
 
-        if (!inode)
-            continue;
+int Ext2::Ext2Volume::ReadBlockCached(uint32_t block, void* buffer) {
+    if (block > super.blockCount)
+        return -EINVAL;
 
-        if (int e = WriteBlockCached(group.inodeBitmap, bitmap)) {
-            Log::Error("[Ext2] Disk error (%d) write inode bitmap (group %d)", e, i);
-            error = DiskWriteError;
-            return nullptr;
-        }
+#ifndef EXT2_NO_CACHE
+    CachedBlock* cachedBlock = GetCachedBlock(block);
+    if (!cachedBlock) {
+        return -EIO;
+    }
 
-        ext2_inode_t ino;
+    memcpy(buffer, cachedBlock->data, blocksize);
+    ReleaseCachedBlock(cachedBlock);
+#else
+    if (int e = m_device->Read(BlockToLocation(block), blocksize, reinterpret_cast<uint8_t*>(buffer));
+        e != blocksize) {
+        Log::Error("[Ext2] Disk error (%d) reading block %d (blocksize: %d)", e, block, blocksize);
+        return e;
+    }
+#endif
+    return 0;
+}
 
-        memset(&ino, 0, sizeof(ext2_inode_t));
+int Ext2::Ext2Volume::WriteBlockCached(uint32_t block, void* buffer, uint32_t owner) {
+    return ModifyCachedBlock(block, 0, buffer, blocksize, owner);
+}
 
-        ino.blocks[0] = AllocateBlock(); // Give it one block
-        ino.uid = 0;
-        ino.mode = 0644;
-        ino.accessTime = ino.createTime = ino.deleteTime = ino.modTime = 0;
-        ino.gid = 0;
-        ino.blockCount = blocksize / 512;
-        ino.linkCount = 0;
-        ino.size = ino.sizeHigh = 0;
-        ino.fragAddr = 0;
-        ino.fileACL = 0;
+int Ext2::Ext2Volume::ModifyCachedBlock(uint32_t block, uint32_t offset, const void* data, uint32_t size,
+                                        uint32_t owner) {
+    if (block > super.blockCount || offset + size > blocksize)
+        return -EINVAL;
 
-        super.freeInodeCount--;
-        blockGroups[i].freeInodeCount--;
+#ifndef EXT2_NO_CACHE
+    // No need to read the block in if it is being overwritten
+    bool overwrite = (offset == 0 && size == blocksize);
 
-        WriteSuperblock();
-        WriteBlockGroupDescriptor(i);
-        SyncInode(ino, inode);
+    CachedBlock* cachedBlock = GetCachedBlock(block, !overwrite);
+    if (!cachedBlock) {
+        return -EIO;
+    }
 
-        Ext2Node* node = new Ext2Node(this, ino, inode);
+    BlockCacheBucket& bucket = GetBlockCacheBucket(block);
+    acquireLock(&bucket.lock);
 
-        if (debugLevelExt2 >= DebugLevelVerbose) {
-            Log::Info("[Ext2] Created inode %d", node->inode);
+    memcpy(cachedBlock->data + offset, data, size);
+    cachedBlock->timestamp = Timer::UsecondsSinceBoot();
+    cachedBlock->upToDate = true;
+    MarkBlockDirty(cachedBlock, owner);
+
+    releaseLock(&bucket.lock);
+    ReleaseCachedBlock(cachedBlock);
+
+    if (DirtyBytes() >= EXT2_DIRTY_BACKGROUND_LIMIT) {
+        Ext2::Instance().WakeFlusher();
+    }
+#else
+    uint8_t buffer[blocksize];
+    if (offset != 0 || size != blocksize) {
+        if (int e = ReadBlock(block, buffer); e) {
+            return e;
         }
+    }
 
-        return node;
+    memcpy(buffer + offset, data, size);
+    if (int e = WriteBlock(block, buffer); e) {
+        return e;
     }
+#endif
+    return 0;
+}
 
-    Log::Error("[Ext2] No inodes left on the filesystem!");
-    return nullptr;
+void Ext2::Ext2Volume::MarkBlockDirty(CachedBlock* cachedBlock, uint32_t owner) {
+    if (!cachedBlock->dirty) {
+        cachedBlock->dirty = true;
+        cachedBlock->owner = owner;
+        __atomic_add_fetch(&m_dirtyBlocks, 1, __ATOMIC_RELAXED);
+    } else if (cachedBlock->owner != owner) {
+        cachedBlock->owner = 0; // Shared by more than one inode
+    }
 }
 
-int Ext2::Ext2Volume::EraseInode(ext2_inode_t& e2inode, uint32_t inode) {
-    if (inode > super.inodeCount)
-        return -1;
+void Ext2::Ext2Volume::OverlayCachedBlocks(uint32_t block, uint32_t count, uint8_t* buffer) {
+    // Cached blocks only differ from the disk when dirty or while being written back
+    if (!__atomic_load_n(&m_dirtyBlocks, __ATOMIC_RELAXED) && !m_flushing) {
+        return;
+    }
 
-    if (e2inode.linkCount > 0) {
-        Log::Warning("[Ext2] EraseInode: inode %d contains %d links! Will not erase.", inode, e2inode.linkCount);
-        return -2;
+    for (uint32_t i = 0; i < count; i++) {
+        BlockCacheBucket& bucket = GetBlockCacheBucket(block + i);
+
+        ScopedSpinLock lockBucket(bucket.lock);
+        for (CachedBlock* cachedBlock = bucket.blocks.get_back(); cachedBlock;
+             cachedBlock = bucket.blocks.prev(cachedBlock)) {
+            if (cachedBlock->valid && cachedBlock->upToDate && cachedBlock->block == block + i) {
+                memcpy(buffer + static_cast<size_t>(i) * blocksize, cachedBlock->data, blocksize);
+                break;
+            }
+        }
     }
+}
 
-    for (unsigned i = 0; i < e2inode.blockCount * (blocksize / 512); i++) {
-        uint32_t block = GetInodeBlock(i, e2inode);
-        FreeBlock(block);
-        if (blockCache.find(block)) {
-            blockCache.remove(block);
+void Ext2::Ext2Volume::Flush(uint32_t inode) {
+#ifndef EXT2_NO_CACHE
+    if (!inode) {
+        WriteDirtyInodes();
+    }
+
+    if (m_flushLock.Wait()) {
+        return; // Interrupted
+    }
+
+    m_flushing = true;
+
+    // Pin every dirty block we are going to write back
+    Vector<CachedBlock*> dirtyBlocks;
+    for (BlockCacheBucket& bucket : blockCache) {
+        ScopedSpinLock lockBucket(bucket.lock);
+        for (CachedBlock* cachedBlock = bucket.blocks.get_front(); cachedBlock;
+             cachedBlock = bucket.blocks.next(cachedBlock)) {
+            if (cachedBlock->valid && cachedBlock->dirty &&
+                (!inode || !cachedBlock->owner || cachedBlock->owner == inode)) {
+                cachedBlock->refCount++;
+                dirtyBlocks.add_back(cachedBlock);
+            }
         }
     }
 
-    if (e2inode.blocks[EXT2_SINGLY_INDIRECT_INDEX]) {
-        FreeBlock(e2inode.blocks[EXT2_SINGLY_INDIRECT_INDEX]);
-        if (e2inode.blocks[EXT2_DOUBLY_INDIRECT_INDEX]) {
-            uint32_t blockPointers[blocksize / sizeof(uint32_t)];
+    HeapSort(dirtyBlocks.Data(), dirtyBlocks.size(),
+             [](CachedBlock* l, CachedBlock* r) -> bool { return l->block < r->block; });
 
-            if (int e = ReadBlockCached(e2inode.blocks[EXT2_DOUBLY_INDIRECT_INDEX], blockPointers)) {
-                (void)e;
+    uint32_t batchBlocks = EXT2_FLUSH_BATCH_SIZE / blocksize;
+    uint8_t* buffer = (uint8_t*)kmalloc(batchBlocks * blocksize);
+
+    size_t i = 0;
+    while (i < dirtyBlocks.size()) {
+        uint32_t first = dirtyBlocks[i]->block;
+
+        uint32_t run = 1;
+        while (i + run < dirtyBlocks.size() && run < batchBlocks && dirtyBlocks[i + run]->block == first + run) {
+            run++;
+        }
+
+        // Snapshot the blocks, anything written after this will mark them dirty again
+        for (uint32_t j = 0; j < run; j++) {
+            CachedBlock* cachedBlock = dirtyBlocks[i + j];
+            BlockCacheBucket& bucket = GetBlockCacheBucket(cachedBlock->block);
+
+            ScopedSpinLock lockBucket(bucket.lock);
+            memcpy(buffer + static_cast<size_t>(j) * blocksize, cachedBlock->data, blocksize);
+            if (cachedBlock->dirty) {
+                cachedBlock->dirty = false;
+                __atomic_sub_fetch(&m_dirtyBlocks, 1, __ATOMIC_RELAXED);
+            }
+        }
+
+        ssize_t size = static_cast<ssize_t>(run) * blocksize;
+        if (ssize_t e = m_device->Write(BlockToLocation(first), size, buffer); e != size) {
+            Log::Error("[Ext2] Disk error (%d) writing %u blocks from %u (blocksize: %d)", e, run, first, blocksize);
+            error = DiskWriteError;
+
+            // Keep the blocks dirty so they get written back next time
+            for (uint32_t j = 0; j < run; j++) {
+                CachedBlock* cachedBlock = dirtyBlocks[i + j];
+                BlockCacheBucket& bucket = GetBlockCacheBucket(cachedBlock->block);
+
+                ScopedSpinLock lockBucket(bucket.lock);
+                if (cachedBlock->valid) {
+                    MarkBlockDirty(cachedBlock, cachedBlock->owner);
+                }
+            }
+        }
+
+        i += run;
+    }
+
+    kfree(buffer);
+
+    for (CachedBlock* cachedBlock : dirtyBlocks) {
+        ReleaseCachedBlock(cachedBlock);
+    }
+
+    m_flushing = false;
+    m_flushLock.Signal();
+#endif
+}
+
+static ALWAYS_INLINE uint64_t LoadBitmapWord(const uint8_t* bitmap, uint32_t word) {
+    uint64_t value;
+    memcpy(&value, bitmap + word * sizeof(uint64_t), sizeof(uint64_t));
+    return value;
+}
+
+// Find the first clear bit in [start, end), returns end if there is none
+static uint32_t FindClearBit(const uint8_t* bitmap, uint32_t start, uint32_t end) {
+    uint32_t bit = start;
+    while (bit < end) {
+        // Treat the bits before start as set
+        uint64_t word = LoadBitmapWord(bitmap, bit / 64) | ((1ULL << (bit % 64)) - 1);
+        if (~word) {
+            uint32_t found = (bit & ~63U) + __builtin_ctzll(~word);
+            return found < end ? found : end;
+        }
+
+        bit = (bit & ~63U) + 64;
+    }
+
+    return end;
+}
+
+// Find the first set bit in [start, end), returns end if there is none
+static uint32_t FindSetBit(const uint8_t* bitmap, uint32_t start, uint32_t end) {
+    uint32_t bit = start;
+    while (bit < end) {
+        // Treat the bits before start as clear
+        uint64_t word = LoadBitmapWord(bitmap, bit / 64) & ~((1ULL << (bit % 64)) - 1);
+        if (word) {
+            uint32_t found = (bit & ~63U) + __builtin_ctzll(word);
+            return found < end ? found : end;
+        }
+
+        bit = (bit & ~63U) + 64;
+    }
+
+    return end;
+}
+
+// Find the first run of at least want clear bits in [start, end).
+// longest is set to the longest shorter run seen.
+static bool FindClearRun(const uint8_t* bitmap, uint32_t start, uint32_t end, uint32_t want, uint32_t& runStart,
+                         uint32_t& longest) {
+    uint32_t bit = start;
+    while ((bit = FindClearBit(bitmap, bit, end)) < end) {
+        uint32_t runEnd = FindSetBit(bitmap, bit, (end - bit > want) ? bit + want : end);
+        if (runEnd - bit >= want) {
+            runStart = bit;
+            return true;
+        }
+
+        if (runEnd - bit > longest) {
+            longest = runEnd - bit;
+        }
+        bit = runEnd;
+    }
+
+    return false;
+}
+
+// Set or clear count bits of a bitmap block starting at bit
+static void ModifyBitmapBits(uint8_t* bytes, uint32_t bit, uint32_t count, bool set) {
+    for (uint32_t i = bit; i < bit + count; i++) {
+        if (set) {
+            bytes[i / 8] |= (1U << (i % 8));
+        } else {
+            bytes[i / 8] &= ~(1U << (i % 8));
+        }
+    }
+}
+
+uint32_t Ext2::Ext2Volume::AllocateZeroedBlock() {
+    uint32_t block = AllocateBlock();
+    if (!block) {
+        return 0;
+    }
+
+    uint8_t zero[blocksize];
+    memset(zero, 0, blocksize);
+    if (WriteBlockCached(block, zero)) {
+        FreeBlock(block);
+        return 0;
+    }
+
+    return block;
+}
+
+uint32_t Ext2::Ext2Volume::AllocateBlock() {
+    uint32_t count = 1;
+    return AllocateBlocks(0, count);
+}
+
+uint32_t Ext2::Ext2Volume::AllocateBlocks(uint32_t goal, uint32_t& count) {
+    ScopedWriteLock<ReadWriteLock> lockAllocator(m_allocatorLock);
+
+    uint32_t goalGroup = 0;
+    uint32_t goalBit = 0;
+    if (goal >= super.firstDataBlock && goal < super.blockCount) {
+        goalGroup = (goal - super.firstDataBlock) / super.blocksPerGroup;
+        goalBit = (goal - super.firstDataBlock) % super.blocksPerGroup;
+    }
+
+    if (count > super.blocksPerGroup) {
+        count = super.blocksPerGroup;
+    }
+
+    // First look for count contiguous free blocks, then settle for whatever is free
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t want = pass ? 1 : count;
+
+        for (unsigned n = 0; n < blockGroupCount; n++) {
+            unsigned i = (goalGroup + n) % blockGroupCount;
+            ext2_blockgrp_desc_t& group = blockGroups[i];
+            GroupAllocInfo& info = groupAllocInfo[i];
+
+            // Skip groups without enough free space without touching their bitmaps
+            if (!group.freeBlockCount || group.freeBlockCount < want || info.largestFreeExtent < want)
+                continue;
+
+            CachedBlock* bitmap = GetCachedBlock(group.blockBitmap);
+            if (!bitmap) {
+                Log::Error("[Ext2] Disk error reading block bitmap (group %d)", i);
                 error = DiskReadError;
                 return 0;
             }
 
-            for (unsigned i = 0; i < (blocksize / sizeof(uint32_t)) && blockPointers[i] != 0; i++) {
-                FreeBlock(blockPointers[i]);
-                if (blockCache.find(blockPointers[i])) {
-                    blockCache.remove(blockPointers[i]);
-                }
+            uint32_t bits = GroupBlockCount(i);
+            uint32_t start = info.firstFreeBlock;
+            if (n == 0 && goalBit > start) {
+                start = goalBit;
             }
 
-            FreeBlock(e2inode.blocks[EXT2_DOUBLY_INDIRECT_INDEX]);
+            uint32_t runStart = 0;
+            uint32_t longest = 0;
+            bool found = FindClearRun(bitmap->data, start, bits, want, runStart, longest);
+            if (!found && start > info.firstFreeBlock) {
+                found = FindClearRun(bitmap->data, info.firstFreeBlock, start, want, runStart, longest);
+            } else if (!found) {
+                // The whole group was searched
+                info.largestFreeExtent = longest;
+            }
 
-            if (e2inode.blocks[EXT2_TRIPLY_INDIRECT_INDEX]) {
-                Log::Error("[Ext2] We do not support triply indirect blocks, will not free them.");
+            if (!found) {
+                ReleaseCachedBlock(bitmap);
+                continue;
             }
+
+            // Take as much of the run as we can
+            uint32_t runEnd = FindSetBit(bitmap->data, runStart, (bits - runStart > count) ? runStart + count : bits);
+            uint32_t runLength = runEnd - runStart;
+
+            uint32_t firstByte = runStart / 8;
+            uint32_t byteCount = (runEnd - 1) / 8 - firstByte + 1;
+            uint8_t bytes[byteCount];
+
+            memcpy(bytes, bitmap->data + firstByte, byteCount);
+            ReleaseCachedBlock(bitmap);
+
+            ModifyBitmapBits(bytes, runStart % 8, runLength, true);
+            if (int e = ModifyCachedBlock(group.blockBitmap, firstByte, bytes, byteCount)) {
+                Log::Error("[Ext2] Disk error (%d) write block bitmap (group %d)", e, i);
+                error = DiskWriteError;
+                return 0;
+            }
+
+            if (runStart == info.firstFreeBlock) {
+                info.firstFreeBlock = runEnd;
+            }
+
+            super.freeBlockCount -= runLength;
+            group.freeBlockCount -= runLength;
+
+            WriteBlockGroupDescriptor(i);
+            WriteSuperblock();
+
+            count = runLength;
+            return GroupFirstBlock(i) + runStart;
         }
     }
 
-    ext2_blockgrp_desc_t& group = blockGroups[inode / super.inodesPerGroup];
+    Log::Error("[Ext2] No space left on filesystem!");
+    return 0;
+}
 
-    uint8_t bitmap[blocksize / sizeof(uint8_t)];
+uint32_t Ext2::Ext2Volume::AllocateNodeBlock(Ext2Node* node, uint32_t index, uint32_t count) {
+    uint32_t goal = 0;
+    if (index > 0) {
+        if (uint32_t previous = GetInodeBlock(index - 1, node->e2inode); previous) {
+            goal = previous + 1;
+        }
+    }
 
-    if (uint8_t * cachedBitmap; bitmapCache.get(group.inodeBitmap, cachedBitmap)) {
-        memcpy(bitmap, cachedBitmap, blocksize);
-    } else {
-        if (int e = ReadBlockCached(group.inodeBitmap, bitmap)) {
-            if (e == -EINTR) {
-                return -EINTR;
-            }
+    if (node->preallocCount) {
+        if (!goal || node->preallocBlock == goal) {
+            node->preallocCount--;
+            return node->preallocBlock++;
+        }
 
-            Log::Error("[Ext2] Disk error (%d) reading inode bitmap (group %d)", e, inode / super.inodesPerGroup);
+        DiscardPreallocation(node); // No longer appending sequentially
+    }
+
+    if (!goal) {
+        goal = GroupFirstBlock(ResolveInodeBlockGroup(node->inode)); // Keep data close to the inode
+    }
+
+    // Only preallocate for regular files
+    if ((node->flags & FS_NODE_TYPE) == FS_NODE_FILE && count < EXT2_PREALLOC_BLOCKS) {
+        count = EXT2_PREALLOC_BLOCKS;
+    }
+
+    uint32_t block = AllocateBlocks(goal, count);
+    if (block && count > 1) {
+        node->preallocBlock = block + 1;
+        node->preallocCount = count - 1;
+    }
+
+    return block;
+}
+
+void Ext2::Ext2Volume::DiscardPreallocation(Ext2Node* node) {
+    while (node->preallocCount) {
+        FreeBlock(node->preallocBlock++);
+        node->preallocCount--;
+    }
+}
+
+int Ext2::Ext2Volume::FreeBlock(uint32_t block) {
+    // Block 0 is used for holes
+    if (!block || block < super.firstDataBlock || block >= super.blockCount)
+        return -1;
+
+    // Make sure any dirty data still cached for the block is never written back
+    InvalidateCachedBlock(block);
+
+    ScopedWriteLock<ReadWriteLock> lockAllocator(m_allocatorLock);
+
+    uint32_t groupIndex = (block - super.firstDataBlock) / super.blocksPerGroup;
+    uint32_t bit = (block - super.firstDataBlock) % super.blocksPerGroup;
+    ext2_blockgrp_desc_t& group = blockGroups[groupIndex];
+    GroupAllocInfo& info = groupAllocInfo[groupIndex];
+
+    CachedBlock* bitmap = GetCachedBlock(group.blockBitmap);
+    if (!bitmap) {
+        Log::Error("[Ext2] Disk error reading block bitmap (group %d)", groupIndex);
+        error = DiskReadError;
+        return -1;
+    }
+
+    uint8_t byte = bitmap->data[bit / 8];
+    ReleaseCachedBlock(bitmap);
+
+    if (!(byte & (1U << (bit % 8)))) {
+        Log::Warning("[Ext2] Block %u is already free", block);
+        return -1;
+    }
+
+    ModifyBitmapBits(&byte, bit % 8, 1, false);
+    if (int e = ModifyCachedBlock(group.blockBitmap, bit / 8, &byte, 1)) {
+        Log::Error("[Ext2] Disk error (%d) write block bitmap (group %d)", e, groupIndex);
+        error = DiskWriteError;
+        return -1;
+    }
+
+    if (bit < info.firstFreeBlock) {
+        info.firstFreeBlock = bit;
+    }
+    info.largestFreeExtent = UINT32_MAX; // Runs may have merged
+
+    super.freeBlockCount++;
+    group.freeBlockCount++;
+
+    WriteBlockGroupDescriptor(groupIndex);
+    WriteSuperblock();
+
+    return 0;
+}
+
+int Ext2::Ext2Volume::FreeBlocks(uint32_t block, uint32_t count) {
+    if (!block || block < super.firstDataBlock || count > super.blockCount || block > super.blockCount - count)
+        return -1;
+
+    for (uint32_t i = 0; i < count; i++) {
+        InvalidateCachedBlock(block + i);
+    }
+
+    ScopedWriteLock<ReadWriteLock> lockAllocator(m_allocatorLock);
+
+    while (count) {
+        uint32_t groupIndex = (block - super.firstDataBlock) / super.blocksPerGroup;
+        uint32_t bit = (block - super.firstDataBlock) % super.blocksPerGroup;
+        uint32_t runLength = MIN(count, super.blocksPerGroup - bit); // Blocks freed in this group
+        ext2_blockgrp_desc_t& group = blockGroups[groupIndex];
+        GroupAllocInfo& info = groupAllocInfo[groupIndex];
+
+        CachedBlock* bitmap = GetCachedBlock(group.blockBitmap);
+        if (!bitmap) {
+            Log::Error("[Ext2] Disk error reading block bitmap (group %d)", groupIndex);
             error = DiskReadError;
             return -1;
         }
+
+        uint32_t firstByte = bit / 8;
+        uint32_t byteCount = (bit + runLength - 1) / 8 - firstByte + 1;
+        uint8_t bytes[byteCount];
+
+        memcpy(bytes, bitmap->data + firstByte, byteCount);
+        ReleaseCachedBlock(bitmap);
+
+        uint32_t freed = 0;
+        for (uint32_t i = bit % 8; i < bit % 8 + runLength; i++) {
+            if (bytes[i / 8] & (1U << (i % 8))) {
+                freed++;
+            }
+        }
+
+        if (freed != runLength) {
+            Log::Warning("[Ext2] %u of blocks %u-%u are already free", runLength - freed, block,
+                         block + runLength - 1);
+        }
+
+        ModifyBitmapBits(bytes, bit % 8, runLength, false);
+        if (int e = ModifyCachedBlock(group.blockBitmap, firstByte, bytes, byteCount)) {
+            Log::Error("[Ext2] Disk error (%d) write block bitmap (group %d)", e, groupIndex);
+            error = DiskWriteError;
+            return -1;
+        }
+
+        if (bit < info.firstFreeBlock) {
+            info.firstFreeBlock = bit;
+        }
+        info.largestFreeExtent = UINT32_MAX;
+
+        super.freeBlockCount += freed;
+        group.freeBlockCount += freed;
+        WriteBlockGroupDescriptor(groupIndex);
+
+        block += runLength;
+        count -= runLength;
     }
 
-    int bmapIndex = (inode % super.inodesPerGroup) / (sizeof(uint8_t) * 8);
-    int bitmask = ~(1 << (inode % 8));
-    bitmap[bmapIndex] &= bitmask;
+    WriteSuperblock();
+    return 0;
+}
+
+uint32_t Ext2::Ext2Volume::AllocateInode() {
+    ScopedWriteLock<ReadWriteLock> lockAllocator(m_allocatorLock);
+
+    // Inodes up to firstInode are reserved
+    uint32_t firstInode = (super.revLevel && superext.firstInode > 11) ? superext.firstInode : 11;
+
+    for (unsigned i = 0; i < blockGroupCount; i++) {
+        ext2_blockgrp_desc_t& group = blockGroups[i];
+        GroupAllocInfo& info = groupAllocInfo[i];
 
-    if (uint8_t * cachedBitmap; bitmapCache.get(group.inodeBitmap, cachedBitmap)) {
-        memcpy(cachedBitmap, bitmap, blocksize);
+        if (!group.freeInodeCount)
+            continue; // No free inodes in this blockgroup
+
+        CachedBlock* bitmap = GetCachedBlock(group.inodeBitmap);
+        if (!bitmap) {
+            Log::Error("[Ext2] Disk error reading inode bitmap (group %d)", i);
+            error = DiskReadError;
+            return 0;
+        }
+
+        // Inode Number = (Group number * inodes per group) + bit + 1 (inodes start at 1)
+        uint32_t bit = FindClearBit(bitmap->data, info.firstFreeInode, super.inodesPerGroup);
+        while (bit < super.inodesPerGroup && i * super.inodesPerGroup + bit + 1 <= firstInode) {
+            bit = FindClearBit(bitmap->data, bit + 1, super.inodesPerGroup);
+        }
+
+        info.firstFreeInode = bit;
+        if (bit >= super.inodesPerGroup) {
+            ReleaseCachedBlock(bitmap);
+            continue;
+        }
+
+        uint8_t byte = bitmap->data[bit / 8];
+        ReleaseCachedBlock(bitmap);
+
+        ModifyBitmapBits(&byte, bit % 8, 1, true);
+        if (int e = ModifyCachedBlock(group.inodeBitmap, bit / 8, &byte, 1)) {
+            Log::Error("[Ext2] Disk error (%d) write inode bitmap (group %d)", e, i);
+            error = DiskWriteError;
+            return 0;
+        }
+
+        info.firstFreeInode = bit + 1;
+
+        super.freeInodeCount--;
+        group.freeInodeCount--;
+
+        WriteBlockGroupDescriptor(i);
+        WriteSuperblock();
+
+        return i * super.inodesPerGroup + bit + 1;
+    }
+
+    return 0;
+}
+
+int Ext2::Ext2Volume::FreeInode(uint32_t inode) {
+    ScopedWriteLock<ReadWriteLock> lockAllocator(m_allocatorLock);
+
+    uint32_t groupIndex = ResolveInodeBlockGroup(inode);
+    uint32_t bit = ResolveInodeBlockGroupIndex(inode);
+    ext2_blockgrp_desc_t& group = blockGroups[groupIndex];
+    GroupAllocInfo& info = groupAllocInfo[groupIndex];
+
+    CachedBlock* bitmap = GetCachedBlock(group.inodeBitmap);
+    if (!bitmap) {
+        Log::Error("[Ext2] Disk error reading inode bitmap (group %d)", groupIndex);
+        error = DiskReadError;
+        return -1;
     }
 
-    if (int e = WriteBlockCached(group.blockBitmap, bitmap)) {
-        Log::Error("[Ext2] Disk error (%d) write block bitmap (group %d)", e, inode / super.inodesPerGroup);
+    uint8_t byte = bitmap->data[bit / 8];
+    ReleaseCachedBlock(bitmap);
+
+    ModifyBitmapBits(&byte, bit % 8, 1, false);
+    if (int e = ModifyCachedBlock(group.inodeBitmap, bit / 8, &byte, 1)) {
+        Log::Error("[Ext2] Disk error (%d) write inode bitmap (group %d)", e, groupIndex);
         error = DiskWriteError;
         return -1;
     }
 
+    if (bit < info.firstFreeInode) {
+        info.firstFreeInode = bit;
+    }
+
     super.freeInodeCount++;
-    blockGroups[inode / super.inodesPerGroup].freeInodeCount++;
+    group.freeInodeCount++;
 
-    WriteBlockGroupDescriptor(inode / super.inodesPerGroup);
+    WriteBlockGroupDescriptor(groupIndex);
     WriteSuperblock();
 
     return 0;
 }
 
-int Ext2::Ext2Volume::ListDir(Ext2Node* node, List<DirectoryEntry>& entries) {
-    if ((node->flags & FS_NODE_TYPE) != FS_NODE_DIRECTORY) {
-        Log::Warning("[Ext2] ListDir: Not a directory (inode %d)", node->inode);
-        error = MiscError;
-        return -ENOTDIR;
+Ext2::Ext2Node* Ext2::Ext2Volume::CreateNode() {
+    uint32_t inode = AllocateInode();
+    if (!inode) {
+        Log::Error("[Ext2] No inodes left on the filesystem!");
+        return nullptr;
     }
 
-    if (node->inode < 1) {
-        Log::Warning("[Ext2] ListDir: Invalid inode: %d", node->inode);
-        error = InvalidInodeError;
-        return -1;
-    }
+    ext2_inode_t ino;
 
-    ext2_inode_t& ino = node->e2inode;
+    memset(&ino, 0, sizeof(ext2_inode_t));
 
-    uint8_t buffer[blocksize];
-    uint32_t currentBlockIndex = 0;
-    uint32_t blockOffset = 0;
+    uint32_t count = 1;
+    uint32_t block = AllocateBlocks(GroupFirstBlock(ResolveInodeBlockGroup(inode)), count); // Give it one block
+    if (extents) {
+        InitializeExtentTree(ino, block);
+    } else {
+        ino.blocks[0] = block;
+    }
+    ino.uid = 0;
+    ino.mode = 0644;
+    ino.accessTime = ino.createTime = ino.deleteTime = ino.modTime = 0;
+    ino.gid = 0;
+    ino.blockCount = blocksize / 512;
+    ino.linkCount = 0;
+    ino.size = ino.sizeHigh = 0;
+    ino.fragAddr = 0;
+    ino.fileACL = 0;
 
-    ext2_directory_entry_t* e2dirent = (ext2_directory_entry_t*)buffer;
+    ScopedSpinLock lockInodes(m_inodesLock);
+    SyncInode(ino, inode);
 
-    if (int e = ReadBlockCached(GetInodeBlock(currentBlockIndex, ino), buffer)) {
-        if (e == -EINTR) {
-            return -EINTR;
-        }
+    Ext2Node* node = new Ext2Node(this, ino, inode);
 
-        Log::Warning("[Ext2] ListDir: Error reading block %d", ino.blocks[currentBlockIndex]);
-        error = DiskReadError;
+    if (debugLevelExt2 >= DebugLevelVerbose) {
+        Log::Info("[Ext2] Created inode %d", node->inode);
+    }
+
+    return node;
+}
+
+int Ext2::Ext2Volume::EraseInode(ext2_inode_t& e2inode, uint32_t inode) {
+    if (inode > super.inodeCount)
         return -1;
+
+    if (e2inode.linkCount > 0) {
+        Log::Warning("[Ext2] EraseInode: inode %d contains %d links! Will not erase.", inode, e2inode.linkCount);
+        return -2;
     }
 
-    for (;;) {
-        if (e2dirent->recordLength == 0)
-            break;
+    if (IsExtentMapped(e2inode)) {
+        FreeExtentTree(e2inode);
+        return FreeInode(inode);
+    }
 
-        if (e2dirent->inode > 0) { // 0 indicates unused
-            DirectoryEntry dirent;
-            dirent.flags = e2dirent->fileType;
-            strncpy(dirent.name, e2dirent->name, e2dirent->nameLength);
-            dirent.name[e2dirent->nameLength] = 0;
-            dirent.inode = e2dirent->inode;
+    for (unsigned i = 0; i < e2inode.blockCount / (blocksize / 512); i++) {
+        uint32_t block = GetInodeBlock(i, e2inode);
+        FreeBlock(block);
+    }
 
-            entries.add_back(dirent);
-        }
+    if (e2inode.blocks[EXT2_SINGLY_INDIRECT_INDEX]) {
+        FreeBlock(e2inode.blocks[EXT2_SINGLY_INDIRECT_INDEX]);
+        if (e2inode.blocks[EXT2_DOUBLY_INDIRECT_INDEX]) {
+            uint32_t blockPointers[blocksize / sizeof(uint32_t)];
 
-        blockOffset += e2dirent->recordLength;
+            if (int e = ReadBlockCached(e2inode.blocks[EXT2_DOUBLY_INDIRECT_INDEX], blockPointers)) {
+                (void)e;
+                error = DiskReadError;
+                return 0;
+            }
 
-        if (blockOffset >= blocksize) {
-            currentBlockIndex++;
+            for (unsigned i = 0; i < (blocksize / sizeof(uint32_t)) && blockPointers[i] != 0; i++) {
+                FreeBlock(blockPointers[i]);
+            }
 
-            if (currentBlockIndex > ino.blockCount / (blocksize / 512)) {
-                // End of dir
-                break;
+            FreeBlock(e2inode.blocks[EXT2_DOUBLY_INDIRECT_INDEX]);
+
+            if (e2inode.blocks[EXT2_TRIPLY_INDIRECT_INDEX]) {
+                Log::Error("[Ext2] We do not support triply indirect blocks, will not free them.");
             }
+        }
+    }
 
-            blockOffset = 0;
-            if (int e = ReadBlockCached(GetInodeBlock(currentBlockIndex, ino), buffer)) {
-                if (e == -EINTR) {
-                    return -EINTR;
-                }
+    return FreeInode(inode);
+}
 
-                error = DiskReadError;
-                return -1;
+bool Ext2::Ext2Volume::SearchDirectoryBlock(const uint8_t* buffer, const char* name, size_t length, uint32_t& offset,
+                                            uint32_t& previousOffset) {
+    offset = previousOffset = 0;
+    while (offset < blocksize) {
+        const ext2_directory_entry_t* e2dirent = reinterpret_cast<const ext2_directory_entry_t*>(buffer + offset);
+        if (!IsValidDirectoryEntry(buffer, offset)) {
+            IF_DEBUG(debugLevelExt2 >= DebugLevelNormal, {
+                Log::Warning("[Ext2] Invalid directory entry (record length: %d, name length: %d)",
+                             e2dirent->recordLength, e2dirent->nameLength);
+            });
+            return false;
+        }
+
+        if (e2dirent->inode && e2dirent->nameLength == length && !strncmp(e2dirent->name, name, length)) {
+            return true;
+        }
+
+        previousOffset = offset;
+        offset += e2dirent->recordLength;
+    }
+
+    return false;
+}
+
+bool Ext2::Ext2Volume::InsertIntoDirectoryBlock(uint8_t* buffer, const char* name, size_t length, uint32_t inode,
+                                                uint8_t fileType) {
+    uint32_t needed = DirectoryRecordLength(length);
+
+    uint32_t offset = 0;
+    while (offset < blocksize && IsValidDirectoryEntry(buffer, offset)) {
+        ext2_directory_entry_t* e2dirent = reinterpret_cast<ext2_directory_entry_t*>(buffer + offset);
+
+        uint32_t used = e2dirent->inode ? DirectoryRecordLength(e2dirent->nameLength) : 0;
+        if (e2dirent->recordLength - used >= needed) {
+            if (used) {
+                // Split the free space off the end of the entry
+                ext2_directory_entry_t* newEntry = reinterpret_cast<ext2_directory_entry_t*>(buffer + offset + used);
+                newEntry->recordLength = e2dirent->recordLength - used;
+                e2dirent->recordLength = used;
+                e2dirent = newEntry;
             }
+
+            e2dirent->inode = inode;
+            e2dirent->nameLength = length;
+            e2dirent->fileType = fileType;
+            memcpy(e2dirent->name, name, length);
+            return true;
         }
 
-        e2dirent = (ext2_directory_entry_t*)(buffer + blockOffset);
+        offset += e2dirent->recordLength;
     }
 
-    return 0;
+    return false;
 }
 
-int Ext2::Ext2Volume::WriteDir(Ext2Node* node, List<DirectoryEntry>& entries) {
-    if ((node->flags & FS_NODE_TYPE) != FS_NODE_DIRECTORY) {
-        return -ENOTDIR;
+int Ext2::Ext2Volume::InitializeDirectory(Ext2Node* dir, uint32_t parent) {
+    uint32_t index, block;
+    if (int e = AppendDirectoryBlock(dir, index, block)) {
+        return e;
     }
 
-    if (node->inode < 1) {
-        Log::Warning("[Ext2] WriteDir: Invalid inode: %d", node->inode);
-        return -1;
+    uint8_t buffer[blocksize];
+    memset(buffer, 0, blocksize);
+
+    ext2_directory_entry_t* current = reinterpret_cast<ext2_directory_entry_t*>(buffer);
+    current->inode = dir->inode;
+    current->recordLength = DirectoryRecordLength(1);
+    current->nameLength = 1;
+    current->fileType = EXT2_FT_DIR;
+    current->name[0] = '.';
+
+    ext2_directory_entry_t* parentEnt = reinterpret_cast<ext2_directory_entry_t*>(buffer + current->recordLength);
+    parentEnt->inode = parent;
+    parentEnt->recordLength = blocksize - current->recordLength;
+    parentEnt->nameLength = 2;
+    parentEnt->fileType = EXT2_FT_DIR;
+    parentEnt->name[0] = parentEnt->name[1] = '.';
+
+    return WriteBlockCached(block, buffer);
+}
+
+int Ext2::Ext2Volume::AppendDirectoryBlock(Ext2Node* dir, uint32_t& index, uint32_t& block) {
+    index = DirectoryBlockCount(dir);
+
+    // New inodes are given a block before their size is set
+    if (IsExtentMapped(dir->e2inode)) {
+        block = GetInodeBlock(index, dir->e2inode);
+    } else {
+        block = (index < EXT2_DIRECT_BLOCK_COUNT) ? dir->e2inode.blocks[index] : 0;
     }
 
-    ext2_inode_t& ino = node->e2inode;
+    if (!block) {
+        block = AllocateNodeBlock(dir, index, 1);
+        if (!block) {
+            return -ENOSPC;
+        }
 
-    uint8_t buffer[blocksize];
-    uint32_t currentBlockIndex = 0;
-    uint32_t blockOffset = 0;
-    uint32_t totalOffset = 0;
+        if (IsExtentMapped(dir->e2inode)) {
+            if (int e = ExtentMapBlock(dir->e2inode, index, block)) {
+                FreeBlock(block);
+                return e;
+            }
+        } else {
+            SetInodeBlock(index, dir->e2inode, block);
+        }
+        dir->e2inode.blockCount += blocksize / 512;
+    }
 
-    ext2_directory_entry_t* e2dirent = (ext2_directory_entry_t*)kmalloc(sizeof(ext2_directory_entry_t) + NAME_MAX);
+    dir->e2inode.size += blocksize;
+    dir->size = dir->e2inode.size;
+    SyncNode(dir);
 
-    unsigned lastIndex = entries.get_length() - 1;
-    for (unsigned i = 0; i < entries.get_length(); i++) {
-        DirectoryEntry ent = entries[i];
+    return 0;
+}
 
-        if (debugLevelExt2 >= DebugLevelVerbose) {
-            Log::Info("[Ext2] Writing entry: %s", ent.name);
+int Ext2::Ext2Volume::FindDirectoryEntry(Ext2Node* dir, const char* name, uint32_t& index, uint8_t* buffer,
+                                         uint32_t& offset, uint32_t& previousOffset) {
+    if (IsIndexed(dir)) {
+        int e = DxFindEntry(dir, name, index, buffer, offset, previousOffset);
+        if (e != -EINVAL) {
+            return e;
         }
+        // The index is corrupt, the leaves can still be searched as a linear directory
+    }
 
-        e2dirent->fileType = ent.flags;
-        e2dirent->inode = ent.inode;
-        strncpy(e2dirent->name, ent.name, strlen(ent.name));
-        e2dirent->nameLength = strlen(ent.name);
+    size_t length = strlen(name);
+    uint32_t blockCount = DirectoryBlockCount(dir);
+    for (index = 0; index < blockCount; index++) {
+        if (int e = ReadBlockCached(GetInodeBlock(index, dir->e2inode), buffer)) {
+            Log::Warning("[Ext2] FindDirectoryEntry: Failed to read directory block %d (inode %d)", index,
+                         dir->inode);
+            return (e == -EINTR) ? -EINTR : -EIO;
+        }
 
-        if (i == lastIndex) {
-            e2dirent->recordLength = blocksize - blockOffset;
-        } else {
-            if (strlen(entries[i + 1].name) + sizeof(ext2_directory_entry_t) + blockOffset > blocksize) {
-                e2dirent->recordLength = blocksize - blockOffset; // Directory entries cannot span multiple blocks
-            } else {
-                e2dirent->recordLength = sizeof(ext2_directory_entry_t) + e2dirent->nameLength;
-                if (e2dirent->recordLength && e2dirent->recordLength % 4) {
-                    memset(((uint8_t*)e2dirent) + e2dirent->recordLength, 0,
-                           4 - (e2dirent->recordLength % 4));                   // Pad with zeros
-                    e2dirent->recordLength += 4 - (e2dirent->recordLength % 4); // Round up to nearest multiple of 4
-                }
-            }
+        if (SearchDirectoryBlock(buffer, name, length, offset, previousOffset)) {
+            return 0;
         }
+    }
 
-        memcpy((buffer + blockOffset), e2dirent, sizeof(ext2_directory_entry_t) + e2dirent->nameLength);
-        blockOffset += e2dirent->recordLength;
-        totalOffset += e2dirent->recordLength;
+    return -ENOENT;
+}
+
+int Ext2::Ext2Volume::AddDirectoryEntry(Ext2Node* dir, const char* name, uint32_t inode, uint8_t fileType) {
+    size_t length = strlen(name);
+    if (length > NAME_MAX) {
+        return -ENAMETOOLONG;
+    }
 
-        if (blockOffset >= blocksize) {
-            if (WriteBlockCached(GetInodeBlock(currentBlockIndex, ino), buffer)) {
-                Log::Error("[Ext2] WriteDir: Failed to write directory block");
-                error = DiskWriteError;
-                return -1;
+    if (dir->e2inode.flags & EXT2_INDEX_FL) {
+        if (dirIndex) {
+            int e = DxAddEntry(dir, name, inode, fileType);
+            if (e != -EINVAL) {
+                return e;
             }
+        }
 
-            currentBlockIndex++;
+        // Modifying the leaves without maintaining the index would corrupt it
+        DropDirectoryIndex(dir);
+    }
 
-            if (currentBlockIndex > ino.blockCount / (blocksize / 512)) {
-                // Allocate a new block
-                SetInodeBlock(currentBlockIndex, node->e2inode, AllocateBlock());
-                node->e2inode.blockCount += blocksize / 512;
-                WriteSuperblock();
-            }
+    uint8_t buffer[blocksize];
+    uint32_t blockCount = DirectoryBlockCount(dir);
+    for (uint32_t index = 0; index < blockCount; index++) {
+        uint32_t block = GetInodeBlock(index, dir->e2inode);
+        if (int e = ReadBlockCached(block, buffer)) {
+            return (e == -EINTR) ? -EINTR : -EIO;
+        }
 
-            blockOffset = 0;
+        if (InsertIntoDirectoryBlock(buffer, name, length, inode, fileType)) {
+            return WriteBlockCached(block, buffer);
         }
+    }
 
-        node->e2inode.size = totalOffset;
-        node->size = node->e2inode.size;
+    if (dirIndex && blockCount == 1) {
+        // First block is full, index the directory before it grows any further
+        int e = MakeIndexedDirectory(dir);
+        if (!e) {
+            return DxAddEntry(dir, name, inode, fileType);
+        } else if (e != -EINVAL) {
+            return e;
+        }
     }
 
-    kfree(e2dirent);
+    uint32_t index, block;
+    if (int e = AppendDirectoryBlock(dir, index, block)) {
+        return e;
+    }
 
-    SyncNode(node);
+    memset(buffer, 0, blocksize);
+    ext2_directory_entry_t* e2dirent = reinterpret_cast<ext2_directory_entry_t*>(buffer);
+    e2dirent->recordLength = blocksize;
 
-    return 0;
+    InsertIntoDirectoryBlock(buffer, name, length, inode, fileType);
+    return WriteBlockCached(block, buffer);
 }
 
-int Ext2::Ext2Volume::InsertDir(Ext2Node* node, List<DirectoryEntry>& newEntries) {
-    List<DirectoryEntry> entries;
-    ListDir(node, entries);
-
-    for (DirectoryEntry& newEnt : newEntries) {
-        for (DirectoryEntry& ent : entries) {
-            if (strcmp(ent.name, newEnt.name) == 0) {
-                Log::Warning("[Ext2] InsertDir: Entry %s already exists!", newEnt.name);
-                return -EEXIST;
-            }
-        }
-        entries.add_back(newEnt);
+int Ext2::Ext2Volume::RemoveDirectoryEntry(Ext2Node* dir, uint32_t index, uint8_t* buffer, uint32_t offset,
+                                           uint32_t previousOffset) {
+    ext2_directory_entry_t* e2dirent = reinterpret_cast<ext2_directory_entry_t*>(buffer + offset);
+    if (offset != previousOffset) {
+        // Merge the record into the previous entry
+        reinterpret_cast<ext2_directory_entry_t*>(buffer + previousOffset)->recordLength += e2dirent->recordLength;
+    } else {
+        e2dirent->inode = 0; // First entry of the block
     }
 
-    return WriteDir(node, entries);
+    return WriteBlockCached(GetInodeBlock(index, dir->e2inode), buffer);
 }
 
-int Ext2::Ext2Volume::InsertDir(Ext2Node* node, DirectoryEntry& ent) {
-    List<DirectoryEntry> ents;
-    ents.add_back(ent);
-
-    return InsertDir(node, ents);
+static uint8_t DirentFlagsFromFileType(uint8_t fileType) {
+    switch (fileType) {
+    case EXT2_FT_REG_FILE:
+        return DT_REG;
+    case EXT2_FT_DIR:
+        return DT_DIR;
+    case EXT2_FT_CHRDEV:
+        return DT_CHR;
+    case EXT2_FT_BLKDEV:
+        return DT_BLK;
+    case EXT2_FT_FIFO:
+        return DT_FIFO;
+    case EXT2_FT_SOCK:
+        return DT_SOCK;
+    case EXT2_FT_SYMLINK:
+        return DT_LNK;
+    default:
+        return DT_UNKNOWN;
+    }
 }
 
 int Ext2::Ext2Volume::ReadDir(Ext2Node* node, DirectoryEntry* dirent, uint32_t index) {
@@ -1011,10 +1820,14 @@ int Ext2::Ext2Volume::ReadDir(Ext2Node* node, DirectoryEntry* dirent, uint32_t i
     ext2_inode_t& ino = node->e2inode;
 
     uint8_t buffer[blocksize];
+    uint32_t blockCount = DirectoryBlockCount(node);
     uint32_t currentBlockIndex = 0;
     uint32_t blockOffset = 0;
+    bool firstInBlock = true; // No entries of the current block have been skipped
 
-    ext2_directory_entry_t* e2dirent = (ext2_directory_entry_t*)buffer;
+    if (!blockCount) {
+        return 0;
+    }
 
     if (ReadBlockCached(GetInodeBlock(currentBlockIndex, ino), buffer)) {
         Log::Warning("[Ext2] Failed to read block %d", GetInodeBlock(currentBlockIndex, ino));
@@ -1022,40 +1835,46 @@ int Ext2::Ext2Volume::ReadDir(Ext2Node* node, DirectoryEntry* dirent, uint32_t i
         return -EIO;
     }
 
-    for (unsigned i = 0; i < index; i++) {
-        if (e2dirent->recordLength == 0)
-            return 0;
+    ext2_directory_entry_t* e2dirent;
+    for (;;) {
+        if (blockOffset >= blocksize) {
+            if (++currentBlockIndex >= blockCount) {
+                return 0; // End of dir
+            }
 
-        blockOffset += e2dirent->recordLength;
+            blockOffset = 0;
+            firstInBlock = true;
+            if (ReadBlockCached(GetInodeBlock(currentBlockIndex, ino), buffer)) {
+                Log::Warning("[Ext2] Failed to read block");
+                return -EIO;
+            }
+        }
 
-        if (e2dirent->recordLength < 8) {
+        e2dirent = (ext2_directory_entry_t*)(buffer + blockOffset);
+        if (!IsValidDirectoryEntry(buffer, blockOffset)) {
             IF_DEBUG(debugLevelExt2 >= DebugLevelNormal, {
                 Log::Warning("[Ext2] Error (inode: %d) record length of directory entry is invalid (value: %d)!",
                              node->inode, e2dirent->recordLength);
             });
-            break;
-        }
-
-        if (e2dirent->inode == 0) {
-            index--; // Ignore the entry
+            return 0;
         }
 
-        if (blockOffset >= blocksize) {
-            currentBlockIndex++;
-
-            if (currentBlockIndex >= ino.blockCount / (blocksize / 512)) {
-                // End of dir
-                return 0;
+        // Unused entries (including htree index nodes) have an inode of 0
+        if (e2dirent->inode) {
+            if (!index) {
+                break;
             }
 
-            blockOffset = 0;
-            if (ReadBlockCached(GetInodeBlock(currentBlockIndex, ino), buffer)) {
-                Log::Warning("[Ext2] Failed to read block");
-                return -EIO;
-            }
+            index--;
+            firstInBlock = false;
         }
 
-        e2dirent = (ext2_directory_entry_t*)(buffer + blockOffset);
+        blockOffset += e2dirent->recordLength;
+    }
+
+    if (firstInBlock) {
+        // Starting on a new directory block, the caller is likely to look up the inodes next
+        PrefetchInodeTables(buffer);
     }
 
     // Insert the retrived directory entry into the cache 
@@ -1063,117 +1882,131 @@ int Ext2::Ext2Volume::ReadDir(Ext2Node* node, DirectoryEntry* dirent, uint32_t i
 
     strncpy(dirent->name, e2dirent->name, e2dirent->nameLength);
     dirent->name[e2dirent->nameLength] = 0; // Null terminate
-    dirent->flags = e2dirent->fileType;
-
-    switch (e2dirent->fileType) {
-    case EXT2_FT_REG_FILE:
-        dirent->flags = DT_REG;
-        break;
-    case EXT2_FT_DIR:
-        dirent->flags = DT_DIR;
-        break;
-    case EXT2_FT_CHRDEV:
-        dirent->flags = DT_CHR;
-        break;
-    case EXT2_FT_BLKDEV:
-        dirent->flags = DT_BLK;
-        break;
-    case EXT2_FT_FIFO:
-        dirent->flags = DT_FIFO;
-        break;
-    case EXT2_FT_SOCK:
-        dirent->flags = DT_SOCK;
-        break;
-    case EXT2_FT_SYMLINK:
-        dirent->flags = DT_LNK;
-        break;
-    }
+    dirent->flags = DirentFlagsFromFileType(e2dirent->fileType);
 
     return 1;
 }
 
-FsNode* Ext2::Ext2Volume::FindDir(Ext2Node* node, const char* name) {
+int Ext2::Ext2Volume::ReadDirBatch(Ext2Node* node, off_t& cursor, DirectoryFiller filler, void* context) {
     if ((node->flags & FS_NODE_TYPE) != FS_NODE_DIRECTORY) {
-        return nullptr;
+        return -ENOTDIR;
+    } else if (cursor < 0) {
+        return -EINVAL;
     }
 
     if (node->inode < 1) {
-        Log::Warning("[Ext2] ReadDir: Invalid inode: %d", node->inode);
-        return nullptr;
+        Log::Warning("[Ext2] ReadDirBatch: Invalid inode: %d", node->inode);
+        return -EIO;
     }
 
-    uint32_t inode;
-    // Check if we have the inode number cached
-    if(!node->directoryCache.get(name, inode)) {
-        ext2_inode_t& ino = node->e2inode;
-
-        uint8_t buffer[blocksize];
-        uint32_t currentBlockIndex = 0;
-        uint32_t blockOffset = 0;
-        uint32_t totalOffset = 0;
-
-        ext2_directory_entry_t* e2dirent = (ext2_directory_entry_t*)buffer;
+    ext2_inode_t& ino = node->e2inode;
 
+    // The cursor is the byte offset of the next entry within the directory
+    uint8_t buffer[blocksize];
+    uint32_t blockCount = DirectoryBlockCount(node);
+    uint32_t currentBlockIndex = cursor / blocksize;
+    uint32_t start = cursor % blocksize;
+
+    // The caller is likely to look up the inodes next,
+    // the inode table blocks of the whole batch are read ahead together once it is done
+    uint32_t tableBlocks[EXT2_BATCH_PREFETCH_BLOCKS];
+    unsigned tableBlockCount = 0;
+
+    DirectoryEntry dirent;
+    int count = 0;
+    bool done = false;
+    for (; !done && currentBlockIndex < blockCount; currentBlockIndex++, start = 0) {
         if (ReadBlockCached(GetInodeBlock(currentBlockIndex, ino), buffer)) {
-            Log::Info("[Ext2] Failed to read block %d", GetInodeBlock(currentBlockIndex, ino));
-            return nullptr;
+            Log::Warning("[Ext2] Failed to read block %d", GetInodeBlock(currentBlockIndex, ino));
+            error = DiskReadError;
+            if (!count) {
+                return -EIO;
+            }
+            break;
         }
 
-        while (currentBlockIndex < ino.blockCount / (blocksize / 512)) {
-            if (e2dirent->recordLength < 8) {
+        // Walk the block from the start as the entry at the cursor
+        // may have been deleted and merged into the record before it
+        uint32_t blockOffset = 0;
+        while (blockOffset < blocksize) {
+            ext2_directory_entry_t* e2dirent = (ext2_directory_entry_t*)(buffer + blockOffset);
+            if (!IsValidDirectoryEntry(buffer, blockOffset)) {
                 IF_DEBUG(debugLevelExt2 >= DebugLevelNormal, {
                     Log::Warning("[Ext2] Error (inode: %d) record length of directory entry is invalid (value: %d)!",
-                                node->inode, e2dirent->recordLength);
+                                 node->inode, e2dirent->recordLength);
                 });
+                cursor = (off_t)blockCount * blocksize;
+                done = true;
                 break;
             }
 
-            if (e2dirent->inode > 0) {
-                IF_DEBUG(debugLevelExt2 >= DebugLevelVerbose, {
-                    char buf[e2dirent->nameLength + 1];
-                    strncpy(buf, e2dirent->name, e2dirent->nameLength);
-                    buf[e2dirent->nameLength] = 0;
-                    Log::Info("Checking name '%s' (name len %d), inode %d, len %d (parent inode: %d)", buf,
-                            e2dirent->nameLength, e2dirent->inode, e2dirent->recordLength, node->inode);
-                });
-
-                if (strlen(name) == e2dirent->nameLength && strncmp(name, e2dirent->name, e2dirent->nameLength) == 0) {
-                    Log::Debug(debugLevelExt2, DebugLevelVerbose, "Found '%s'!", name);
-                    break;
-                }
+            uint32_t next = blockOffset + e2dirent->recordLength;
+            if (blockOffset < start || !e2dirent->inode) {
+                blockOffset = next;
+                continue;
             }
 
-            blockOffset += e2dirent->recordLength;
-            totalOffset += e2dirent->recordLength;
+            node->directoryCache.insert(e2dirent->name, e2dirent->inode);
 
-            if (totalOffset > ino.size)
-                return nullptr;
-
-            if (blockOffset >= blocksize) {
-                currentBlockIndex++;
+            strncpy(dirent.name, e2dirent->name, e2dirent->nameLength);
+            dirent.name[e2dirent->nameLength] = 0; // Null terminate
+            dirent.inode = e2dirent->inode;
+            dirent.flags = DirentFlagsFromFileType(e2dirent->fileType);
 
-                if (currentBlockIndex >= ino.blockCount / (blocksize / 512)) {
-                    // End of dir
-                    return nullptr;
-                }
+            off_t nextCursor = (off_t)currentBlockIndex * blocksize + next;
+            if (!filler(context, dirent, nextCursor)) {
+                done = true;
+                break;
+            }
 
-                blockOffset = 0;
+            if (e2dirent->inode <= super.inodeCount) {
+                // Entries created together usually share a table block
+                uint32_t tableBlock = LocationToBlock(InodeOffset(e2dirent->inode));
+                if (!tableBlockCount || tableBlocks[tableBlockCount - 1] != tableBlock) {
+                    if (tableBlockCount == EXT2_BATCH_PREFETCH_BLOCKS) {
+                        PrefetchBlockList(tableBlocks, tableBlockCount);
+                        tableBlockCount = 0;
+                    }
 
-                if (ReadBlockCached(GetInodeBlock(currentBlockIndex, ino), buffer)) {
-                    Log::Error("[Ext2] Failed to read block");
-                    return nullptr;
+                    tableBlocks[tableBlockCount++] = tableBlock;
                 }
             }
 
-            e2dirent = (ext2_directory_entry_t*)(buffer + blockOffset);
+            cursor = nextCursor;
+            count++;
+            blockOffset = next;
         }
 
-        if (strlen(name) != e2dirent->nameLength || strncmp(e2dirent->name, name, e2dirent->nameLength) != 0) {
-            // Not found
-            return nullptr;
+        if (!done) {
+            cursor = (off_t)(currentBlockIndex + 1) * blocksize;
+        }
+    }
+
+    PrefetchBlockList(tableBlocks, tableBlockCount);
+    return count;
+}
+
+FsNode* Ext2::Ext2Volume::FindDir(Ext2Node* node, const char* name) {
+    if ((node->flags & FS_NODE_TYPE) != FS_NODE_DIRECTORY) {
+        return nullptr;
+    }
+
+    if (node->inode < 1) {
+        Log::Warning("[Ext2] ReadDir: Invalid inode: %d", node->inode);
+        return nullptr;
+    }
+
+    uint32_t inode;
+    // Check if we have the inode number cached
+    if(!node->directoryCache.get(name, inode)) {
+        uint8_t buffer[blocksize];
+        uint32_t blockIndex, offset, previousOffset;
+        if (FindDirectoryEntry(node, name, blockIndex, buffer, offset, previousOffset)) {
+            return nullptr; // Not found
         }
 
-        if (!e2dirent->inode || e2dirent->inode > super.inodeCount) {
+        ext2_directory_entry_t* e2dirent = (ext2_directory_entry_t*)(buffer + offset);
+        if (e2dirent->inode > super.inodeCount) {
             Log::Error("[Ext2] Directory Entry %s contains invalid inode %d", name, e2dirent->inode);
             return nullptr;
         }
@@ -1225,21 +2058,34 @@ ssize_t Ext2::Ext2Volume::Read(Ext2Node* node, size_t offset, size_t size, uint8
 
     ssize_t ret = size;
     Vector<uint32_t> blocks = GetInodeBlocks(blockIndex, blockLimit - blockIndex + 1, node->e2inode);
-    assert(blocks.size() == (blockLimit - blockIndex + 1));
+    if (blocks.size() != (blockLimit - blockIndex + 1)) {
+        return -EIO;
+    }
 
 #ifdef EXT2_ENABLE_TIMER
     long blktv2 = Timer::UsecondsSinceBoot();
     long readtv1 = Timer::UsecondsSinceBoot();
 #endif
 
-    for (uint32_t block : blocks) {
+    // File data is held in the page cache, keep the block cache for metadata and directories
+    auto readBlock = [this, node](uint32_t block, void* buffer) -> int {
+        if (!block) {
+            memset(buffer, 0, blocksize); // Hole
+            return 0;
+        }
+
+        return node->pageCached ? ReadBlock(block, buffer) : ReadBlockCached(block, buffer);
+    };
+
+    for (unsigned i = 0; i < blocks.size(); i++) {
+        uint32_t block = blocks[i];
         if (size <= 0)
             break;
 
         // Check if offset is a full block
         long offsetRemainder = offset & (blocksize - 1);
         if (offsetRemainder) {
-            if (int e = ReadBlockCached(block, blockBuffer); e) {
+            if (int e = readBlock(block, blockBuffer); e) {
                 Log::Info("[Ext2] Error %i reading block %u", e, block);
                 error = DiskReadError;
                 return e;
@@ -1255,8 +2101,26 @@ ssize_t Ext2::Ext2Volume::Read(Ext2Node* node, size_t offset, size_t size, uint8
             size -= readSize;
             buffer += readSize;
             offset += readSize;
+        } else if (size >= blocksize && node->pageCached && block) {
+            // Read physically contiguous blocks with a single request
+            uint32_t count = 1;
+            while (i + count < blocks.size() && (count + 1) * blocksize <= size &&
+                   blocks[i + count] == block + count) {
+                count++;
+            }
+
+            if (int e = ReadBlocks(block, count, buffer); e) {
+                Log::Info("[Ext2] Error %i reading blocks %u-%u", e, block, block + count - 1);
+                error = DiskReadError;
+                break;
+            }
+            size -= count * blocksize;
+            buffer += count * blocksize;
+            offset += count * blocksize;
+
+            i += count - 1;
         } else if (size >= blocksize) {
-            if (int e = ReadBlockCached(block, buffer); e) {
+            if (int e = readBlock(block, buffer); e) {
                 Log::Info("[Ext2] Error %i reading block %u", e, block);
                 error = DiskReadError;
                 break;
@@ -1265,7 +2129,7 @@ ssize_t Ext2::Ext2Volume::Read(Ext2Node* node, size_t offset, size_t size, uint8
             buffer += blocksize;
             offset += blocksize;
         } else {
-            if (int e = ReadBlockCached(block, blockBuffer); e) {
+            if (int e = readBlock(block, blockBuffer); e) {
                 Log::Info("[Ext2] Error %i reading block %u", e, block);
                 error = DiskReadError;
                 break;
@@ -1312,12 +2176,23 @@ ssize_t Ext2::Ext2Volume::Write(Ext2Node* node, size_t offset, size_t size, uint
     uint8_t blockBuffer[blocksize];                                         // block buffer
     bool sync = false;                                                      // Need to sync the inode?
 
-    if (blockLimit >= fileBlockCount) {
+    if (IsExtentMapped(node->e2inode)) {
+        // Extent mapped files may have holes anywhere,
+        // only allocate the blocks being written so we do not map past the end of the file
+        uint32_t lastBlock = size ? LocationToBlock(offset + size - 1) : blockIndex;
+        if (int e = size ? AllocateExtentBlocks(node, blockIndex, lastBlock - blockIndex + 1, sync) : 0) {
+            Log::Warning("[Ext2] Error %d allocating blocks for inode %d", e, node->inode);
+            if (sync) {
+                SyncNode(node);
+            }
+            return e;
+        }
+    } else if (blockLimit >= fileBlockCount) {
         if (debugLevelExt2 >= DebugLevelVerbose) {
             Log::Info("[Ext2] Allocating blocks for inode %d", node->inode);
         }
         for (unsigned i = fileBlockCount; i <= blockLimit; i++) {
-            uint32_t block = AllocateBlock();
+            uint32_t block = AllocateNodeBlock(node, i, blockLimit - i + 1);
             SetInodeBlock(i, node->e2inode, block);
         }
         node->e2inode.blockCount = (blockLimit + 1) * (blocksize / 512);
@@ -1350,17 +2225,17 @@ ssize_t Ext2::Ext2Volume::Write(Ext2Node* node, size_t offset, size_t size, uint
             break;
 
         if (offset % blocksize) {
-            ReadBlockCached(block, blockBuffer);
-
             size_t writeSize = blocksize - (offset % blocksize);
             size_t writeOffset = (offset % blocksize);
 
             if (writeSize > size)
                 writeSize = size;
 
-            memcpy(blockBuffer + writeOffset, buffer, writeSize);
-            if (int e = WriteBlockCached(block, blockBuffer); e) {
-                if (int e = WriteBlockCached(block, blockBuffer); e) { // Try again
+            // Stage in blockBuffer so the user buffer is not touched with the cache lock held
+            memcpy(blockBuffer, buffer, writeSize);
+            if (int e = ModifyCachedBlock(block, writeOffset, blockBuffer, writeSize, node->inode); e) {
+                if (int e = ModifyCachedBlock(block, writeOffset, blockBuffer, writeSize, node->inode);
+                    e) { // Try again
                     Log::Warning("[Ext2] Error %i writing block %u", e, block);
                     error = DiskReadError;
                     break;
@@ -1372,8 +2247,8 @@ ssize_t Ext2::Ext2Volume::Write(Ext2Node* node, size_t offset, size_t size, uint
             offset += writeSize;
         } else if (size >= blocksize) {
             memcpy(blockBuffer, buffer, blocksize);
-            if (int e = WriteBlockCached(block, blockBuffer); e) {
-                if (int e = WriteBlockCached(block, blockBuffer); e) { // Try again
+            if (int e = WriteBlockCached(block, blockBuffer, node->inode); e) {
+                if (int e = WriteBlockCached(block, blockBuffer, node->inode); e) { // Try again
                     Log::Warning("[Ext2] Error %i writing block %u", e, block);
                     error = DiskReadError;
                     break;
@@ -1384,18 +2259,10 @@ ssize_t Ext2::Ext2Volume::Write(Ext2Node* node, size_t offset, size_t size, uint
             buffer += blocksize;
             offset += blocksize;
         } else {
-            if (int e = ReadBlockCached(block, blockBuffer); e) {
-                if (int e = ReadBlockCached(block, blockBuffer); e) { // Try again
-                    Log::Info("[Ext2] Error %i reading block %u", e, block);
-                    error = DiskReadError;
-                    break;
-                }
-            }
-
             memcpy(blockBuffer, buffer, size);
 
-            if (int e = WriteBlockCached(block, blockBuffer); e) {
-                if (int e = WriteBlockCached(block, blockBuffer); e) { // Try again
+            if (int e = ModifyCachedBlock(block, 0, blockBuffer, size, node->inode); e) {
+                if (int e = ModifyCachedBlock(block, 0, blockBuffer, size, node->inode); e) { // Try again
                     Log::Warning("[Ext2] Error %i writing block %u", e, block);
                     error = DiskReadError;
                     break;
@@ -1416,22 +2283,20 @@ ssize_t Ext2::Ext2Volume::Write(Ext2Node* node, size_t offset, size_t size, uint
         ret -= size;
     }
 
+    // Throttle writers which dirty blocks faster than the flusher writes them back
+    if (DirtyBytes() >= EXT2_DIRTY_LIMIT) {
+        Flush();
+    }
+
     return ret;
 }
 
 void Ext2::Ext2Volume::SyncInode(ext2_inode_t& e2inode, uint32_t inode) {
-    uint8_t buf[blocksize];
     uint64_t off = InodeOffset(inode);
 
-    if (int e = fs::Read(m_device, off & (~511U), blocksize, buf); e != blocksize) {
-        Log::Error("[Ext2] Sync: Disk Error (%d) Reading Inode %d", e, inode);
-        error = DiskReadError;
-        return;
-    }
-
-    *(ext2_inode_t*)(buf + (off & (511U))) = e2inode;
-
-    if (int e = fs::Write(m_device, off & (~511U), blocksize, buf); e != blocksize) {
+    // Update the inode table block in the block cache, it gets written back with the other dirty blocks
+    if (int e = ModifyCachedBlock(LocationToBlock(off), off & (blocksize - 1), &e2inode, sizeof(ext2_inode_t));
+        e) {
         Log::Error("[Ext2] Sync: Disk Error (%d) Writing Inode %d", e, inode);
         error = DiskWriteError;
         return;
@@ -1440,10 +2305,108 @@ void Ext2::Ext2Volume::SyncInode(ext2_inode_t& e2inode, uint32_t inode) {
 
 void Ext2::Ext2Volume::SyncNode(Ext2Node* node) {
     ScopedSpinLock lockInodes(m_inodesLock);
-    SyncInode(node->e2inode, node->inode);
+    if (!node->inodeDirty) {
+        node->inodeDirty = true;
+        m_dirtyNodes.add_back(node);
+    }
+}
+
+void Ext2::Ext2Volume::WriteBackNode(Ext2Node* node) {
+    ScopedWriteLock<ReadWriteLock> lockWriteBack(m_inodeWriteBackLock);
+
+    ext2_inode_t e2inode;
+    {
+        ScopedSpinLock lockInodes(m_inodesLock);
+        if (!node->inodeDirty) {
+            return;
+        }
+
+        node->inodeDirty = false;
+        m_dirtyNodes.remove(node);
+
+        e2inode = node->e2inode;
+    }
+
+    SyncInode(e2inode, node->inode);
+}
+
+void Ext2::Ext2Volume::WriteDirtyInodes() {
+    ScopedWriteLock<ReadWriteLock> lockWriteBack(m_inodeWriteBackLock);
+
+    struct DirtyInode {
+        uint32_t inode;
+        ext2_inode_t e2inode;
+    };
+
+    // Copy the dirty inodes so the inode table can be read in without holding m_inodesLock
+    Vector<DirtyInode> dirtyInodes;
+    {
+        ScopedSpinLock lockInodes(m_inodesLock);
+
+        // Sorted by inode number, inodes sharing an inode table block end up next to each other
+        HeapSort(m_dirtyNodes.Data(), m_dirtyNodes.size(),
+                 [](Ext2Node* l, Ext2Node* r) -> bool { return l->inode < r->inode; });
+
+        dirtyInodes.reserve(m_dirtyNodes.size());
+        for (Ext2Node* node : m_dirtyNodes) {
+            node->inodeDirty = false;
+            dirtyInodes.add_back({static_cast<uint32_t>(node->inode), node->e2inode});
+        }
+        m_dirtyNodes.clear();
+    }
+
+    size_t count = dirtyInodes.size();
+    size_t i = 0;
+    while (i < count) {
+        uint32_t block = LocationToBlock(InodeOffset(dirtyInodes[i].inode));
+
+#ifndef EXT2_NO_CACHE
+        CachedBlock* table = GetCachedBlock(block);
+        if (!table) {
+            Log::Error("[Ext2] Disk error reading inode table block %u", block);
+            error = DiskReadError;
+            break;
+        }
+
+        BlockCacheBucket& bucket = GetBlockCacheBucket(block);
+        acquireLock(&bucket.lock);
+
+        // Update every dirty inode in the table block, then mark it dirty once
+        for (; i < count; i++) {
+            uint64_t off = InodeOffset(dirtyInodes[i].inode);
+            if (LocationToBlock(off) != block) {
+                break;
+            }
+
+            *(ext2_inode_t*)(table->data + (off & (blocksize - 1))) = dirtyInodes[i].e2inode;
+        }
+
+        MarkBlockDirty(table, 0);
+        releaseLock(&bucket.lock);
+        ReleaseCachedBlock(table);
+#else
+        SyncInode(dirtyInodes[i].e2inode, dirtyInodes[i].inode);
+        i++;
+#endif
+    }
+
+    if (i < count) {
+        // Keep the remaining inodes dirty, nodes which have since been evicted were written back by CleanNode
+        ScopedSpinLock lockInodes(m_inodesLock);
+        for (; i < count; i++) {
+            if (Ext2Node * node; inodeCache.get(dirtyInodes[i].inode, node) && node && !node->inodeDirty) {
+                node->inodeDirty = true;
+                m_dirtyNodes.add_back(node);
+            }
+        }
+    }
 }
 
 int Ext2::Ext2Volume::Create(Ext2Node* node, DirectoryEntry* ent, uint32_t mode) {
+    if (readOnly) {
+        return -EROFS;
+    }
+
     if ((node->flags & FS_NODE_TYPE) != FS_NODE_DIRECTORY)
         return -ENOTDIR; // Ensure the directory node is actually a directory
 
@@ -1477,7 +2440,7 @@ int Ext2::Ext2Volume::Create(Ext2Node* node, DirectoryEntry* ent, uint32_t mode)
     SyncNode(file);
 
     // Add the new entry in the given directory
-    return InsertDir(node, *ent);
+    return AddDirectoryEntry(node, ent->name, file->inode, EXT2_FT_REG_FILE);
 }
 
 int Ext2::Ext2Volume::CreateDirectory(Ext2Node* node, DirectoryEntry* ent, uint32_t mode) {
@@ -1504,6 +2467,7 @@ int Ext2::Ext2Volume::CreateDirectory(Ext2Node* node, DirectoryEntry* ent, uint3
 
     dir->e2inode.mode = EXT2_S_IFDIR;
     dir->flags = FS_NODE_DIRECTORY;
+    dir->cacheDentries = true;
     dir->e2inode.linkCount = 1;
 
     inodeCache.insert(dir->inode, dir);
@@ -1511,29 +2475,15 @@ int Ext2::Ext2Volume::CreateDirectory(Ext2Node* node, DirectoryEntry* ent, uint3
     ent->inode = dir->inode;
     ent->flags = EXT2_FT_DIR;
 
-    DirectoryEntry currentEnt;
-    strcpy(currentEnt.name, ".");
-    currentEnt.node = dir;
-    currentEnt.inode = dir->inode;
-    currentEnt.flags = EXT2_FT_DIR;
+    // '.' and '..'
     dir->e2inode.linkCount++;
-
-    DirectoryEntry parentEnt;
-    strcpy(parentEnt.name, "..");
-    parentEnt.node = node;
-    parentEnt.inode = node->inode;
-    parentEnt.flags = EXT2_FT_DIR;
     node->e2inode.linkCount++;
 
-    List<DirectoryEntry> entries;
-    entries.add_back(currentEnt);
-    entries.add_back(parentEnt);
-
-    if (int e = InsertDir(dir, entries)) {
+    if (int e = InitializeDirectory(dir, node->inode)) {
         return e;
     }
 
-    if (int e = InsertDir(node, *ent)) {
+    if (int e = AddDirectoryEntry(node, ent->name, dir->inode, EXT2_FT_DIR)) {
         return e;
     }
 
@@ -1561,7 +2511,32 @@ ssize_t Ext2::Ext2Volume::ReadLink(Ext2Node* node, char* pathBuffer, size_t bufS
     }
 }
 
+static uint8_t FileTypeFromMode(uint16_t mode) {
+    switch (mode & EXT2_S_IFMT) {
+    case EXT2_S_IFREG:
+        return EXT2_FT_REG_FILE;
+    case EXT2_S_IFDIR:
+        return EXT2_FT_DIR;
+    case EXT2_S_IFCHR:
+        return EXT2_FT_CHRDEV;
+    case EXT2_S_IFBLK:
+        return EXT2_FT_BLKDEV;
+    case EXT2_S_IFIFO:
+        return EXT2_FT_FIFO;
+    case EXT2_S_IFSOCK:
+        return EXT2_FT_SOCK;
+    case EXT2_S_IFLNK:
+        return EXT2_FT_SYMLINK;
+    default:
+        return EXT2_FT_UNKNOWN;
+    }
+}
+
 int Ext2::Ext2Volume::Link(Ext2Node* node, Ext2Node* file, DirectoryEntry* ent) {
+    if (readOnly) {
+        return -EROFS;
+    }
+
     ent->inode = file->inode;
     if (!ent->inode) {
         Log::Error("[Ext2] Link: Invalid inode %d", ent->inode);
@@ -1572,55 +2547,54 @@ int Ext2::Ext2Volume::Link(Ext2Node* node, Ext2Node* file, DirectoryEntry* ent)
         return -EXDEV; // Different filesystem
     }
 
-    List<DirectoryEntry> entries;
-    if (int e = ListDir(node, entries)) {
-        Log::Error("[Ext2] Link: Error listing directory!", ent->inode);
-        return e;
-    }
-
-    for (DirectoryEntry& dirent : entries) {
-        if (strcmp(dirent.name, ent->name) == 0) {
+    uint8_t buffer[blocksize];
+    uint32_t blockIndex, offset, previousOffset;
+    if (int e = FindDirectoryEntry(node, ent->name, blockIndex, buffer, offset, previousOffset); e != -ENOENT) {
+        if (!e) {
             Log::Error("[Ext2] Link: Directory entry %s already exists!", ent->name);
             return -EEXIST;
         }
+
+        Log::Error("[Ext2] Link: Error searching directory!");
+        return e;
     }
 
-    entries.add_back(*ent);
+    if (int e = AddDirectoryEntry(node, ent->name, file->inode, FileTypeFromMode(file->e2inode.mode))) {
+        return e;
+    }
 
     file->nlink++;
     file->e2inode.linkCount++;
 
     SyncNode(file);
 
-    return WriteDir(node, entries);
+    return 0;
 }
 
 int Ext2::Ext2Volume::Unlink(Ext2Node* node, DirectoryEntry* ent, bool unlinkDirectories) {
-    List<DirectoryEntry> entries;
-    if (int e = ListDir(node, entries)) {
-        Log::Error("[Ext2] Unlink: Error listing directory!", ent->inode);
-        return e;
+    if (readOnly) {
+        return -EROFS;
     }
 
     // Remove from cache if cached
     node->directoryCache.remove(ent->name);
 
-    for (unsigned i = 0; i < entries.get_length(); i++) {
-        if (strcmp(entries[i].name, ent->name) == 0) {
-            ent->inode = entries.remove_at(i).inode;
-            goto found;
+    uint8_t buffer[blocksize];
+    uint32_t blockIndex, offset, previousOffset;
+    if (int e = FindDirectoryEntry(node, ent->name, blockIndex, buffer, offset, previousOffset)) {
+        if (e == -ENOENT) {
+            Log::Error("[Ext2] Unlink: Directory entry %s does not exist!", ent->name);
         }
+        return e;
     }
 
-    Log::Error("[Ext2] Unlink: Directory entry %s does not exist!", ent->name);
-    return -ENOENT;
-
-found:
+    ent->inode = ((ext2_directory_entry_t*)(buffer + offset))->inode;
     if (!ent->inode) {
         Log::Error("[Ext2] Unlink: Invalid inode %d", ent->inode);
         return -EINVAL;
     }
 
+    Ext2Node* unusedNode = nullptr; // Cleaned up once m_inodesLock is released
     {
         ScopedSpinLock lockInodes(m_inodesLock);
         if (Ext2Node * file; inodeCache.get(ent->inode, file)) {
@@ -1635,7 +2609,7 @@ found:
 
             if (!file->handleCount) {
                 inodeCache.remove(file->inode);
-                CleanNode(file);
+                unusedNode = file;
             }
         } else {
             ext2_inode_t e2inode;
@@ -1661,20 +2635,31 @@ found:
         }
     }
 
-    return WriteDir(node, entries);
+    if (unusedNode) {
+        CleanNode(unusedNode); // CleanNode writes the inode back, which takes m_inodesLock
+    }
+
+    return RemoveDirectoryEntry(node, blockIndex, buffer, offset, previousOffset);
 }
 
 int Ext2::Ext2Volume::Truncate(Ext2Node* node, off_t length) {
+    if (readOnly) {
+        return -EROFS;
+    }
+
     if (length < 0) {
         return -EINVAL;
     }
 
-    if (length > node->e2inode.blockCount * 512) { // We need to allocate blocks
+    // Extent mapped files are left sparse, blocks are allocated when written
+    if (!IsExtentMapped(node->e2inode) && length > node->e2inode.blockCount * 512) { // We need to allocate blocks
         uint64_t blocksNeeded = (length + blocksize - 1) / blocksize;
         uint64_t blocksAllocated = node->e2inode.blockCount / (blocksize / 512);
 
         while (blocksAllocated < blocksNeeded) {
-            SetInodeBlock(blocksAllocated++, node->e2inode, AllocateBlock());
+            SetInodeBlock(blocksAllocated, node->e2inode,
+                          AllocateNodeBlock(node, blocksAllocated, blocksNeeded - blocksAllocated));
+            blocksAllocated++;
         }
 
         node->e2inode.blockCount = blocksNeeded * (blocksize / 512);
@@ -1693,11 +2678,17 @@ void Ext2::Ext2Volume::CleanNode(Ext2Node* node) {
         return;
     }
 
+    DiscardPreallocation(node);
+    WriteBackNode(node);
+
     if (node->e2inode.linkCount == 0) { // No links to file
         EraseInode(node->e2inode, node->inode);
     }
 
-    inodeCache.remove(node->inode);
+    {
+        ScopedSpinLock lockInodes(m_inodesLock);
+        inodeCache.remove(node->inode);
+    }
     delete node;
 }
 
@@ -1719,6 +2710,7 @@ Ext2::Ext2Node::Ext2Node(Ext2Volume* vol, ext2_inode_t& ino, ino_t inode) {
         break;
     case EXT2_S_IFDIR:
         flags = FS_NODE_DIRECTORY;
+        cacheDentries = true;
         break;
     case EXT2_S_IFLNK:
         flags = FS_NODE_SYMLINK;
@@ -1728,6 +2720,7 @@ Ext2::Ext2Node::Ext2Node(Ext2Volume* vol, ext2_inode_t& ino, ino_t inode) {
         break;
     default:
         flags = FS_NODE_FILE;
+        pageCached = true;
         break;
     }
 
@@ -1741,6 +2734,13 @@ int Ext2::Ext2Node::ReadDir(DirectoryEntry* ent, uint32_t idx) {
     return ret;
 }
 
+int Ext2::Ext2Node::ReadDirBatch(off_t& cursor, DirectoryFiller filler, void* context) {
+    flock.AcquireRead();
+    auto ret = vol->ReadDirBatch(this, cursor, filler, context);
+    flock.ReleaseRead();
+    return ret;
+}
+
 FsNode* Ext2::Ext2Node::FindDir(const char* name) {
     flock.AcquireRead();
     auto ret = vol->FindDir(this, name);
@@ -1809,7 +2809,10 @@ int Ext2::Ext2Node::Truncate(off_t length) {
     return ret;
 }
 
-void Ext2::Ext2Node::Sync() { vol->SyncNode(this); }
+void Ext2::Ext2Node::Sync() {
+    vol->WriteBackNode(this);
+    vol->Flush(inode);
+}
 
 void Ext2::Ext2Node::Close() {
     handleCount--;
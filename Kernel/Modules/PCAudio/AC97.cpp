@@ -3,6 +3,7 @@
 #include <IDT.h>
 #include <IOPorts.h>
 #include <Math.h>
+#include <Timer.h>
 
 namespace Audio {
 
@@ -131,6 +132,14 @@ int AC97Controller::WriteSamples(void* output, uint8_t* buffer, size_t size, boo
     int totalSamplesWritten = 0;
     int buffersToWrite = (((int)size + PAGE_SIZE_4K - 1) >> PAGE_SHIFT_4K);
 
+    if (m_streamActive && !IsDMARunning()) {
+        if (Timer::UsecondsSinceBoot() <= m_streamDrainTime + AC97_UNDERRUN_GRACE_US) {
+            m_underruns++;
+            Log::Warning("[AC97] Underrun (count: %u)", m_underruns);
+        }
+        m_streamActive = false;
+    }
+
     while (size > 0) {
         uint8_t isDMARunning = !(inportw(m_nabmPort + PO_TransferStatus) & NBDMAStatus);
         if (isDMARunning) {
@@ -203,6 +212,10 @@ int AC97Controller::WriteSamples(void* output, uint8_t* buffer, size_t size, boo
             if (!isDMARunning) {
                 StartDMA(); // Ensure DMA is running
             }
+            m_streamActive = true;
+
+            uint64_t now = Timer::UsecondsSinceBoot();
+            m_streamDrainTime = MAX(m_streamDrainTime, now) + (uint64_t)samplesWritten * 1000000 / AC97_SAMPLE_RATE;
         }
         totalSamplesWritten += samplesWritten;
     }
@@ -27,6 +27,8 @@
 #define AC97_BDL_ENTRIES 32
 
 #define AC97_SAMPLE_RATE 48000
+// Writes arriving within this long (microseconds) of the queued samples draining count as underruns
+#define AC97_UNDERRUN_GRACE_US 100000
 
 namespace Audio {
 
@@ -58,6 +60,7 @@ private:
 
     inline void StopDMA() {
         outportb(m_nabmPort + PO_TransferControl, inportb(m_nabmPort + PO_TransferControl) & ~NBTransferDMAControl);
+        m_streamActive = false;
     }
 
     inline uint8_t IsDMARunning() const {
@@ -172,6 +175,14 @@ private:
     uint16_t* sampleBuffers[32];
     // Amount of samples per channel in each buffer
     int m_samplesPerBuffer;
+
+    // Set once we have started playback, cleared when DMA is stopped.
+    // The DMA engine also halts by itself after the last valid entry,
+    // this is only an underrun if the next write arrives shortly after the queued samples drained,
+    // a longer gap is the stream idling or being paused
+    bool m_streamActive = false;
+    // Time (in microseconds since boot) at which the queued samples finish playing
+    uint64_t m_streamDrainTime = 0;
 };
 
 }
\ No newline at end of file
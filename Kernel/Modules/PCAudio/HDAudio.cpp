@@ -54,6 +54,23 @@ void IntelHDAudioController::OnInterrupt() {
 
     // Clear overrun and interrupt flags
     m_cRegs->rirbStatus |= 4 | 1;
+
+    for (HDAOutput* out : m_outputs) {
+        if (!out->stream) {
+            continue;
+        }
+
+        StreamDescriptor* desc = &m_cRegs->streams[out->stream->descriptor];
+        uint8_t status = desc->status;
+        if (status & HDA_STREAM_STS_FIFO_ERROR) {
+            // The output FIFO ran dry before the next buffer was available
+            m_underruns++;
+            Log::Warning("[HDAudio] Underrun (count: %u)", m_underruns);
+        }
+
+        // Status bits are write 1 to clear
+        desc->status = status & (HDA_STREAM_STS_BCIS | HDA_STREAM_STS_FIFO_ERROR | HDA_STREAM_STS_DESC_ERROR);
+    }
 }
 
 IntelHDAudioController::IntelHDAudioController(const PCIInfo& info) : PCIDevice(info) {
@@ -339,6 +356,8 @@ FancyRefPtr<HDAStream> IntelHDAudioController::CreateStream(int codec, int num,
                       HDA_STREAM_CTL_STRIPE_MASK | HDA_STREAM_CTL_TRAFFIC_PRIORITY | HDA_STREAM_CTL_BIDIRECTIONAL_DIR);
     // Enable intrrupts
     desc->control |= HDA_STREAM_CTL_ICOE | HDA_STREAM_CTL_FEIE | HDA_STREAM_CTL_DEIE;
+    // Let the stream raise controller interrupts (SIE bit for this descriptor)
+    m_cRegs->intControl |= (1U << stream->descriptor);
     // Set stream number
     desc->control |= HDA_STREAM_CTL_STREAM_NUM(num);
 
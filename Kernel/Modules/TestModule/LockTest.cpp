@@ -0,0 +1,138 @@
+#include <Lock.h>
+
+#include <Logging.h>
+#include <Scheduler.h>
+
+#define RACE_WRITER_ITERATIONS 2000
+#define RACE_TRY_READERS 2
+
+static ReadWriteLock raceLock;
+static volatile bool raceStop = false;
+static volatile bool raceWriterInside = false;
+static volatile unsigned raceReadersInside = 0;
+static volatile unsigned raceThreadsDone = 0;
+static volatile bool raceFailed = false;
+
+static void RaceReaderInside() {
+    __atomic_add_fetch(&raceReadersInside, 1, __ATOMIC_SEQ_CST);
+    if (raceWriterInside) {
+        raceFailed = true;
+    }
+    __atomic_sub_fetch(&raceReadersInside, 1, __ATOMIC_SEQ_CST);
+}
+
+static void RaceThreadExit() {
+    __atomic_add_fetch(&raceThreadsDone, 1, __ATOMIC_SEQ_CST);
+
+    acquireLock(&Thread::Current()->kernelLock);
+    Process::Current()->Die();
+}
+
+// Readers which hold the lock, so the writer has to wait on a reader phase
+static void RaceReaderThread() {
+    while (!raceStop) {
+        raceLock.AcquireRead();
+        RaceReaderInside();
+        raceLock.ReleaseRead();
+    }
+
+    RaceThreadExit();
+}
+
+// Try-readers which keep failing whilst the writer waits on the readers above
+static void RaceTryReaderThread() {
+    while (!raceStop) {
+        if (raceLock.TryAcquireRead()) {
+            RaceReaderInside();
+            raceLock.ReleaseRead();
+        }
+    }
+
+    RaceThreadExit();
+}
+
+// Try-readers racing a writer must neither let the writer in early nor leave it waiting forever
+static int RaceTryReaders() {
+    Process::CreateKernelProcess((void*)RaceReaderThread, "LockTest Reader", nullptr)->Start();
+    for (unsigned i = 0; i < RACE_TRY_READERS; i++) {
+        Process::CreateKernelProcess((void*)RaceTryReaderThread, "LockTest TryReader", nullptr)->Start();
+    }
+
+    for (unsigned i = 0; i < RACE_WRITER_ITERATIONS; i++) {
+        raceLock.AcquireWrite();
+        raceWriterInside = true;
+        if (__atomic_load_n(&raceReadersInside, __ATOMIC_SEQ_CST)) {
+            raceFailed = true;
+        }
+        raceWriterInside = false;
+        raceLock.ReleaseWrite();
+    }
+
+    raceStop = true;
+    while (raceThreadsDone < RACE_TRY_READERS + 1) {
+        Scheduler::Yield();
+    }
+
+    return raceFailed;
+}
+
+int LockTest() {
+    Log::Info("[TestModule] Running Lock Test...");
+
+    ReadWriteLock lock;
+
+    lock.AcquireRead();
+    lock.AcquireRead();
+    if (lock.TryAcquireWrite()) {
+        Log::Warning("Failed Test 0, acquired write lock with active readers");
+        return 1;
+    }
+
+    lock.ReleaseRead();
+    lock.ReleaseRead();
+    if (!lock.TryAcquireWrite()) {
+        Log::Warning("Failed Test 1, could not acquire write lock without readers");
+        return 1;
+    }
+
+    if (!lock.IsWriteLocked()) {
+        Log::Warning("Failed Test 2, lock not write locked");
+        return 1;
+    }
+
+    if (lock.TryAcquireRead()) {
+        Log::Warning("Failed Test 3, acquired read lock whilst write locked");
+        return 1;
+    }
+
+    lock.ReleaseWrite();
+    if (!lock.TryAcquireRead()) {
+        Log::Warning("Failed Test 4, could not acquire read lock after writer released");
+        return 1;
+    }
+    lock.ReleaseRead();
+
+    // Second writer phase uses the other phase ID
+    lock.AcquireWrite();
+    lock.ReleaseWrite();
+    lock.AcquireRead();
+    lock.ReleaseRead();
+
+    PerCPUReadWriteLock perCPULock;
+    unsigned slot = perCPULock.AcquireRead();
+    perCPULock.ReleaseRead(slot);
+
+    perCPULock.AcquireWrite();
+    if (!perCPULock.IsWriteLocked()) {
+        Log::Warning("Failed Test 5, per-CPU lock not write locked");
+        return 1;
+    }
+    perCPULock.ReleaseWrite();
+
+    if (RaceTryReaders()) {
+        Log::Warning("Failed Test 6, writer entered whilst a reader held the lock");
+        return 1;
+    }
+
+    return 0;
+}
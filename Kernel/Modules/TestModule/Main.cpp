@@ -4,10 +4,12 @@
 
 #include "Tests.h"
 
-#define TEST_COUNT 2
+#define TEST_COUNT 4
 Test tests[TEST_COUNT]{
     StringTest,
 	ThreadingTest,
+	LockTest,
+	PageCacheTest,
 };
 
 static int ModuleInit(){
@@ -0,0 +1,121 @@
+#include <Fs/Filesystem.h>
+
+#include <Errno.h>
+#include <Logging.h>
+#include <Math.h>
+#include <Paging.h>
+#include <String.h>
+
+#define MEMORY_NODE_CAPACITY (PAGE_SIZE_4K * 4)
+
+// Page cached file backed by a fixed buffer
+class MemoryNode final : public FsNode {
+public:
+    MemoryNode() {
+        flags = FS_NODE_FILE;
+        pageCached = true;
+        memset(m_data, 0, MEMORY_NODE_CAPACITY);
+    }
+
+    ssize_t Read(size_t off, size_t readSize, uint8_t* buffer) override {
+        if (off >= size) {
+            return 0;
+        }
+
+        readSize = MIN(readSize, size - off);
+        memcpy(buffer, m_data + off, readSize);
+        return readSize;
+    }
+
+    ssize_t Write(size_t off, size_t writeSize, uint8_t* buffer) override {
+        if (off + writeSize > MEMORY_NODE_CAPACITY) {
+            return -ENOSPC;
+        }
+
+        memcpy(m_data + off, buffer, writeSize);
+        if (off + writeSize > size) {
+            size = off + writeSize;
+        }
+        return writeSize;
+    }
+
+    int Truncate(off_t length) override {
+        if (length < 0 || length > MEMORY_NODE_CAPACITY) {
+            return -EINVAL;
+        }
+
+        if (static_cast<size_t>(length) < size) {
+            memset(m_data + length, 0, size - length);
+        }
+        size = length;
+        return 0;
+    }
+
+private:
+    uint8_t m_data[MEMORY_NODE_CAPACITY];
+};
+
+// Check that buffer holds value for [start, end)
+static bool CheckRange(const uint8_t* buffer, size_t start, size_t end, uint8_t value) {
+    for (size_t i = start; i < end; i++) {
+        if (buffer[i] != value) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int PageCacheTest() {
+    Log::Info("[TestModule] Running Page Cache Test...");
+
+    int result = 0;
+    uint8_t* buffer = new uint8_t[MEMORY_NODE_CAPACITY];
+    uint8_t pattern[100];
+    memset(pattern, 'a', sizeof(pattern));
+
+    // Grow with ftruncate after the short end of file page has been cached
+    MemoryNode* node = new MemoryNode();
+    fs::Write(node, 0, sizeof(pattern), pattern);
+    if (fs::Read(node, 0, MEMORY_NODE_CAPACITY, buffer) != sizeof(pattern)) {
+        Log::Warning("Failed Test 0, short read of new file");
+        result = 1;
+    }
+
+    fs::Truncate(node, PAGE_SIZE_4K * 2);
+    memset(buffer, 0xff, MEMORY_NODE_CAPACITY);
+    if (ssize_t ret = fs::Read(node, 0, MEMORY_NODE_CAPACITY, buffer); ret != PAGE_SIZE_4K * 2) {
+        Log::Warning("Failed Test 1, read %d bytes after growing file with truncate", ret);
+        result = 1;
+    } else if (!CheckRange(buffer, 0, sizeof(pattern), 'a') ||
+               !CheckRange(buffer, sizeof(pattern), PAGE_SIZE_4K * 2, 0)) {
+        Log::Warning("Failed Test 2, bad data after growing file with truncate");
+        result = 1;
+    }
+    delete node;
+
+    // Grow by writing past the end of file after the short end of file page has been cached
+    node = new MemoryNode();
+    fs::Write(node, 0, sizeof(pattern), pattern);
+    fs::Read(node, 0, MEMORY_NODE_CAPACITY, buffer);
+
+    uint8_t tail[10];
+    memset(tail, 'b', sizeof(tail));
+
+    size_t tailOffset = PAGE_SIZE_4K + 1000;
+    fs::Write(node, tailOffset, sizeof(tail), tail);
+    memset(buffer, 0xff, MEMORY_NODE_CAPACITY);
+    if (ssize_t ret = fs::Read(node, 0, MEMORY_NODE_CAPACITY, buffer); ret != tailOffset + sizeof(tail)) {
+        Log::Warning("Failed Test 3, read %d bytes after writing past end of file", ret);
+        result = 1;
+    } else if (!CheckRange(buffer, 0, sizeof(pattern), 'a') ||
+               !CheckRange(buffer, sizeof(pattern), tailOffset, 0) ||
+               !CheckRange(buffer, tailOffset, tailOffset + sizeof(tail), 'b')) {
+        Log::Warning("Failed Test 4, bad data after writing past end of file");
+        result = 1;
+    }
+    delete node;
+
+    delete[] buffer;
+    return result;
+}
@@ -3,4 +3,6 @@
 using Test = int (*)();
 
 int StringTest();
-int ThreadingTest();
\ No newline at end of file
+int ThreadingTest();
+int LockTest();
+int PageCacheTest();
\ No newline at end of file
@@ -35,6 +35,10 @@ struct CPU {
     Process* idleProcess;
     volatile int runQueueLock = 0;
     FastList<Thread*>* runQueue;
+
+    volatile bool rtPreempt = false; // A real-time thread became runnable, reschedule on next tick
+    uint64_t rtPeriodStart = 0;      // Start of the current real-time throttling period (us since boot)
+    uint64_t rtTicksUsed = 0;        // Ticks used by real-time threads in the current period
 } __attribute__((packed));
 
 #define CPU_LOCAL_SELF 0x0
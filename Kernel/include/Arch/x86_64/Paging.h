@@ -149,8 +149,14 @@ uintptr_t GetIOMapping(uintptr_t addr);
 
 bool CheckKernelPointer(uintptr_t addr, uint64_t len);
 bool CheckUsermodePointer(uintptr_t addr, uint64_t len, AddressSpace* addressSpace);
+// Checks the page tables directly without taking any locks,
+// for use in interrupt handlers where the address space lock may already be held
+bool CheckUsermodePointerUnlocked(uintptr_t addr, uint64_t len, PageMap* pageMap);
 uint64_t VirtualToPhysicalAddress(uint64_t addr);
 uint64_t VirtualToPhysicalAddress(uint64_t addr, page_map_t* addressSpace);
+// Physical address of a mapped kernel heap address (including the offset into the page),
+// 0 if addr is not a mapped kernel heap address
+uintptr_t KernelHeapVirtualToPhysical(uintptr_t addr);
 
 void SwitchPageDirectory(uint64_t phys);
 
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <CPU.h>
+#include <Compiler.h>
+
+// Sampling CPU profiler, samples are exposed through /dev/profiler
+namespace Profiler {
+extern bool enabled;
+
+void Tick();
+void TakeSample(CPU* cpu, RegisterContext* r);
+
+/////////////////////////////
+/// \brief Record a sample of the interrupted context if the profiler is running
+///
+/// Called from the scheduler on every CPU, interrupts must be disabled.
+/////////////////////////////
+ALWAYS_INLINE void Sample(CPU* cpu, RegisterContext* r) {
+    if (__builtin_expect(enabled, 0)) {
+        TakeSample(cpu, r);
+    }
+}
+} // namespace Profiler
@@ -9,4 +9,12 @@ namespace SMP{
     void InitializeCPU(uint16_t id);
     void InitializeCPU0Context();
     void Initialize();
+
+    /////////////////////////////
+    /// \brief Run work on every processor before the scheduler is started
+    ///
+    /// Application processors pick the work up from their idle loop,
+    /// the calling processor runs it as well. Returns once every processor has finished.
+    /////////////////////////////
+    void RunOnAllProcessors(void (*work)(void*), void* arg);
 }
\ No newline at end of file
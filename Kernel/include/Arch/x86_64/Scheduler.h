@@ -21,6 +21,13 @@
 #define USER_SS 0x1B
 #define USER_CS 0x23
 
+#define PID_TABLE_SIZE 512
+
+// Real-time threads may use at most SCHED_RT_RUNTIME_US of each SCHED_RT_PERIOD_US on a CPU
+// so a runaway real-time thread cannot lock up the system
+#define SCHED_RT_PERIOD_US 1000000
+#define SCHED_RT_RUNTIME_US 950000
+
 namespace Scheduler {
 class ProcessStateThreadBlocker;
 }
@@ -51,6 +58,17 @@ pid_t GetNextPID();
 FancyRefPtr<Process> FindProcessByPID(pid_t pid);
 pid_t GetNextProcessPID(pid_t pid);
 void InsertNewThreadIntoQueue(Thread* thread);
+
+/////////////////////////////
+/// \brief Set the scheduling policy of a thread
+///
+/// \param thread Thread to modify
+/// \param policy LEMON_SCHED_NORMAL, LEMON_SCHED_FIFO or LEMON_SCHED_RR
+/// \param priority Real-time priority, must be 0 for LEMON_SCHED_NORMAL
+///
+/// \return 0 on success, -EINVAL if the policy or priority is invalid
+/////////////////////////////
+long SetThreadPolicy(Thread* thread, int policy, int priority);
 void BalanceRunQueues();
 
 void Initialize();
@@ -3,22 +3,43 @@
 #include <Logging.h>
 #include <Paging.h>
 
-inline static void PrintStackTrace(uint64_t _rbp){
+// Walk a frame pointer chain starting at _rbp,
+// isValid(frame) is used to check each frame can be read
+// and callback(rip) is called with the return address of each frame, return false to stop
+template<typename V, typename C>
+inline static void WalkStackTrace(uint64_t _rbp, V isValid, C callback){
 	uint64_t* rbp = (uint64_t*)_rbp;
-	uint64_t rip = 0;
-	while(rbp && Memory::CheckKernelPointer((uintptr_t)rbp, 16)){
-		rip = *(rbp + 1);
-		Log::Info(rip);
+	while(rbp && isValid((uintptr_t)rbp)){
+		if(!callback(*(rbp + 1))){
+			break;
+		}
 		rbp = (uint64_t*)(*rbp);
 	}
 }
 
+// Fill frames with return addresses from the kernel stack, returns the amount of frames
+inline static int GetStackTrace(uint64_t _rbp, uintptr_t* frames, int maxFrames){
+	int count = 0;
+	WalkStackTrace(_rbp, [](uintptr_t frame) { return Memory::CheckKernelPointer(frame, 16); },
+		[&](uint64_t rip) { frames[count++] = rip; return count < maxFrames; });
+	return count;
+}
+
+// Fill frames with return addresses from a user stack, returns the amount of frames
+// Does not take the address space lock so it is safe to use from interrupt handlers
+inline static int UserGetStackTrace(uint64_t _rbp, PageMap* pageMap, uintptr_t* frames, int maxFrames){
+	int count = 0;
+	WalkStackTrace(_rbp, [pageMap](uintptr_t frame) { return Memory::CheckUsermodePointerUnlocked(frame, 16, pageMap); },
+		[&](uint64_t rip) { frames[count++] = rip; return count < maxFrames; });
+	return count;
+}
+
+inline static void PrintStackTrace(uint64_t _rbp){
+	WalkStackTrace(_rbp, [](uintptr_t frame) { return Memory::CheckKernelPointer(frame, 16); },
+		[](uint64_t rip) { Log::Info(rip); return true; });
+}
+
 inline static void UserPrintStackTrace(uint64_t _rbp, AddressSpace* addressSpace){
-	uint64_t* rbp = (uint64_t*)_rbp;
-	uint64_t rip = 0;
-	while(rbp && Memory::CheckUsermodePointer((uintptr_t)rbp, 16, addressSpace)){
-		rip = *(rbp + 1);
-		Log::Info(rip);
-		rbp = (uint64_t*)(*rbp);
-	}
-}
\ No newline at end of file
+	WalkStackTrace(_rbp, [addressSpace](uintptr_t frame) { return Memory::CheckUsermodePointer(frame, 16, addressSpace); },
+		[](uint64_t rip) { Log::Info(rip); return true; });
+}
@@ -10,6 +10,8 @@
 #include <stdint.h>
 #include <abi-bits/pid_t.h>
 
+#include <ABI/Process.h>
+
 #define THREAD_TIMESLICE_DEFAULT 10
 
 enum {
@@ -81,6 +83,9 @@ struct Thread {
     uint8_t priority = 0;               // Thread priority
     uint8_t state = ThreadStateRunning; // Thread state
 
+    uint8_t schedPolicy = LEMON_SCHED_NORMAL; // Scheduling policy
+    uint8_t rtPriority = 0; // Real-time priority, real-time threads always run before normal threads
+
     uint64_t fsBase = 0;
 
     bool blockTimedOut = false;
@@ -113,6 +118,8 @@ struct Thread {
         return signalMask & (~UNMASKABLE_SIGNALS);
     }
 
+    ALWAYS_INLINE bool IsRealTime() const { return schedPolicy != LEMON_SCHED_NORMAL; }
+
     ALWAYS_INLINE bool HasPendingSignals() {
         return (~EffectiveSignalMask()) & pendingSignals;
     }
@@ -30,8 +30,12 @@ public:
     virtual int OutputSetNumberOfChannels(int channels) = 0;
 
     virtual int WriteSamples(void* output, uint8_t* buffer, size_t size, bool async) = 0;
-private:
 
+    // Number of times playback ran out of samples
+    ALWAYS_INLINE uint64_t UnderrunCount() const { return m_underruns; }
+
+protected:
+    uint64_t m_underruns = 0;
 };
 
 void InitializeSystem();
@@ -133,6 +133,9 @@ public:
     DiskDevice* parentDisk;
 
 private:
+    // Drop blocks about to be written from the page cache
+    void InvalidateCachedBlocks(uint64_t lba, uint32_t count);
+
     uint64_t m_startLBA;
     uint64_t m_endLBA;
 };
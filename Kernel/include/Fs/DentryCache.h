@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Fs/Filesystem.h>
+
+#include <Compiler.h>
+
+#define DENTRY_CACHE_BUCKETS 4096
+#define DENTRY_CACHE_ENTRIES 8192
+
+// Longer names are not cached
+#define DENTRY_NAME_MAX 47
+
+// VFS wide cache of directory lookups, keyed by (parent directory, name).
+// Failed lookups are cached as negative entries.
+//
+// Only directories with FsNode::cacheDentries set are cached, their contents must only change
+// through fs::Create, fs::CreateDirectory, fs::Link, fs::Unlink and fs::Rename, which invalidate entries.
+//
+// Lookups do not take any locks. Each bucket has a sequence count which writers increment
+// before and after modifying the bucket, readers retry if it changed during the lookup.
+// Entries come from a fixed pool and are never freed so readers can always follow the chains.
+namespace fs::DentryCache {
+
+struct Dentry {
+    FsNode* parent;
+    FsNode* node; // nullptr for a negative entry
+    uint32_t hash;
+
+    volatile bool referenced; // Set on lookup, cleared as the eviction clock hand passes
+
+    Dentry* hashNext;
+
+    // Entries with the same parent, and entries pointing to the same node,
+    // used to drop all entries of a node when it is destroyed.
+    Dentry* parentNext;
+    Dentry* parentPrev;
+    Dentry* nodeNext;
+    Dentry* nodePrev;
+
+    char name[DENTRY_NAME_MAX + 1];
+};
+
+/////////////////////////////
+/// \brief Look up name in dir
+///
+/// \param node Set to the cached node, nullptr if name is known not to exist
+///
+/// \return true if the lookup was cached
+/////////////////////////////
+bool Lookup(FsNode* dir, const char* name, FsNode*& node);
+
+/////////////////////////////
+/// \return Invalidation count, taken before a filesystem lookup and passed to Insert
+/////////////////////////////
+uint64_t Generation();
+
+/////////////////////////////
+/// \brief Cache the result of a lookup
+///
+/// The entry is not inserted if anything was invalidated since generation was taken,
+/// as the lookup may have raced with a change to the directory.
+///
+/// \param node Result of the lookup, nullptr for a negative entry
+/////////////////////////////
+void Insert(FsNode* dir, const char* name, FsNode* node, uint64_t generation);
+
+/////////////////////////////
+/// \brief Drop the entry for name in dir
+/////////////////////////////
+void Invalidate(FsNode* dir, const char* name);
+
+/////////////////////////////
+/// \brief Drop all entries of node as a directory or as a result, called when node is destroyed
+/////////////////////////////
+void InvalidateNode(FsNode* node);
+
+} // namespace fs::DentryCache
@@ -5,6 +5,8 @@
 #include <Device.h>
 #include <Fs/Filesystem.h>
 #include <Fs/FsVolume.h>
+#include <Lock.h>
+#include <Vector.h>
 
 #define FAT_ATTR_READ_ONLY 0x1
 #define FAT_ATTR_HIDDEN 0x2
@@ -13,6 +15,16 @@
 #define FAT_ATTR_DIRECTORY 0x10
 #define FAT_ATTR_ARCHIVE 0x20
 
+#define FAT32_CLUSTER_MASK 0x0FFFFFFF // Upper 4 bits of a FAT entry are reserved
+#define FAT32_CLUSTER_EOC 0x0FFFFFF8  // Entries at or above this mark the end of a cluster chain
+
+#define FAT32_FLAG_NO_MIRROR 0x80    // Only the active FAT is in use
+#define FAT32_FLAG_ACTIVE_FAT 0xF    // Number of the active FAT when mirroring is disabled
+
+// The FAT is read and cached in blocks of this size
+#define FAT32_FAT_BLOCK_SIZE 4096
+#define FAT32_FAT_BLOCK_ENTRIES (FAT32_FAT_BLOCK_SIZE / sizeof(uint32_t))
+
 typedef struct {
     uint8_t jmp[3]; // Can be ignored
     int8_t oem[8]; // OEM identifier
@@ -93,6 +105,13 @@ typedef struct
 namespace fs::FAT32{
     class Fat32Volume;
 
+    // Run of contiguous clusters in a cluster chain
+    struct Fat32Extent {
+        uint32_t fileCluster; // Index of the first cluster within the file
+        uint32_t diskCluster; // First cluster on disk
+        uint32_t length; // Amount of clusters
+    };
+
     class Fat32Node : public FsNode {
     public:
         ssize_t Read(size_t, size_t, uint8_t *);
@@ -100,9 +119,17 @@ namespace fs::FAT32{
         //fs_fd_t* Open(size_t flags);
         //void Close();
         int ReadDir(DirectoryEntry*, uint32_t);
+        int ReadDirBatch(off_t& cursor, DirectoryFiller filler, void* context);
         FsNode* FindDir(const char* name);
 
         Fat32Volume* vol;
+
+        // Cluster chain as extents sorted by fileCluster, loaded on first access.
+        // The volume is read only so the extents never change once loaded.
+        Vector<Fat32Extent> extents;
+        uint32_t chainLength = 0; // Amount of clusters in the chain
+        bool extentsLoaded = false;
+        FilesystemLock extentLock; // Held while loading the extents
     };
 
     class Fat32Volume : public FsVolume {
@@ -114,18 +141,52 @@ namespace fs::FAT32{
         void Open(Fat32Node* node, uint32_t flags);
         void Close(Fat32Node* node);
         int ReadDir(Fat32Node* node, DirectoryEntry* dirent, uint32_t index);
+        int ReadDirBatch(Fat32Node* node, off_t& cursor, DirectoryFiller filler, void* context);
         FsNode* FindDir(Fat32Node* node, const char* name);
 
     private:
         uint64_t ClusterToLBA(uint32_t cluster);
-        List<uint32_t>* GetClusterChain(uint32_t cluster);
-        void* ReadClusterChain(uint32_t cluster, int* count);
-        void* ReadClusterChain(uint32_t cluster, int* count, size_t max);
+
+        /////////////////////////////
+        /// \brief Get the next cluster in a chain from the cached FAT
+        ///
+        /// \return 0 on success, otherwise a negative error code
+        /////////////////////////////
+        int GetNextCluster(uint32_t cluster, uint32_t& next);
+
+        /////////////////////////////
+        /// \brief Walk the cluster chain of node and build its extents if not already done
+        ///
+        /// \return 0 on success, otherwise a negative error code
+        /////////////////////////////
+        int LoadExtents(Fat32Node* node);
+
+        /////////////////////////////
+        /// \brief Read size bytes at offset within the cluster chain of node
+        ///
+        /// Only the clusters covering the range are read, contiguous runs of clusters are read with a single request.
+        ///
+        /// \return Bytes read or if negative an error code
+        /////////////////////////////
+        ssize_t ReadClusters(Fat32Node* node, size_t offset, size_t size, uint8_t* buffer);
+
+        /////////////////////////////
+        /// \brief Read the whole cluster chain of a directory into a kmalloc'd buffer
+        /////////////////////////////
+        void* ReadDirectory(Fat32Node* node, size_t* size);
+
+        // Fill dirent from the directory entry at index, preceded by lfnCount long file name entries
+        void FillDirectoryEntry(fat_entry_t* dirEntries, unsigned index, unsigned lfnCount, DirectoryEntry* dirent);
 
         PartitionDevice* part;
         fat32_boot_record_t* bootRecord;
 
         int clusterSizeBytes;
+        uint32_t clusterCount; // Amount of data clusters on the volume
+
+        uint64_t fatSector; // First sector of the FAT in use
+        uint32_t fatBlockCount;
+        uint32_t** fatCache; // Blocks of the FAT, nullptr until read
         Fat32Node fat32MountPoint;
     };
 
@@ -13,11 +13,17 @@
 
 #include <abi-bits/fcntl.h>
 #include <abi-bits/uid_t.h>
+#include <bits/posix/iovec.h>
 
 #define FD_SETSIZE 1024
 
 #define PATH_MAX 4096
 #define NAME_MAX 255
+#define IOV_MAX 1024
+
+// Data moved by fs::Splice is written out in batches of up to this size
+#define SPLICE_BATCH_SIZE 65536
+#define SPLICE_BATCH_PAGES (SPLICE_BATCH_SIZE / 4096)
 
 #define S_IFMT 0xF000
 #define S_IFBLK 0x6000
@@ -45,7 +51,8 @@
 #define FS_NODE_BLKDEVICE S_IFBLK 
 #define FS_NODE_SYMLINK S_IFLNK   
 #define FS_NODE_CHARDEVICE S_IFCHR
-#define FS_NODE_SOCKET S_IFSOCK   
+#define FS_NODE_SOCKET S_IFSOCK
+#define FS_NODE_PIPE S_IFIFO   
 
 #define POLLIN 0x01
 #define POLLOUT 0x02
@@ -129,6 +136,24 @@ static inline void FD_SET(int fd, fd_set_t* fds) {
 class FilesystemWatcher;
 class DirectoryEntry;
 
+/////////////////////////////
+/// \brief Called by FsNode::ReadDirBatch for each directory entry
+///
+/// \param context Context passed to ReadDirBatch
+/// \param entry Directory entry, node is not set
+/// \param next Cursor of the entry after this one
+///
+/// \return false to stop before this entry (e.g. the buffer is full), the next batch starts with it
+/////////////////////////////
+typedef bool (*DirectoryFiller)(void* context, const DirectoryEntry& entry, off_t next);
+
+// Sequential access tracking of an open file, used by the page cache for readahead
+struct FileReadahead {
+    uint64_t nextIndex = 0;  // Page the next read starts at if access is sequential
+    uint64_t aheadIndex = 0; // Pages before this have already been read ahead
+    unsigned window = 0;     // Readahead window in pages, 0 if access is random
+};
+
 class UNIXOpenFile : public KernelObject {
     DECLARE_KOBJECT(UNIXOpenFile);
 public:
@@ -139,8 +164,14 @@ public:
     class FsNode* node = nullptr;
     off_t pos = 0;
     mode_t mode = 0;
+
+    FileReadahead readahead;
 };
 
+namespace fs::DentryCache {
+struct Dentry;
+}
+
 class FsNode {
     friend class FilesystemBlocker;
 
@@ -159,6 +190,12 @@ public:
 
     int error = 0;
 
+    bool pageCached = false; // Reads and writes through fs::Read and fs::Write use the page cache
+    bool cacheDentries = false; // Lookups in this directory through fs::FindDir use the dentry cache
+
+    fs::DentryCache::Dentry* dentries = nullptr;      // Dentry cache entries resolving to this node
+    fs::DentryCache::Dentry* childDentries = nullptr; // Dentry cache entries of this directory
+
     virtual ~FsNode();
 
     /////////////////////////////
@@ -185,10 +222,56 @@ public:
     /////////////////////////////
     virtual ssize_t Write(size_t off, size_t size, uint8_t* buffer); // Write Data
 
+    /////////////////////////////
+    /// \brief Read data from filesystem node into multiple buffers
+    ///
+    /// The default implementation calls Read for each buffer in turn and stops at the first short read.
+    /// Nodes where a read may block or consumes a message (pipes, sockets) override this.
+    ///
+    /// \param off Offset of data to read
+    /// \param iov Buffers to fill, already validated
+    /// \param iovcnt Amount of buffers
+    ///
+    /// \return Bytes read or if negative an error code
+    /////////////////////////////
+    virtual ssize_t ReadV(size_t off, const iovec* iov, int iovcnt);
+
+    /////////////////////////////
+    /// \brief Write data from multiple buffers to filesystem node
+    ///
+    /// The default implementation calls Write for each buffer in turn and stops at the first short write.
+    ///
+    /// \return Bytes written or if negative an error code
+    /////////////////////////////
+    virtual ssize_t WriteV(size_t off, const iovec* iov, int iovcnt);
+
+    /////////////////////////////
+    /// \brief Get the contents of the node if they are resident in kernel memory
+    ///
+    /// Lets callers which need the whole file (e.g. exec) use it in place instead of copying it out with Read.
+    ///
+    /// \return Pointer to size bytes of file data, nullptr if the node has to be read
+    /////////////////////////////
+    virtual const uint8_t* ResidentData() { return nullptr; }
+
     virtual ErrorOr<UNIXOpenFile*> Open(size_t flags); // Open
     virtual void Close();                           // Close
 
     virtual int ReadDir(DirectoryEntry*, uint32_t); // Read Directory
+
+    /////////////////////////////
+    /// \brief Read directory entries until filler returns false or the end of the directory
+    ///
+    /// Cursors are opaque, 0 is the start of the directory.
+    /// A cursor stays valid whilst entries are added and removed,
+    /// entries present for the whole listing are returned exactly once.
+    /// The base implementation uses the cursor as an index for ReadDir.
+    ///
+    /// \param cursor Position to start at, updated to the position after the last entry accepted by filler
+    ///
+    /// \return Amount of entries accepted by filler or if negative an error code
+    /////////////////////////////
+    virtual int ReadDirBatch(off_t& cursor, DirectoryFiller filler, void* context);
     virtual FsNode* FindDir(const char* name);            // Find in directory
 
     virtual int Create(DirectoryEntry* ent, uint32_t mode);
@@ -215,6 +298,7 @@ public:
     virtual inline bool IsSymlink() { return (flags & FS_NODE_TYPE) == FS_NODE_SYMLINK; }
     virtual inline bool IsCharDevice() { return (flags & FS_NODE_TYPE) == FS_NODE_CHARDEVICE; }
     virtual inline bool IsSocket() { return (flags & FS_NODE_TYPE) == FS_NODE_SOCKET; }
+    virtual inline bool IsPipe() { return (flags & FS_NODE_TYPE) == FS_NODE_PIPE; }
     virtual inline bool IsEPoll() const { return false; }
 
     void UnblockAll();
@@ -467,6 +551,54 @@ ssize_t Read(FsNode* node, size_t offset, size_t size, void* buffer);
 /// \return Bytes written or if negative an error code
 /////////////////////////////
 ssize_t Write(FsNode* node, size_t offset, size_t size, void* buffer);
+
+/////////////////////////////
+/// \brief Read data from filesystem node into multiple buffers
+///
+/// Page cached nodes are read through the page cache, otherwise FsNode::ReadV is used.
+///
+/// \param iov Buffers to fill, these must already be validated
+///
+/// \return Bytes read or if negative an error code
+/////////////////////////////
+ssize_t ReadV(FsNode* node, size_t offset, const iovec* iov, int iovcnt);
+
+/////////////////////////////
+/// \brief Write data from multiple buffers to filesystem node
+///
+/// \param iov Buffers to write, these must already be validated
+///
+/// \return Bytes written or if negative an error code
+/////////////////////////////
+ssize_t WriteV(FsNode* node, size_t offset, const iovec* iov, int iovcnt);
+
+/////////////////////////////
+/// \brief Move data from one node to another without copying it through user memory
+///
+/// Page cached data is written straight out of the pinned cache pages, in batches of up to SPLICE_BATCH_SIZE.
+/// Other nodes are read into a kernel buffer, streams (pipes, sockets) are only read from once.
+///
+/// \param in Node to read from
+/// \param inOffset Offset to read at, ignored by streams
+/// \param out Node to write to
+/// \param outOffset Offset to write at, ignored by streams
+/// \param size Maximum amount of data (in bytes) to move
+///
+/// \return Bytes moved or if negative an error code
+/////////////////////////////
+ssize_t Splice(FsNode* in, size_t inOffset, FsNode* out, size_t outOffset, size_t size);
+
+/////////////////////////////
+/// \brief Truncate filesystem node
+///
+/// Drops any cached pages past the new length
+///
+/// \param node Pointer to node to truncate
+/// \param length New length of the node
+///
+/// \return 0 on success or if negative an error code
+/////////////////////////////
+int Truncate(FsNode* node, off_t length);
 ErrorOr<UNIXOpenFile*> Open(FsNode* node, uint32_t flags = 0);
 void Close(FsNode* node);
 void Close(UNIXOpenFile* openFile);
@@ -475,9 +607,24 @@ FsNode* FindDir(FsNode* node, const char* name);
 
 ssize_t Read(const FancyRefPtr<UNIXOpenFile>& handle, size_t size, uint8_t* buffer);
 ssize_t Write(const FancyRefPtr<UNIXOpenFile>& handle, size_t size, uint8_t* buffer);
+ssize_t ReadV(const FancyRefPtr<UNIXOpenFile>& handle, const iovec* iov, int iovcnt);
+ssize_t WriteV(const FancyRefPtr<UNIXOpenFile>& handle, const iovec* iov, int iovcnt);
 int ReadDir(const FancyRefPtr<UNIXOpenFile>& handle, DirectoryEntry* dirent, uint32_t index);
+
+/////////////////////////////
+/// \brief Read directory entries from the position of handle
+///
+/// The position of handle is the directory cursor and is advanced past the entries accepted by filler.
+///
+/// \return Amount of entries accepted by filler or if negative an error code
+/////////////////////////////
+int ReadDirBatch(const FancyRefPtr<UNIXOpenFile>& handle, DirectoryFiller filler, void* context);
 FsNode* FindDir(const FancyRefPtr<UNIXOpenFile>& handle, const char* name);
 
+// Directory modifications, these keep the dentry cache up to date
+// and should be used instead of calling the FsNode methods directly
+int Create(FsNode* dir, DirectoryEntry* ent, uint32_t mode);
+int CreateDirectory(FsNode* dir, DirectoryEntry* ent, uint32_t mode);
 int Link(FsNode*, FsNode*, DirectoryEntry*);
 int Unlink(FsNode*, DirectoryEntry*, bool unlinkDirectories = false);
 
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <Fs/Filesystem.h>
+
+#include <Compiler.h>
+#include <Paging.h>
+
+#define PAGE_CACHE_BUCKETS 4096
+
+// Readahead window limits in pages
+#define READAHEAD_MIN_PAGES 4
+#define READAHEAD_MAX_PAGES 64
+// Maximum amount of queued readahead requests
+#define READAHEAD_QUEUE_MAX 32
+
+// Unified page cache, file data is cached by (FsNode, page index)
+// Nodes opt in by setting FsNode::pageCached, fs::Read and fs::Write then go through the cache.
+namespace fs::PageCache {
+
+struct CachedPage {
+    FsNode* node;
+    uint64_t index; // Offset of the page in the node >> PAGE_SHIFT_4K
+
+    uintptr_t physicalAddress;
+    uint8_t* data; // Kernel mapping of the page
+
+    size_t length; // Amount of valid bytes, less than a page at the end of a file
+
+    int refCount;           // Pinned pages cannot be evicted
+    volatile bool upToDate; // Set once the page has been read in
+    volatile bool error;    // Failed to read page
+    bool hashed;            // False once evicted or invalidated
+
+    CachedPage* hashNext;
+
+    // LRU list, most recently used at the front
+    CachedPage* next;
+    CachedPage* prev;
+};
+
+/////////////////////////////
+/// \brief Get a page of node, reading it in if necessary
+///
+/// The page is pinned and will not be evicted until it is released,
+/// allowing the underlying physical page to be mapped or handed to a device without copying.
+///
+/// \param node Node to read
+/// \param index Page index (offset >> PAGE_SHIFT_4K)
+///
+/// \return Pinned page on success, nullptr on I/O error
+/////////////////////////////
+CachedPage* GetPage(FsNode* node, uint64_t index);
+
+/////////////////////////////
+/// \brief Check whether a range of node can be read from the cache without waiting on I/O
+///
+/// Only a hint, the pages may be evicted at any time after returning.
+/////////////////////////////
+bool IsCached(FsNode* node, size_t offset, size_t size);
+
+/////////////////////////////
+/// \brief Unpin a page retrieved with GetPage
+/////////////////////////////
+void ReleasePage(CachedPage* page);
+
+/////////////////////////////
+/// \brief Read through the page cache
+///
+/// \return Bytes read or if negative an error code
+/////////////////////////////
+ssize_t Read(FsNode* node, size_t offset, size_t size, uint8_t* buffer);
+
+/////////////////////////////
+/// \brief Write to node and update any cached pages (write-through)
+///
+/// \return Bytes written or if negative an error code
+/////////////////////////////
+ssize_t Write(FsNode* node, size_t offset, size_t size, uint8_t* buffer);
+
+/////////////////////////////
+/// \brief Drop cached pages of node overlapping the range
+/////////////////////////////
+void Invalidate(FsNode* node, size_t offset, size_t size);
+
+/////////////////////////////
+/// \brief Drop all cached pages of node
+/////////////////////////////
+void InvalidateNode(FsNode* node);
+
+/////////////////////////////
+/// \brief Evict unpinned pages until at most maxPages are cached
+/////////////////////////////
+void Shrink(size_t maxPages);
+
+/////////////////////////////
+/// \return Amount of pages in the page cache
+/////////////////////////////
+size_t CachedPageCount();
+
+/////////////////////////////
+/// \brief Start the readahead thread
+/////////////////////////////
+void Initialize();
+
+/////////////////////////////
+/// \brief Note a read of an open file, reading ahead if access is sequential
+///
+/// The readahead window starts at READAHEAD_MIN_PAGES and doubles with each sequential read
+/// up to READAHEAD_MAX_PAGES. Pages are read in the background by the readahead thread,
+/// readers which catch up wait on the pages being read.
+///
+/// \param handle Open file being read, the file is kept open until the readahead completes
+/// \param offset Offset of the read
+/// \param size Size of the read
+/////////////////////////////
+void Readahead(const FancyRefPtr<UNIXOpenFile>& handle, size_t offset, size_t size);
+
+} // namespace fs::PageCache
@@ -11,6 +11,14 @@ public:
     ssize_t Read(size_t off, size_t size, uint8_t* buffer);
     ssize_t Write(size_t off, size_t size, uint8_t* buffer);
 
+    ssize_t ReadV(size_t off, const iovec* iov, int iovcnt);
+    ssize_t WriteV(size_t off, const iovec* iov, int iovcnt);
+
+    // Readable once there is data in the pipe or the write end has been closed
+    bool CanRead() { return end == ReadEnd && (widowed || stream->Pos() > 0); }
+    // Amount of bytes which can be read without blocking
+    size_t Available() { return stream->Pos(); }
+
     void Watch(FilesystemWatcher& watcher, int events);
     void Unwatch(FilesystemWatcher& watcher);
 
@@ -18,6 +26,11 @@ public:
 
     static void CreatePipe(UNIXPipe*& read, UNIXPipe*& write);
 protected:
+    // Wait until size bytes can be read or the write end is closed
+    int WaitForData(size_t size);
+    // Wake readers and watchers on the other end after a write
+    void NotifyReader();
+
     enum {
         InvalidPipe,
         ReadEnd,
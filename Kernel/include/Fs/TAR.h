@@ -64,6 +64,9 @@ namespace fs::tar {
         ino_t parentInode;
         int entryCount; // For Directories - Amount of child nodes
         ino_t* children; // For Directories - Inodes of children
+
+        uint32_t nameHash; // Hash of the parent inode and name
+        ino_t hashNext; // Next node in the same name index bucket, 0 if last
         
         ssize_t Read(size_t, size_t, uint8_t *);
         ssize_t Write(size_t, size_t, uint8_t *);
@@ -71,6 +74,8 @@ namespace fs::tar {
         int ReadDir(DirectoryEntry*, uint32_t);
         FsNode* FindDir(const char* name);
 
+        const uint8_t* ResidentData();
+
         TarVolume* vol;
     };
 
@@ -82,6 +87,12 @@ namespace fs::tar {
 
         ino_t nextNode = 1;
 
+        // Name index, buckets hold the inode of the first node in the chain (0 if empty)
+        ino_t* nameIndex;
+        unsigned nameIndexSize; // Power of two
+
+        void IndexNode(TarNode* node);
+
         int ReadDirectory(int index, ino_t parent);
         void MakeNode(tar_header_t* header, TarNode* n, ino_t inode, ino_t parent, tar_header_t* dirHeader = nullptr);
 
@@ -6,12 +6,44 @@
 #include <Hash.h>
 #include <Spinlock.h>
 
-#define TEMP_BUFFER_CHUNK_SIZE 1024UL // Must be power of two
-static_assert((TEMP_BUFFER_CHUNK_SIZE & (TEMP_BUFFER_CHUNK_SIZE - 1)) == 0);
+#include <Paging.h>
+
+// File data is kept in a radix tree of 4KB pages, each tree node holds TEMP_RADIX_SLOTS entries
+#define TEMP_RADIX_SHIFT 9
+#define TEMP_RADIX_SLOTS (1UL << TEMP_RADIX_SHIFT)
+#define TEMP_RADIX_MAX_HEIGHT ((64 - PAGE_SHIFT_4K + TEMP_RADIX_SHIFT - 1) / TEMP_RADIX_SHIFT)
+
+// Directory hash tables start with this many buckets and double once the load factor passes 2
+#define TEMP_DIR_INITIAL_BUCKETS 16
 
 namespace fs::Temp{
     class TempVolume;
 
+    struct TempDirent {
+        DirectoryEntry entry;
+        uint32_t hash;
+        // Insertion order, tells whether a removed entry came before the ReadDir cursor
+        uint64_t sequence;
+
+        TempDirent* hashNext;
+
+        // Entries in insertion order, the order ReadDir returns them in
+        TempDirent* next;
+        TempDirent* prev;
+    };
+
+    // Page of file data, the physical page can be mapped directly
+    struct TempPage {
+        uintptr_t physicalAddress;
+        uint8_t* data; // Kernel mapping of the page
+    };
+
+    // Leaf nodes (level 1) point to TempPages, other nodes point to the nodes below them.
+    // Missing entries are holes and read as zeros.
+    struct TempRadixNode {
+        void* slots[TEMP_RADIX_SLOTS];
+    };
+
     class TempNode final : public FsNode {
         friend class TempVolume;
     protected:
@@ -19,17 +51,42 @@ namespace fs::Temp{
         TempNode* parent;
 
         union {
-            struct{
-                List<DirectoryEntry> children;
+            struct {
+                lock_t directoryLock;
+                TempDirent** buckets;
+                unsigned bucketCount;
+                unsigned entryCount;
+
+                TempDirent* firstEntry;
+                TempDirent* lastEntry;
+                uint64_t nextSequence;
+
+                // Last entry returned by ReadDir and its index,
+                // sequential reads continue from here instead of walking the whole directory
+                TempDirent* cursor;
+                unsigned cursorIndex;
             };
             struct {
                 ReadWriteLock bufferLock;
-                uint8_t* buffer;
-                size_t bufferSize;
+                TempRadixNode* pageTree;
+                unsigned pageTreeHeight; // Levels in the page tree, 0 when empty
             };
         };
 
-        TempNode* Find(const char* name);
+        // Directory entries, directoryLock must be held
+        TempDirent* FindEntry(const char* name);
+        void InsertEntry(const DirectoryEntry& entry);
+        void RemoveEntry(TempDirent* entry);
+        TempDirent* EntryAt(unsigned index);
+
+        // Get the page at index, nullptr if it is a hole
+        TempPage* LookupPage(uint64_t index);
+        // Get the page at index, allocating it and any tree nodes if necessary
+        TempPage* GetPage(uint64_t index);
+        // Free all pages at or past index
+        void FreePages(uint64_t index);
+        // Returns true if the subtree is left empty
+        bool FreePages(TempRadixNode* tree, unsigned level, uint64_t base, uint64_t index);
     public:
         TempNode(TempVolume* v, int flags);
         ~TempNode();
@@ -40,6 +97,7 @@ namespace fs::Temp{
         int Truncate(off_t length); // Truncate file
 
         int ReadDir(DirectoryEntry*, uint32_t); // Read Directory
+        int ReadDirBatch(off_t& position, DirectoryFiller filler, void* context);
         FsNode* FindDir(const char* name); // Find in directory
 
         int Create(DirectoryEntry* entry, uint32_t mode); // Create regular file
@@ -58,15 +116,16 @@ namespace fs::Temp{
         uint32_t nextInode = 1;
         HashMap<uint32_t, TempNode*> nodes;
         TempNode* tempMountPoint;
-        unsigned memoryUsage = 0;
+        size_t memoryUsage = 0;
 
-        void ReallocateNode(TempNode* node, size_t old);
+        TempPage* AllocatePage();
+        void FreePage(TempPage* page);
     public:
 
         TempVolume(const char* name);
 
         void SetVolumeID(volume_id_t id);
 
-        inline unsigned GetMemoryUsage() { return memoryUsage; }
+        inline size_t GetMemoryUsage() { return memoryUsage; }
     };
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <Types.h>
+
+#define LZ4_FRAME_MAGIC 0x184D2204U
+
+// Frame descriptor flags
+#define LZ4_FLG_VERSION_MASK 0xC0
+#define LZ4_FLG_VERSION 0x40
+#define LZ4_FLG_BLOCK_INDEPENDENCE 0x20
+#define LZ4_FLG_BLOCK_CHECKSUM 0x10
+#define LZ4_FLG_CONTENT_SIZE 0x08
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+#define LZ4_FLG_DICTIONARY_ID 0x01
+
+// Set in a block size when the block is stored uncompressed
+#define LZ4_BLOCK_UNCOMPRESSED 0x80000000U
+
+/////////////////////////////
+/// \brief LZ4 frame format decoder
+///
+/// Decodes frames as described in the LZ4 frame format specification.
+/// Checksums are skipped over but not verified.
+/////////////////////////////
+namespace LZ4 {
+
+struct FrameInfo {
+    size_t headerSize;   // Size of the frame header, the first block starts here
+    size_t contentSize;  // Decompressed size, 0 if not present in the header
+    size_t blockMaxSize; // Maximum decompressed size of a block
+
+    bool hasContentSize;
+    bool independentBlocks; // Blocks do not reference data in previous blocks
+    bool blockChecksums;
+    bool contentChecksum;
+};
+
+/////////////////////////////
+/// \return true if data starts with an LZ4 frame
+/////////////////////////////
+bool IsFrame(const void* data, size_t size);
+
+/////////////////////////////
+/// \brief Parse the header of an LZ4 frame
+///
+/// \return 0 on success, otherwise a negative error code
+/////////////////////////////
+int GetFrameInfo(const void* data, size_t size, FrameInfo& info);
+
+/////////////////////////////
+/// \brief Decompress a single LZ4 block
+///
+/// \param prefix Amount of bytes before dest that matches may reference (previously decompressed data)
+///
+/// \return Bytes written to dest or if negative an error code
+/////////////////////////////
+ssize_t DecompressBlock(const uint8_t* src, size_t srcSize, uint8_t* dest, size_t destSize, size_t prefix = 0);
+
+/////////////////////////////
+/// \brief Decompress an LZ4 frame
+///
+/// If parallel is set and the frame has independent blocks, the blocks are decompressed
+/// on every processor with SMP::RunOnAllProcessors, so it may only be used before the scheduler is started.
+///
+/// \return Bytes written to dest or if negative an error code
+/////////////////////////////
+ssize_t DecompressFrame(const void* src, size_t srcSize, void* dest, size_t destSize, bool parallel = false);
+
+} // namespace LZ4
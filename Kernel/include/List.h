@@ -254,6 +254,14 @@ public:
         return o->next;
     }
 
+    __attribute__((always_inline)) inline T prev(const T& o) const {
+        if (o->prev == back) {
+            return nullptr;
+        }
+
+        return o->prev;
+    }
+
     __attribute__((always_inline)) inline T get_front() const { return front; }
 
     __attribute__((always_inline)) inline T get_back() const { return back; }
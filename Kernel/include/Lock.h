@@ -81,60 +81,221 @@ public:
     void Signal();
 };
 
+#define RWLOCK_READER_INCREMENT 0x100
+#define RWLOCK_WRITER_BITS 0x3
+#define RWLOCK_PHASE_ID 0x1
+#define RWLOCK_WRITER_PRESENT 0x2
+
+#define RWLOCK_SPIN_COUNT 1024 // Number of times to spin before blocking
+
+/////////////////////////////
+/// \brief Phase-fair reader-writer lock
+///
+/// Readers and writers alternate in phases so neither can starve the other.
+/// A reader waits for at most one writer phase and a writer waits for at most one reader phase.
+/// Writers are served in FIFO order through tickets.
+///
+/// Waiters spin for a short while then block. If interrupts are disabled the waiter keeps spinning.
+/////////////////////////////
 class ReadWriteLock {
-    unsigned activeReaders = 0;
-    lock_t fileLock = 0;
-    lock_t lock = 0;
+    class ReadWriteLockBlocker : public ThreadBlocker {
+        friend class ReadWriteLock;
 
-    bool writerAcquiredLock = false; // Whether or not the writer has acquired lock (but not fileLock) 
+    public:
+        ReadWriteLockBlocker* next = nullptr;
+        ReadWriteLockBlocker* prev = nullptr;
 
-    FastList<Thread*> readers;
-    FastList<Thread*> writers;
-public:
+        ReadWriteLock* rwLock;
+        bool queued = false;
 
-    ALWAYS_INLINE ReadWriteLock() {}
+        ALWAYS_INLINE ReadWriteLockBlocker(ReadWriteLock* lock) : rwLock(lock) {}
+        ~ReadWriteLockBlocker();
+    };
+
+    // Upper bits count readers, lower bits hold the writer present flag and phase ID
+    volatile unsigned m_readersIn = 0;
+    volatile unsigned m_readersOut = 0;
+    // Writer tickets
+    volatile unsigned m_writersIn = 0;
+    volatile unsigned m_writersOut = 0;
+
+    volatile unsigned m_waiterCount = 0;
+    lock_t m_waitersLock = 0;
+    FastList<ReadWriteLockBlocker*> m_waiters;
+
+    /////////////////////////////
+    /// \brief Wait until ((*word & mask) == value) == equal
+    /////////////////////////////
+    void Wait(volatile unsigned* word, unsigned mask, unsigned value, bool equal);
+    void WakeWaiters();
+
+    ALWAYS_INLINE void WakeIfWaiting() {
+        if (__atomic_load_n(&m_waiterCount, __ATOMIC_SEQ_CST)) {
+            WakeWaiters();
+        }
+    }
 
-    ALWAYS_INLINE void AcquireRead(){
-        acquireLock(&lock);
+public:
+    ALWAYS_INLINE ReadWriteLock() {}
 
-        if(__atomic_add_fetch(&activeReaders, 1, __ATOMIC_ACQUIRE) == 1){ // We are the first reader
-            acquireLock(&fileLock);
+    ALWAYS_INLINE void AcquireRead() {
+        unsigned w = __atomic_fetch_add(&m_readersIn, RWLOCK_READER_INCREMENT, __ATOMIC_SEQ_CST) & RWLOCK_WRITER_BITS;
+        if (w) {
+            // Wait for the writer phase to end
+            Wait(&m_readersIn, RWLOCK_WRITER_BITS, w, false);
         }
+    }
 
-        releaseLock(&lock);
+    /////////////////////////////
+    /// \brief Attempt to acquire a read lock without waiting
+    ///
+    /// \return true if the read lock was acquired, false if a writer holds or is waiting on the lock
+    /////////////////////////////
+    ALWAYS_INLINE bool TryAcquireRead() {
+        // Only enter when no writer is present. Backing out through m_readersOut would
+        // break the count a waiting writer expects, so m_readersIn is never touched on failure.
+        unsigned readersIn = __atomic_load_n(&m_readersIn, __ATOMIC_RELAXED);
+        do {
+            if (readersIn & RWLOCK_WRITER_BITS) {
+                return false;
+            }
+        } while (!__atomic_compare_exchange_n(&m_readersIn, &readersIn, readersIn + RWLOCK_READER_INCREMENT, true,
+                                              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+        return true;
     }
 
-    ALWAYS_INLINE void AcquireWrite(){
-        acquireLock(&lock); // Stop more threads from reading
-        acquireLock(&fileLock);
+    ALWAYS_INLINE void AcquireWrite() {
+        unsigned ticket = __atomic_fetch_add(&m_writersIn, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&m_writersOut, __ATOMIC_ACQUIRE) != ticket) {
+            Wait(&m_writersOut, ~0U, ticket, true); // Wait for writers ahead of us
+        }
+
+        // Block new readers and wait for existing readers to leave
+        unsigned readers = __atomic_fetch_add(&m_readersIn, RWLOCK_WRITER_PRESENT | (ticket & RWLOCK_PHASE_ID),
+                                              __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&m_readersOut, __ATOMIC_ACQUIRE) != readers) {
+            Wait(&m_readersOut, ~0U, readers, true);
+        }
     }
 
-    ALWAYS_INLINE bool TryAcquireWrite(){
-        if(!writerAcquiredLock && acquireTestLock(&lock)){ // Stop more threads from reading
-            return true;
+    /////////////////////////////
+    /// \brief Attempt to acquire a write lock
+    ///
+    /// Fails if another writer holds or is waiting on the lock, or if there are active readers.
+    /// May briefly wait on readers which entered whilst the lock was being acquired.
+    ///
+    /// \return true if the write lock was acquired
+    /////////////////////////////
+    ALWAYS_INLINE bool TryAcquireWrite() {
+        unsigned ticket = __atomic_load_n(&m_writersIn, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&m_writersOut, __ATOMIC_ACQUIRE) != ticket) {
+            return false;
+        }
+
+        if ((__atomic_load_n(&m_readersIn, __ATOMIC_ACQUIRE) & ~RWLOCK_WRITER_BITS) !=
+            __atomic_load_n(&m_readersOut, __ATOMIC_ACQUIRE)) {
+            return false;
         }
-        writerAcquiredLock = true; // No need to acquire lock next time when we come back
 
-        if(acquireTestLock(&fileLock)){
-            return true;
+        if (!__atomic_compare_exchange_n(&m_writersIn, &ticket, ticket + 1, false, __ATOMIC_SEQ_CST,
+                                         __ATOMIC_RELAXED)) {
+            return false;
         }
-        writerAcquiredLock = false;
 
-        return false;
+        unsigned readers = __atomic_fetch_add(&m_readersIn, RWLOCK_WRITER_PRESENT | (ticket & RWLOCK_PHASE_ID),
+                                              __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&m_readersOut, __ATOMIC_ACQUIRE) != readers) {
+            Wait(&m_readersOut, ~0U, readers, true);
+        }
+
+        return true;
+    }
+
+    ALWAYS_INLINE void ReleaseRead() {
+        __atomic_add_fetch(&m_readersOut, RWLOCK_READER_INCREMENT, __ATOMIC_SEQ_CST);
+        WakeIfWaiting();
+    }
+
+    ALWAYS_INLINE void ReleaseWrite() {
+        __atomic_fetch_and(&m_readersIn, ~RWLOCK_WRITER_BITS, __ATOMIC_SEQ_CST); // Let readers in
+        __atomic_add_fetch(&m_writersOut, 1, __ATOMIC_SEQ_CST);                  // Let the next writer in
+        WakeIfWaiting();
+    }
+
+    ALWAYS_INLINE bool IsWriteLocked() const {
+        unsigned readersIn = __atomic_load_n(&m_readersIn, __ATOMIC_ACQUIRE);
+        return (readersIn & RWLOCK_WRITER_PRESENT) &&
+               (readersIn & ~RWLOCK_WRITER_BITS) == __atomic_load_n(&m_readersOut, __ATOMIC_ACQUIRE);
     }
+};
+
+#define PERCPU_RWLOCK_SLOTS 16
+
+/////////////////////////////
+/// \brief Read-mostly reader-writer lock with per-CPU reader counts
+///
+/// Readers only touch the cache line belonging to their CPU, so concurrent readers do not contend.
+/// Writers are expensive as they must wait for the reader count of every CPU to drain.
+///
+/// AcquireRead returns a token which must be passed to ReleaseRead, as the thread may migrate to another CPU.
+/////////////////////////////
+class PerCPUReadWriteLock {
+    struct alignas(64) ReaderSlot {
+        volatile long count = 0;
+    };
+
+    ReaderSlot m_slots[PERCPU_RWLOCK_SLOTS];
+    volatile int m_writer = 0;
+
+public:
+    ALWAYS_INLINE PerCPUReadWriteLock() {}
+
+    PerCPUReadWriteLock(const PerCPUReadWriteLock&) = delete;
+    PerCPUReadWriteLock& operator=(const PerCPUReadWriteLock&) = delete;
+
+    [[nodiscard]] ALWAYS_INLINE unsigned AcquireRead() {
+        unsigned slot = GetCPULocal()->id % PERCPU_RWLOCK_SLOTS;
+        for (;;) {
+            __atomic_add_fetch(&m_slots[slot].count, 1, __ATOMIC_SEQ_CST);
+            if (!__atomic_load_n(&m_writer, __ATOMIC_SEQ_CST)) {
+                return slot;
+            }
 
-    ALWAYS_INLINE void ReleaseRead(){
-        if(__atomic_sub_fetch(&activeReaders, 1, __ATOMIC_RELEASE) == 0){
-            releaseLock(&fileLock);
+            // Back off and let the writer through
+            __atomic_sub_fetch(&m_slots[slot].count, 1, __ATOMIC_RELEASE);
+            while (__atomic_load_n(&m_writer, __ATOMIC_ACQUIRE)) {
+                asm volatile("pause");
+            }
         }
     }
 
-    ALWAYS_INLINE void ReleaseWrite(){
-        releaseLock(&fileLock);
-        releaseLock(&lock);
+    ALWAYS_INLINE void ReleaseRead(unsigned slot) { __atomic_sub_fetch(&m_slots[slot].count, 1, __ATOMIC_RELEASE); }
+
+    ALWAYS_INLINE void AcquireWrite() {
+        while (__atomic_exchange_n(&m_writer, 1, __ATOMIC_SEQ_CST)) {
+            asm volatile("pause");
+        }
+
+        for (unsigned i = 0; i < PERCPU_RWLOCK_SLOTS; i++) {
+            while (__atomic_load_n(&m_slots[i].count, __ATOMIC_SEQ_CST)) {
+                asm volatile("pause");
+            }
+        }
     }
 
-    ALWAYS_INLINE bool IsWriteLocked() const { return lock && activeReaders == 0; }
+    ALWAYS_INLINE void ReleaseWrite() { __atomic_store_n(&m_writer, 0, __ATOMIC_RELEASE); }
+
+    ALWAYS_INLINE bool IsWriteLocked() const { return m_writer; }
+};
+
+template <typename T> class ScopedWriteLock final {
+public:
+    ALWAYS_INLINE ScopedWriteLock(T& lock) : m_lock(lock) { m_lock.AcquireWrite(); }
+    ALWAYS_INLINE ~ScopedWriteLock() { m_lock.ReleaseWrite(); }
+
+private:
+    T& m_lock;
 };
 
 using FilesystemLock = ReadWriteLock;
\ No newline at end of file
@@ -33,6 +33,7 @@ public:
     /// \brief Find and write lock a region from an address
     ///
     /// Due to the lock, the region cannot be deallocated or modified until this thread releases the write lock.
+    /// The region list lock is taken before region locks, so the lock must be released before unmapping memory.
     ///
     /// \param address Address of region
     ///
@@ -50,15 +51,6 @@ public:
     /////////////////////////////
     bool RangeInRegion(uintptr_t base, size_t size);
 
-    /////////////////////////////
-    /// \brief Unmap a region object
-    ///
-    /// Unmaps a region object. It is expected that the caller has acquired a write lock
-    ///
-    /// \return 0 if sucessful
-    /////////////////////////////
-    long UnmapRegion(MappedRegion* region);
-
     [[nodiscard]] MappedRegion* MapVMO(FancyRefPtr<VMObject> obj, uintptr_t base, bool fixed);
     MappedRegion* AllocateAnonymousVMObject(size_t size, uintptr_t base, bool fixed);
     AddressSpace* Fork();
@@ -70,9 +62,9 @@ public:
 
     ALWAYS_INLINE PageMap* GetPageMap() { return m_pageMap; }
 
-    ALWAYS_INLINE lock_t* GetLock() { return &m_lock; }
-
 protected:
+    // Expects the region list lock to be held
+    MappedRegion* FindRegion(uintptr_t address);
     MappedRegion* FindAvailableRegion(size_t size);
     MappedRegion* AllocateRegionAt(uintptr_t base, size_t size);
 
@@ -83,7 +75,8 @@ protected:
     uintptr_t m_startRegion = 0; // Start of the address space (0 for usermode, KERNEL_VIRTUAL_BASE for kernel)
     uintptr_t m_endRegion = KERNEL_VIRTUAL_BASE;   // End of the address space (KERNEL_VIRTUAL_BASE for usermode, UINT64_MAX for kernel)
 
-    lock_t m_lock = 0;
+    // Region lookups (e.g. on page fault) are far more common than changes to the region list
+    PerCPUReadWriteLock m_lock;
 
     PageMap* m_pageMap = nullptr;
     List<MappedRegion> m_regions;
@@ -18,6 +18,9 @@
 
 #define CONNECTION_BACKLOG 128
 
+// Largest amount of data gathered into one send or scattered from one receive by ReadV/WriteV
+#define SOCKET_IOV_BUFFER_MAX 65536
+
 #define STREAM_MAX_BUFSIZE 0x20000 // 128 KB
 
 struct rtentry {
@@ -113,6 +116,10 @@ class Socket : public FsNode {
     virtual int64_t Send(void* buffer, size_t len, int flags);
     virtual ssize_t Write(size_t offset, size_t size, uint8_t* buffer);
 
+    // Vectored I/O is a single receive or send so datagrams are not split
+    virtual ssize_t ReadV(size_t offset, const iovec* iov, int iovcnt);
+    virtual ssize_t WriteV(size_t offset, const iovec* iov, int iovcnt);
+
     virtual int SetSocketOptions(int level, int opt, const void* optValue, socklen_t optLength);
     virtual int GetSocketOptions(int level, int opt, void* optValue, socklen_t* optLength);
 
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <ABI/IORing.h>
+
+#include <Error.h>
+#include <Fs/Filesystem.h>
+#include <List.h>
+#include <Lock.h>
+#include <MM/VMObject.h>
+#include <Objects/KObject.h>
+#include <RefPtr.h>
+
+// Amount of kernel threads executing operations which would block
+#define IORING_WORKER_COUNT 2
+// Most bytes of a file write copied into the kernel for a worker, longer writes are short
+#define IORING_MAX_WRITE_COPY (1024 * 1024)
+
+class Process;
+
+/////////////////////////////
+/// \brief Memory shared between a ring and userspace
+///
+/// All pages are allocated up front and mapped into the kernel,
+/// so completions can be posted from any address space.
+/////////////////////////////
+class IORingVMObject final : public PhysicalVMObject {
+public:
+    IORingVMObject(size_t size);
+    ~IORingVMObject();
+
+    ALWAYS_INLINE void* KernelMapping() { return m_kernelMapping; }
+
+    ALWAYS_INLINE bool CanMunmap() const override { return true; }
+
+private:
+    void* m_kernelMapping;
+};
+
+struct IORingRequest {
+    ioring_sqe sqe; // Copy of the submission, userspace may reuse the entry once consumed
+    // File the operation works on. For IORING_OP_OPENAT the directory,
+    // replaced by the opened file once a worker has opened it.
+    FancyRefPtr<UNIXOpenFile> handle = nullptr;
+    uint8_t* buffer = nullptr; // Kernel copy of the write payload or path, workers cannot touch user memory
+
+    uint64_t deadline = 0; // Uptime in microseconds at which a timeout expires
+    long workResult = 0;   // Error a worker ran into opening a file
+    bool workDone = false; // A worker has done its part, the operation completes in the owning process
+
+    ~IORingRequest() { delete[] buffer; }
+};
+
+/////////////////////////////
+/// \brief Asynchronous submission and completion queues
+///
+/// Operations are started when submitted with Enter.
+/// Operations which can complete without blocking run inline.
+/// Operations on sockets, pipes and devices which are not ready are parked
+/// and retried from Enter once the file signals readiness, so they never tie up a thread.
+/// File reads which would wait on the disk, file writes, opens and fsync are handed to worker threads.
+///
+/// Workers never touch user memory. File write payloads and paths are copied into the kernel on submission.
+/// For reads a worker only reads the pages into the page cache and for opens it only opens the file,
+/// the copy to the user buffer and the handle allocation happen on the next call to Enter in the owning process.
+/// Callers waiting on completions should call Enter with IORING_ENTER_GETEVENTS.
+/////////////////////////////
+class IORing final : public KernelObject {
+    DECLARE_KOBJECT(IORing);
+
+public:
+    /////////////////////////////
+    /// \brief Create a ring and map it into the address space of proc
+    ///
+    /// \param entries Amount of submission queue entries, rounded up to a power of two
+    /////////////////////////////
+    static ErrorOr<FancyRefPtr<IORing>> Create(Process* proc, unsigned entries);
+
+    ~IORing();
+
+    ALWAYS_INLINE uintptr_t UserBase() const { return m_userBase; }
+    ALWAYS_INLINE size_t Size() const { return m_size; }
+    ALWAYS_INLINE unsigned SubmissionEntries() const { return m_sqEntries; }
+    ALWAYS_INLINE unsigned CompletionEntries() const { return m_cqEntries; }
+
+    /////////////////////////////
+    /// \brief Submit and optionally wait on operations
+    ///
+    /// \param ring Ring to enter, kept alive by operations handed to workers
+    /// \param proc Owning process, must be the current process
+    /// \param toSubmit Maximum amount of submission queue entries to consume
+    /// \param minComplete With IORING_ENTER_GETEVENTS, wait until at least this many completions are in the queue
+    ///
+    /// \return Amount of entries consumed or if negative an error code
+    /////////////////////////////
+    static long Enter(const FancyRefPtr<IORing>& ring, Process* proc, unsigned toSubmit, unsigned minComplete,
+                      unsigned flags);
+
+private:
+    IORing() = default;
+
+    // Consume up to count submissions
+    long Submit(const FancyRefPtr<IORing>& self, Process* proc, unsigned count);
+    // Start an operation, it will either complete, be parked or be handed to a worker
+    void Dispatch(const FancyRefPtr<IORing>& self, Process* proc, const ioring_sqe& sqe);
+    // Run an operation, returns -EAGAIN if it would block
+    long Execute(Process* proc, IORingRequest* req);
+    // Retry parked operations and expire timeouts.
+    // If watcher is set, the files of operations which are still blocked are watched with it
+    // and deadline is set to the earliest timeout.
+    void RunPending(Process* proc, FilesystemWatcher* watcher, uint64_t* deadline);
+
+    void Park(IORingRequest* req);
+    void Complete(uint64_t userData, long result);
+    unsigned CompletionsReady();
+    void WakeWaiters();
+
+    static void QueueWork(const FancyRefPtr<IORing>& ring, IORingRequest* req);
+    static void WorkerThread();
+
+    FancyRefPtr<IORingVMObject> m_vmo;
+    ioring_shared* m_shared = nullptr;
+    ioring_sqe* m_sqes = nullptr;
+    ioring_cqe* m_cqes = nullptr;
+
+    uintptr_t m_userBase = 0;
+    size_t m_size = 0;
+
+    // Our own copies, userspace may scribble over the shared header
+    unsigned m_sqEntries = 0;
+    unsigned m_cqEntries = 0;
+    uint32_t m_sqHead = 0;
+    uint32_t m_cqTail = 0;
+
+    FilesystemLock m_enterLock; // Serializes submission and retrying of parked operations
+    lock_t m_cqLock = 0;
+
+    lock_t m_lock = 0; // Protects m_pending and m_waiters
+    List<IORingRequest*> m_pending;
+    List<FilesystemWatcher*> m_waiters;
+};
@@ -19,6 +19,7 @@ enum class KOTypeID : int {
     Service,
     UNIXOpenFile,
     Process,
+    IORing,
 };
 
 #define DECLARE_KOBJECT(type)                                                                                          \
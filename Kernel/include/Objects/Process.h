@@ -377,6 +377,7 @@ public:
     }
 
     char name[NAME_MAX + 1];
+    char execPath[PATH_MAX + 1]; // Absolute path of the running executable, empty for kernel processes
 
     FancyRefPtr<UNIXOpenFile> workingDir;
     char workingDirPath[PATH_MAX + 1];
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <Compiler.h>
+#include <CPU.h>
+
+#define RCU_READER_SLOTS 16
+
+/////////////////////////////
+/// \brief Read-copy-update
+///
+/// Readers traverse RCU protected data without taking any locks,
+/// they only mark themselves as active in a per-CPU counter.
+/// Writers unpublish data then either wait for a grace period with Synchronize(),
+/// or defer freeing with Retire() so that readers which may still hold references
+/// are guaranteed to have finished.
+/////////////////////////////
+namespace RCU {
+
+struct ReadToken {
+    unsigned slot;
+    unsigned epoch;
+};
+
+struct alignas(64) ReaderSlot {
+    volatile long count[2] = {0, 0}; // Readers active in each epoch parity
+};
+
+extern ReaderSlot readers[RCU_READER_SLOTS];
+extern volatile unsigned epoch;
+
+/////////////////////////////
+/// \brief Enter an RCU read-side critical section
+///
+/// The thread may block whilst in the critical section, however doing so will delay reclamation.
+///
+/// \return Token to be passed to ReadUnlock
+/////////////////////////////
+[[nodiscard]] ALWAYS_INLINE ReadToken ReadLock() {
+    unsigned slot = GetCPULocal()->id % RCU_READER_SLOTS;
+    for (;;) {
+        unsigned e = __atomic_load_n(&epoch, __ATOMIC_SEQ_CST) & 1;
+        __atomic_add_fetch(&readers[slot].count[e], 1, __ATOMIC_SEQ_CST);
+
+        // If a writer flipped the epoch before we were counted,
+        // it may not have waited for us so try again with the new epoch
+        if ((__atomic_load_n(&epoch, __ATOMIC_SEQ_CST) & 1) == e) {
+            return {slot, e};
+        }
+
+        __atomic_sub_fetch(&readers[slot].count[e], 1, __ATOMIC_RELEASE);
+    }
+}
+
+ALWAYS_INLINE void ReadUnlock(ReadToken token) {
+    __atomic_sub_fetch(&readers[token.slot].count[token.epoch], 1, __ATOMIC_RELEASE);
+}
+
+/////////////////////////////
+/// \brief Load an RCU protected pointer
+/////////////////////////////
+template <typename T> ALWAYS_INLINE T* Dereference(T* const volatile& ptr) {
+    return __atomic_load_n(&ptr, __ATOMIC_ACQUIRE);
+}
+
+/////////////////////////////
+/// \brief Publish an RCU protected pointer
+///
+/// The object must be fully initialized before being published.
+/////////////////////////////
+template <typename T> ALWAYS_INLINE void Assign(T* volatile& ptr, T* value) {
+    __atomic_store_n(&ptr, value, __ATOMIC_RELEASE);
+}
+
+/////////////////////////////
+/// \brief Wait until all pre-existing read-side critical sections have finished
+///
+/// May block, do not call from an RCU read-side critical section.
+/////////////////////////////
+void Synchronize();
+
+/////////////////////////////
+/// \brief Defer a callback until after a grace period
+///
+/// Safe to call with spinlocks held and interrupts disabled.
+///
+/// \param callback Function to call after the grace period, usually frees \a data
+/////////////////////////////
+void Retire(void (*callback)(void*), void* data);
+
+/////////////////////////////
+/// \brief Wait for a grace period then run all retired callbacks
+///
+/// Called periodically by the kernel reaper thread.
+/////////////////////////////
+void Reclaim();
+
+} // namespace RCU
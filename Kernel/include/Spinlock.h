@@ -6,7 +6,61 @@ typedef volatile int lock_t;
 #include <Compiler.h>
 
 //#define CHECK_DEADLOCK
-#ifdef CHECK_DEADLOCK
+#ifdef KERNEL_LOCK_PROFILING
+// Lock profiling build (see LockProfiler.cpp),
+// every acquisition is recorded against the call site (file and line)
+namespace LockProfiler {
+// Called once the lock has been acquired
+void Acquired(lock_t* lock, const char* file, int line, uintptr_t ip, uint64_t spinCycles, bool contended);
+// Called just before the lock is released
+void Released(lock_t* lock);
+} // namespace LockProfiler
+
+#define lockProfilerIP()                                                                                               \
+    ({                                                                                                                 \
+        uintptr_t __ip;                                                                                                \
+        asm volatile("lea 0(%%rip), %0" : "=r"(__ip));                                                                 \
+        __ip;                                                                                                          \
+    })
+
+#define lockProfilerTSC()                                                                                              \
+    ({                                                                                                                 \
+        uint32_t __lo, __hi;                                                                                           \
+        asm volatile("rdtsc" : "=a"(__lo), "=d"(__hi));                                                                \
+        ((uint64_t)__hi << 32) | __lo;                                                                                 \
+    })
+
+#define acquireLockProfiled(lock, file, line)                                                                          \
+    ({                                                                                                                 \
+        uint64_t __spinCycles = 0;                                                                                     \
+        bool __contended = __atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE);                                             \
+        if (__contended) {                                                                                             \
+            uint64_t __spinStart = lockProfilerTSC();                                                                  \
+            while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))                                                     \
+                asm("pause");                                                                                          \
+            __spinCycles = lockProfilerTSC() - __spinStart;                                                            \
+        }                                                                                                              \
+        LockProfiler::Acquired(lock, file, line, lockProfilerIP(), __spinCycles, __contended);                         \
+    })
+
+#define acquireLockIntDisableProfiled(lock, file, line)                                                                \
+    ({                                                                                                                 \
+        uint64_t __spinCycles = 0;                                                                                     \
+        asm volatile("cli");                                                                                           \
+        bool __contended = __atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE);                                             \
+        if (__contended) {                                                                                             \
+            uint64_t __spinStart = lockProfilerTSC();                                                                  \
+            while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))                                                     \
+                asm volatile("sti; pause; cli");                                                                       \
+            __spinCycles = lockProfilerTSC() - __spinStart;                                                            \
+        }                                                                                                              \
+        LockProfiler::Acquired(lock, file, line, lockProfilerIP(), __spinCycles, __contended);                         \
+    })
+
+#define acquireLock(lock) acquireLockProfiled(lock, __FILE__, __LINE__)
+#define acquireLockIntDisable(lock) acquireLockIntDisableProfiled(lock, __FILE__, __LINE__)
+
+#elif defined(CHECK_DEADLOCK)
 #include <Assert.h>
 
 #define acquireLock(lock)                                                                                              \
@@ -47,6 +101,23 @@ typedef volatile int lock_t;
 
 #endif
 
+#ifdef KERNEL_LOCK_PROFILING
+#define releaseLock(lock)                                                                                              \
+    ({                                                                                                                 \
+        LockProfiler::Released(lock);                                                                                  \
+        __atomic_store_n(lock, 0, __ATOMIC_RELEASE);                                                                   \
+    });
+
+#define acquireTestLock(lock)                                                                                          \
+    ({                                                                                                                 \
+        int status;                                                                                                    \
+        status = __atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE);                                                       \
+        if (!status) {                                                                                                 \
+            LockProfiler::Acquired(lock, __FILE__, __LINE__, lockProfilerIP(), 0, false);                              \
+        }                                                                                                              \
+        status;                                                                                                        \
+    })
+#else
 #define releaseLock(lock) ({ __atomic_store_n(lock, 0, __ATOMIC_RELEASE); });
 
 #define acquireTestLock(lock)                                                                                          \
@@ -55,9 +126,26 @@ typedef volatile int lock_t;
         status = __atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE);                                                       \
         status;                                                                                                        \
     })
+#endif
 
 template <bool disableInterrupts = false> class ScopedSpinLock final {
 public:
+#ifdef KERNEL_LOCK_PROFILING
+    // Attribute the acquisition to where the ScopedSpinLock was declared
+    ALWAYS_INLINE ScopedSpinLock(lock_t& lock, const char* file = __builtin_FILE(), int line = __builtin_LINE())
+        : m_lock(lock) {
+        if constexpr (disableInterrupts) {
+            m_irq = CheckInterrupts();
+            if (m_irq) {
+                acquireLockIntDisableProfiled(&m_lock, file, line);
+            } else {
+                acquireLockProfiled(&m_lock, file, line);
+            }
+        } else {
+            acquireLockProfiled(&m_lock, file, line);
+        }
+    }
+#else
     ALWAYS_INLINE ScopedSpinLock(lock_t& lock) : m_lock(lock) {
         if constexpr (disableInterrupts) {
             m_irq = CheckInterrupts();
@@ -70,6 +158,7 @@ public:
             acquireLock(&m_lock);
         }
     }
+#endif
     ALWAYS_INLINE ~ScopedSpinLock() {
         releaseLock(&m_lock);
 
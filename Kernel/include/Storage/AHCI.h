@@ -358,8 +358,18 @@ namespace AHCI{
 		int AcquireBuffer();
 		void ReleaseBuffer(int index);
 
+		// Physically contiguous part of a transfer
+		struct DMARegion {
+			uintptr_t phys;
+			uint32_t size;
+		};
+
 		int FindCmdSlot();
 		int Access(uint64_t lba, uint32_t count, uintptr_t physBuffer, int write);
+		int Access(uint64_t lba, uint32_t count, const DMARegion* regions, unsigned regionCount, int write);
+		// Transfer straight to/from a kernel heap buffer without using the bounce buffers,
+		// returns 1 if the buffer cannot be used for DMA
+		int AccessDirect(uint64_t lba, uint32_t count, uint8_t* buffer, int write);
 		void Identify();
 
 		hba_port_t* registers;
@@ -183,7 +183,7 @@ public:
         for (unsigned i = 0; i < count; i++) {
             if (data[i] == val) {
                 EraseUnlocked(i);
-                return;
+                break;
             }
         }
 
@@ -51,6 +51,27 @@ uint64_t VirtualToPhysicalAddress(uint64_t addr) {
     return address;
 }
 
+uintptr_t KernelHeapVirtualToPhysical(uintptr_t addr) {
+    if (PML4_GET_INDEX(addr) != KERNEL_HEAP_PML4_INDEX || PDPT_GET_INDEX(addr) != KERNEL_HEAP_PDPT_INDEX) {
+        return 0;
+    }
+
+    uint32_t pageDirIndex = PAGE_DIR_GET_INDEX(addr);
+    if (!(kernelHeapDir[pageDirIndex] & PAGE_PRESENT)) {
+        return 0;
+    } else if (kernelHeapDir[pageDirIndex] & 0x80) { // 2MB page
+        return (static_cast<uintptr_t>(GetPageFrame(kernelHeapDir[pageDirIndex])) << 12) +
+               (addr & (PAGE_SIZE_2M - 1));
+    }
+
+    page_t page = kernelHeapDirTables[pageDirIndex][PAGE_TABLE_GET_INDEX(addr)];
+    if (!(page & PAGE_PRESENT)) {
+        return 0;
+    }
+
+    return (static_cast<uintptr_t>(GetPageFrame(page)) << 12) + (addr & (PAGE_SIZE_4K - 1));
+}
+
 uint64_t VirtualToPhysicalAddress(uint64_t addr, page_map_t* addressSpace) {
     uint64_t address = 0;
 
@@ -332,6 +353,43 @@ bool CheckUsermodePointer(uintptr_t addr, uint64_t len, AddressSpace* addressSpa
     return addressSpace->RangeInRegion(addr, len);
 }
 
+bool CheckUsermodePointerUnlocked(uintptr_t addr, uint64_t len, PageMap* pageMap) {
+    if (!len || addr + len < addr) {
+        return false;
+    }
+
+    for (uintptr_t page = addr & ~(PAGE_SIZE_4K - 1); page < addr + len; page += PAGE_SIZE_4K) {
+        if (PML4_GET_INDEX(page) != 0) {
+            return false; // Process address space is only the first PML4 entry
+        }
+
+        uint32_t pdptIndex = PDPT_GET_INDEX(page);
+        uint32_t pageDirIndex = PAGE_DIR_GET_INDEX(page);
+        if (!(pageMap->pdpt[pdptIndex] & PDPT_PRESENT)) {
+            return false;
+        }
+
+        pd_entry_t dir = pageMap->pageDirs[pdptIndex][pageDirIndex];
+        if (!(dir & PAGE_PRESENT) || !(dir & PDE_USER)) {
+            return false;
+        } else if (dir & PDE_2M) {
+            continue;
+        }
+
+        page_t* table = pageMap->pageTables[pdptIndex][pageDirIndex];
+        if (!table) {
+            return false;
+        }
+
+        page_t pte = table[PAGE_TABLE_GET_INDEX(page)];
+        if (!(pte & PAGE_PRESENT) || !(pte & PAGE_USER)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void* Allocate4KPages(uint64_t amount, PageMap* pageMap) {
     uint64_t offset = 0;
     uint64_t pageDirOffset = 0;
@@ -0,0 +1,177 @@
+#include <Profiler.h>
+
+#include <ABI/Profiler.h>
+#include <Assert.h>
+#include <CString.h>
+#include <Device.h>
+#include <Errno.h>
+#include <SMP.h>
+#include <Scheduler.h>
+#include <StackTrace.h>
+#include <Symbols.h>
+#include <Thread.h>
+#include <UserPointer.h>
+
+// Amount of samples each CPU can buffer before they are dropped
+#define PROFILER_BUFFER_SAMPLES 2048
+
+namespace Profiler {
+
+// Single producer (the CPU in its timer interrupt), single consumer (the profiler device) ring buffer
+struct SampleBuffer {
+    profiler_sample_t samples[PROFILER_BUFFER_SAMPLES];
+    volatile uint64_t head; // Written by the CPU
+    volatile uint64_t tail; // Written by the reader
+
+    uint64_t lastTick; // Last profiler tick sampled on this CPU
+};
+
+bool enabled = false;
+
+static SampleBuffer** buffers = nullptr;
+static unsigned bufferCount = 0;
+
+static volatile uint64_t profilerTicks = 0;
+static uint64_t sampleInterval = 1; // Timer ticks between samples
+static uint64_t dropped = 0;
+
+static lock_t readerLock = 0;
+
+void Tick() {
+    if (enabled) {
+        __atomic_add_fetch(&profilerTicks, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void TakeSample(CPU* cpu, RegisterContext* r) {
+    assert(!CheckInterrupts());
+
+    if (cpu->id >= bufferCount || !cpu->currentThread) {
+        return;
+    }
+
+    // Schedule also runs when a thread yields,
+    // only take one sample per interval
+    SampleBuffer* buffer = buffers[cpu->id];
+    uint64_t tick = __atomic_load_n(&profilerTicks, __ATOMIC_RELAXED);
+    if (tick - buffer->lastTick < sampleInterval) {
+        return;
+    }
+    buffer->lastTick = tick;
+
+    uint64_t head = buffer->head;
+    if (head - __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE) >= PROFILER_BUFFER_SAMPLES) {
+        __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    Thread* thread = cpu->currentThread;
+    profiler_sample_t& sample = buffer->samples[head % PROFILER_BUFFER_SAMPLES];
+    sample.pid = thread->parent->PID();
+    sample.tid = thread->tid;
+    sample.cpu = cpu->id;
+    sample.flags = 0;
+
+    sample.frames[0] = r->rip;
+    if (r->cs & 0x3) {
+        sample.flags |= PROFILER_SAMPLE_USER;
+        sample.frameCount =
+            1 + UserGetStackTrace(r->rbp, thread->parent->GetPageMap(), sample.frames + 1, PROFILER_MAX_FRAMES - 1);
+    } else {
+        sample.frameCount = 1 + GetStackTrace(r->rbp, sample.frames + 1, PROFILER_MAX_FRAMES - 1);
+    }
+
+    __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void Start(uint64_t interval) {
+    enabled = false;
+
+    if (!buffers) {
+        bufferCount = SMP::processorCount;
+        buffers = new SampleBuffer*[bufferCount];
+        for (unsigned i = 0; i < bufferCount; i++) {
+            buffers[i] = new SampleBuffer;
+            buffers[i]->head = buffers[i]->tail = 0;
+        }
+    }
+
+    sampleInterval = interval ? interval : 1;
+    for (unsigned i = 0; i < bufferCount; i++) {
+        buffers[i]->lastTick = profilerTicks;
+    }
+
+    __atomic_store_n(&dropped, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&enabled, true, __ATOMIC_RELEASE);
+}
+
+// /dev/profiler, reading drains samples from the per-CPU buffers
+class ProfilerDevice final : public Device {
+public:
+    ProfilerDevice(const char* name) : Device(name, DeviceTypeUNIXPseudo) {
+        flags = FS_NODE_CHARDEVICE;
+
+        SetDeviceName("CPU Profiler");
+    }
+
+    ssize_t Read(size_t offset, size_t size, uint8_t* data) override {
+        ScopedSpinLock lock(readerLock);
+
+        size_t written = 0;
+        for (unsigned i = 0; i < bufferCount; i++) {
+            SampleBuffer* buffer = buffers[i];
+
+            uint64_t tail = buffer->tail;
+            uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+            while (tail < head && written + sizeof(profiler_sample_t) <= size) {
+                memcpy(data + written, &buffer->samples[tail % PROFILER_BUFFER_SAMPLES], sizeof(profiler_sample_t));
+                written += sizeof(profiler_sample_t);
+                tail++;
+            }
+
+            __atomic_store_n(&buffer->tail, tail, __ATOMIC_RELEASE);
+        }
+
+        return written;
+    }
+
+    int Ioctl(uint64_t cmd, uint64_t arg) override {
+        switch (cmd) {
+        case IoCtlProfilerStart:
+            Start(arg);
+            return 0;
+        case IoCtlProfilerStop:
+            __atomic_store_n(&enabled, false, __ATOMIC_RELEASE);
+            return 0;
+        case IoCtlProfilerGetDropped:
+            return (int)__atomic_load_n(&dropped, __ATOMIC_RELAXED);
+        case IoCtlProfilerResolveSymbol: {
+            if (!IsUsermodePointer<profiler_symbol_t>((profiler_symbol_t*)arg)) {
+                return -EFAULT;
+            }
+
+            UserPointer<profiler_symbol_t> symbolPtr(arg);
+            profiler_symbol_t symbol;
+            TRY_GET_UMODE_VALUE(symbolPtr, symbol);
+
+            KernelSymbol* ksym;
+            if (!ResolveKernelSymbol(symbol.address, ksym)) {
+                return -ENOENT;
+            }
+
+            symbol.base = ksym->address;
+            memset(symbol.name, 0, PROFILER_SYMBOL_NAME_MAX);
+            strncpy(symbol.name, ksym->mangledName, PROFILER_SYMBOL_NAME_MAX - 1);
+
+            TRY_STORE_UMODE_VALUE(symbolPtr, symbol);
+            return 0;
+        }
+        default:
+            return -EINVAL;
+        }
+    }
+};
+
+ProfilerDevice profilerDevice("profiler");
+
+} // namespace Profiler
@@ -29,6 +29,13 @@ volatile uint64_t* smpEntry2 = (uint64_t*)SMP_TRAMPOLINE_ENTRY2;
 
 volatile bool doneInit = false;
 
+// Work handed to the application processors by RunOnAllProcessors
+static void (*volatile bootWork)(void*) = nullptr;
+static void* volatile bootWorkArg = nullptr;
+static volatile unsigned bootWorkGeneration = 0;
+static volatile unsigned bootWorkDone = 0;
+static volatile unsigned runningAPs = 0;
+
 extern gdt_ptr_t GDT64Pointer64;
 extern idt_ptr_t idtPtr;
 
@@ -60,14 +67,25 @@ void SMPEntry(uint16_t id) {
 
     cpu->runQueue = new FastList<Thread*>();
 
+    __atomic_add_fetch(&runningAPs, 1, __ATOMIC_RELEASE);
     doneInit = true;
 
     syscall_init();
 
     asm("sti");
-    
-    for (;;)
+
+    // Until the scheduler takes over, run any work from RunOnAllProcessors
+    unsigned generation = 0;
+    for (;;) {
+        if (__atomic_load_n(&bootWorkGeneration, __ATOMIC_ACQUIRE) != generation) {
+            generation = bootWorkGeneration;
+            bootWork(bootWorkArg);
+
+            __atomic_add_fetch(&bootWorkDone, 1, __ATOMIC_RELEASE);
+        }
+
         asm volatile("pause");
+    }
 }
 
 void InitializeCPU(uint16_t id) {
@@ -150,4 +168,18 @@ void Initialize() {
 
     TSS::InitializeTSS(&cpus[0]->tss, cpus[0]->gdt);
 }
+
+void RunOnAllProcessors(void (*work)(void*), void* arg) {
+    bootWorkDone = 0;
+    bootWork = work;
+    bootWorkArg = arg;
+    __atomic_add_fetch(&bootWorkGeneration, 1, __ATOMIC_RELEASE);
+
+    work(arg);
+
+    unsigned aps = __atomic_load_n(&runningAPs, __ATOMIC_ACQUIRE);
+    while (__atomic_load_n(&bootWorkDone, __ATOMIC_ACQUIRE) < aps) {
+        asm volatile("pause");
+    }
+}
 } // namespace SMP
\ No newline at end of file
@@ -16,6 +16,8 @@
 #include <Paging.h>
 #include <Panic.h>
 #include <PhysicalAllocator.h>
+#include <Profiler.h>
+#include <RCU.h>
 #include <SMP.h>
 #include <Serial.h>
 #include <String.h>
@@ -36,7 +38,17 @@ List<FancyRefPtr<Process>>* processes;
 lock_t destroyedProcessesLock = 0;
 List<FancyRefPtr<Process>>* destroyedProcesses;
 
-unsigned processTableSize = 512;
+// PID table, readers are protected by RCU so lookups never contend with the scheduler.
+// Writers must hold pidTableLock.
+struct PIDTableEntry {
+    PIDTableEntry* volatile next;
+    pid_t pid;
+    FancyRefPtr<Process> process;
+};
+
+lock_t pidTableLock = 0;
+PIDTableEntry* volatile pidTable[PID_TABLE_SIZE];
+
 std::atomic<pid_t> nextPID = 1;
 
 // When the run queue was last balanced
@@ -95,7 +107,41 @@ void Initialize() {
     assert(!"Failed to initiailze scheduler!");
 }
 
+ALWAYS_INLINE static PIDTableEntry* volatile& PIDTableBucket(pid_t pid) {
+    return pidTable[HashU(pid) % PID_TABLE_SIZE];
+}
+
+static void PIDTableInsert(FancyRefPtr<Process> proc) {
+    PIDTableEntry* entry = new PIDTableEntry{nullptr, proc->PID(), std::move(proc)};
+
+    ScopedSpinLock<true> lockTable(pidTableLock);
+    PIDTableEntry* volatile& bucket = PIDTableBucket(entry->pid);
+
+    entry->next = bucket;
+    RCU::Assign(bucket, entry); // Entry is initialized, publish it to readers
+}
+
+static void PIDTableRemove(pid_t pid) {
+    ScopedSpinLock<true> lockTable(pidTableLock);
+
+    PIDTableEntry* volatile* link = &PIDTableBucket(pid);
+    while (PIDTableEntry* entry = *link) {
+        if (entry->pid == pid) {
+            RCU::Assign(*link, static_cast<PIDTableEntry*>(entry->next));
+
+            // Readers may still be looking at the entry,
+            // free it (and drop the process reference) after a grace period
+            RCU::Retire([](void* e) { delete reinterpret_cast<PIDTableEntry*>(e); }, entry);
+            return;
+        }
+
+        link = &entry->next;
+    }
+}
+
 void RegisterProcess(FancyRefPtr<Process> proc) {
+    PIDTableInsert(proc);
+
     ScopedSpinLock acq(processesLock);
     processes->add_back(std::move(proc));
 }
@@ -106,6 +152,8 @@ void MarkProcessForDestruction(Process* proc) {
 
     for (auto it = processes->begin(); it != processes->end(); it++) {
         if (it->get() == proc) {
+            PIDTableRemove(proc->PID());
+
             destroyedProcesses->add_back(*it);
             processes->remove(it);
             return;
@@ -117,25 +165,105 @@ void MarkProcessForDestruction(Process* proc) {
 
 pid_t GetNextPID() { return nextPID++; }
 
+long SetThreadPolicy(Thread* thread, int policy, int priority) {
+    if (policy == LEMON_SCHED_NORMAL) {
+        if (priority != 0) {
+            return -EINVAL;
+        }
+    } else if (policy == LEMON_SCHED_FIFO || policy == LEMON_SCHED_RR) {
+        if (priority < LEMON_SCHED_RT_PRIORITY_MIN || priority > LEMON_SCHED_RT_PRIORITY_MAX) {
+            return -EINVAL;
+        }
+    } else {
+        return -EINVAL;
+    }
+
+    ScopedSpinLock<true> lockState(thread->stateLock);
+    thread->rtPriority = priority;
+    thread->schedPolicy = policy;
+
+    if (thread->cpu >= 0 && thread->IsRealTime()) {
+        SMP::cpus[thread->cpu]->rtPreempt = true;
+    }
+
+    return 0;
+}
+
+// Returns true if real-time threads have used up their budget on this CPU
+static bool RealTimeThrottled(CPU* cpu) {
+    uint64_t now = Timer::UsecondsSinceBoot();
+    if (now - cpu->rtPeriodStart >= SCHED_RT_PERIOD_US) {
+        cpu->rtPeriodStart = now;
+        cpu->rtTicksUsed = 0;
+    }
+
+    return cpu->rtTicksUsed >= (uint64_t)Timer::GetFrequency() * SCHED_RT_RUNTIME_US / 1000000;
+}
+
+// Find the highest priority runnable real-time thread,
+// starting after the previous thread so threads of the same priority take turns (round robin).
+// A FIFO thread keeps running until a higher priority thread is runnable.
+static Thread* PickRealTimeThread(CPU* cpu, Thread* previous) {
+    Thread* front = cpu->runQueue->get_front();
+    if (!front) {
+        return nullptr;
+    }
+
+    Thread* start = front;
+    if (previous && previous != cpu->idleThread && previous->cpu == (int)cpu->id && previous->next) {
+        start = previous->next;
+    }
+
+    Thread* best = nullptr;
+    Thread* it = start;
+    do {
+        if (it->IsRealTime() && !(it->state & ThreadStateBlocked) && it->state != ThreadStateDying) {
+            if (!best || it->rtPriority > best->rtPriority) {
+                best = it;
+            }
+        }
+
+        it = it->next;
+    } while (it && it != start);
+
+    if (best && previous && previous->schedPolicy == LEMON_SCHED_FIFO && previous->timeSlice > 0 &&
+        !(previous->state & ThreadStateBlocked) && previous->state != ThreadStateDying &&
+        previous->rtPriority >= best->rtPriority) {
+        return previous; // FIFO threads are not preempted by threads of the same priority
+    }
+
+    return best;
+}
+
 FancyRefPtr<Process> FindProcessByPID(pid_t pid) {
-    ScopedSpinLock lockProcesses(processesLock);
-    for (auto& proc : *processes) {
-        if (proc->PID() == pid)
-            return proc;
+    RCU::ReadToken rcu = RCU::ReadLock();
+
+    FancyRefPtr<Process> proc = nullptr;
+    for (PIDTableEntry* entry = RCU::Dereference(PIDTableBucket(pid)); entry; entry = RCU::Dereference(entry->next)) {
+        if (entry->pid == pid) {
+            proc = entry->process; // Take a reference before leaving the critical section
+            break;
+        }
     }
 
-    return nullptr;
+    RCU::ReadUnlock(rcu);
+    return proc;
 }
 
 pid_t GetNextProcessPID(pid_t pid) {
-    ScopedSpinLock lockProcesses(processesLock);
-    for (auto it = processes->begin(); it != processes->end(); it++) {
-        if (it->get()->PID() > pid) { // Found process with PID greater than pid
-            return it->get()->PID();
+    RCU::ReadToken rcu = RCU::ReadLock();
+
+    pid_t next = 0;
+    for (unsigned i = 0; i < PID_TABLE_SIZE; i++) {
+        for (PIDTableEntry* entry = RCU::Dereference(pidTable[i]); entry; entry = RCU::Dereference(entry->next)) {
+            if (entry->pid > pid && (!next || entry->pid < next)) { // Find the lowest PID greater than pid
+                next = entry->pid;
+            }
         }
     }
 
-    return 0; // Could not find process, return as if end of list
+    RCU::ReadUnlock(rcu);
+    return next; // 0 if we could not find a process, as if end of list
 }
 
 void Yield() {
@@ -152,6 +280,7 @@ void Tick(RegisterContext* r) {
     if (!schedulerReady)
         return;
 
+    Profiler::Tick();
     APIC::Local::SendIPI(0, ICR_DSH_OTHER, ICR_MESSAGE_TYPE_FIXED, IPI_SCHEDULE);
 
     Schedule(nullptr, r);
@@ -272,12 +401,23 @@ void Schedule(__attribute__((unused)) void* data, RegisterContext* r) {
     assert(!CheckInterrupts());
 
     CPU* cpu = GetCPULocal();
+    Profiler::Sample(cpu, r);
 
+    bool rtThrottled = RealTimeThrottled(cpu);
     if (cpu->currentThread && !(cpu->currentThread->state & ThreadStateBlocked)) {
         cpu->currentThread->parent->activeTicks++;
-        if (cpu->currentThread->timeSlice > 0) {
+
+        bool preempt = cpu->rtPreempt;
+        if (cpu->currentThread->IsRealTime()) {
+            cpu->rtTicksUsed++;
+            preempt = preempt || rtThrottled; // Give normal threads a chance to run
+        }
+
+        if (cpu->currentThread->timeSlice > 0 && !preempt) {
             cpu->currentThread->ticksSinceBalance++;
-            cpu->currentThread->timeSlice--;
+            if (cpu->currentThread->schedPolicy != LEMON_SCHED_FIFO) {
+                cpu->currentThread->timeSlice--;
+            }
             return;
         }
     }
@@ -298,6 +438,9 @@ void Schedule(__attribute__((unused)) void* data, RegisterContext* r) {
         }
     }
 
+    cpu->rtPreempt = false;
+    Thread* previousThread = cpu->currentThread;
+
     if (__builtin_expect(cpu->runQueue->get_length() <= 0 || !cpu->currentThread, 0)) {
         cpu->currentThread = cpu->idleThread;
     } else if (__builtin_expect(cpu->currentThread->state == ThreadStateDying, 0)) {
@@ -331,6 +474,13 @@ void Schedule(__attribute__((unused)) void* data, RegisterContext* r) {
         // Check if we could find an unblocked thread
         if (cpu->currentThread->state & ThreadStateBlocked) {
                 cpu->currentThread = cpu->idleThread;
+        }
+
+        // Real-time threads take strict priority over normal threads, unless throttled
+        if (!rtThrottled) {
+            if (Thread* rtThread = PickRealTimeThread(cpu, previousThread)) {
+                cpu->currentThread = rtThread;
+            }
         } /*else if(SMP::processorCount > 1) {
             // See if we can find a better thread
             // where better is the thread w/ least CPU time
@@ -9,6 +9,10 @@
 
 HashMap<StringView, KernelSymbol*> symbolHashMap;
 
+// Used to find the symbol containing an address
+Vector<KernelSymbol*> addressSymbols;
+lock_t addressSymbolsLock = 0;
+
 void LoadSymbolsFromFile(FsNode* node) {
     unsigned bufferSize = node->size;
     char* buffer = new char[node->size];
@@ -54,6 +58,10 @@ void LoadSymbolsFromFile(FsNode* node) {
                        sym->mangledName);
 
             symbolHashMap.insert(sym->mangledName, sym);
+            {
+                ScopedSpinLock lock(addressSymbolsLock);
+                addressSymbols.add_back(sym);
+            }
 
             bufferPos += (lineEnd - line) + 1;
         }
@@ -67,10 +75,40 @@ int ResolveKernelSymbol(const char* mangledName, KernelSymbol*& symbolPtr) {
     return symbolHashMap.get(mangledName, symbolPtr);
 }
 
+int ResolveKernelSymbol(uintptr_t address, KernelSymbol*& symbolPtr) {
+    ScopedSpinLock lock(addressSymbolsLock);
+
+    // Find the closest symbol at or below address
+    KernelSymbol* closest = nullptr;
+    for (KernelSymbol* sym : addressSymbols) {
+        if (sym->address <= address && (!closest || sym->address > closest->address)) {
+            closest = sym;
+        }
+    }
+
+    if (!closest) {
+        return 0;
+    }
+
+    symbolPtr = closest;
+    return 1;
+}
+
 void AddKernelSymbol(KernelSymbol* sym) {
     assert(!symbolHashMap.find(sym->mangledName));
 
     symbolHashMap.insert(sym->mangledName, sym);
+
+    ScopedSpinLock lock(addressSymbolsLock);
+    addressSymbols.add_back(sym);
 }
 
-void RemoveKernelSymbol(const char* mangledName) { symbolHashMap.remove(mangledName); }
\ No newline at end of file
+void RemoveKernelSymbol(const char* mangledName) {
+    KernelSymbol* sym;
+    if (symbolHashMap.get(mangledName, sym)) {
+        ScopedSpinLock lock(addressSymbolsLock);
+        addressSymbols.remove(sym);
+    }
+
+    symbolHashMap.remove(mangledName);
+}
\ No newline at end of file
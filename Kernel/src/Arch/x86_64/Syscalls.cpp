@@ -67,6 +67,18 @@ long SysEPollCtl(RegisterContext* r);
 long SysEpollWait(RegisterContext* r);
 long SysPipe(RegisterContext* r);
 long SysFChdir(RegisterContext* r);
+long SysFsync(RegisterContext* r);
+long SysReadV(RegisterContext* r);
+long SysWriteV(RegisterContext* r);
+long SysPReadV(RegisterContext* r);
+long SysPWriteV(RegisterContext* r);
+long SysSendfile(RegisterContext* r);
+long SysSplice(RegisterContext* r);
+long SysCopyFileRange(RegisterContext* r);
+long SysIORingSetup(RegisterContext* r);
+long SysIORingEnter(RegisterContext* r);
+long SysGetDents64(RegisterContext* r);
+long SysGetDentsPlus(RegisterContext* r);
 
 long SysExit(RegisterContext* r) {
     int code = SC_ARG0(r);
@@ -146,17 +158,25 @@ long SysExec(RegisterContext* r) {
     }
 
     timeval tv = Timer::GetSystemUptimeStruct();
-    uint8_t* buffer = (uint8_t*)kmalloc(node->size);
-    size_t read = fs::Read(node, 0, node->size, buffer);
-    if (read != node->size) {
-        Log::Warning("Could not read file: %s", filepath);
-        return 0;
+    // Use the file in place if possible (e.g. initrd), otherwise read it in
+    uint8_t* buffer = const_cast<uint8_t*>(node->ResidentData());
+    bool resident = buffer;
+    if (!resident) {
+        buffer = (uint8_t*)kmalloc(node->size);
+        size_t read = fs::Read(node, 0, node->size, buffer);
+        if (read != node->size) {
+            Log::Warning("Could not read file: %s", filepath);
+            kfree(buffer);
+            return 0;
+        }
     }
     timeval tvnew = Timer::GetSystemUptimeStruct();
     Log::Info("Done (took %d us)", Timer::TimeDifference(tvnew, tv));
     FancyRefPtr<Process> proc = Process::CreateELFProcess((void*)buffer, kernelArgv, kernelEnvp, filepath,
                                                           ((flags & EXEC_CHILD) ? currentProcess : nullptr));
-    kfree(buffer);
+    if (!resident) {
+        kfree(buffer);
+    }
 
     if (!proc) {
         Log::Warning("SysExec: Proc is null!");
@@ -165,6 +185,7 @@ long SysExec(RegisterContext* r) {
 
     proc->workingDir = currentProcess->workingDir;
     strncpy(proc->workingDirPath, currentProcess->workingDirPath, PATH_MAX);
+    strncpy(proc->execPath, fs::CanonicalizePath(filepath, currentProcess->workingDirPath).c_str(), PATH_MAX);
 
     if (flags & EXEC_CHILD) {
         currentProcess->RegisterChildProcess(proc);
@@ -260,11 +281,17 @@ long SysExecve(RegisterContext* r) {
     }
 
     timeval tv = Timer::GetSystemUptimeStruct();
-    uint8_t* buffer = (uint8_t*)kmalloc(node->size);
-    size_t read = fs::Read(node, 0, node->size, buffer);
-    if (read != node->size) {
-        Log::Warning("Could not read file: %s", filepath);
-        return -EIO;
+    // Use the file in place if possible (e.g. initrd), otherwise read it in
+    uint8_t* buffer = const_cast<uint8_t*>(node->ResidentData());
+    bool resident = buffer;
+    if (!resident) {
+        buffer = (uint8_t*)kmalloc(node->size);
+        size_t read = fs::Read(node, 0, node->size, buffer);
+        if (read != node->size) {
+            Log::Warning("Could not read file: %s", filepath);
+            kfree(buffer);
+            return -EIO;
+        }
     }
     timeval tvnew = Timer::GetSystemUptimeStruct();
     Log::Info("Done (took %d us)", Timer::TimeDifference(tvnew, tv));
@@ -300,7 +327,9 @@ long SysExecve(RegisterContext* r) {
 
     elf_info_t elfInfo = LoadELFSegments(currentProcess, buffer, 0);
     r->rip = currentProcess->LoadELF(&r->rsp, elfInfo, kernelArgv, kernelEnvp, filepath);
-    kfree(buffer);
+    if (!resident) {
+        kfree(buffer);
+    }
 
     if (!r->rip) {
         // Its really important that we kill the process afterwards,
@@ -311,6 +340,8 @@ long SysExecve(RegisterContext* r) {
     }
 
     strncpy(currentProcess->name, kernelArgv[0].c_str(), sizeof(currentProcess->name));
+    strncpy(currentProcess->execPath, fs::CanonicalizePath(filepath, currentProcess->workingDirPath).c_str(),
+            PATH_MAX);
 
     assert(!(r->rsp & 0xF));
 
@@ -672,14 +703,20 @@ long SysUnmapSharedMemory(RegisterContext* r) {
         if (!sMem.get())
             return -EINVAL;
 
-        MappedRegion* region = proc->addressSpace->AddressToRegionWriteLock(address);
-        if (!region || region->vmObject != sMem) {
-            region->lock.ReleaseWrite();
+        MappedRegion* region = proc->addressSpace->AddressToRegionReadLock(address);
+        if (!region) {
             return -EINVAL; // Invalid memory region
+        } else if (region->vmObject != sMem) {
+            region->lock.ReleaseRead();
+            return -EINVAL;
         }
 
-        long r = proc->addressSpace->UnmapRegion(region);
-        assert(!r);
+        uintptr_t base = region->Base();
+        size_t size = region->Size();
+        region->lock.ReleaseRead();
+
+        // UnmapMemory takes the region list lock before the region lock
+        proc->addressSpace->UnmapMemory(base, size);
     }
 
     Memory::DestroySharedMemory(key); // Active shared memory will not be destroyed and this will return
@@ -1117,6 +1154,8 @@ long SysGetProcessInfo(RegisterContext* r) {
     pInfo->state = reqProcess->GetMainThread()->state;
 
     strcpy(pInfo->name, reqProcess->name);
+    strncpy(pInfo->execPath, reqProcess->execPath, sizeof(pInfo->execPath) - 1);
+    pInfo->execPath[sizeof(pInfo->execPath) - 1] = 0;
 
     pInfo->runningTime = Timer::GetSystemUptime() - reqProcess->creationTime.tv_sec;
     pInfo->activeUs = reqProcess->activeTicks * 1000000 / Timer::GetFrequency();
@@ -1171,6 +1210,8 @@ long SysGetNextProcessInfo(RegisterContext* r) {
     pInfo->state = reqProcess->GetMainThread()->state;
 
     strcpy(pInfo->name, reqProcess->name);
+    strncpy(pInfo->execPath, reqProcess->execPath, sizeof(pInfo->execPath) - 1);
+    pInfo->execPath[sizeof(pInfo->execPath) - 1] = 0;
 
     pInfo->runningTime = Timer::GetSystemUptime() - reqProcess->creationTime.tv_sec;
     pInfo->activeUs = reqProcess->activeTicks * 1000000 / Timer::GetFrequency();
@@ -2376,6 +2417,73 @@ long SysGetResourceLimit(RegisterContext* r) {
     return -ENOSYS;
 }
 
+/////////////////////////////
+/// \brief SysSchedSetScheduler (tid, policy, priority)
+///
+/// Set the scheduling policy of a thread in the calling process,
+/// only root may use the real-time policies
+///
+/// \param tid Thread ID, 0 for the calling thread
+/// \param policy LEMON_SCHED_NORMAL, LEMON_SCHED_FIFO or LEMON_SCHED_RR
+/// \param priority Real-time priority (LEMON_SCHED_RT_PRIORITY_MIN - LEMON_SCHED_RT_PRIORITY_MAX), 0 if normal
+///
+/// \return 0 on success, negative error code on failure
+/////////////////////////////
+long SysSchedSetScheduler(RegisterContext* r) {
+    pid_t tid = SC_ARG0(r);
+    int policy = SC_ARG1(r);
+    int priority = SC_ARG2(r);
+
+    if (policy != LEMON_SCHED_NORMAL && Process::Current()->euid != 0) {
+        return -EPERM; // Must be root
+    }
+
+    FancyRefPtr<Thread> thread;
+    if (tid == 0) {
+        thread = Process::Current()->GetThreadFromTID(Thread::Current()->tid);
+    } else {
+        thread = Process::Current()->GetThreadFromTID(tid);
+    }
+
+    if (!thread.get()) {
+        return -ESRCH;
+    }
+
+    return Scheduler::SetThreadPolicy(thread.get(), policy, priority);
+}
+
+/////////////////////////////
+/// \brief SysSchedGetScheduler (tid, priority)
+///
+/// \param tid Thread ID, 0 for the calling thread
+/// \param priority Pointer to int filled with the real-time priority of the thread (can be null)
+///
+/// \return Scheduling policy on success, negative error code on failure
+/////////////////////////////
+long SysSchedGetScheduler(RegisterContext* r) {
+    pid_t tid = SC_ARG0(r);
+    UserPointer<int> priority = SC_ARG1(r);
+
+    FancyRefPtr<Thread> thread;
+    if (tid == 0) {
+        thread = Process::Current()->GetThreadFromTID(Thread::Current()->tid);
+    } else {
+        thread = Process::Current()->GetThreadFromTID(tid);
+    }
+
+    if (!thread.get()) {
+        return -ESRCH;
+    }
+
+    if (priority) {
+        if (!IsUsermodePointer<int>(priority.Pointer()) || priority.StoreValue(thread->rtPriority)) {
+            return -EFAULT;
+        }
+    }
+
+    return thread->schedPolicy;
+}
+
 // clang-format off
 syscall_t syscalls[NUM_SYSCALLS]{
     SysDebug,
@@ -2489,7 +2597,21 @@ syscall_t syscalls[NUM_SYSCALLS]{
     SysEpollCreate,
     SysEPollCtl,
     SysEpollWait, // 110
-    SysFChdir
+    SysFChdir,
+    SysSchedSetScheduler,
+    SysSchedGetScheduler,
+    SysFsync,
+    SysReadV, // 115
+    SysWriteV,
+    SysPReadV,
+    SysPWriteV,
+    SysSendfile,
+    SysSplice, // 120
+    SysCopyFileRange,
+    SysIORingSetup,
+    SysIORingEnter,
+    SysGetDents64,
+    SysGetDentsPlus,
 };
 // clang-format on
 
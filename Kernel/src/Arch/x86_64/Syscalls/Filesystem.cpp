@@ -1,9 +1,13 @@
 #include <Scheduler.h>
 #include <Syscalls.h>
 
+#include <ABI/Dirent.h>
+
+#include <Fs/PageCache.h>
 #include <Fs/Pipe.h>
 #include <Net/Socket.h>
 
+#include <Math.h>
 #include <StackTrace.h>
 #include <UserPointer.h>
 
@@ -95,7 +99,7 @@ open:
 
             IF_DEBUG(debugLevelSyscalls >= DebugLevelNormal, { Log::Info("SysOpen: Creating %s", filepath); });
 
-            parent->Create(&ent, flags);
+            fs::Create(parent, &ent, flags);
 
             flags &= ~O_CREAT;
             goto open;
@@ -115,7 +119,7 @@ open:
     }
 
     if (flags & O_TRUNC && ((flags & O_ACCESS) == O_RDWR || (flags & O_ACCESS) == O_WRONLY)) {
-        node->Truncate(0);
+        fs::Truncate(node, 0);
     }
 
     FancyRefPtr<UNIXOpenFile> handle = SC_TRY_OR_ERROR(fs::Open(node, SC_ARG1(r)));
@@ -167,7 +171,7 @@ long SysLink(RegisterContext* r) {
 
     DirectoryEntry entry;
     strcpy(entry.name, linkName.c_str());
-    return parentDirectory->Link(file, &entry);
+    return fs::Link(parentDirectory, file, &entry);
 }
 
 long SysUnlink(RegisterContext* r) {
@@ -212,7 +216,7 @@ long SysUnlink(RegisterContext* r) {
 
     DirectoryEntry entry;
     strcpy(entry.name, linkName.c_str());
-    return workingDir->Unlink(&entry);
+    return fs::Unlink(workingDir, &entry);
 }
 
 long SysChdir(RegisterContext* r) {
@@ -264,18 +268,7 @@ long SysChmod(RegisterContext* r) {
     return 0;
 }
 
-long SysFStat(RegisterContext* r) {
-    Process* process = Scheduler::GetCurrentProcess();
-
-    stat_t* stat = (stat_t*)SC_ARG0(r);
-    FancyRefPtr<UNIXOpenFile> handle = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG1(r)));
-    if (!handle) {
-        Log::Warning("sys_fstat: Invalid File Descriptor, %d", SC_ARG1(r));
-        return -EBADF;
-    }
-
-    FsNode* const& node = handle->node;
-
+static void FillStat(FsNode* node, stat_t* stat) {
     stat->st_dev = 0;
     stat->st_ino = node->inode;
     stat->st_mode = 0;
@@ -300,7 +293,19 @@ long SysFStat(RegisterContext* r) {
     stat->st_size = node->size;
     stat->st_blksize = 0;
     stat->st_blocks = 0;
+}
+
+long SysFStat(RegisterContext* r) {
+    Process* process = Scheduler::GetCurrentProcess();
 
+    stat_t* stat = (stat_t*)SC_ARG0(r);
+    FancyRefPtr<UNIXOpenFile> handle = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG1(r)));
+    if (!handle) {
+        Log::Warning("sys_fstat: Invalid File Descriptor, %d", SC_ARG1(r));
+        return -EBADF;
+    }
+
+    FillStat(handle->node, stat);
     return 0;
 }
 
@@ -326,31 +331,7 @@ long SysStat(RegisterContext* r) {
         return -ENOENT;
     }
 
-    stat->st_dev = 0;
-    stat->st_ino = node->inode;
-    stat->st_mode = 0;
-
-    if ((node->flags & FS_NODE_TYPE) == FS_NODE_DIRECTORY)
-        stat->st_mode = S_IFDIR;
-    if ((node->flags & FS_NODE_TYPE) == FS_NODE_FILE)
-        stat->st_mode = S_IFREG;
-    if ((node->flags & FS_NODE_TYPE) == FS_NODE_BLKDEVICE)
-        stat->st_mode = S_IFBLK;
-    if ((node->flags & FS_NODE_TYPE) == FS_NODE_CHARDEVICE)
-        stat->st_mode = S_IFCHR;
-    if ((node->flags & FS_NODE_TYPE) == FS_NODE_SYMLINK)
-        stat->st_mode = S_IFLNK;
-    if ((node->flags & FS_NODE_TYPE) == FS_NODE_SOCKET)
-        stat->st_mode = S_IFSOCK;
-
-    stat->st_nlink = 0;
-    stat->st_uid = node->uid;
-    stat->st_gid = 0;
-    stat->st_rdev = 0;
-    stat->st_size = node->size;
-    stat->st_blksize = 0;
-    stat->st_blocks = 0;
-
+    FillStat(node, stat);
     return 0;
 }
 
@@ -409,7 +390,7 @@ long SysMkdir(RegisterContext* r) {
 
     DirectoryEntry dir;
     strcpy(dir.name, dirPath.c_str());
-    int ret = parentDirectory->CreateDirectory(&dir, mode);
+    int ret = fs::CreateDirectory(parentDirectory, &dir, mode);
 
     return ret;
 }
@@ -499,14 +480,34 @@ long SysReadDirNext(RegisterContext* r) {
         return -ENOTDIR;
     }
 
-    DirectoryEntry tempent;
-    int ret = fs::ReadDir(handle, &tempent, handle->pos++);
+    // Go through ReadDirBatch so the file position is the same cursor used by getdents64
+    struct {
+        DirectoryEntry ent;
+        bool filled = false;
+    } single;
 
-    strcpy(direntPointer->name, tempent.name);
-    direntPointer->type = tempent.flags;
-    direntPointer->inode = tempent.inode;
+    int ret = fs::ReadDirBatch(
+        handle,
+        [](void* context, const DirectoryEntry& ent, off_t) -> bool {
+            auto* s = reinterpret_cast<decltype(single)*>(context);
+            if (s->filled) {
+                return false; // Only take one entry
+            }
 
-    return ret;
+            s->ent = ent;
+            s->filled = true;
+            return true;
+        },
+        &single);
+    if (ret <= 0) {
+        return ret;
+    }
+
+    strcpy(direntPointer->name, single.ent.name);
+    direntPointer->type = single.ent.flags;
+    direntPointer->inode = single.ent.inode;
+
+    return 1;
 }
 
 long SysRenameAt(RegisterContext* r) {
@@ -1113,3 +1114,607 @@ long SysPipe(RegisterContext* r) {
 
     return 0;
 }
+
+/////////////////////////////
+/// \brief SysFsync(fd)
+///
+/// Write back the file's inode and data to disk
+///
+/// \param fd File descriptor to sync
+///
+/// \return Negative error code on error, otherwise 0
+/////////////////////////////
+long SysFsync(RegisterContext* r) {
+    Process* process = Process::Current();
+
+    auto handle = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG0(r)));
+    if (!handle->node) {
+        return -EINVAL;
+    }
+
+    handle->node->Sync();
+    return 0;
+}
+
+// Copy the iovec array of a vectored I/O syscall into kernel memory and validate every buffer.
+// Returns the amount of iovecs or a negative error code, on success iov has to be freed with kfree.
+static long CopyIOVecs(Process* process, uintptr_t userIov, long iovcnt, iovec*& iov) {
+    if (iovcnt < 0 || iovcnt > IOV_MAX) {
+        return -EINVAL;
+    }
+
+    if (!Memory::CheckUsermodePointer(userIov, sizeof(iovec) * iovcnt, process->addressSpace)) {
+        return -EFAULT;
+    }
+
+    // Copy first so the buffers cannot be changed after they have been checked
+    iov = reinterpret_cast<iovec*>(kmalloc(sizeof(iovec) * iovcnt));
+    memcpy(iov, reinterpret_cast<iovec*>(userIov), sizeof(iovec) * iovcnt);
+
+    size_t total = 0;
+    for (long i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > static_cast<size_t>(INT64_MAX) - total) {
+            kfree(iov);
+            return -EINVAL; // Total length has to fit in ssize_t
+        }
+        total += iov[i].iov_len;
+
+        if (iov[i].iov_len && !Memory::CheckUsermodePointer(reinterpret_cast<uintptr_t>(iov[i].iov_base),
+                                                            iov[i].iov_len, process->addressSpace)) {
+            kfree(iov);
+            return -EFAULT;
+        }
+    }
+
+    return iovcnt;
+}
+
+/////////////////////////////
+/// \brief SysReadV(fd, iov, iovcnt)
+///
+/// Read from a file into multiple buffers, the file lock is only taken once
+///
+/// \param fd File descriptor to read from
+/// \param iov Array of iovec structures describing the buffers
+/// \param iovcnt Amount of iovecs, at most IOV_MAX
+///
+/// \return Bytes read, otherwise a negative error code
+/////////////////////////////
+long SysReadV(RegisterContext* r) {
+    Process* process = Process::Current();
+
+    FancyRefPtr<UNIXOpenFile> handle = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG0(r)));
+    if (!handle) {
+        return -EBADF;
+    }
+
+    iovec* iov;
+    long iovcnt = CopyIOVecs(process, SC_ARG1(r), SC_ARG2(r), iov);
+    if (iovcnt < 0) {
+        return iovcnt;
+    }
+
+    ssize_t ret = fs::ReadV(handle, iov, iovcnt);
+    kfree(iov);
+    return ret;
+}
+
+/////////////////////////////
+/// \brief SysWriteV(fd, iov, iovcnt)
+///
+/// Write multiple buffers to a file, the file lock is only taken once
+///
+/// \param fd File descriptor to write to
+/// \param iov Array of iovec structures describing the buffers
+/// \param iovcnt Amount of iovecs, at most IOV_MAX
+///
+/// \return Bytes written, otherwise a negative error code
+/////////////////////////////
+long SysWriteV(RegisterContext* r) {
+    Process* process = Process::Current();
+
+    FancyRefPtr<UNIXOpenFile> handle = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG0(r)));
+    if (!handle) {
+        return -EBADF;
+    }
+
+    iovec* iov;
+    long iovcnt = CopyIOVecs(process, SC_ARG1(r), SC_ARG2(r), iov);
+    if (iovcnt < 0) {
+        return iovcnt;
+    }
+
+    ssize_t ret = fs::WriteV(handle, iov, iovcnt);
+    kfree(iov);
+    return ret;
+}
+
+/////////////////////////////
+/// \brief SysPReadV(fd, iov, iovcnt, offset)
+///
+/// Read from a file at offset into multiple buffers, does not change the file position
+///
+/// \return Bytes read, otherwise a negative error code
+/////////////////////////////
+long SysPReadV(RegisterContext* r) {
+    Process* process = Process::Current();
+
+    FancyRefPtr<UNIXOpenFile> handle = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG0(r)));
+    if (!handle) {
+        return -EBADF;
+    }
+
+    off_t offset = SC_ARG3(r);
+    if (offset < 0) {
+        return -EINVAL;
+    }
+
+    iovec* iov;
+    long iovcnt = CopyIOVecs(process, SC_ARG1(r), SC_ARG2(r), iov);
+    if (iovcnt < 0) {
+        return iovcnt;
+    }
+
+    ssize_t ret = fs::ReadV(handle->node, offset, iov, iovcnt);
+    kfree(iov);
+    return ret;
+}
+
+/////////////////////////////
+/// \brief SysPWriteV(fd, iov, iovcnt, offset)
+///
+/// Write multiple buffers to a file at offset, does not change the file position
+///
+/// \return Bytes written, otherwise a negative error code
+/////////////////////////////
+long SysPWriteV(RegisterContext* r) {
+    Process* process = Process::Current();
+
+    FancyRefPtr<UNIXOpenFile> handle = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG0(r)));
+    if (!handle) {
+        return -EBADF;
+    }
+
+    off_t offset = SC_ARG3(r);
+    if (offset < 0) {
+        return -EINVAL;
+    }
+
+    iovec* iov;
+    long iovcnt = CopyIOVecs(process, SC_ARG1(r), SC_ARG2(r), iov);
+    if (iovcnt < 0) {
+        return iovcnt;
+    }
+
+    ssize_t ret = fs::WriteV(handle->node, offset, iov, iovcnt);
+    kfree(iov);
+    return ret;
+}
+
+// Read an optional user offset pointer used by sendfile, splice and copy_file_range
+static int GetUserOffset(UserPointer<off_t>& ptr, off_t& offset) {
+    if (!ptr) {
+        return 0;
+    }
+
+    if (!IsUsermodePointer<off_t>(ptr.Pointer()) || ptr.GetValue(offset)) {
+        return -EFAULT;
+    }
+
+    if (offset < 0) {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+// Move data between two open files with fs::Splice.
+// Each side uses the given offset if there is one (updating it), otherwise the file position.
+static long SpliceHandles(const FancyRefPtr<UNIXOpenFile>& in, UserPointer<off_t> inOffsetPtr,
+                          const FancyRefPtr<UNIXOpenFile>& out, UserPointer<off_t> outOffsetPtr, size_t size) {
+    off_t inOffset = 0;
+    off_t outOffset = 0;
+    if (int e = GetUserOffset(inOffsetPtr, inOffset); e) {
+        return e;
+    }
+
+    if (int e = GetUserOffset(outOffsetPtr, outOffset); e) {
+        return e;
+    }
+
+    if (size > INT64_MAX) {
+        size = INT64_MAX;
+    }
+
+    // As with fs::Read, the data lock of each handle whose position is used is held across the whole copy,
+    // so a concurrent read, write or splice on the same handle can not move the same bytes.
+    // Lock in address order so splices in opposite directions can not deadlock.
+    UNIXOpenFile* first = inOffsetPtr ? nullptr : in.get();
+    UNIXOpenFile* second = outOffsetPtr ? nullptr : out.get();
+    if (first == second) {
+        second = nullptr;
+    } else if (first && second && second < first) {
+        UNIXOpenFile* temp = first;
+        first = second;
+        second = temp;
+    }
+
+    if (first) {
+        acquireLock(&first->dataLock);
+    }
+    if (second) {
+        acquireLock(&second->dataLock);
+    }
+
+    if (!inOffsetPtr) {
+        inOffset = in->pos;
+    }
+
+    if (!outOffsetPtr) {
+        outOffset = out->pos;
+    }
+
+    if (in->node->pageCached) {
+        // The readahead state of the handle is also protected by the data lock
+        if (in.get() == first || in.get() == second) {
+            fs::PageCache::Readahead(in, inOffset, MIN(size, SPLICE_BATCH_SIZE));
+        } else {
+            ScopedSpinLock lockIn(in->dataLock);
+            fs::PageCache::Readahead(in, inOffset, MIN(size, SPLICE_BATCH_SIZE));
+        }
+    }
+
+    ssize_t ret = fs::Splice(in->node, inOffset, out->node, outOffset, size);
+    if (ret > 0) {
+        if (!inOffsetPtr) {
+            in->pos += ret;
+        }
+
+        if (!outOffsetPtr) {
+            out->pos += ret;
+        }
+    }
+
+    if (second) {
+        releaseLock(&second->dataLock);
+    }
+    if (first) {
+        releaseLock(&first->dataLock);
+    }
+
+    if (ret <= 0) {
+        return ret;
+    }
+
+    if (inOffsetPtr && inOffsetPtr.StoreValue(inOffset + ret)) {
+        return -EFAULT;
+    }
+
+    if (outOffsetPtr && outOffsetPtr.StoreValue(outOffset + ret)) {
+        return -EFAULT;
+    }
+
+    return ret;
+}
+
+/////////////////////////////
+/// \brief SysSendfile(outFd, inFd, offset, count)
+///
+/// Copy data from a file to another file descriptor (e.g. a socket) in the kernel
+///
+/// \param outFd File descriptor to write to
+/// \param inFd File descriptor to read from, must be a file or block device
+/// \param offset Pointer to the offset to read from which is updated, if null the file position is used
+/// \param count Maximum amount of bytes to copy
+///
+/// \return Bytes copied, otherwise a negative error code
+/////////////////////////////
+long SysSendfile(RegisterContext* r) {
+    Process* process = Process::Current();
+
+    FancyRefPtr<UNIXOpenFile> out = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG0(r)));
+    FancyRefPtr<UNIXOpenFile> in = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG1(r)));
+    if (!in->node || !out->node) {
+        return -EBADF;
+    }
+
+    if (!in->node->IsFile() && !in->node->IsBlockDevice()) {
+        return -EINVAL;
+    }
+
+    return SpliceHandles(in, SC_ARG2(r), out, 0, SC_ARG3(r));
+}
+
+/////////////////////////////
+/// \brief SysSplice(inFd, inOffset, outFd, outOffset, len, flags)
+///
+/// Move data between a pipe and another file descriptor in the kernel
+///
+/// \param inFd File descriptor to read from
+/// \param inOffset Pointer to the offset to read from, must be null for pipes and sockets
+/// \param outFd File descriptor to write to
+/// \param outOffset Pointer to the offset to write at, must be null for pipes and sockets
+/// \param len Maximum amount of bytes to move
+/// \param flags Ignored, all moves are done by copying from the page cache or a kernel buffer
+///
+/// \return Bytes moved, otherwise a negative error code
+/////////////////////////////
+long SysSplice(RegisterContext* r) {
+    Process* process = Process::Current();
+
+    FancyRefPtr<UNIXOpenFile> in = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG0(r)));
+    FancyRefPtr<UNIXOpenFile> out = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG2(r)));
+    if (!in->node || !out->node) {
+        return -EBADF;
+    }
+
+    UserPointer<off_t> inOffset = SC_ARG1(r);
+    UserPointer<off_t> outOffset = SC_ARG3(r);
+
+    // One end has to be a pipe
+    if (!in->node->IsPipe() && !out->node->IsPipe()) {
+        return -EINVAL;
+    }
+
+    if ((inOffset && (in->node->IsPipe() || in->node->IsSocket())) ||
+        (outOffset && (out->node->IsPipe() || out->node->IsSocket()))) {
+        return -ESPIPE;
+    }
+
+    return SpliceHandles(in, inOffset, out, outOffset, SC_ARG4(r));
+}
+
+/////////////////////////////
+/// \brief SysCopyFileRange(inFd, inOffset, outFd, outOffset, len, flags)
+///
+/// Copy a range of a file to another file in the kernel
+///
+/// \param inOffset Pointer to the offset to read from which is updated, if null the file position is used
+/// \param outOffset Pointer to the offset to write at which is updated, if null the file position is used
+/// \param flags Must be 0
+///
+/// \return Bytes copied, otherwise a negative error code
+/////////////////////////////
+long SysCopyFileRange(RegisterContext* r) {
+    Process* process = Process::Current();
+
+    FancyRefPtr<UNIXOpenFile> in = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG0(r)));
+    FancyRefPtr<UNIXOpenFile> out = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG2(r)));
+    if (!in->node || !out->node) {
+        return -EBADF;
+    }
+
+    if (SC_ARG5(r)) {
+        return -EINVAL;
+    }
+
+    if (in->node->IsDirectory() || out->node->IsDirectory()) {
+        return -EISDIR;
+    }
+
+    if (!in->node->IsFile() || !out->node->IsFile()) {
+        return -EINVAL;
+    }
+
+    UserPointer<off_t> inOffsetPtr = SC_ARG1(r);
+    UserPointer<off_t> outOffsetPtr = SC_ARG3(r);
+    size_t len = SC_ARG4(r);
+
+    if (in->node == out->node) {
+        // Overlapping ranges within the same file are not allowed
+        off_t inOffset = 0;
+        off_t outOffset = 0;
+        if (!inOffsetPtr) {
+            ScopedSpinLock lockIn(in->dataLock);
+            inOffset = in->pos;
+        } else if (int e = GetUserOffset(inOffsetPtr, inOffset); e) {
+            return e;
+        }
+
+        if (!outOffsetPtr) {
+            ScopedSpinLock lockOut(out->dataLock);
+            outOffset = out->pos;
+        } else if (int e = GetUserOffset(outOffsetPtr, outOffset); e) {
+            return e;
+        }
+
+        // Nothing past the end of the input is copied, clamping also keeps the ranges below from wrapping
+        // (len is commonly SIZE_MAX to copy everything)
+        size_t inSize = in->node->size;
+        size_t copyLength = (static_cast<size_t>(inOffset) < inSize) ? MIN(len, inSize - inOffset) : 0;
+        if (copyLength && static_cast<size_t>(inOffset) < outOffset + copyLength &&
+            static_cast<size_t>(outOffset) < inOffset + copyLength) {
+            return -EINVAL;
+        }
+    }
+
+    return SpliceHandles(in, inOffsetPtr, out, outOffsetPtr, len);
+}
+
+// Largest amount of records filled in by one call to getdents64
+#define GETDENTS_MAX_BUFFER 65536
+
+struct GetDentsBuffer {
+    uint8_t* buffer;
+    size_t size;
+    size_t used;
+    bool full; // A record did not fit
+};
+
+static bool GetDentsFiller(void* context, const DirectoryEntry& ent, off_t next) {
+    GetDentsBuffer* buf = reinterpret_cast<GetDentsBuffer*>(context);
+
+    size_t nameLength = strlen(ent.name);
+    size_t recordLength = LEMON_DIRENT64_RECLEN(nameLength);
+    if (buf->used + recordLength > buf->size) {
+        buf->full = true;
+        return false;
+    }
+
+    // Zero the whole record first, the padding is copied to userspace
+    lemon_dirent64* dirent = reinterpret_cast<lemon_dirent64*>(buf->buffer + buf->used);
+    memset(dirent, 0, recordLength);
+    dirent->d_ino = ent.inode;
+    dirent->d_off = next;
+    dirent->d_reclen = recordLength;
+    dirent->d_type = ent.flags;
+    memcpy(dirent->d_name, ent.name, nameLength);
+
+    buf->used += recordLength;
+    return true;
+}
+
+/////////////////////////////
+/// \brief SysGetDents64(fd, buffer, count)
+///
+/// Read as many directory entries as fit into buffer, the directory is only locked once
+/// and filesystems read each directory block once for the whole batch.
+/// The file position is advanced past the last entry returned.
+///
+/// \param fd File descriptor of directory
+/// \param buffer Buffer to fill with lemon_dirent64 records
+/// \param count Size of buffer in bytes
+///
+/// \return Bytes written to buffer, 0 at the end of the directory, otherwise a negative error code
+/////////////////////////////
+long SysGetDents64(RegisterContext* r) {
+    Process* process = Process::Current();
+
+    FancyRefPtr<UNIXOpenFile> handle = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG0(r)));
+    if (!handle) {
+        return -EBADF;
+    }
+
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(SC_ARG1(r));
+    size_t count = SC_ARG2(r);
+    if (!count) {
+        return -EINVAL;
+    } else if (!Memory::CheckUsermodePointer(SC_ARG1(r), count, process->addressSpace)) {
+        return -EFAULT;
+    }
+
+    // Filesystem locks are held while filling records so fill a kernel buffer
+    GetDentsBuffer buf;
+    buf.size = MIN(count, GETDENTS_MAX_BUFFER);
+    buf.used = 0;
+    buf.full = false;
+    buf.buffer = reinterpret_cast<uint8_t*>(kmalloc(buf.size));
+
+    long ret = fs::ReadDirBatch(handle, GetDentsFiller, &buf);
+    if (ret >= 0) {
+        if (!buf.used && buf.full) {
+            ret = -EINVAL; // Buffer too small for the next record
+        } else if (UserMemcpy(buffer, buf.buffer, buf.used)) {
+            ret = -EFAULT;
+        } else {
+            ret = buf.used;
+        }
+    }
+
+    kfree(buf.buffer);
+    return ret;
+}
+
+static bool GetDentsPlusFiller(void* context, const DirectoryEntry& ent, off_t next) {
+    GetDentsBuffer* buf = reinterpret_cast<GetDentsBuffer*>(context);
+
+    size_t nameLength = strlen(ent.name);
+    size_t recordLength = LEMON_DIRENT_PLUS_RECLEN(nameLength);
+    if (buf->used + recordLength > buf->size) {
+        buf->full = true;
+        return false;
+    }
+
+    // Attributes are filled in once the directory is unlocked
+    lemon_dirent_plus* dirent = reinterpret_cast<lemon_dirent_plus*>(buf->buffer + buf->used);
+    memset(dirent, 0, recordLength);
+    dirent->d_off = next;
+    dirent->d_reclen = recordLength;
+    dirent->d_type = ent.flags;
+    dirent->st_ino = ent.inode;
+    memcpy(dirent->d_name, ent.name, nameLength);
+
+    buf->used += recordLength;
+    return true;
+}
+
+/////////////////////////////
+/// \brief SysGetDentsPlus(fd, buffer, count)
+///
+/// Like SysGetDents64, but each record also carries the attributes of the file (as with lstat).
+/// Saves a stat and a path walk per entry when listing a directory with details.
+/// Ext2 reads ahead the inode table blocks of the whole batch in sorted order,
+/// so looking up the attributes afterwards hits the block cache.
+///
+/// \param fd File descriptor of directory
+/// \param buffer Buffer to fill with lemon_dirent_plus records
+/// \param count Size of buffer in bytes
+///
+/// \return Bytes written to buffer, 0 at the end of the directory, otherwise a negative error code
+/////////////////////////////
+long SysGetDentsPlus(RegisterContext* r) {
+    Process* process = Process::Current();
+
+    FancyRefPtr<UNIXOpenFile> handle = SC_TRY_OR_ERROR(process->GetHandleAs<UNIXOpenFile>(SC_ARG0(r)));
+    if (!handle) {
+        return -EBADF;
+    }
+
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(SC_ARG1(r));
+    size_t count = SC_ARG2(r);
+    if (!count) {
+        return -EINVAL;
+    } else if (!Memory::CheckUsermodePointer(SC_ARG1(r), count, process->addressSpace)) {
+        return -EFAULT;
+    }
+
+    GetDentsBuffer buf;
+    buf.size = MIN(count, GETDENTS_MAX_BUFFER);
+    buf.used = 0;
+    buf.full = false;
+    buf.buffer = reinterpret_cast<uint8_t*>(kmalloc(buf.size));
+
+    long ret = fs::ReadDirBatch(handle, GetDentsPlusFiller, &buf);
+    if (ret < 0) {
+        kfree(buf.buffer);
+        return ret;
+    } else if (!buf.used && buf.full) {
+        kfree(buf.buffer);
+        return -EINVAL; // Buffer too small for the next record
+    }
+
+    // Look up each entry in the directory itself, skipping the path walk
+    for (size_t offset = 0; offset < buf.used;) {
+        lemon_dirent_plus* dirent = reinterpret_cast<lemon_dirent_plus*>(buf.buffer + offset);
+        offset += dirent->d_reclen;
+
+        FsNode* node = fs::FindDir(handle->node, dirent->d_name);
+        if (!node) {
+            dirent->d_error = -ENOENT;
+            continue;
+        }
+
+        stat_t st;
+        FillStat(node, &st);
+
+        dirent->st_dev = st.st_dev;
+        dirent->st_ino = st.st_ino;
+        dirent->st_mode = st.st_mode;
+        dirent->st_nlink = st.st_nlink;
+        dirent->st_uid = st.st_uid;
+        dirent->st_gid = st.st_gid;
+        dirent->st_rdev = st.st_rdev;
+        dirent->st_size = st.st_size;
+        dirent->st_blksize = st.st_blksize;
+        dirent->st_blocks = st.st_blocks;
+    }
+
+    if (UserMemcpy(buffer, buf.buffer, buf.used)) {
+        ret = -EFAULT;
+    } else {
+        ret = buf.used;
+    }
+
+    kfree(buf.buffer);
+    return ret;
+}
@@ -0,0 +1,53 @@
+#include <Scheduler.h>
+#include <Syscalls.h>
+
+#include <Objects/IORing.h>
+
+#include <UserPointer.h>
+
+/////////////////////////////
+/// \name SysIORingSetup (entries, params) - Create an asynchronous I/O ring
+/// \param entries - Amount of submission queue entries
+/// \param params - Pointer to ioring_params, filled with the size and address of the ring
+///
+/// \return Handle of the ring, negative error code on failure
+/////////////////////////////
+long SysIORingSetup(RegisterContext* r) {
+    Process* proc = Process::Current();
+    unsigned entries = SC_ARG0(r);
+    UserPointer<ioring_params> params = SC_ARG1(r);
+
+    if (!Memory::CheckUsermodePointer(SC_ARG1(r), sizeof(ioring_params), proc->addressSpace)) {
+        return -EFAULT;
+    }
+
+    FancyRefPtr<IORing> ring = SC_TRY_OR_ERROR(IORing::Create(proc, entries));
+
+    ioring_params p;
+    p.sqEntries = ring->SubmissionEntries();
+    p.cqEntries = ring->CompletionEntries();
+    p.ringBase = ring->UserBase();
+    p.ringSize = ring->Size();
+    if (params.StoreValue(p)) {
+        proc->addressSpace->UnmapMemory(ring->UserBase(), ring->Size()); // Do not leave the ring mapped
+        return -EFAULT;
+    }
+
+    return proc->AllocateHandle(ring);
+}
+
+/////////////////////////////
+/// \name SysIORingEnter (ring, toSubmit, minComplete, flags) - Submit and wait on operations
+/// \param ring - Handle of the ring
+/// \param toSubmit - Maximum amount of submission queue entries to consume
+/// \param minComplete - With IORING_ENTER_GETEVENTS, amount of completions to wait for
+/// \param flags - IORING_ENTER_* flags
+///
+/// \return Amount of entries consumed, negative error code on failure
+/////////////////////////////
+long SysIORingEnter(RegisterContext* r) {
+    Process* proc = Process::Current();
+
+    FancyRefPtr<IORing> ring = SC_TRY_OR_ERROR(proc->GetHandleAs<IORing>(SC_ARG0(r)));
+    return IORing::Enter(ring, proc, SC_ARG1(r), SC_ARG2(r), SC_ARG3(r));
+}
@@ -2,6 +2,7 @@
 
 #include <CPU.h>
 #include <Debug.h>
+#include <SMP.h>
 #include <Scheduler.h>
 #include <Timer.h>
 #include <TimerEvent.h>
@@ -373,6 +374,11 @@ void Thread::Unblock() {
     if (state != ThreadStateZombie)
         state = ThreadStateRunning;
 
+    // Let a real-time thread preempt whatever is running on its CPU
+    if (IsRealTime() && cpu >= 0) {
+        SMP::cpus[cpu]->rtPreempt = true;
+    }
+
     releaseLock(&stateLock);
     if(intsWereEnabled)
         asm volatile("sti");
@@ -54,6 +54,8 @@ public:
         case IoCtlOutputSetAsync:
             m_async = (bool)arg;
             return 0;
+        case IoCtlOutputGetUnderruns:
+            return (int)c->UnderrunCount();
         case IoCtlOutputSetNumberOfChannels:
         default:
             return -EINVAL;
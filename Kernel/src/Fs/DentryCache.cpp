@@ -0,0 +1,254 @@
+#include <Fs/DentryCache.h>
+
+#include <CString.h>
+#include <Hash.h>
+#include <Lock.h>
+#include <Memory.h>
+
+// Readers give up and go to the filesystem after this many attempts
+#define DENTRY_LOOKUP_RETRIES 8
+
+namespace fs::DentryCache {
+
+struct Bucket {
+    volatile uint32_t sequence; // Odd while the bucket is being modified
+    Dentry* volatile head;
+};
+
+static Bucket buckets[DENTRY_CACHE_BUCKETS];
+
+// Protects everything but lookups
+static lock_t dentryLock = 0;
+static uint64_t invalidations = 0;
+
+static Dentry* pool = nullptr;
+static Dentry* freeList = nullptr; // Linked through hashNext
+static unsigned clockHand = 0;
+
+// FNV-1a over the name, mixed with the parent directory
+static ALWAYS_INLINE uint32_t HashName(FsNode* dir, const char* name, size_t length) {
+    uint32_t hash = 2166136261U ^ HashU(static_cast<unsigned>(reinterpret_cast<uintptr_t>(dir) >> 4));
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619U;
+    }
+
+    return hash;
+}
+
+static ALWAYS_INLINE void BeginWrite(Bucket& bucket) {
+    __atomic_store_n(&bucket.sequence, bucket.sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static ALWAYS_INLINE void EndWrite(Bucket& bucket) {
+    __atomic_store_n(&bucket.sequence, bucket.sequence + 1, __ATOMIC_RELEASE);
+}
+
+static void UnlinkLocked(Dentry* dentry) {
+    Bucket& bucket = buckets[dentry->hash % DENTRY_CACHE_BUCKETS];
+
+    BeginWrite(bucket);
+    if (bucket.head == dentry) {
+        bucket.head = dentry->hashNext;
+    } else {
+        Dentry* previous = bucket.head;
+        while (previous && previous->hashNext != dentry) {
+            previous = previous->hashNext;
+        }
+
+        if (previous) {
+            previous->hashNext = dentry->hashNext;
+        }
+    }
+    EndWrite(bucket);
+
+    if (dentry->parentPrev) {
+        dentry->parentPrev->parentNext = dentry->parentNext;
+    } else {
+        dentry->parent->childDentries = dentry->parentNext;
+    }
+
+    if (dentry->parentNext) {
+        dentry->parentNext->parentPrev = dentry->parentPrev;
+    }
+
+    if (dentry->node) {
+        if (dentry->nodePrev) {
+            dentry->nodePrev->nodeNext = dentry->nodeNext;
+        } else {
+            dentry->node->dentries = dentry->nodeNext;
+        }
+
+        if (dentry->nodeNext) {
+            dentry->nodeNext->nodePrev = dentry->nodePrev;
+        }
+    }
+
+    // The memory may still be read by lookups, the bucket sequence tells them to retry
+    dentry->parent = nullptr;
+    dentry->node = nullptr;
+    dentry->hashNext = freeList;
+    freeList = dentry;
+}
+
+static Dentry* AllocateLocked() {
+    if (!pool) {
+        pool = new Dentry[DENTRY_CACHE_ENTRIES];
+        for (unsigned i = 0; i < DENTRY_CACHE_ENTRIES; i++) {
+            pool[i].parent = nullptr;
+            pool[i].hashNext = (i + 1 < DENTRY_CACHE_ENTRIES) ? &pool[i + 1] : nullptr;
+        }
+        freeList = pool;
+    }
+
+    if (!freeList) {
+        // Clock eviction, take the first entry that has not been looked up since the hand last passed
+        for (;;) {
+            Dentry* dentry = &pool[clockHand];
+            clockHand = (clockHand + 1) % DENTRY_CACHE_ENTRIES;
+
+            if (!dentry->parent) {
+                continue;
+            }
+
+            if (dentry->referenced) {
+                dentry->referenced = false;
+                continue;
+            }
+
+            UnlinkLocked(dentry);
+            break;
+        }
+    }
+
+    Dentry* dentry = freeList;
+    freeList = dentry->hashNext;
+    return dentry;
+}
+
+bool Lookup(FsNode* dir, const char* name, FsNode*& node) {
+    size_t length = strlen(name);
+    if (length > DENTRY_NAME_MAX) {
+        return false;
+    }
+
+    uint32_t hash = HashName(dir, name, length);
+    Bucket& bucket = buckets[hash % DENTRY_CACHE_BUCKETS];
+
+    for (int retry = 0; retry < DENTRY_LOOKUP_RETRIES; retry++) {
+        uint32_t sequence = __atomic_load_n(&bucket.sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1) {
+            asm volatile("pause");
+            continue; // Being modified
+        }
+
+        Dentry* found = nullptr;
+        FsNode* result = nullptr;
+
+        // Chains can be left inconsistent by a concurrent writer, never walk more than the pool size
+        Dentry* dentry = bucket.head;
+        for (unsigned i = 0; dentry && i < DENTRY_CACHE_ENTRIES; i++, dentry = dentry->hashNext) {
+            if (dentry->hash == hash && dentry->parent == dir && !strncmp(dentry->name, name, DENTRY_NAME_MAX + 1)) {
+                found = dentry;
+                result = dentry->node;
+                break;
+            }
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&bucket.sequence, __ATOMIC_RELAXED) != sequence) {
+            continue;
+        }
+
+        if (found) {
+            found->referenced = true;
+            node = result;
+            return true;
+        }
+
+        return false;
+    }
+
+    return false;
+}
+
+uint64_t Generation() { return __atomic_load_n(&invalidations, __ATOMIC_ACQUIRE); }
+
+void Insert(FsNode* dir, const char* name, FsNode* node, uint64_t generation) {
+    size_t length = strlen(name);
+    if (length > DENTRY_NAME_MAX) {
+        return;
+    }
+
+    uint32_t hash = HashName(dir, name, length);
+    Bucket& bucket = buckets[hash % DENTRY_CACHE_BUCKETS];
+
+    ScopedSpinLock lock(dentryLock);
+    if (invalidations != generation) {
+        return; // The directory may have changed since the lookup
+    }
+
+    for (Dentry* dentry = bucket.head; dentry; dentry = dentry->hashNext) {
+        if (dentry->hash == hash && dentry->parent == dir && !strcmp(dentry->name, name)) {
+            return; // Inserted by someone else
+        }
+    }
+
+    Dentry* dentry = AllocateLocked();
+    dentry->parent = dir;
+    dentry->node = node;
+    dentry->hash = hash;
+    dentry->referenced = false;
+    strcpy(dentry->name, name);
+
+    dentry->parentPrev = nullptr;
+    dentry->parentNext = dir->childDentries;
+    if (dir->childDentries) {
+        dir->childDentries->parentPrev = dentry;
+    }
+    dir->childDentries = dentry;
+
+    if (node) {
+        dentry->nodePrev = nullptr;
+        dentry->nodeNext = node->dentries;
+        if (node->dentries) {
+            node->dentries->nodePrev = dentry;
+        }
+        node->dentries = dentry;
+    }
+
+    BeginWrite(bucket);
+    dentry->hashNext = bucket.head;
+    bucket.head = dentry;
+    EndWrite(bucket);
+}
+
+void Invalidate(FsNode* dir, const char* name) {
+    uint32_t hash = HashName(dir, name, strlen(name));
+    Bucket& bucket = buckets[hash % DENTRY_CACHE_BUCKETS];
+
+    ScopedSpinLock lock(dentryLock);
+    __atomic_add_fetch(&invalidations, 1, __ATOMIC_RELEASE);
+
+    for (Dentry* dentry = bucket.head; dentry; dentry = dentry->hashNext) {
+        if (dentry->hash == hash && dentry->parent == dir && !strcmp(dentry->name, name)) {
+            UnlinkLocked(dentry);
+            return;
+        }
+    }
+}
+
+void InvalidateNode(FsNode* node) {
+    ScopedSpinLock lock(dentryLock);
+    __atomic_add_fetch(&invalidations, 1, __ATOMIC_RELEASE);
+
+    while (node->childDentries) {
+        UnlinkLocked(node->childDentries);
+    }
+
+    while (node->dentries) {
+        UnlinkLocked(node->dentries);
+    }
+}
+
+} // namespace fs::DentryCache
@@ -4,6 +4,7 @@
 #include <Device.h>
 #include <Errno.h>
 #include <Logging.h>
+#include <Math.h>
 #include <Memory.h>
 
 namespace fs::FAT32 {
@@ -53,8 +54,24 @@ Fat32Volume::Fat32Volume(PartitionDevice* _part, char* name) {
               (char*)bootRecord->bpb.oem, bootRecord->bpb.largeSectorCount * 512 / 1024 / 1024);
 
     clusterSizeBytes = bootRecord->bpb.sectorsPerCluster * part->parentDisk->blocksize;
+    clusterCount = (bootRecord->bpb.largeSectorCount -
+                    (bootRecord->bpb.reservedSectors + bootRecord->ebr.sectorsPerFAT * bootRecord->bpb.fatCount)) /
+                   bootRecord->bpb.sectorsPerCluster;
+
+    fatSector = bootRecord->bpb.reservedSectors;
+    if (bootRecord->ebr.flags & FAT32_FLAG_NO_MIRROR) {
+        fatSector += (bootRecord->ebr.flags & FAT32_FLAG_ACTIVE_FAT) * bootRecord->ebr.sectorsPerFAT;
+    }
+
+    // FAT blocks are read as they are needed
+    fatBlockCount =
+        (static_cast<uint64_t>(bootRecord->ebr.sectorsPerFAT) * part->parentDisk->blocksize + FAT32_FAT_BLOCK_SIZE - 1) /
+        FAT32_FAT_BLOCK_SIZE;
+    fatCache = reinterpret_cast<uint32_t**>(kmalloc(sizeof(uint32_t*) * fatBlockCount));
+    memset(fatCache, 0, sizeof(uint32_t*) * fatBlockCount);
 
     fat32MountPoint.flags = FS_NODE_MOUNTPOINT | FS_NODE_DIRECTORY;
+    fat32MountPoint.cacheDentries = true;
     fat32MountPoint.inode = bootRecord->ebr.rootClusterNum;
 
     fat32MountPoint.vol = this;
@@ -67,110 +84,207 @@ Fat32Volume::Fat32Volume(PartitionDevice* _part, char* name) {
     strcpy(mountPointDirent.name, name);
 }
 
-List<uint32_t>* Fat32Volume::GetClusterChain(uint32_t cluster) {
-    List<uint32_t>* list = new List<uint32_t>();
+int Fat32Volume::GetNextCluster(uint32_t cluster, uint32_t& next) {
+    uint32_t block = cluster / FAT32_FAT_BLOCK_ENTRIES;
+    if (block >= fatBlockCount) {
+        return -EIO;
+    }
 
-    uint32_t* buf = (uint32_t*)kmalloc(4096);
+    uint32_t* fatBlock = __atomic_load_n(&fatCache[block], __ATOMIC_ACQUIRE);
+    if (!fatBlock) {
+        fatBlock = reinterpret_cast<uint32_t*>(kmalloc(FAT32_FAT_BLOCK_SIZE));
+        if (part->ReadBlock(fatSector + block * (FAT32_FAT_BLOCK_SIZE / part->parentDisk->blocksize),
+                            FAT32_FAT_BLOCK_SIZE, fatBlock)) {
+            kfree(fatBlock);
+            return -EIO;
+        }
 
-    uint32_t lastBlock = 0xFFFFFFFF;
+        // FAT blocks are never evicted, if another thread got here first use its copy
+        uint32_t* expected = nullptr;
+        if (!__atomic_compare_exchange_n(&fatCache[block], &expected, fatBlock, false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE)) {
+            kfree(fatBlock);
+            fatBlock = expected;
+        }
+    }
 
-    do {
-        list->add_back(cluster);
+    next = fatBlock[cluster % FAT32_FAT_BLOCK_ENTRIES] & FAT32_CLUSTER_MASK;
+    return 0;
+}
 
-        uint32_t block = ((cluster * 4) / 4096);
-        uint32_t offset = cluster % (4096 / 4);
+int Fat32Volume::LoadExtents(Fat32Node* node) {
+    if (__atomic_load_n(&node->extentsLoaded, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
 
-        if (block != lastBlock) {
-            if (part->ReadBlock(bootRecord->bpb.reservedSectors +
-                                    block * (4096 / part->parentDisk->blocksize) /* Get Sector of Block */,
-                                4096, buf)) {
-                delete list;
-                return nullptr;
-            }
+    node->extentLock.AcquireWrite();
+    if (node->extentsLoaded) {
+        node->extentLock.ReleaseWrite();
+        return 0;
+    }
+
+    uint32_t cluster = node->inode;
+    uint32_t length = 0;
+    while (cluster >= 2 && cluster < FAT32_CLUSTER_EOC) {
+        if (length >= clusterCount || cluster - 2 >= clusterCount) {
+            Log::Warning("[FAT32] Invalid cluster chain for inode %u", node->inode);
+            node->extents.clear();
+            node->extentLock.ReleaseWrite();
+            return -EIO;
+        }
 
-            lastBlock = block;
+        if (node->extents.size() && node->extents.at(node->extents.size() - 1).diskCluster +
+                                            node->extents.at(node->extents.size() - 1).length == cluster) {
+            node->extents.at(node->extents.size() - 1).length++;
+        } else {
+            node->extents.add_back({.fileCluster = length, .diskCluster = cluster, .length = 1});
         }
+        length++;
 
-        cluster = buf[offset] & 0x0FFFFFFF;
+        if (int e = GetNextCluster(cluster, cluster); e) {
+            node->extents.clear();
+            node->extentLock.ReleaseWrite();
+            return e;
+        }
+    }
 
-    } while (cluster && (cluster & 0x0FFFFFFF) < 0x0FFFFFF8);
+    node->chainLength = length;
+    __atomic_store_n(&node->extentsLoaded, true, __ATOMIC_RELEASE);
 
-    return list;
+    node->extentLock.ReleaseWrite();
+    return 0;
 }
 
-void* Fat32Volume::ReadClusterChain(uint32_t cluster, int* clusterCount, size_t max) {
-    uint32_t maxCluster = (max / (bootRecord->bpb.sectorsPerCluster * part->parentDisk->blocksize)) + 1;
-    List<uint32_t>* clusterChain = GetClusterChain(cluster);
+ssize_t Fat32Volume::ReadClusters(Fat32Node* node, size_t offset, size_t size, uint8_t* buffer) {
+    if (int e = LoadExtents(node); e) {
+        return e;
+    }
 
-    if (!clusterChain)
-        return nullptr;
+    size_t chainSize = static_cast<size_t>(node->chainLength) * clusterSizeBytes;
+    if (offset >= chainSize) {
+        return 0;
+    } else if (offset + size > chainSize) {
+        size = chainSize - offset;
+    }
+
+    const size_t blocksize = part->parentDisk->blocksize;
+    uint8_t* bounce = nullptr;
+
+    // Find the extent containing the first cluster
+    uint32_t fileCluster = offset / clusterSizeBytes;
+    size_t low = 0;
+    size_t high = node->extents.size();
+    while (high - low > 1) {
+        size_t mid = (low + high) / 2;
+        if (node->extents.at(mid).fileCluster <= fileCluster) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
 
-    uint8_t* buf = reinterpret_cast<uint8_t*>(kmalloc(clusterChain->get_length() * clusterSizeBytes));
-    void* _buf = buf;
+    size_t done = 0;
+    for (size_t i = low; i < node->extents.size() && done < size; i++) {
+        const Fat32Extent& extent = node->extents.at(i);
 
-    for (unsigned i = 0; i < clusterChain->get_length() && maxCluster; i++) {
-        part->ReadBlock(ClusterToLBA(clusterChain->get_at(i)), clusterSizeBytes, buf);
+        size_t pos = offset + done; // Position within the chain
+        size_t extentOffset = pos - static_cast<size_t>(extent.fileCluster) * clusterSizeBytes;
+        size_t extentRemaining = static_cast<size_t>(extent.length) * clusterSizeBytes - extentOffset;
 
-        buf += clusterSizeBytes;
-    }
+        uint64_t lba = ClusterToLBA(extent.diskCluster) + extentOffset / blocksize;
+        size_t sectorOffset = extentOffset % blocksize;
+        size_t count = MIN(size - done, extentRemaining);
+
+        // Partial sector at the start of the range
+        if (sectorOffset) {
+            if (!bounce) {
+                bounce = reinterpret_cast<uint8_t*>(kmalloc(blocksize));
+            }
 
-    if (clusterCount)
-        *clusterCount = clusterChain->get_length();
+            if (part->ReadBlock(lba, blocksize, bounce)) {
+                kfree(bounce);
+                return -EIO;
+            }
 
-    delete clusterChain;
+            size_t partial = MIN(count, blocksize - sectorOffset);
+            memcpy(buffer + done, bounce + sectorOffset, partial);
 
-    return _buf;
-}
+            done += partial;
+            count -= partial;
+            lba++;
+        }
 
-void* Fat32Volume::ReadClusterChain(uint32_t cluster, int* clusterCount) {
-    if (cluster == 0)
-        cluster = bootRecord->ebr.rootClusterNum;
-    List<uint32_t>* clusterChain = GetClusterChain(cluster);
+        // Whole sectors are read straight into the buffer
+        size_t direct = count - count % blocksize;
+        if (direct) {
+            if (part->ReadBlock(lba, direct, buffer + done)) {
+                if (bounce) {
+                    kfree(bounce);
+                }
+                return -EIO;
+            }
 
-    if (!clusterChain)
-        return nullptr;
+            done += direct;
+            count -= direct;
+            lba += direct / blocksize;
+        }
+
+        // Partial sector at the end of the range
+        if (count) {
+            if (!bounce) {
+                bounce = reinterpret_cast<uint8_t*>(kmalloc(blocksize));
+            }
+
+            if (part->ReadBlock(lba, blocksize, bounce)) {
+                kfree(bounce);
+                return -EIO;
+            }
+
+            memcpy(buffer + done, bounce, count);
+            done += count;
+        }
+    }
 
-    uint8_t* buf = reinterpret_cast<uint8_t*>(kmalloc(clusterChain->get_length() * clusterSizeBytes));
-    void* _buf = buf;
+    if (bounce) {
+        kfree(bounce);
+    }
 
-    for (unsigned i = 0; i < clusterChain->get_length(); i++) {
-        part->ReadBlock(ClusterToLBA(clusterChain->get_at(i)), clusterSizeBytes, buf);
+    return done;
+}
 
-        buf += clusterSizeBytes;
+void* Fat32Volume::ReadDirectory(Fat32Node* node, size_t* size) {
+    if (LoadExtents(node)) {
+        return nullptr;
     }
 
-    if (clusterCount)
-        *clusterCount = clusterChain->get_length();
+    size_t directorySize = static_cast<size_t>(node->chainLength) * clusterSizeBytes;
+    void* buf = kmalloc(directorySize);
 
-    delete clusterChain;
+    ssize_t r = ReadClusters(node, 0, directorySize, reinterpret_cast<uint8_t*>(buf));
+    if (r < 0 || static_cast<size_t>(r) != directorySize) {
+        kfree(buf);
+        return nullptr;
+    }
 
-    return _buf;
+    *size = directorySize;
+    return buf;
 }
 
 ssize_t Fat32Volume::Read(Fat32Node* node, size_t offset, size_t size, uint8_t* buffer) {
     if (!node->inode || node->flags & FS_NODE_DIRECTORY)
         return -1;
 
-    int count;
-    void* _buf = ReadClusterChain(node->inode, &count, size);
-
-    if (static_cast<unsigned>(count) * bootRecord->bpb.sectorsPerCluster * part->parentDisk->blocksize < size)
+    if (offset >= node->size)
         return 0;
 
-    memcpy(buffer, _buf, size);
-    return size;
-}
-
-ssize_t Fat32Volume::Write(Fat32Node* node, size_t offset, size_t size, uint8_t* buffer) {
-    return -EROFS;
+    if (offset + size > node->size)
+        size = node->size - offset;
 
-    List<uint32_t>* clusters = GetClusterChain(node->inode);
-    if (offset + size > clusters->get_length() * bootRecord->bpb.sectorsPerCluster * part->parentDisk->blocksize) {
-        // TODO: Allocate clusters
-        Log::Info("[FAT32] Allocating Clusters");
-    }
+    return ReadClusters(node, offset, size, buffer);
 }
 
+ssize_t Fat32Volume::Write(Fat32Node* node, size_t offset, size_t size, uint8_t* buffer) { return -EROFS; }
+
 void Fat32Volume::Open(Fat32Node* node, uint32_t flags) {}
 
 void Fat32Volume::Close(Fat32Node* node) {}
@@ -179,17 +293,15 @@ int Fat32Volume::ReadDir(Fat32Node* node, DirectoryEntry* dirent, uint32_t index
     unsigned lfnCount = 0;
     unsigned entryCount = 0;
 
-    uint32_t cluster = node->inode;
-    int clusterCount = 0;
-
-    fat_entry_t* dirEntries = (fat_entry_t*)ReadClusterChain(cluster, &clusterCount);
+    size_t directorySize = 0;
+    fat_entry_t* dirEntries = (fat_entry_t*)ReadDirectory(node, &directorySize);
+    if (!dirEntries) {
+        return -EIO;
+    }
 
-    fat_entry_t* dirEntry;
     int dirEntryIndex = -1;
 
-    fat_lfn_entry_t** lfnEntries;
-
-    for (unsigned i = 0; i < static_cast<unsigned>(clusterCount) * clusterSizeBytes / sizeof(fat_entry_t); i++) {
+    for (unsigned i = 0; i < directorySize / sizeof(fat_entry_t); i++) {
         if (dirEntries[i].filename[0] == 0)
             continue; // No Directory Entry at index
         else if (dirEntries[i].filename[0] == 0xE5) {
@@ -202,7 +314,6 @@ int Fat32Volume::ReadDir(Fat32Node* node, DirectoryEntry* dirent, uint32_t index
             continue;
         } else {
             if (entryCount == index) {
-                dirEntry = &dirEntries[i];
                 dirEntryIndex = i;
                 break;
             }
@@ -213,18 +324,70 @@ int Fat32Volume::ReadDir(Fat32Node* node, DirectoryEntry* dirent, uint32_t index
     }
 
     if (dirEntryIndex == -1) {
+        kfree(dirEntries);
         return 0;
     }
 
-    lfnEntries = (fat_lfn_entry_t**)kmalloc(sizeof(fat_lfn_entry_t*) * lfnCount);
+    FillDirectoryEntry(dirEntries, dirEntryIndex, lfnCount, dirent);
+
+    kfree(dirEntries);
+    return 1;
+}
+
+int Fat32Volume::ReadDirBatch(Fat32Node* node, off_t& cursor, DirectoryFiller filler, void* context) {
+    if (cursor < 0) {
+        return -EINVAL;
+    }
+
+    size_t directorySize = 0;
+    fat_entry_t* dirEntries = (fat_entry_t*)ReadDirectory(node, &directorySize);
+    if (!dirEntries) {
+        return -EIO;
+    }
+
+    // The cursor is the index of the first directory entry (or long file name entry) of the next file
+    int count = 0;
+    unsigned lfnCount = 0;
+    DirectoryEntry dirent;
+    for (size_t i = cursor; i < directorySize / sizeof(fat_entry_t); i++) {
+        if (dirEntries[i].filename[0] == 0) {
+            continue; // No Directory Entry at index
+        } else if (dirEntries[i].filename[0] == 0xE5) {
+            lfnCount = 0;
+            continue; // Unused Entry
+        } else if (dirEntries[i].attributes == 0x0F) {
+            lfnCount++; // Long File Name Entry
+            continue;
+        } else if (dirEntries[i].attributes & 0x08 /*Volume ID*/) {
+            lfnCount = 0;
+            continue;
+        }
+
+        FillDirectoryEntry(dirEntries, i, lfnCount, &dirent);
+        lfnCount = 0;
 
-    for (unsigned i = 0; i < lfnCount; i++) {
-        fat_lfn_entry_t* lfnEntry = (fat_lfn_entry_t*)(&dirEntries[dirEntryIndex - i - 1]);
+        if (!filler(context, dirent, i + 1)) {
+            break;
+        }
 
-        lfnEntries[i] = lfnEntry;
+        cursor = i + 1;
+        count++;
     }
 
+    kfree(dirEntries);
+    return count;
+}
+
+void Fat32Volume::FillDirectoryEntry(fat_entry_t* dirEntries, unsigned index, unsigned lfnCount,
+                                     DirectoryEntry* dirent) {
+    fat_entry_t* dirEntry = &dirEntries[index];
+
     if (lfnCount) {
+        fat_lfn_entry_t* lfnEntries[lfnCount];
+        for (unsigned i = 0; i < lfnCount; i++) {
+            lfnEntries[i] = (fat_lfn_entry_t*)(&dirEntries[index - i - 1]);
+        }
+
         GetLongFilename(dirent->name, lfnEntries, lfnCount);
     } else {
         strncpy(dirent->name, (char*)dirEntry->filename, 8);
@@ -240,27 +403,23 @@ int Fat32Volume::ReadDir(Fat32Node* node, DirectoryEntry* dirent, uint32_t index
         dirent->flags = DT_DIR;
     else
         dirent->flags = DT_REG;
-
-    return 1;
 }
 
 FsNode* Fat32Volume::FindDir(Fat32Node* node, const char* name) {
     unsigned lfnCount = 0;
 
-    uint32_t cluster = node->inode;
-    int clusterCount = 0;
-
-    fat_entry_t* dirEntries = (fat_entry_t*)ReadClusterChain(cluster, &clusterCount);
-
-    List<int> foundEntries;
-    List<int> foundEntriesLfnCount;
+    size_t directorySize = 0;
+    fat_entry_t* dirEntries = (fat_entry_t*)ReadDirectory(node, &directorySize);
+    if (!dirEntries) {
+        return nullptr;
+    }
 
     fat_lfn_entry_t** lfnEntries;
     Fat32Node* _node = nullptr;
 
-    for (unsigned i = 0; i < static_cast<unsigned>(clusterCount) * clusterSizeBytes; i++) {
+    for (unsigned i = 0; i < directorySize / sizeof(fat_entry_t); i++) {
         if (dirEntries[i].filename[0] == 0)
-            return nullptr; // No Directory Entry at index
+            break; // No Directory Entry at index
         else if (dirEntries[i].filename[0] == 0xE5) {
             lfnCount = 0;
             continue; // Unused Entry
@@ -293,23 +452,33 @@ FsNode* Fat32Volume::FindDir(Fat32Node* node, const char* name) {
                 }
             }
 
-            if (strcmp(_name, name) == 0) {
+            bool match = strcmp(_name, name) == 0;
+            kfree(_name);
+
+            if (match) {
                 uint64_t clusterNum = (((uint32_t)dirEntries[i].highClusterNum) << 16) | dirEntries[i].lowClusterNum;
-                if (clusterNum == bootRecord->ebr.rootClusterNum || clusterNum == 0)
+                if (clusterNum == bootRecord->ebr.rootClusterNum || clusterNum == 0) {
+                    kfree(dirEntries);
                     return mountPoint; // Root Directory
+                }
                 _node = new Fat32Node();
                 _node->size = dirEntries[i].fileSize;
                 _node->inode = clusterNum;
-                if (dirEntries[i].attributes & FAT_ATTR_DIRECTORY)
+                if (dirEntries[i].attributes & FAT_ATTR_DIRECTORY) {
                     _node->flags = FS_NODE_DIRECTORY;
-                else
+                    _node->cacheDentries = true;
+                } else {
                     _node->flags = FS_NODE_FILE;
+                    _node->pageCached = true;
+                }
                 break;
             }
             lfnCount = 0;
         }
     }
 
+    kfree(dirEntries);
+
     if (_node) {
         _node->vol = this;
     }
@@ -323,5 +492,9 @@ ssize_t Fat32Node::Write(size_t offset, size_t size, uint8_t* buffer) { return v
 
 int Fat32Node::ReadDir(DirectoryEntry* dirent, uint32_t index) { return vol->ReadDir(this, dirent, index); }
 
+int Fat32Node::ReadDirBatch(off_t& cursor, DirectoryFiller filler, void* context) {
+    return vol->ReadDirBatch(this, cursor, filler, context);
+}
+
 FsNode* Fat32Node::FindDir(const char* name) { return vol->FindDir(this, name); }
 } // namespace fs::FAT32
\ No newline at end of file
@@ -1,9 +1,12 @@
 #include <Fs/Filesystem.h>
 
 #include <Errno.h>
+#include <Fs/DentryCache.h>
 #include <Fs/FsVolume.h>
+#include <Fs/PageCache.h>
 #include <Fs/VolumeManager.h>
 #include <Logging.h>
+#include <Math.h>
 #include <Panic.h>
 #include <Scheduler.h>
 
@@ -189,21 +192,39 @@ FsNode* ResolvePath(const String& path, FsNode* workingDir, bool followSymlinks)
         currentNode = workingDir;
     }
 
-    Vector<String> components = path.Split('/');
-    if(components.size() == 0){
+    // Walk the path in place, one component at a time
+    const char* it = path.c_str();
+    char component[NAME_MAX + 1];
+
+    while(*it == '/') it++;
+    if(!*it){
         if(path.Compare("/") == 0){
             return fs::GetRoot();
         } else {
             return nullptr;
         }
     }
-    
-    unsigned i = 0;
-    for(; i < components.size() - 1; i++){
-        String& component = components[i];
-        FsNode* node = fs::FindDir(currentNode, component.c_str());
+
+    for(;;){
+        size_t length = 0;
+        while(*it && *it != '/'){
+            if(length >= NAME_MAX){
+                Log::Debug(debugLevelFilesystem, DebugLevelVerbose, "ResolvePath: Path component too long!");
+                return nullptr;
+            }
+
+            component[length++] = *it++;
+        }
+        component[length] = 0;
+
+        while(*it == '/') it++;
+        if(!*it){
+            break; // Last component
+        }
+
+        FsNode* node = fs::FindDir(currentNode, component);
         if (!node) {
-            Log::Debug(debugLevelFilesystem, DebugLevelVerbose, "%s not found!", component.c_str());
+            Log::Debug(debugLevelFilesystem, DebugLevelVerbose, "%s not found!", component);
 
             return nullptr;
         }
@@ -226,20 +247,16 @@ FsNode* ResolvePath(const String& path, FsNode* workingDir, bool followSymlinks)
         }
 
         if(!(node->IsDirectory())){
-            Log::Debug(debugLevelFilesystem, DebugLevelNormal, "Failed to resolve path component: Expected a directory at '%s'!", component.c_str());
+            Log::Debug(debugLevelFilesystem, DebugLevelNormal, "Failed to resolve path component: Expected a directory at '%s'!", component);
             return nullptr;
         }
 
         currentNode = node;
     }
 
-    if(i >= components.size()){
-        return currentNode;
-    }
-
-    FsNode* node = fs::FindDir(currentNode, components[i].c_str());
+    FsNode* node = fs::FindDir(currentNode, component);
     if(!node){
-        Log::Debug(debugLevelFilesystem, DebugLevelVerbose, "ResolvePath: Failed to find %s!", components[i].c_str());
+        Log::Debug(debugLevelFilesystem, DebugLevelVerbose, "ResolvePath: Failed to find %s!", component);
         return nullptr;
     }
 
@@ -260,7 +277,7 @@ FsNode* ResolvePath(const String& path, FsNode* workingDir, bool followSymlinks)
         }
     }
 
-    Log::Debug(debugLevelFilesystem, DebugLevelVerbose, "Found %s!", components[i].c_str());
+    Log::Debug(debugLevelFilesystem, DebugLevelVerbose, "Found %s!", component);
     return node;
 }
 
@@ -417,29 +434,255 @@ FsNode* Root::FindDir(const char* name) {
 ssize_t Read(FsNode* node, size_t offset, size_t size, void* buffer) {
     assert(node);
 
+    if (node->pageCached) {
+        return PageCache::Read(node, offset, size, reinterpret_cast<uint8_t*>(buffer));
+    }
+
     return node->Read(offset, size, reinterpret_cast<uint8_t*>(buffer));
 }
 
 ssize_t Write(FsNode* node, size_t offset, size_t size, void* buffer) {
     assert(node);
 
+    if (node->pageCached) {
+        return PageCache::Write(node, offset, size, reinterpret_cast<uint8_t*>(buffer));
+    }
+
     return node->Write(offset, size, reinterpret_cast<uint8_t*>(buffer));
 }
 
+ssize_t ReadV(FsNode* node, size_t offset, const iovec* iov, int iovcnt) {
+    assert(node);
+
+    if (!node->pageCached) {
+        return node->ReadV(offset, iov, iovcnt);
+    }
+
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        ssize_t ret =
+            PageCache::Read(node, offset + total, iov[i].iov_len, reinterpret_cast<uint8_t*>(iov[i].iov_base));
+        if (ret < 0) {
+            return total ? total : ret;
+        }
+
+        total += ret;
+        if (static_cast<size_t>(ret) < iov[i].iov_len) {
+            break; // End of file
+        }
+    }
+
+    return total;
+}
+
+ssize_t WriteV(FsNode* node, size_t offset, const iovec* iov, int iovcnt) {
+    assert(node);
+
+    if (!node->pageCached) {
+        return node->WriteV(offset, iov, iovcnt);
+    }
+
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        ssize_t ret =
+            PageCache::Write(node, offset + total, iov[i].iov_len, reinterpret_cast<uint8_t*>(iov[i].iov_base));
+        if (ret < 0) {
+            return total ? total : ret;
+        }
+
+        total += ret;
+        if (static_cast<size_t>(ret) < iov[i].iov_len) {
+            break;
+        }
+    }
+
+    return total;
+}
+
+// Move data through a kernel buffer, for nodes which are not page cached
+static ssize_t SpliceBuffered(FsNode* in, size_t inOffset, FsNode* out, size_t outOffset, size_t size) {
+    bool seekable = in->IsFile() || in->IsBlockDevice();
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(kmalloc(MIN(size, SPLICE_BATCH_SIZE)));
+
+    ssize_t total = 0;
+    while (static_cast<size_t>(total) < size) {
+        size_t chunk = MIN(size - total, SPLICE_BATCH_SIZE);
+
+        ssize_t r = Read(in, inOffset + total, chunk, buffer);
+        if (r <= 0) {
+            kfree(buffer);
+            return total ? total : r;
+        }
+
+        // Data read from a stream is gone, so write all of it
+        ssize_t written = 0;
+        while (written < r) {
+            ssize_t w = Write(out, outOffset + total + written, r - written, buffer + written);
+            if (w <= 0) {
+                kfree(buffer);
+                total += written;
+                return total ? total : w;
+            }
+
+            written += w;
+        }
+
+        total += r;
+        if (!seekable || static_cast<size_t>(r) < chunk) {
+            break; // Do not block on a stream again once some data has been moved
+        }
+    }
+
+    kfree(buffer);
+    return total;
+}
+
+ssize_t Splice(FsNode* in, size_t inOffset, FsNode* out, size_t outOffset, size_t size) {
+    assert(in && out);
+
+    if (!in->pageCached) {
+        return SpliceBuffered(in, inOffset, out, outOffset, size);
+    }
+
+    if (in->IsFile()) {
+        if (inOffset >= in->size) {
+            return 0;
+        }
+
+        size = MIN(size, in->size - inOffset);
+    }
+
+    ssize_t total = 0;
+    while (static_cast<size_t>(total) < size) {
+        PageCache::CachedPage* pages[SPLICE_BATCH_PAGES];
+        iovec iov[SPLICE_BATCH_PAGES];
+
+        // Pin a batch of pages and hand them to the output as one vector
+        int count = 0;
+        size_t batch = 0;
+        bool endOfFile = false;
+        bool uncached = false;
+        while (count < SPLICE_BATCH_PAGES && total + batch < size) {
+            size_t offset = inOffset + total + batch;
+            size_t pageOffset = offset & (PAGE_SIZE_4K - 1);
+
+            PageCache::CachedPage* page = PageCache::GetPage(in, offset >> PAGE_SHIFT_4K);
+            if (!page) {
+                uncached = true;
+                break;
+            }
+
+            if (pageOffset >= page->length) {
+                PageCache::ReleasePage(page);
+                endOfFile = true;
+                break;
+            }
+
+            size_t length = MIN(page->length - pageOffset, size - total - batch);
+            pages[count] = page;
+            iov[count] = {.iov_base = page->data + pageOffset, .iov_len = length};
+            count++;
+            batch += length;
+
+            if (page->length < PAGE_SIZE_4K) {
+                endOfFile = true;
+                break;
+            }
+        }
+
+        ssize_t written = 0;
+        if (count) {
+            written = WriteV(out, outOffset + total, iov, count);
+            for (int i = 0; i < count; i++) {
+                PageCache::ReleasePage(pages[i]);
+            }
+
+            if (written < 0) {
+                return total ? total : written;
+            }
+
+            total += written;
+            if (static_cast<size_t>(written) < batch) {
+                break;
+            }
+        }
+
+        if (uncached && !count) {
+            // The page could not be cached, read it directly instead
+            ssize_t r = SpliceBuffered(in, inOffset + total, out, outOffset + total,
+                                       MIN(size - total, PAGE_SIZE_4K - ((inOffset + total) & (PAGE_SIZE_4K - 1))));
+            if (r <= 0) {
+                return total ? total : r;
+            }
+
+            total += r;
+        } else if (endOfFile) {
+            break;
+        }
+    }
+
+    return total;
+}
+
+int Truncate(FsNode* node, off_t length) {
+    assert(node);
+
+    size_t oldSize = node->size;
+    int ret = node->Truncate(length);
+    if (node->pageCached) {
+        // Partially truncated pages are read in again,
+        // when growing the old end of file page is short and has to be read in again too
+        size_t start = MIN(oldSize, static_cast<size_t>(length));
+        PageCache::Invalidate(node, start & ~(PAGE_SIZE_4K - 1), SIZE_MAX);
+    }
+
+    return ret;
+}
+
 ErrorOr<UNIXOpenFile*> Open(FsNode* node, uint32_t flags) { return node->Open(flags); }
 
+int Create(FsNode* dir, DirectoryEntry* ent, uint32_t mode) {
+    assert(dir);
+    assert(ent);
+
+    int ret = dir->Create(ent, mode);
+    if (dir->cacheDentries) {
+        DentryCache::Invalidate(dir, ent->name);
+    }
+    return ret;
+}
+
+int CreateDirectory(FsNode* dir, DirectoryEntry* ent, uint32_t mode) {
+    assert(dir);
+    assert(ent);
+
+    int ret = dir->CreateDirectory(ent, mode);
+    if (dir->cacheDentries) {
+        DentryCache::Invalidate(dir, ent->name);
+    }
+    return ret;
+}
+
 int Link(FsNode* dir, FsNode* link, DirectoryEntry* ent) {
     assert(dir);
     assert(link);
 
-    return dir->Link(link, ent);
+    int ret = dir->Link(link, ent);
+    if (dir->cacheDentries) {
+        DentryCache::Invalidate(dir, ent->name);
+    }
+    return ret;
 }
 
 int Unlink(FsNode* dir, DirectoryEntry* ent, bool unlinkDirectories) {
     assert(dir);
     assert(ent);
 
-    return dir->Unlink(ent, unlinkDirectories);
+    int ret = dir->Unlink(ent, unlinkDirectories);
+    if (dir->cacheDentries) {
+        DentryCache::Invalidate(dir, ent->name);
+    }
+    return ret;
 }
 
 void Close(FsNode* node) { return node->Close(); }
@@ -465,13 +708,31 @@ int ReadDir(FsNode* node, DirectoryEntry* dirent, uint32_t index) {
 FsNode* FindDir(FsNode* node, const char* name) {
     assert(node);
 
-    return node->FindDir(name);
+    // '.' and '..' are left to the filesystem, '..' changes when a directory is moved
+    if (!node->cacheDentries || (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))) {
+        return node->FindDir(name);
+    }
+
+    FsNode* result;
+    if (DentryCache::Lookup(node, name, result)) {
+        return result;
+    }
+
+    uint64_t generation = DentryCache::Generation();
+    result = node->FindDir(name);
+    DentryCache::Insert(node, name, result, generation);
+
+    return result;
 }
 
 ssize_t Read(const FancyRefPtr<UNIXOpenFile>& handle, size_t size, uint8_t* buffer) {
     assert(handle->node);
 
     ScopedSpinLock lockOpenFile(handle->dataLock);
+    if (handle->node->pageCached) {
+        PageCache::Readahead(handle, handle->pos, size);
+    }
+
     ssize_t ret = Read(handle->node, handle->pos, size, buffer);
 
     if (ret > 0) {
@@ -493,12 +754,57 @@ ssize_t Write(const FancyRefPtr<UNIXOpenFile>& handle, size_t size, uint8_t* buf
     return ret;
 }
 
+ssize_t ReadV(const FancyRefPtr<UNIXOpenFile>& handle, const iovec* iov, int iovcnt) {
+    assert(handle->node);
+
+    ScopedSpinLock lockOpenFile(handle->dataLock);
+    if (handle->node->pageCached) {
+        size_t size = 0;
+        for (int i = 0; i < iovcnt; i++) {
+            size += iov[i].iov_len;
+        }
+
+        PageCache::Readahead(handle, handle->pos, size);
+    }
+
+    ssize_t ret = ReadV(handle->node, handle->pos, iov, iovcnt);
+
+    if (ret > 0) {
+        handle->pos += ret;
+    }
+
+    return ret;
+}
+
+ssize_t WriteV(const FancyRefPtr<UNIXOpenFile>& handle, const iovec* iov, int iovcnt) {
+    assert(handle->node);
+    ScopedSpinLock lockOpenFile(handle->dataLock);
+    ssize_t ret = WriteV(handle->node, handle->pos, iov, iovcnt);
+
+    if (ret >= 0) {
+        handle->pos += ret;
+    }
+
+    return ret;
+}
+
 int ReadDir(const FancyRefPtr<UNIXOpenFile>& handle, DirectoryEntry* dirent, uint32_t index) {
     assert(handle->node);
 
     return ReadDir(handle->node, dirent, index);
 }
 
+int ReadDirBatch(const FancyRefPtr<UNIXOpenFile>& handle, DirectoryFiller filler, void* context) {
+    assert(handle->node);
+
+    if (!handle->node->IsDirectory()) {
+        return -ENOTDIR;
+    }
+
+    ScopedSpinLock lockOpenFile(handle->dataLock);
+    return handle->node->ReadDirBatch(handle->pos, filler, context);
+}
+
 FsNode* FindDir(const FancyRefPtr<UNIXOpenFile>& handle, const char* name) {
     assert(handle->node);
 
@@ -561,23 +867,23 @@ int Rename(FsNode* olddir, const char* oldpath, FsNode* newdir, const char* newp
         assert(oldpathParent); // If this is null something went horribly wrong
 
         if (newnode) {
-            if (auto e = newpathParent->Unlink(&newpathDirent)) {
+            if (auto e = fs::Unlink(newpathParent, &newpathDirent)) {
                 return e; // Unlink error
             }
         }
 
-        if (auto e = newpathParent->Link(oldnode, &newpathDirent)) {
+        if (auto e = fs::Link(newpathParent, oldnode, &newpathDirent)) {
             return e; // Link error
         }
 
-        if (auto e = oldpathParent->Unlink(&oldpathDirent)) {
+        if (auto e = fs::Unlink(oldpathParent, &oldpathDirent)) {
             return e; // Unlink error
         }
     } else if ((oldnode->flags & FS_NODE_TYPE) != FS_NODE_SYMLINK) { // Aight we have to copy it
         FsNode* oldpathParent = fs::ResolveParent(oldpath, olddir);
         assert(oldpathParent); // If this is null something went horribly wrong
 
-        if (auto e = newpathParent->Create(&newpathDirent, 0)) {
+        if (auto e = fs::Create(newpathParent, &newpathDirent, 0)) {
             return e; // Create error
         }
 
@@ -608,7 +914,7 @@ int Rename(FsNode* olddir, const char* oldpath, FsNode* newdir, const char* newp
 
         kfree(buffer);
 
-        if (auto e = oldpathParent->Unlink(&oldpathDirent)) {
+        if (auto e = fs::Unlink(oldpathParent, &oldpathDirent)) {
             return e; // Unlink error
         }
     } else {
@@ -1,10 +1,18 @@
 #include <Fs/Filesystem.h>
+#include <Fs/DentryCache.h>
+#include <Fs/PageCache.h>
 
 #include <Errno.h>
 #include <Logging.h>
 
 FsNode::~FsNode(){
-    
+    if(pageCached){
+        fs::PageCache::InvalidateNode(this);
+    }
+
+    if(dentries || childDentries){
+        fs::DentryCache::InvalidateNode(this);
+    }
 }
 
 ssize_t FsNode::Read(size_t, size_t, uint8_t *){
@@ -17,6 +25,40 @@ ssize_t FsNode::Write(size_t, size_t, uint8_t *){
     return -ENOSYS;
 }
 
+ssize_t FsNode::ReadV(size_t off, const iovec* iov, int iovcnt){
+    ssize_t total = 0;
+    for(int i = 0; i < iovcnt; i++){
+        ssize_t ret = Read(off + total, iov[i].iov_len, reinterpret_cast<uint8_t*>(iov[i].iov_base));
+        if(ret < 0){
+            return total ? total : ret; // Report the error on the next call
+        }
+
+        total += ret;
+        if(static_cast<size_t>(ret) < iov[i].iov_len){
+            break;
+        }
+    }
+
+    return total;
+}
+
+ssize_t FsNode::WriteV(size_t off, const iovec* iov, int iovcnt){
+    ssize_t total = 0;
+    for(int i = 0; i < iovcnt; i++){
+        ssize_t ret = Write(off + total, iov[i].iov_len, reinterpret_cast<uint8_t*>(iov[i].iov_base));
+        if(ret < 0){
+            return total ? total : ret;
+        }
+
+        total += ret;
+        if(static_cast<size_t>(ret) < iov[i].iov_len){
+            break;
+        }
+    }
+
+    return total;
+}
+
 ErrorOr<UNIXOpenFile*> FsNode::Open(size_t flags){
     UNIXOpenFile* fDesc = new UNIXOpenFile;
 
@@ -42,6 +84,32 @@ int FsNode::ReadDir(DirectoryEntry*, uint32_t){
     return -ENOSYS;
 }
 
+int FsNode::ReadDirBatch(off_t& cursor, DirectoryFiller filler, void* context){
+    if(cursor < 0){
+        return -EINVAL;
+    }
+
+    DirectoryEntry ent;
+    int count = 0;
+    for(;;){
+        int ret = ReadDir(&ent, cursor);
+        if(ret < 0){
+            return count ? count : ret;
+        } else if(!ret){
+            break; // End of directory
+        }
+
+        if(!filler(context, ent, cursor + 1)){
+            break;
+        }
+
+        cursor++;
+        count++;
+    }
+
+    return count;
+}
+
 FsNode* FsNode::FindDir(const char*){
     assert(IsDirectory());
 
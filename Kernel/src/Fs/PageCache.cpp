@@ -0,0 +1,638 @@
+#include <Fs/PageCache.h>
+
+#include <Assert.h>
+#include <CString.h>
+#include <Hash.h>
+#include <List.h>
+#include <Lock.h>
+#include <Memory.h>
+#include <Objects/Process.h>
+#include <PhysicalAllocator.h>
+#include <Scheduler.h>
+#include <Spinlock.h>
+
+// The page cache may use at most 1 / PAGE_CACHE_MEMORY_FRACTION of physical memory
+#define PAGE_CACHE_MEMORY_FRACTION 4
+
+namespace fs::PageCache {
+
+static lock_t cacheLock = 0;
+static CachedPage* buckets[PAGE_CACHE_BUCKETS];
+
+// Global LRU list of every cached page
+static CachedPage* lruHead = nullptr;
+static CachedPage* lruTail = nullptr;
+
+static size_t pageCount = 0;
+static size_t maxPages = 0;
+
+static ALWAYS_INLINE unsigned BucketIndex(FsNode* node, uint64_t index) {
+    return HashU(static_cast<unsigned>(reinterpret_cast<uintptr_t>(node) >> 4) ^
+                 static_cast<unsigned>(index * 2654435761U)) %
+           PAGE_CACHE_BUCKETS;
+}
+
+static CachedPage* LookupLocked(FsNode* node, uint64_t index) {
+    for (CachedPage* page = buckets[BucketIndex(node, index)]; page; page = page->hashNext) {
+        if (page->node == node && page->index == index) {
+            return page;
+        }
+    }
+
+    return nullptr;
+}
+
+static void LRUUnlinkLocked(CachedPage* page) {
+    if (page->prev) {
+        page->prev->next = page->next;
+    } else {
+        lruHead = page->next;
+    }
+
+    if (page->next) {
+        page->next->prev = page->prev;
+    } else {
+        lruTail = page->prev;
+    }
+
+    page->next = page->prev = nullptr;
+}
+
+static void LRUPushFrontLocked(CachedPage* page) {
+    page->prev = nullptr;
+    page->next = lruHead;
+
+    if (lruHead) {
+        lruHead->prev = page;
+    } else {
+        lruTail = page;
+    }
+    lruHead = page;
+}
+
+// Remove the page from the cache,
+// returns true if the caller should free the page (nobody has it pinned)
+static bool UnhashLocked(CachedPage* page) {
+    assert(page->hashed);
+
+    CachedPage** link = &buckets[BucketIndex(page->node, page->index)];
+    while (*link != page) {
+        assert(*link);
+        link = &(*link)->hashNext;
+    }
+    *link = page->hashNext;
+    page->hashNext = nullptr;
+
+    LRUUnlinkLocked(page);
+
+    page->hashed = false;
+    pageCount--;
+
+    return page->refCount == 0;
+}
+
+static CachedPage* AllocatePage(FsNode* node, uint64_t index) {
+    uintptr_t phys;
+    uint8_t* data;
+    KernelAllocateMappedBlock(&phys, &data);
+    if (!phys) {
+        return nullptr;
+    }
+
+    CachedPage* page = new CachedPage;
+    page->node = node;
+    page->index = index;
+    page->physicalAddress = phys;
+    page->data = data;
+    page->length = 0;
+    page->refCount = 1;
+    page->upToDate = false;
+    page->error = false;
+    page->hashed = false;
+    page->hashNext = page->next = page->prev = nullptr;
+
+    return page;
+}
+
+static void FreePage(CachedPage* page) {
+    assert(!page->hashed && page->refCount == 0);
+
+    Memory::KernelFree4KPages(page->data, 1);
+    Memory::FreePhysicalMemoryBlock(page->physicalAddress);
+
+    delete page;
+}
+
+// Evict unpinned pages from the tail of the LRU list,
+// evicted pages are added to the victims list to be freed once the lock is released
+static void EvictLocked(size_t limit, CachedPage*& victims) {
+    CachedPage* page = lruTail;
+    while (page && pageCount > limit) {
+        CachedPage* prev = page->prev;
+        if (page->refCount == 0 && UnhashLocked(page)) {
+            page->hashNext = victims;
+            victims = page;
+        }
+
+        page = prev;
+    }
+}
+
+static void FreeVictims(CachedPage* victims) {
+    while (victims) {
+        CachedPage* next = victims->hashNext;
+        FreePage(victims);
+        victims = next;
+    }
+}
+
+// Mark a page as read in, or as failed if bytes is negative
+static void CompletePage(CachedPage* page, ssize_t bytes) {
+    if (bytes < 0) {
+        acquireLock(&cacheLock);
+        page->error = true;
+        if (page->hashed) {
+            UnhashLocked(page); // Let the next reader retry
+        }
+        releaseLock(&cacheLock);
+        return;
+    }
+
+    if (bytes < PAGE_SIZE_4K) {
+        memset(page->data + bytes, 0, PAGE_SIZE_4K - bytes);
+    }
+
+    page->length = bytes;
+    __atomic_store_n(&page->upToDate, true, __ATOMIC_RELEASE);
+}
+
+// Amount of bytes of the node that lie within count pages from index
+static size_t PageRangeLength(FsNode* node, uint64_t index, unsigned count) {
+    size_t offset = index << PAGE_SHIFT_4K;
+    size_t length = count * PAGE_SIZE_4K;
+
+    if (node->IsFile()) {
+        if (offset >= node->size) {
+            return 0;
+        } else if (node->size - offset < length) {
+            return node->size - offset;
+        }
+    }
+
+    return length;
+}
+
+static void FillPage(CachedPage* page) {
+    FsNode* node = page->node;
+
+    size_t length = PageRangeLength(node, page->index, 1);
+    CompletePage(page, length ? node->Read(page->index << PAGE_SHIFT_4K, length, page->data) : 0);
+}
+
+// Read a run of consecutive pages in with a single request to the node,
+// the pages are mapped next to each other so the node reads straight into them
+static void FillPages(CachedPage** pages, unsigned count) {
+    if (count == 1) {
+        FillPage(pages[0]);
+        return;
+    }
+
+    FsNode* node = pages[0]->node;
+
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(Memory::KernelAllocate4KPages(count));
+    uintptr_t virt = reinterpret_cast<uintptr_t>(buffer);
+    for (unsigned i = 0; i < count; i++) {
+        Memory::KernelMapVirtualMemory4K(pages[i]->physicalAddress, virt + i * PAGE_SIZE_4K, 1);
+    }
+
+    size_t length = PageRangeLength(node, pages[0]->index, count);
+    ssize_t ret = length ? node->Read(pages[0]->index << PAGE_SHIFT_4K, length, buffer) : 0;
+
+    Memory::KernelFree4KPages(buffer, count);
+
+    for (unsigned i = 0; i < count; i++) {
+        if (ret < 0) {
+            CompletePage(pages[i], ret);
+        } else if (static_cast<size_t>(ret) <= i * PAGE_SIZE_4K) {
+            CompletePage(pages[i], 0);
+        } else {
+            size_t bytes = ret - i * PAGE_SIZE_4K;
+            CompletePage(pages[i], (bytes > PAGE_SIZE_4K) ? PAGE_SIZE_4K : bytes);
+        }
+    }
+}
+
+// Find a page and pin it, otherwise insert a new page.
+// If created is set the page has yet to be read in and the caller must fill it.
+// Returns nullptr if out of memory.
+static CachedPage* LookupOrInsert(FsNode* node, uint64_t index, bool& created) {
+    created = false;
+
+    acquireLock(&cacheLock);
+    CachedPage* page = LookupLocked(node, index);
+    if (page) {
+        page->refCount++;
+
+        LRUUnlinkLocked(page);
+        LRUPushFrontLocked(page);
+        releaseLock(&cacheLock);
+
+        return page;
+    }
+    releaseLock(&cacheLock);
+
+    CachedPage* newPage = AllocatePage(node, index);
+    if (!newPage) {
+        return nullptr;
+    }
+
+    CachedPage* victims = nullptr;
+
+    acquireLock(&cacheLock);
+    if ((page = LookupLocked(node, index))) {
+        // Someone else read the page in whilst we were allocating
+        page->refCount++;
+        releaseLock(&cacheLock);
+
+        newPage->refCount = 0;
+        FreePage(newPage);
+        return page;
+    }
+
+    page = newPage;
+
+    unsigned bucket = BucketIndex(node, index);
+    page->hashNext = buckets[bucket];
+    buckets[bucket] = page;
+    page->hashed = true;
+
+    LRUPushFrontLocked(page);
+    pageCount++;
+
+    if (!maxPages) {
+        maxPages = Memory::maxPhysicalBlocks / PAGE_CACHE_MEMORY_FRACTION;
+    }
+    EvictLocked(maxPages, victims);
+    releaseLock(&cacheLock);
+
+    FreeVictims(victims);
+
+    created = true;
+    return page;
+}
+
+CachedPage* GetPage(FsNode* node, uint64_t index) {
+    assert(node->pageCached);
+
+    bool created;
+    CachedPage* page = LookupOrInsert(node, index, created);
+    if (!page) {
+        return nullptr;
+    }
+
+    if (created) {
+        // Other readers of this page will wait for us to fill it
+        FillPage(page);
+    }
+
+    while (!__atomic_load_n(&page->upToDate, __ATOMIC_ACQUIRE) && !page->error) {
+        Scheduler::Yield();
+    }
+
+    if (page->error) {
+        ReleasePage(page);
+        return nullptr;
+    }
+
+    return page;
+}
+
+bool IsCached(FsNode* node, size_t offset, size_t size) {
+    if (node->IsFile()) {
+        if (offset >= node->size) {
+            return true; // Nothing to read
+        }
+
+        if (size > node->size - offset) {
+            size = node->size - offset;
+        }
+    }
+
+    if (!size) {
+        return true;
+    }
+
+    uint64_t last = (offset + size - 1) >> PAGE_SHIFT_4K;
+
+    bool cached = true;
+
+    acquireLock(&cacheLock);
+    for (uint64_t index = offset >> PAGE_SHIFT_4K; index <= last && cached; index++) {
+        CachedPage* page = LookupLocked(node, index);
+        cached = page && __atomic_load_n(&page->upToDate, __ATOMIC_ACQUIRE);
+    }
+    releaseLock(&cacheLock);
+
+    return cached;
+}
+
+void ReleasePage(CachedPage* page) {
+    acquireLock(&cacheLock);
+    bool shouldFree = (--page->refCount == 0) && !page->hashed;
+    releaseLock(&cacheLock);
+
+    if (shouldFree) {
+        FreePage(page);
+    }
+}
+
+ssize_t Read(FsNode* node, size_t offset, size_t size, uint8_t* buffer) {
+    if (node->IsFile()) {
+        if (offset >= node->size) {
+            return 0;
+        }
+
+        if (size > node->size - offset) {
+            size = node->size - offset;
+        }
+    }
+
+    size_t done = 0;
+    while (done < size) {
+        uint64_t index = (offset + done) >> PAGE_SHIFT_4K;
+        size_t pageOffset = (offset + done) & (PAGE_SIZE_4K - 1);
+
+        CachedPage* page = GetPage(node, index);
+        if (!page) {
+            // Could not cache the page (e.g. out of memory or a partial page at the end of a device),
+            // fall back to reading directly
+            ssize_t ret = node->Read(offset + done, size - done, buffer + done);
+            if (ret < 0) {
+                return done ? done : ret;
+            }
+
+            return done + ret;
+        }
+
+        size_t length = page->length;
+        if (pageOffset >= length) {
+            ReleasePage(page);
+            break; // End of file
+        }
+
+        size_t count = (size - done < length - pageOffset) ? size - done : length - pageOffset;
+        memcpy(buffer + done, page->data + pageOffset, count);
+        ReleasePage(page);
+
+        done += count;
+        if (length < PAGE_SIZE_4K) {
+            break; // End of file
+        }
+    }
+
+    return done;
+}
+
+ssize_t Write(FsNode* node, size_t offset, size_t size, uint8_t* buffer) {
+    size_t oldSize = node->size;
+    ssize_t written = node->Write(offset, size, buffer);
+    if (written <= 0) {
+        return written;
+    }
+
+    if (node->IsFile() && node->size > oldSize) {
+        // The old end of file page is short and a write past the end leaves a hole of zeroes,
+        // drop everything from the old end of file page up to the end of the write so it is read in again
+        size_t start = oldSize & ~(PAGE_SIZE_4K - 1);
+        Invalidate(node, start, offset + written - start);
+    }
+
+    // Bring any cached pages up to date with what was written
+    size_t done = 0;
+    while (done < static_cast<size_t>(written)) {
+        uint64_t index = (offset + done) >> PAGE_SHIFT_4K;
+        size_t pageOffset = (offset + done) & (PAGE_SIZE_4K - 1);
+        size_t count = (written - done < PAGE_SIZE_4K - pageOffset) ? written - done : PAGE_SIZE_4K - pageOffset;
+
+        CachedPage* victim = nullptr;
+
+        acquireLock(&cacheLock);
+        CachedPage* page = LookupLocked(node, index);
+        if (page && !__atomic_load_n(&page->upToDate, __ATOMIC_ACQUIRE)) {
+            // The page is still being read in and may end up with the old data,
+            // drop it and let it be read again
+            if (UnhashLocked(page)) {
+                victim = page;
+            }
+            page = nullptr;
+        } else if (page) {
+            page->refCount++;
+        }
+        releaseLock(&cacheLock);
+
+        if (victim) {
+            FreePage(victim);
+        }
+
+        if (page) {
+            memcpy(page->data + pageOffset, buffer + done, count);
+            if (pageOffset + count > page->length) {
+                page->length = pageOffset + count;
+            }
+
+            ReleasePage(page);
+        }
+
+        done += count;
+    }
+
+    return written;
+}
+
+void Invalidate(FsNode* node, size_t offset, size_t size) {
+    if (!size) {
+        return;
+    }
+
+    uint64_t first = offset >> PAGE_SHIFT_4K;
+    uint64_t last = (offset + size - 1) >> PAGE_SHIFT_4K;
+    if (offset + size < offset) {
+        last = UINT64_MAX >> PAGE_SHIFT_4K; // Overflow, invalidate to the end
+    }
+
+    CachedPage* victims = nullptr;
+
+    acquireLock(&cacheLock);
+    if (last - first < PAGE_CACHE_BUCKETS) {
+        for (uint64_t index = first; index <= last; index++) {
+            CachedPage* page = LookupLocked(node, index);
+            if (page && UnhashLocked(page)) {
+                page->hashNext = victims;
+                victims = page;
+            }
+        }
+    } else {
+        // Quicker to walk every bucket
+        for (unsigned i = 0; i < PAGE_CACHE_BUCKETS; i++) {
+            CachedPage* page = buckets[i];
+            while (page) {
+                CachedPage* next = page->hashNext;
+                if (page->node == node && page->index >= first && page->index <= last && UnhashLocked(page)) {
+                    page->hashNext = victims;
+                    victims = page;
+                }
+
+                page = next;
+            }
+        }
+    }
+    releaseLock(&cacheLock);
+
+    FreeVictims(victims);
+}
+
+void InvalidateNode(FsNode* node) { Invalidate(node, 0, SIZE_MAX); }
+
+void Shrink(size_t limit) {
+    CachedPage* victims = nullptr;
+
+    acquireLock(&cacheLock);
+    EvictLocked(limit, victims);
+    releaseLock(&cacheLock);
+
+    FreeVictims(victims);
+}
+
+size_t CachedPageCount() { return pageCount; }
+
+struct ReadaheadRequest {
+    // Keeps the node open until the readahead is done
+    FancyRefPtr<UNIXOpenFile> handle;
+    uint64_t index;
+    unsigned count;
+};
+
+static lock_t readaheadLock = 0;
+static List<ReadaheadRequest> readaheadQueue;
+static Semaphore readaheadSemaphore(0);
+static FancyRefPtr<Process> readaheadProcess;
+
+// Read in any pages in the range which are not cached,
+// consecutive missing pages are read in together
+static void ReadaheadPages(FsNode* node, uint64_t index, unsigned count) {
+    CachedPage* pages[READAHEAD_MAX_PAGES];
+
+    uint64_t end = index + count;
+    bool outOfMemory = false;
+    while (index < end && !outOfMemory) {
+        unsigned run = 0;
+        while (index + run < end) {
+            bool created;
+            CachedPage* page = LookupOrInsert(node, index + run, created);
+            if (!page) {
+                outOfMemory = true;
+                break;
+            } else if (!created) {
+                ReleasePage(page); // Already cached or being read in
+                break;
+            }
+
+            pages[run++] = page;
+        }
+
+        if (run) {
+            FillPages(pages, run);
+            for (unsigned i = 0; i < run; i++) {
+                ReleasePage(pages[i]);
+            }
+        }
+
+        index += run + 1;
+    }
+}
+
+static void ReadaheadThread() {
+    for (;;) {
+        if (readaheadSemaphore.Wait()) {
+            continue; // Interrupted
+        }
+
+        acquireLock(&readaheadLock);
+        if (!readaheadQueue.get_length()) {
+            releaseLock(&readaheadLock);
+            continue;
+        }
+
+        ReadaheadRequest request = readaheadQueue.remove_at(0);
+        releaseLock(&readaheadLock);
+
+        if (FsNode* node = request.handle->node) {
+            ReadaheadPages(node, request.index, request.count);
+        }
+    }
+}
+
+void Initialize() {
+    readaheadProcess = Process::CreateKernelProcess((void*)ReadaheadThread, "Readahead", nullptr);
+    readaheadProcess->Start();
+}
+
+void Readahead(const FancyRefPtr<UNIXOpenFile>& handle, size_t offset, size_t size) {
+    FsNode* node = handle->node;
+    FileReadahead& ra = handle->readahead;
+
+    if (!size || !node->pageCached) {
+        return;
+    }
+
+    uint64_t first = offset >> PAGE_SHIFT_4K;
+    uint64_t last = (offset + size - 1) >> PAGE_SHIFT_4K;
+
+    // Small reads may continue in the last page of the previous read
+    if (first == ra.nextIndex || first + 1 == ra.nextIndex) {
+        // Sequential access, keep growing the window
+        ra.window = ra.window ? ((ra.window * 2 > READAHEAD_MAX_PAGES) ? READAHEAD_MAX_PAGES : ra.window * 2)
+                              : READAHEAD_MIN_PAGES;
+    } else {
+        ra.window = 0;
+        ra.aheadIndex = 0;
+    }
+    ra.nextIndex = last + 1;
+
+    if (!ra.window) {
+        return;
+    }
+
+    // Wait for the reader to get through half of the pages already read ahead
+    // instead of queueing lots of small requests
+    if (ra.aheadIndex > ra.nextIndex && ra.aheadIndex - ra.nextIndex > ra.window / 2) {
+        return;
+    }
+
+    uint64_t start = (ra.aheadIndex > ra.nextIndex) ? ra.aheadIndex : ra.nextIndex;
+    uint64_t end = ra.nextIndex + ra.window;
+    if (node->IsFile()) {
+        uint64_t endOfFile = (node->size + PAGE_SIZE_4K - 1) >> PAGE_SHIFT_4K;
+        if (end > endOfFile) {
+            end = endOfFile;
+        }
+    }
+
+    if (start >= end || !readaheadProcess.get()) {
+        return;
+    }
+
+    acquireLock(&readaheadLock);
+    if (readaheadQueue.get_length() >= READAHEAD_QUEUE_MAX) {
+        releaseLock(&readaheadLock);
+        return; // Readahead is only a hint, drop the request
+    }
+
+    readaheadQueue.add_back(ReadaheadRequest{handle, start, static_cast<unsigned>(end - start)});
+    releaseLock(&readaheadLock);
+
+    ra.aheadIndex = end;
+    readaheadSemaphore.Signal();
+}
+
+} // namespace fs::PageCache
@@ -5,13 +5,10 @@
 
 UNIXPipe::UNIXPipe(int _end, FancyRefPtr<DataStream> stream)
     : end(static_cast<decltype(end)>(_end)), stream(std::move(stream)){
+    flags = FS_NODE_PIPE;
 }
 
-ssize_t UNIXPipe::Read(size_t off, size_t size, uint8_t* buffer){
-    if(end != ReadEnd){
-        return -ESPIPE;
-    }
-
+int UNIXPipe::WaitForData(size_t size){
     if(!widowed && size > stream->Pos()){
         FilesystemBlocker bl(this, size);
 
@@ -20,6 +17,41 @@ ssize_t UNIXPipe::Read(size_t off, size_t size, uint8_t* buffer){
         }
     }
 
+    return 0;
+}
+
+void UNIXPipe::NotifyReader(){
+    ScopedSpinLock acq(otherEnd->watchingLock);
+
+    for(auto& w : otherEnd->watching){
+        w->Signal();
+    }
+
+    acquireLock(&otherEnd->blockedLock);
+    FilesystemBlocker* bl = otherEnd->blocked.get_front();
+    while(bl){
+        FilesystemBlocker* next = otherEnd->blocked.next(bl);
+
+        if(bl->RequestedLength() <= stream->Pos()){
+            bl->Unblock();
+        }
+
+        bl = next;
+    }
+    releaseLock(&otherEnd->blockedLock);
+
+    otherEnd->watching.clear();
+}
+
+ssize_t UNIXPipe::Read(size_t off, size_t size, uint8_t* buffer){
+    if(end != ReadEnd){
+        return -ESPIPE;
+    }
+
+    if(WaitForData(size)){
+        return -EINTR;
+    }
+
     if(size > stream->Pos()){
         size = stream->Pos();
     }
@@ -37,30 +69,69 @@ ssize_t UNIXPipe::Write(size_t off, size_t size, uint8_t* buffer){
 
     ssize_t ret = stream->Write(buffer, size);
 
-    {
-        ScopedSpinLock acq(otherEnd->watchingLock);
+    NotifyReader();
+
+    return ret;
+}
 
-        for(auto& w : otherEnd->watching){
-            w->Signal();
+ssize_t UNIXPipe::ReadV(size_t off, const iovec* iov, int iovcnt){
+    if(end != ReadEnd){
+        return -ESPIPE;
+    }
+
+    size_t size = 0;
+    for(int i = 0; i < iovcnt; i++){
+        size += iov[i].iov_len;
+    }
+
+    // Block once for the whole read, not for each buffer
+    if(WaitForData(size)){
+        return -EINTR;
+    }
+
+    ssize_t total = 0;
+    for(int i = 0; i < iovcnt && stream->Pos(); i++){
+        size_t len = iov[i].iov_len;
+        if(len > static_cast<size_t>(stream->Pos())){
+            len = stream->Pos();
         }
 
-        acquireLock(&otherEnd->blockedLock);
-        FilesystemBlocker* bl = otherEnd->blocked.get_front();
-        while(bl){
-            FilesystemBlocker* next = otherEnd->blocked.next(bl);
+        int64_t ret = stream->Read(iov[i].iov_base, len);
+        if(ret < 0){
+            return total ? total : ret;
+        }
 
-            if(bl->RequestedLength() <= stream->Pos()){
-                bl->Unblock();
-            }
+        total += ret;
+    }
 
-            bl = next;
+    return total;
+}
+
+ssize_t UNIXPipe::WriteV(size_t off, const iovec* iov, int iovcnt){
+    if(end != WriteEnd){
+        return -ESPIPE;
+    } else if(widowed || !otherEnd){
+        Thread::Current()->Signal(SIGPIPE); // Send SIGPIPE on broken pipe
+        return -EPIPE;
+    }
+
+    ssize_t total = 0;
+    for(int i = 0; i < iovcnt; i++){
+        int64_t ret = stream->Write(iov[i].iov_base, iov[i].iov_len);
+        if(ret < 0){
+            if(!total){
+                return ret;
+            }
+            break;
         }
-        releaseLock(&otherEnd->blockedLock);
 
-        otherEnd->watching.clear();
+        total += ret;
     }
 
-    return ret;
+    // Readers only wake up once the whole vector is in the pipe
+    NotifyReader();
+
+    return total;
 }
 
 void UNIXPipe::Watch(FilesystemWatcher& watcher, int events){
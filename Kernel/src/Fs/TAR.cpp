@@ -1,5 +1,6 @@
 #include <Fs/TAR.h>
 
+#include <Hash.h>
 #include <Logging.h>
 #include <Errno.h>
 
@@ -23,6 +24,16 @@ inline static long GetBlockCount(char* size){ // Get size of file in blocks
     return (sz + 511) / 512;
 }
 
+// FNV-1a over the name, seeded with the parent inode
+inline static uint32_t HashName(ino_t parent, const char* name){
+    uint32_t hash = 2166136261U ^ HashU(parent);
+    while(*name){
+        hash = (hash ^ static_cast<uint8_t>(*name++)) * 16777619U;
+    }
+
+    return hash;
+}
+
 inline static uint32_t TarTypeToFilesystemFlags(char type){
     switch(type){
         case TAR_TYPE_DIRECTORY:
@@ -61,6 +72,29 @@ namespace fs::tar{
         } else return nullptr;
     }
 
+    const uint8_t* TarNode::ResidentData(){
+        if(!header || (flags & FS_NODE_TYPE) != FS_NODE_FILE){
+            return nullptr;
+        }
+
+        return reinterpret_cast<const uint8_t*>(header) + 512; // File data follows the header
+    }
+
+    void TarVolume::IndexNode(TarNode* node){
+        node->nameHash = HashName(node->parentInode, node->name);
+
+        ino_t& bucket = nameIndex[node->nameHash & (nameIndexSize - 1)];
+        for(ino_t i = bucket; i; i = nodes[i].hashNext){
+            if(nodes[i].parentInode == node->parentInode && !strcmp(nodes[i].name, node->name)){
+                node->hashNext = 0;
+                return; // Duplicate entry, lookups find the first one
+            }
+        }
+
+        node->hashNext = bucket;
+        bucket = node->inode;
+    }
+
     void TarVolume::MakeNode(tar_header_t* header, TarNode* n, ino_t inode, ino_t parent, tar_header_t* dirHeader){
         n->parentInode = parent;
         n->header = header;
@@ -68,6 +102,7 @@ namespace fs::tar{
         n->inode = inode;
         n->uid = OctToDec(header->ustar.uid, 8);
         n->flags = TarTypeToFilesystemFlags(header->ustar.type);
+        n->cacheDentries = ((n->flags & FS_NODE_TYPE) == FS_NODE_DIRECTORY);
         n->vol = this;
         n->volumeID = volumeID;
 
@@ -80,6 +115,8 @@ namespace fs::tar{
         }
         strcpy(n->name, name);
         n->size = GetSize(header->ustar.size);
+
+        IndexNode(n);
     }
 
     int TarVolume::ReadDirectory(int blockIndex, ino_t parent){
@@ -133,9 +170,18 @@ namespace fs::tar{
 
         nodes = new TarNode[nodeCount];
 
+        nameIndexSize = 1;
+        while(nameIndexSize < nodeCount){
+            nameIndexSize <<= 1;
+        }
+
+        nameIndex = new ino_t[nameIndexSize];
+        memset(nameIndex, 0, sizeof(ino_t) * nameIndexSize);
+
         TarNode* volumeNode = &nodes[0];
         volumeNode->header = nullptr;
         volumeNode->flags = FS_NODE_DIRECTORY | FS_NODE_MOUNTPOINT;
+        volumeNode->cacheDentries = true;
         volumeNode->inode = 0;
         volumeNode->size = size;
         volumeNode->vol = this;
@@ -261,8 +307,12 @@ namespace fs::tar{
             else return &nodes[tarNode->parentInode];
         }
 
-        for(int i = 0; i < tarNode->entryCount; i++){
-            if(strcmp(nodes[tarNode->children[i]].name, name) == 0) return &nodes[tarNode->children[i]];
+        uint32_t hash = HashName(node->inode, name);
+        for(ino_t i = nameIndex[hash & (nameIndexSize - 1)]; i; i = nodes[i].hashNext){
+            TarNode* child = &nodes[i];
+            if(child->nameHash == hash && child->parentInode == node->inode && strcmp(child->name, name) == 0){
+                return child;
+            }
         }
 
         return nullptr;
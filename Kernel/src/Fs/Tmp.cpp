@@ -2,6 +2,8 @@
 
 #include <Errno.h>
 #include <Debug.h>
+#include <Math.h>
+#include <Memory.h>
 
 namespace fs::Temp{
     TempVolume::TempVolume(const char* name){
@@ -17,51 +19,31 @@ namespace fs::Temp{
         mountPoint->volumeID = volumeID;
     }
 
-    void TempVolume::ReallocateNode(TempNode* node, size_t oldSize){
-        unsigned newBufferSize = (node->size + (TEMP_BUFFER_CHUNK_SIZE - 1)) & (~(TEMP_BUFFER_CHUNK_SIZE - 1)); // Round up to multiple of the chunk size
-
-        if(newBufferSize <= 0){
-            if(node->buffer){
-                delete node->buffer;
-
-                node->buffer = nullptr;
-            }
-
-            memoryUsage -= node->bufferSize;
-            node->bufferSize = 0;
-        } else if(newBufferSize > node->bufferSize){
-            if(!node->buffer){
-                node->buffer = new uint8_t[newBufferSize];
-
-                memoryUsage += newBufferSize;
-            } else {
-                uint8_t* newBuffer = new uint8_t[newBufferSize];
-                memcpy(newBuffer, node->buffer, oldSize);
+    TempPage* TempVolume::AllocatePage(){
+        uintptr_t phys;
+        uint8_t* data;
+        KernelAllocateMappedBlock(&phys, &data);
+        if(!phys){
+            return nullptr;
+        }
 
-                delete node->buffer;
-                node->buffer = newBuffer;
+        memset(data, 0, PAGE_SIZE_4K);
 
-                memoryUsage += newBufferSize - node->bufferSize;
-            }
+        TempPage* page = new TempPage;
+        page->physicalAddress = phys;
+        page->data = data;
 
-            node->bufferSize = newBufferSize;
-        } else if(newBufferSize < node->bufferSize){
-            if(!node->buffer){
-                node->buffer = new uint8_t[newBufferSize];
-
-                memoryUsage += newBufferSize;
-            } else {
-                uint8_t* newBuffer = new uint8_t[newBufferSize];
-                memcpy(newBuffer, node->buffer, node->size);
+        __sync_fetch_and_add(&memoryUsage, PAGE_SIZE_4K);
+        return page;
+    }
 
-                delete node->buffer;
-                node->buffer = newBuffer;
+    void TempVolume::FreePage(TempPage* page){
+        Memory::KernelFree4KPages(page->data, 1);
+        Memory::FreePhysicalMemoryBlock(page->physicalAddress);
 
-                memoryUsage -= (node->bufferSize - newBufferSize);
-            }
+        delete page;
 
-            node->bufferSize = newBufferSize;
-        }
+        __sync_fetch_and_sub(&memoryUsage, PAGE_SIZE_4K);
     }
 
     TempNode::TempNode(TempVolume* v, int createFlags){
@@ -77,10 +59,22 @@ namespace fs::Temp{
 
         if((flags & FS_NODE_TYPE) == FS_NODE_FILE){
             bufferLock = ReadWriteLock();
-            buffer = nullptr;
-            bufferSize = 0;
+            pageTree = nullptr;
+            pageTreeHeight = 0;
         } else if((flags & FS_NODE_TYPE) == FS_NODE_DIRECTORY){
-            children = List<DirectoryEntry>();
+            directoryLock = 0;
+            bucketCount = TEMP_DIR_INITIAL_BUCKETS;
+            buckets = new TempDirent*[bucketCount];
+            memset(buckets, 0, sizeof(TempDirent*) * bucketCount);
+            entryCount = 0;
+
+            firstEntry = lastEntry = nullptr;
+            nextSequence = 0;
+
+            cursor = nullptr;
+            cursorIndex = 0;
+
+            cacheDentries = true;
         } else {
             assert(!"TempNode not regular file or directory!");
         }
@@ -88,26 +82,216 @@ namespace fs::Temp{
 
     TempNode::~TempNode(){
         if(IsDirectory()){ // Check if we are a directory
-            for(auto& ent : children){
+            while(firstEntry){
+                DirectoryEntry ent = firstEntry->entry;
                 Unlink(&ent, true); // Unlink all files
             }
-        } else if(buffer){
-            delete buffer;
+
+            delete[] buckets;
+        } else {
+            FreePages(0);
         }
     }
 
-    TempNode* TempNode::Find(const char* name){
+    // FNV-1a
+    static ALWAYS_INLINE uint32_t HashName(const char* name){
+        uint32_t hash = 2166136261U;
+        for(size_t i = 0; i < NAME_MAX && name[i]; i++){
+            hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619U;
+        }
+
+        return hash;
+    }
+
+    TempDirent* TempNode::FindEntry(const char* name){
         assert((flags & FS_NODE_TYPE) == FS_NODE_DIRECTORY);
 
-        for(DirectoryEntry& ent : children){
-            if(strncmp(ent.name, name, NAME_MAX) == 0){
-                return reinterpret_cast<TempNode*>(ent.node);
+        uint32_t hash = HashName(name);
+        for(TempDirent* ent = buckets[hash % bucketCount]; ent; ent = ent->hashNext){
+            if(ent->hash == hash && strncmp(ent->entry.name, name, NAME_MAX) == 0){
+                return ent;
             }
         }
 
         return nullptr;
     }
 
+    void TempNode::InsertEntry(const DirectoryEntry& entry){
+        if(entryCount >= bucketCount * 2){
+            // Rehash into twice as many buckets
+            unsigned newCount = bucketCount * 2;
+            TempDirent** newBuckets = new TempDirent*[newCount];
+            memset(newBuckets, 0, sizeof(TempDirent*) * newCount);
+
+            for(TempDirent* ent = firstEntry; ent; ent = ent->next){
+                TempDirent*& bucket = newBuckets[ent->hash % newCount];
+                ent->hashNext = bucket;
+                bucket = ent;
+            }
+
+            delete[] buckets;
+            buckets = newBuckets;
+            bucketCount = newCount;
+        }
+
+        TempDirent* ent = new TempDirent;
+        ent->entry = entry;
+        ent->hash = HashName(entry.name);
+        ent->sequence = nextSequence++;
+
+        TempDirent*& bucket = buckets[ent->hash % bucketCount];
+        ent->hashNext = bucket;
+        bucket = ent;
+
+        // New entries go at the end so they do not move the ReadDir cursor
+        ent->next = nullptr;
+        ent->prev = lastEntry;
+        if(lastEntry){
+            lastEntry->next = ent;
+        } else {
+            firstEntry = ent;
+        }
+        lastEntry = ent;
+
+        entryCount++;
+    }
+
+    void TempNode::RemoveEntry(TempDirent* ent){
+        // Keep the cursor index pointing at the same entry
+        if(cursor == ent){
+            cursor = ent->prev;
+            cursorIndex--;
+        } else if(cursor && ent->sequence < cursor->sequence){
+            cursorIndex--;
+        }
+
+        TempDirent** link = &buckets[ent->hash % bucketCount];
+        while(*link != ent){
+            link = &(*link)->hashNext;
+        }
+        *link = ent->hashNext;
+
+        if(ent->prev){
+            ent->prev->next = ent->next;
+        } else {
+            firstEntry = ent->next;
+        }
+
+        if(ent->next){
+            ent->next->prev = ent->prev;
+        } else {
+            lastEntry = ent->prev;
+        }
+
+        entryCount--;
+        delete ent;
+    }
+
+    TempDirent* TempNode::EntryAt(unsigned index){
+        if(index >= entryCount){
+            return nullptr;
+        }
+
+        // Continue from the cursor if we can, otherwise start from the front
+        TempDirent* ent = firstEntry;
+        unsigned i = 0;
+        if(cursor && cursorIndex <= index){
+            ent = cursor;
+            i = cursorIndex;
+        }
+
+        for(; i < index; i++){
+            ent = ent->next;
+        }
+
+        cursor = ent;
+        cursorIndex = index;
+        return ent;
+    }
+
+    TempPage* TempNode::LookupPage(uint64_t index){
+        if(!pageTreeHeight || (index >> (pageTreeHeight * TEMP_RADIX_SHIFT))){
+            return nullptr; // Past the end of the tree
+        }
+
+        void* slot = pageTree;
+        for(unsigned level = pageTreeHeight; level > 0 && slot; level--){
+            unsigned i = (index >> ((level - 1) * TEMP_RADIX_SHIFT)) & (TEMP_RADIX_SLOTS - 1);
+            slot = reinterpret_cast<TempRadixNode*>(slot)->slots[i];
+        }
+
+        return reinterpret_cast<TempPage*>(slot);
+    }
+
+    TempPage* TempNode::GetPage(uint64_t index){
+        // Add levels above the root until index is covered
+        while(!pageTreeHeight || (index >> (pageTreeHeight * TEMP_RADIX_SHIFT))){
+            assert(pageTreeHeight < TEMP_RADIX_MAX_HEIGHT);
+
+            TempRadixNode* root = new TempRadixNode;
+            memset(root, 0, sizeof(TempRadixNode));
+            root->slots[0] = pageTree;
+
+            pageTree = root;
+            pageTreeHeight++;
+        }
+
+        TempRadixNode* tree = pageTree;
+        for(unsigned level = pageTreeHeight; level > 1; level--){
+            void*& slot = tree->slots[(index >> ((level - 1) * TEMP_RADIX_SHIFT)) & (TEMP_RADIX_SLOTS - 1)];
+            if(!slot){
+                TempRadixNode* node = new TempRadixNode;
+                memset(node, 0, sizeof(TempRadixNode));
+                slot = node;
+            }
+
+            tree = reinterpret_cast<TempRadixNode*>(slot);
+        }
+
+        void*& slot = tree->slots[index & (TEMP_RADIX_SLOTS - 1)];
+        if(!slot){
+            slot = vol->AllocatePage();
+        }
+
+        return reinterpret_cast<TempPage*>(slot);
+    }
+
+    void TempNode::FreePages(uint64_t index){
+        if(pageTree && FreePages(pageTree, pageTreeHeight, 0, index)){
+            delete pageTree;
+
+            pageTree = nullptr;
+            pageTreeHeight = 0;
+        }
+    }
+
+    bool TempNode::FreePages(TempRadixNode* tree, unsigned level, uint64_t base, uint64_t index){
+        uint64_t span = 1ULL << ((level - 1) * TEMP_RADIX_SHIFT); // Pages covered by each slot
+        bool empty = true;
+
+        for(unsigned i = 0; i < TEMP_RADIX_SLOTS; i++){
+            void*& slot = tree->slots[i];
+            if(!slot){
+                continue;
+            }
+
+            uint64_t slotBase = base + i * span;
+            if(slotBase + span <= index){
+                empty = false; // Entirely before index
+            } else if(level == 1){
+                vol->FreePage(reinterpret_cast<TempPage*>(slot));
+                slot = nullptr;
+            } else if(FreePages(reinterpret_cast<TempRadixNode*>(slot), level - 1, slotBase, index)){
+                delete reinterpret_cast<TempRadixNode*>(slot);
+                slot = nullptr;
+            } else {
+                empty = false;
+            }
+        }
+
+        return empty;
+    }
+
     ssize_t TempNode::Read(size_t off, size_t readSize, uint8_t* readBuffer){
         if((flags & FS_NODE_TYPE) == FS_NODE_DIRECTORY){
             return -EISDIR;
@@ -122,7 +306,20 @@ namespace fs::Temp{
         }
 
         bufferLock.AcquireRead();
-        memcpy(readBuffer, buffer + off, readSize);
+        size_t done = 0;
+        while(done < readSize){
+            size_t pageOffset = (off + done) & (PAGE_SIZE_4K - 1);
+            size_t count = MIN(readSize - done, PAGE_SIZE_4K - pageOffset);
+
+            TempPage* page = LookupPage((off + done) >> PAGE_SHIFT_4K);
+            if(page){
+                memcpy(readBuffer + done, page->data + pageOffset, count);
+            } else {
+                memset(readBuffer + done, 0, count); // Hole
+            }
+
+            done += count;
+        }
         bufferLock.ReleaseRead();
 
         return readSize;
@@ -138,21 +335,33 @@ namespace fs::Temp{
         }
 
         bufferLock.AcquireWrite();
-        if(!buffer || off + writeSize > size){
-            size_t old = size;
-            size = off + writeSize;
 
-            if(size >= bufferSize){
-                vol->ReallocateNode(this, old);
+        Log::Debug(debugLevelTmpFS, DebugLevelVerbose, "Writing (offset: %u, size: %u, nsize: %u)", off, writeSize, size);
+
+        size_t done = 0;
+        while(done < writeSize){
+            size_t pageOffset = (off + done) & (PAGE_SIZE_4K - 1);
+            size_t count = MIN(writeSize - done, PAGE_SIZE_4K - pageOffset);
+
+            TempPage* page = GetPage((off + done) >> PAGE_SHIFT_4K);
+            if(!page){
+                break;
             }
-        }
 
-        Log::Debug(debugLevelTmpFS, DebugLevelVerbose, "Writing (offset: %u, size: %u, nsize: %u, bsize: %u)", off, writeSize, size, bufferSize);
+            memcpy(page->data + pageOffset, writeBuffer + done, count);
+            done += count;
+        }
 
-        memcpy(buffer + off, writeBuffer, writeSize);
+        if(off + done > size){
+            size = off + done;
+        }
         bufferLock.ReleaseWrite();
 
-        return writeSize;
+        if(!done){
+            return -ENOSPC;
+        }
+
+        return done;
     }
 
     int TempNode::Truncate(off_t length){
@@ -166,9 +375,18 @@ namespace fs::Temp{
 
         bufferLock.AcquireWrite();
 
-        size_t old = size;
-        size = length;
-        vol->ReallocateNode(this, old);
+        if(static_cast<size_t>(length) < size){
+            // Free whole pages past the end and zero the rest of the last page,
+            // anything past the end of the file must read as zeros if the file grows again
+            FreePages((length + PAGE_SIZE_4K - 1) >> PAGE_SHIFT_4K);
+
+            size_t pageOffset = length & (PAGE_SIZE_4K - 1);
+            TempPage* page = pageOffset ? LookupPage(length >> PAGE_SHIFT_4K) : nullptr;
+            if(page){
+                memset(page->data + pageOffset, 0, PAGE_SIZE_4K - pageOffset);
+            }
+        }
+        size = length; // Growing the file leaves a hole
 
         bufferLock.ReleaseWrite();
 
@@ -176,10 +394,6 @@ namespace fs::Temp{
     }
 
     int TempNode::ReadDir(DirectoryEntry* dirent, uint32_t index){
-        if(index >= children.get_length() + 2){
-            return 0; // Out of range
-        }
-
         if(index == 0){
             strcpy(dirent->name, ".");
             dirent->flags = DirectoryEntry::FileToDirentFlags(flags);
@@ -195,7 +409,14 @@ namespace fs::Temp{
 
             return 1;
         } else {
-            *dirent = children[index - 2];
+            ScopedSpinLock lock(directoryLock);
+
+            TempDirent* ent = EntryAt(index - 2);
+            if(!ent){
+                return 0; // Out of range
+            }
+
+            *dirent = ent->entry;
             dirent->flags = DirectoryEntry::FileToDirentFlags(dirent->node->flags);
             dirent->node = nullptr; // Do not expose node
 
@@ -203,6 +424,53 @@ namespace fs::Temp{
         }
     }
 
+    int TempNode::ReadDirBatch(off_t& position, DirectoryFiller filler, void* context){
+        if((flags & FS_NODE_TYPE) != FS_NODE_DIRECTORY){
+            return -ENOTDIR;
+        } else if(position < 0){
+            return -EINVAL;
+        }
+
+        DirectoryEntry dirent;
+        int count = 0;
+
+        // Positions 0 and 1 are '.' and '..', after that the position is 2 + the sequence number of the next entry.
+        // Sequence numbers only ever increase, so removing entries does not move the position.
+        while(position < 2){
+            ReadDir(&dirent, position);
+            if(!filler(context, dirent, position + 1)){
+                return count;
+            }
+
+            position++;
+            count++;
+        }
+
+        ScopedSpinLock lock(directoryLock);
+
+        uint64_t sequence = position - 2;
+        TempDirent* ent = (cursor && cursor->sequence < sequence) ? cursor : firstEntry;
+        while(ent && ent->sequence < sequence){
+            ent = ent->next;
+        }
+
+        for(; ent; ent = ent->next){
+            dirent = ent->entry;
+            dirent.flags = DirectoryEntry::FileToDirentFlags(dirent.node->flags);
+            dirent.node = nullptr; // Do not expose node
+
+            off_t next = ent->sequence + 3;
+            if(!filler(context, dirent, next)){
+                break;
+            }
+
+            position = next;
+            count++;
+        }
+
+        return count;
+    }
+
     FsNode* TempNode::FindDir(const char* name){
         if(strcmp(name, ".") == 0){
             return this;
@@ -216,19 +484,14 @@ namespace fs::Temp{
             }
         }
 
-        for(DirectoryEntry& ent : children){
-            if(strncmp(ent.name, name, NAME_MAX) == 0){
-                IF_DEBUG(debugLevelTmpFS >= DebugLevelVerbose, {
-                    Log::Info("found node: %x (%s)", ent.node, ent.name);
-                });
-                return ent.node;
-            }
-            IF_DEBUG(debugLevelTmpFS >= DebugLevelVerbose, {
-                Log::Info("searched node: %x (%s)", ent.node, ent.name);
-            });
-        }
+        ScopedSpinLock lock(directoryLock);
 
-        return nullptr;
+        TempDirent* ent = FindEntry(name);
+        IF_DEBUG(debugLevelTmpFS >= DebugLevelVerbose, {
+            Log::Info("[tmpfs] FindDir: %s (node: %x)", name, ent ? ent->entry.node : nullptr);
+        });
+
+        return ent ? ent->entry.node : nullptr;
     }
 
     int TempNode::Create(DirectoryEntry* ent, uint32_t mode){
@@ -240,7 +503,8 @@ namespace fs::Temp{
             return -ENOTDIR;
         }
 
-        if(Find(ent->name)){
+        ScopedSpinLock lock(directoryLock);
+        if(FindEntry(ent->name)){
             return -EEXIST;
         }
 
@@ -248,14 +512,12 @@ namespace fs::Temp{
         newNode->parent = this;
         
         *ent = DirectoryEntry(newNode, ent->name);
-        DirectoryEntry dirent = *ent;
+        InsertEntry(*ent);
 
         IF_DEBUG(debugLevelTmpFS >= DebugLevelNormal, {
-            Log::Info("[tmpfs] created %s (addr: %x, nlink: %d)!", dirent.name, newNode, newNode->nlink);
+            Log::Info("[tmpfs] created %s (addr: %x, nlink: %d)!", ent->name, newNode, newNode->nlink);
         });
 
-        children.add_back(dirent);
-
         return 0;
     }
 
@@ -268,7 +530,8 @@ namespace fs::Temp{
             return -ENOTDIR;
         }
 
-        if(Find(ent->name)){
+        ScopedSpinLock lock(directoryLock);
+        if(FindEntry(ent->name)){
             return -EEXIST;
         }
 
@@ -276,9 +539,7 @@ namespace fs::Temp{
         newNode->parent = this;
         
         *ent = DirectoryEntry(newNode, ent->name);
-        DirectoryEntry dirent = *ent;
-
-        children.add_back(dirent);
+        InsertEntry(*ent);
 
         return 0;
     }
@@ -292,10 +553,6 @@ namespace fs::Temp{
         if(file->volumeID != vol->volumeID){
             return -EXDEV; // Different filesystem
         }
-        
-        if(Find(ent->name)){
-            return -EEXIST;
-        }
 
         if(file->IsDirectory()){
             IF_DEBUG(debugLevelTmpFS >= DebugLevelNormal, {
@@ -304,11 +561,16 @@ namespace fs::Temp{
             return -EPERM; // Don't hard link directories
         }
 
+        ScopedSpinLock lock(directoryLock);
+        if(FindEntry(ent->name)){
+            return -EEXIST;
+        }
+
         DirectoryEntry dirent(file, ent->name);
 
         file->nlink++;
 
-        children.add_back(dirent);
+        InsertEntry(dirent);
 
         *ent = dirent;
 
@@ -323,29 +585,31 @@ namespace fs::Temp{
             return -ENOTDIR;
         }
 
-        TempNode* node = Find(ent->name);
-        if(!node){
+        acquireLock(&directoryLock);
+        TempDirent* dirent = FindEntry(ent->name);
+        if(!dirent){
+            releaseLock(&directoryLock);
+
             IF_DEBUG(debugLevelTmpFS >= DebugLevelNormal, {
                 Log::Warning("[tmpfs] Unlink: '%s' does not exist!", ent->name);
             });
             return -ENOENT; // Could not find entry with the name in ent
         }
 
+        TempNode* node = reinterpret_cast<TempNode*>(dirent->entry.node);
         if(!unlinkDirectories && node->IsDirectory()){
+            releaseLock(&directoryLock);
+
             IF_DEBUG(debugLevelTmpFS >= DebugLevelNormal, {
                 Log::Warning("[tmpfs] Unlink: Entry is a directory!");
             });
             return -EISDIR; // Don't unlink directories unless explicitly told to do so
         }
 
-        node->nlink--;
+        RemoveEntry(dirent);
+        releaseLock(&directoryLock);
 
-        for(auto it = children.begin(); it != children.end(); it++){
-            if(!strcmp(ent->name, it->name)){
-                children.remove(it);
-                break;
-            }
-        }
+        node->nlink--;
 
         if(node->nlink <= 0 && node->handleCount <= 0){ // Check if there are any open handles to the node
             Log::Debug(debugLevelTmpFS, DebugLevelVerbose, "[tmpfs] Deleting node (%s)!", ent->name);
@@ -1,9 +1,11 @@
 #include <Audio/Audio.h>
 #include <CPU.h>
+#include <Fs/PageCache.h>
 #include <Fs/TAR.h>
 #include <Fs/Tmp.h>
 #include <Fs/VolumeManager.h>
 #include <HAL.h>
+#include <LZ4.h>
 #include <Lemon.h>
 #include <Logging.h>
 #include <MM/KMalloc.h>
@@ -14,6 +16,8 @@
 #include <PCI.h>
 #include <PS2.h>
 #include <Panic.h>
+#include <RCU.h>
+#include <SMP.h>
 #include <Scheduler.h>
 #include <SharedMemory.h>
 #include <Storage/AHCI.h>
@@ -49,6 +53,7 @@ void KernelProcess() {
     AHCI::Init();
 
     ServiceFS::Initialize();
+    fs::PageCache::Initialize();
 
     Network::InitializeConnections();
     Audio::InitializeSystem();
@@ -140,10 +145,79 @@ void KernelProcess() {
         }
         releaseLock(&Scheduler::destroyedProcessesLock);
 
+        RCU::Reclaim(); // Free anything retired by RCU writers, such as PID table entries
+
         Thread::Current()->Sleep(100000);
     }
 }
 
+// Unmap and free pages allocated with KernelAllocate4KPages and backed by AllocatePhysicalMemoryBlock
+static void FreeKernelPages(uintptr_t base, size_t pageCount) {
+    for (size_t i = 0; i < pageCount; i++) {
+        if (uintptr_t phys = Memory::KernelHeapVirtualToPhysical(base + i * PAGE_SIZE_4K); phys) {
+            Memory::FreePhysicalMemoryBlock(phys);
+        }
+    }
+
+    Memory::KernelFree4KPages(reinterpret_cast<void*>(base), pageCount);
+}
+
+// Give the memory of a boot module which is no longer needed back to the physical allocator
+static void FreeBootModule(boot_module_t& module) {
+    if (module.base >= IO_VIRTUAL_BASE && module.base < KERNEL_VIRTUAL_BASE) {
+        // Multiboot modules are accessed through the IO mapping,
+        // only free the pages which lie entirely within the module
+        uintptr_t phys = module.base - IO_VIRTUAL_BASE;
+        uintptr_t first = (phys + PAGE_SIZE_4K - 1) & ~static_cast<uintptr_t>(PAGE_SIZE_4K - 1);
+        uintptr_t end = (phys + module.size) & ~static_cast<uintptr_t>(PAGE_SIZE_4K - 1);
+        for (uintptr_t page = first; page < end; page += PAGE_SIZE_4K) {
+            Memory::FreePhysicalMemoryBlock(page);
+        }
+    } else {
+        // Stivale2 modules are mapped into the kernel heap
+        FreeKernelPages(module.base, PAGE_COUNT_4K(module.size));
+    }
+
+    module.base = 0;
+    module.size = 0;
+}
+
+// Decompress an LZ4 compressed initrd in place of the boot module,
+// the compressed module is freed on success
+static bool DecompressInitrd(boot_module_t& module) {
+    LZ4::FrameInfo info;
+    if (int e = LZ4::GetFrameInfo(reinterpret_cast<void*>(module.base), module.size, info); e || !info.hasContentSize) {
+        Log::Error("Invalid LZ4 initrd (error %d), the frame must include the content size", e);
+        return false;
+    }
+
+    size_t pageCount = (info.contentSize + PAGE_SIZE_4K - 1) / PAGE_SIZE_4K;
+    uintptr_t buffer = reinterpret_cast<uintptr_t>(Memory::KernelAllocate4KPages(pageCount));
+    for (size_t i = 0; i < pageCount; i++) {
+        Memory::KernelMapVirtualMemory4K(Memory::AllocatePhysicalMemoryBlock(), buffer + i * PAGE_SIZE_4K, 1);
+    }
+
+    uint64_t start = Timer::UsecondsSinceBoot();
+    ssize_t size = LZ4::DecompressFrame(reinterpret_cast<void*>(module.base), module.size,
+                                        reinterpret_cast<void*>(buffer), info.contentSize, true);
+    uint64_t elapsed = Timer::UsecondsSinceBoot() - start;
+
+    if (size < 0 || static_cast<size_t>(size) != info.contentSize) {
+        Log::Error("Failed to decompress initrd (%d)", size);
+        FreeKernelPages(buffer, pageCount);
+        return false;
+    }
+
+    Log::Info("Decompressed initrd (%u KB -> %u KB) in %u us on %u CPUs (%u MB/s)", module.size / 1024, size / 1024,
+              elapsed, SMP::processorCount, elapsed ? size / elapsed : 0);
+
+    FreeBootModule(module);
+
+    module.base = buffer;
+    module.size = size;
+    return true;
+}
+
 typedef void (*ctor_t)(void);
 extern ctor_t _ctors_start[0];
 extern ctor_t _ctors_end[0];
@@ -186,6 +260,13 @@ extern "C" [[noreturn]] void kmain() {
 
     Log::Info("Initializing Ramdisk...");
 
+    if (LZ4::IsFrame(reinterpret_cast<void*>(HAL::bootModules[0].base), HAL::bootModules[0].size)) {
+        if (!DecompressInitrd(HAL::bootModules[0])) {
+            // Never mount the compressed bytes as an archive
+            KernelPanic("Failed to decompress initrd!");
+        }
+    }
+
     fs::tar::TarVolume* tar = new fs::tar::TarVolume(HAL::bootModules[0].base, HAL::bootModules[0].size, "initrd");
     fs::VolumeManager::RegisterVolume(tar);
 
@@ -0,0 +1,314 @@
+#include <LZ4.h>
+
+#include <CString.h>
+#include <Errno.h>
+#include <Logging.h>
+#include <MM/KMalloc.h>
+#include <Math.h>
+#include <SMP.h>
+
+// Minimum length of a match
+#define LZ4_MIN_MATCH 4
+
+namespace LZ4 {
+
+struct Block {
+    const uint8_t* data;
+    uint32_t size;
+    bool compressed;
+};
+
+struct ParallelJob {
+    const Block* blocks;
+    size_t blockCount;
+    size_t blockMaxSize;
+
+    uint8_t* dest;
+    size_t destSize;
+
+    volatile size_t nextBlock;
+    volatile size_t lastBlockSize;
+    volatile bool failed;
+};
+
+static ALWAYS_INLINE uint32_t ReadLE32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Read the extra bytes of a literal or match length
+static ALWAYS_INLINE bool ReadLength(const uint8_t*& ip, const uint8_t* end, size_t& length) {
+    uint8_t b;
+    do {
+        if (ip >= end) {
+            return false;
+        }
+
+        b = *ip++;
+        length += b;
+    } while (b == 255);
+
+    return true;
+}
+
+bool IsFrame(const void* data, size_t size) {
+    return size >= 4 && ReadLE32(reinterpret_cast<const uint8_t*>(data)) == LZ4_FRAME_MAGIC;
+}
+
+int GetFrameInfo(const void* data, size_t size, FrameInfo& info) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    if (size < 7 || !IsFrame(data, size)) {
+        return -EINVAL;
+    }
+
+    uint8_t flags = p[4];
+    uint8_t bd = p[5];
+    if ((flags & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION) {
+        return -EINVAL;
+    }
+
+    unsigned blockSizeID = (bd >> 4) & 0x7;
+    if (blockSizeID < 4) {
+        return -EINVAL;
+    }
+
+    info.blockMaxSize = 1UL << (8 + 2 * blockSizeID); // 64KB, 256KB, 1MB or 4MB
+    info.hasContentSize = flags & LZ4_FLG_CONTENT_SIZE;
+    info.independentBlocks = flags & LZ4_FLG_BLOCK_INDEPENDENCE;
+    info.blockChecksums = flags & LZ4_FLG_BLOCK_CHECKSUM;
+    info.contentChecksum = flags & LZ4_FLG_CONTENT_CHECKSUM;
+    info.contentSize = 0;
+
+    size_t headerSize = 6;
+    if (info.hasContentSize) {
+        if (size < headerSize + 8) {
+            return -EINVAL;
+        }
+
+        info.contentSize = ReadLE32(p + headerSize) | (static_cast<uint64_t>(ReadLE32(p + headerSize + 4)) << 32);
+        headerSize += 8;
+    }
+
+    if (flags & LZ4_FLG_DICTIONARY_ID) {
+        return -ENOTSUP; // We do not have any dictionaries
+    }
+
+    info.headerSize = headerSize + 1; // Header checksum
+    if (size < info.headerSize) {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+ssize_t DecompressBlock(const uint8_t* src, size_t srcSize, uint8_t* dest, size_t destSize, size_t prefix) {
+    const uint8_t* ip = src;
+    const uint8_t* const ipEnd = src + srcSize;
+    uint8_t* op = dest;
+    uint8_t* const opEnd = dest + destSize;
+
+    while (ip < ipEnd) {
+        uint8_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !ReadLength(ip, ipEnd, literals)) {
+            return -EINVAL;
+        }
+
+        if (literals > static_cast<size_t>(ipEnd - ip) || literals > static_cast<size_t>(opEnd - op)) {
+            return -EINVAL;
+        }
+
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip >= ipEnd) {
+            break; // The last sequence only has literals
+        }
+
+        if (ipEnd - ip < 2) {
+            return -EINVAL;
+        }
+
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > static_cast<size_t>(op - dest) + prefix) {
+            return -EINVAL;
+        }
+
+        size_t length = token & 0xF;
+        if (length == 15 && !ReadLength(ip, ipEnd, length)) {
+            return -EINVAL;
+        }
+        length += LZ4_MIN_MATCH;
+
+        if (length > static_cast<size_t>(opEnd - op)) {
+            return -EINVAL;
+        }
+
+        const uint8_t* match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+        } else if (offset >= 8) {
+            // Overlapping, but each 8 byte chunk is written before it is read
+            size_t i = 0;
+            for (; i + 8 <= length; i += 8) {
+                memcpy(op + i, match + i, 8);
+            }
+
+            for (; i < length; i++) {
+                op[i] = match[i];
+            }
+        } else {
+            // Short repeating pattern
+            for (size_t i = 0; i < length; i++) {
+                op[i] = match[i];
+            }
+        }
+
+        op += length;
+    }
+
+    return op - dest;
+}
+
+// Walk the blocks of a frame, blocks may be nullptr to only count them
+static ssize_t ScanBlocks(const uint8_t* src, size_t srcSize, const FrameInfo& info, Block* blocks) {
+    size_t pos = info.headerSize;
+    size_t count = 0;
+
+    for (;;) {
+        if (srcSize - pos < 4) {
+            return -EINVAL;
+        }
+
+        uint32_t size = ReadLE32(src + pos);
+        pos += 4;
+        if (!size) {
+            break; // End mark
+        }
+
+        bool compressed = !(size & LZ4_BLOCK_UNCOMPRESSED);
+        size &= ~LZ4_BLOCK_UNCOMPRESSED;
+        if (size > info.blockMaxSize || size > srcSize - pos) {
+            return -EINVAL;
+        }
+
+        if (blocks) {
+            blocks[count] = {.data = src + pos, .size = size, .compressed = compressed};
+        }
+
+        count++;
+        pos += size;
+
+        if (info.blockChecksums) {
+            pos += 4;
+            if (pos > srcSize) {
+                return -EINVAL;
+            }
+        }
+    }
+
+    return count;
+}
+
+static ssize_t DecompressBlockAt(const Block& block, uint8_t* dest, size_t destSize, size_t prefix) {
+    if (!block.compressed) {
+        if (block.size > destSize) {
+            return -EINVAL;
+        }
+
+        memcpy(dest, block.data, block.size);
+        return block.size;
+    }
+
+    return DecompressBlock(block.data, block.size, dest, destSize, prefix);
+}
+
+static void DecompressWorker(void* arg) {
+    ParallelJob* job = reinterpret_cast<ParallelJob*>(arg);
+
+    for (;;) {
+        size_t i = __atomic_fetch_add(&job->nextBlock, 1, __ATOMIC_RELAXED);
+        if (i >= job->blockCount || job->failed) {
+            break;
+        }
+
+        // Every block but the last decompresses to exactly blockMaxSize
+        size_t offset = i * job->blockMaxSize;
+        if (offset > job->destSize) {
+            job->failed = true;
+            break;
+        }
+
+        ssize_t written = DecompressBlockAt(job->blocks[i], job->dest + offset,
+                                            MIN(job->blockMaxSize, job->destSize - offset), 0);
+        if (written < 0 || (i + 1 < job->blockCount && static_cast<size_t>(written) != job->blockMaxSize)) {
+            job->failed = true;
+            break;
+        }
+
+        if (i + 1 == job->blockCount) {
+            job->lastBlockSize = written;
+        }
+    }
+}
+
+ssize_t DecompressFrame(const void* _src, size_t srcSize, void* _dest, size_t destSize, bool parallel) {
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(_src);
+    uint8_t* dest = reinterpret_cast<uint8_t*>(_dest);
+
+    FrameInfo info;
+    if (int e = GetFrameInfo(src, srcSize, info)) {
+        return e;
+    }
+
+    ssize_t blockCount = ScanBlocks(src, srcSize, info, nullptr);
+    if (blockCount < 0) {
+        return blockCount;
+    } else if (!blockCount) {
+        return 0;
+    }
+
+    Block* blocks = reinterpret_cast<Block*>(kmalloc(sizeof(Block) * blockCount));
+    ScanBlocks(src, srcSize, info, blocks);
+
+    if (parallel && info.independentBlocks && SMP::processorCount > 1) {
+        ParallelJob job;
+        job.blocks = blocks;
+        job.blockCount = blockCount;
+        job.blockMaxSize = info.blockMaxSize;
+        job.dest = dest;
+        job.destSize = destSize;
+        job.nextBlock = 0;
+        job.lastBlockSize = 0;
+        job.failed = false;
+
+        SMP::RunOnAllProcessors(DecompressWorker, &job);
+
+        if (!job.failed) {
+            kfree(blocks);
+            return (blockCount - 1) * info.blockMaxSize + job.lastBlockSize;
+        }
+
+        // Blocks which are not full can only be handled in order
+        Log::Warning("[LZ4] Parallel decompression failed, retrying on one processor");
+    }
+
+    size_t written = 0;
+    for (ssize_t i = 0; i < blockCount; i++) {
+        ssize_t r = DecompressBlockAt(blocks[i], dest + written, destSize - written,
+                                      info.independentBlocks ? 0 : written);
+        if (r < 0) {
+            kfree(blocks);
+            return r;
+        }
+
+        written += r;
+    }
+
+    kfree(blocks);
+    return written;
+}
+
+} // namespace LZ4
@@ -50,4 +50,68 @@ void Semaphore::Signal() {
     }
 
     releaseLock(&lock);
-}
\ No newline at end of file
+}
+
+ReadWriteLock::ReadWriteLockBlocker::~ReadWriteLockBlocker() {
+    // Make sure a waker is not still holding a reference to us
+    ScopedSpinLock<true> acquired(rwLock->m_waitersLock);
+    if (queued) {
+        rwLock->m_waiters.remove(this);
+        __atomic_sub_fetch(&rwLock->m_waiterCount, 1, __ATOMIC_SEQ_CST);
+        queued = false;
+    }
+}
+
+void ReadWriteLock::Wait(volatile unsigned* word, unsigned mask, unsigned value, bool equal) {
+    auto satisfied = [&]() -> bool { return ((__atomic_load_n(word, __ATOMIC_ACQUIRE) & mask) == value) == equal; };
+
+    for (unsigned i = 0; i < RWLOCK_SPIN_COUNT; i++) {
+        if (satisfied()) {
+            return;
+        }
+
+        asm volatile("pause");
+    }
+
+    // We cannot block with interrupts disabled or before the scheduler has started
+    if (!CheckInterrupts() || !Thread::Current()) {
+        while (!satisfied()) {
+            asm volatile("pause");
+        }
+        return;
+    }
+
+    while (!satisfied()) {
+        ReadWriteLockBlocker blocker(this);
+
+        {
+            ScopedSpinLock<true> acquired(m_waitersLock);
+            m_waiters.add_back(&blocker);
+            blocker.queued = true;
+            __atomic_add_fetch(&m_waiterCount, 1, __ATOMIC_SEQ_CST);
+        }
+
+        // The lock may have been released before we were added to the wait queue
+        if (satisfied()) {
+            break;
+        }
+
+        if (Thread::Current()->Block(&blocker)) {
+            Scheduler::Yield(); // Pending signal, Block will return immediately so let another thread run
+        }
+    }
+}
+
+void ReadWriteLock::WakeWaiters() {
+    ScopedSpinLock<true> acquired(m_waitersLock);
+
+    // Each waiter rechecks its own condition so just wake them all
+    while (m_waiters.get_length()) {
+        ReadWriteLockBlocker* blocker = m_waiters.get_front();
+        m_waiters.remove(blocker);
+        blocker->queued = false;
+        __atomic_sub_fetch(&m_waiterCount, 1, __ATOMIC_SEQ_CST);
+
+        blocker->Unblock();
+    }
+}
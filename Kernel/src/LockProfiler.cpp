@@ -0,0 +1,200 @@
+#ifdef KERNEL_LOCK_PROFILING
+
+#include <Spinlock.h>
+
+#include <ABI/LockStat.h>
+#include <CString.h>
+#include <Device.h>
+#include <Errno.h>
+#include <Hash.h>
+#include <Symbols.h>
+
+// Maximum amount of distinct lock call sites
+#define LOCK_PROFILER_MAX_SITES 4096
+// Amount of slots used to track which call site is holding a lock
+#define LOCK_PROFILER_HOLDER_SLOTS 1024
+
+#define LOCK_PROFILER_SITE_FREE 0
+#define LOCK_PROFILER_SITE_INITIALIZING 1
+#define LOCK_PROFILER_SITE_READY 2
+
+namespace LockProfiler {
+
+// The profiler is called from within acquireLock and releaseLock,
+// so it must never take a spinlock itself, everything here is lock free.
+struct Site {
+    volatile int state;
+    const char* file;
+    int line;
+    uintptr_t ip;
+
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t spinCycles;
+    uint64_t holdCycles;
+    uint64_t maxHoldCycles;
+};
+
+// Most recent acquisition of a lock, indexed by lock address.
+// Two locks held at the same time which share a slot only lose hold times.
+struct Holder {
+    lock_t* volatile lock;
+    Site* site;
+    uint64_t acquiredAt;
+};
+
+static Site sites[LOCK_PROFILER_MAX_SITES];
+static Holder holders[LOCK_PROFILER_HOLDER_SLOTS];
+
+static ALWAYS_INLINE unsigned HolderIndex(lock_t* lock) {
+    return HashU((unsigned)((uintptr_t)lock >> 2)) % LOCK_PROFILER_HOLDER_SLOTS;
+}
+
+static Site* FindSite(const char* file, int line, uintptr_t ip) {
+    unsigned index = HashU((unsigned)(uintptr_t)file ^ (unsigned)line) % LOCK_PROFILER_MAX_SITES;
+
+    for (unsigned i = 0; i < LOCK_PROFILER_MAX_SITES; i++) {
+        Site& site = sites[(index + i) % LOCK_PROFILER_MAX_SITES];
+
+        int state = __atomic_load_n(&site.state, __ATOMIC_ACQUIRE);
+        if (state == LOCK_PROFILER_SITE_FREE) {
+            if (__atomic_compare_exchange_n(&site.state, &state, LOCK_PROFILER_SITE_INITIALIZING, false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                site.file = file;
+                site.line = line;
+                site.ip = ip;
+
+                __atomic_store_n(&site.state, LOCK_PROFILER_SITE_READY, __ATOMIC_RELEASE);
+                return &site;
+            }
+        }
+
+        // Another CPU is claiming this slot, wait for it to fill in the call site
+        while ((state = __atomic_load_n(&site.state, __ATOMIC_ACQUIRE)) == LOCK_PROFILER_SITE_INITIALIZING) {
+            asm("pause");
+        }
+
+        if (site.file == file && site.line == line) {
+            return &site;
+        }
+    }
+
+    return nullptr; // Out of sites, ignore
+}
+
+void Acquired(lock_t* lock, const char* file, int line, uintptr_t ip, uint64_t spinCycles, bool contended) {
+    Site* site = FindSite(file, line, ip);
+    if (!site) {
+        return;
+    }
+
+    __atomic_add_fetch(&site->acquisitions, 1, __ATOMIC_RELAXED);
+    if (contended) {
+        __atomic_add_fetch(&site->contended, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&site->spinCycles, spinCycles, __ATOMIC_RELAXED);
+    }
+
+    Holder& holder = holders[HolderIndex(lock)];
+    holder.site = site;
+    holder.acquiredAt = lockProfilerTSC();
+    __atomic_store_n(&holder.lock, lock, __ATOMIC_RELEASE);
+}
+
+void Released(lock_t* lock) {
+    Holder& holder = holders[HolderIndex(lock)];
+    if (__atomic_load_n(&holder.lock, __ATOMIC_ACQUIRE) != lock) {
+        return; // Slot was taken by another lock
+    }
+
+    Site* site = holder.site;
+    uint64_t held = lockProfilerTSC() - holder.acquiredAt;
+    __atomic_store_n(&holder.lock, nullptr, __ATOMIC_RELAXED);
+
+    __atomic_add_fetch(&site->holdCycles, held, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&site->maxHoldCycles, __ATOMIC_RELAXED);
+    while (held > max &&
+           !__atomic_compare_exchange_n(&site->maxHoldCycles, &max, held, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void Reset() {
+    for (Site& site : sites) {
+        __atomic_store_n(&site.acquisitions, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site.contended, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site.spinCycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site.holdCycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site.maxHoldCycles, 0, __ATOMIC_RELAXED);
+    }
+}
+
+// /dev/lockstat, reads return an array of lockstat_entry_t, one per call site
+class LockStatDevice final : public Device {
+public:
+    LockStatDevice(const char* name) : Device(name, DeviceTypeUNIXPseudo) {
+        flags = FS_NODE_CHARDEVICE;
+
+        SetDeviceName("Lock Profiler");
+    }
+
+    ssize_t Read(size_t offset, size_t size, uint8_t* buffer) override {
+        if (offset % sizeof(lockstat_entry_t)) {
+            return -EINVAL;
+        }
+
+        size_t skip = offset / sizeof(lockstat_entry_t);
+        size_t written = 0;
+        for (Site& site : sites) {
+            if (written + sizeof(lockstat_entry_t) > size) {
+                break;
+            }
+
+            if (__atomic_load_n(&site.state, __ATOMIC_ACQUIRE) != LOCK_PROFILER_SITE_READY) {
+                continue;
+            }
+
+            if (skip) {
+                skip--;
+                continue;
+            }
+
+            lockstat_entry_t entry;
+            memset(&entry, 0, sizeof(lockstat_entry_t));
+
+            entry.address = site.ip;
+            entry.acquisitions = site.acquisitions;
+            entry.contended = site.contended;
+            entry.spinCycles = site.spinCycles;
+            entry.holdCycles = site.holdCycles;
+            entry.maxHoldCycles = site.maxHoldCycles;
+            entry.line = site.line;
+            strncpy(entry.file, site.file, LOCKSTAT_FILE_NAME_MAX - 1);
+
+            KernelSymbol* sym;
+            if (ResolveKernelSymbol(site.ip, sym)) {
+                strncpy(entry.symbol, sym->mangledName, LOCKSTAT_SYMBOL_NAME_MAX - 1);
+            }
+
+            memcpy(buffer + written, &entry, sizeof(lockstat_entry_t));
+            written += sizeof(lockstat_entry_t);
+        }
+
+        return written;
+    }
+
+    int Ioctl(uint64_t cmd, uint64_t arg) override {
+        switch (cmd) {
+        case IoCtlLockStatReset:
+            Reset();
+            return 0;
+        default:
+            return -EINVAL;
+        }
+    }
+};
+
+LockStatDevice lockStat("lockstat");
+
+} // namespace LockProfiler
+
+#endif
@@ -20,37 +20,29 @@ AddressSpace::~AddressSpace() {
 }
 
 MappedRegion* AddressSpace::AddressToRegionReadLock(uintptr_t address) {
-    ScopedSpinLock acquired(m_lock);
+    // The region list lock is always taken before a region lock,
+    // so the region cannot be unmapped whilst we wait on it
+    unsigned slot = m_lock.AcquireRead();
 
-    for (MappedRegion& region : m_regions) {
-        if (!region.vmObject.get()) {
-            continue;
-        }
-
-        if (address >= region.Base() && address < region.End()) {
-            region.lock.AcquireRead();
-            return &region;
-        }
+    MappedRegion* region = FindRegion(address);
+    if (region) {
+        region->lock.AcquireRead();
     }
 
-    return nullptr;
+    m_lock.ReleaseRead(slot);
+    return region;
 }
 
 MappedRegion* AddressSpace::AddressToRegionWriteLock(uintptr_t address) {
-    ScopedSpinLock acquired(m_lock);
+    unsigned slot = m_lock.AcquireRead();
 
-    for (MappedRegion& region : m_regions) {
-        if (!region.vmObject.get()) {
-            continue;
-        }
-
-        if (address >= region.Base() && address < region.End()) {
-            region.lock.AcquireWrite();
-            return &region;
-        }
+    MappedRegion* region = FindRegion(address);
+    if (region) {
+        region->lock.AcquireWrite();
     }
 
-    return nullptr;
+    m_lock.ReleaseRead(slot);
+    return region;
 }
 
 bool AddressSpace::RangeInRegion(uintptr_t base, size_t size) {
@@ -80,41 +72,13 @@ bool AddressSpace::RangeInRegion(uintptr_t base, size_t size) {
     return false;
 }
 
-long AddressSpace::UnmapRegion(MappedRegion* region) {
-    ScopedSpinLock acquired(m_lock);
-    InterruptDisabler disableInterrupts;
-
-    assert(region->lock.IsWriteLocked());
-
-    for (auto it = m_regions.begin(); it != m_regions.end(); it++) {
-        if (it->Base() == region->Base()) {
-            if(IsKernel()){
-                assert(it->Base() >= KERNEL_VIRTUAL_BASE);
-                Memory::KernelMapVirtualMemory4K(0, region->Base(), PAGE_COUNT_4K(region->Size()), 0);
-            } else {
-                Memory::MapVirtualMemory4K(0, region->Base(), PAGE_COUNT_4K(region->Size()), 0, m_pageMap);
-            }
-
-            if (it->vmObject) {
-                it->vmObject->refCount--;
-            }
-
-            m_regions.remove(it);
-            return 0;
-        }
-    }
-
-    Log::Warning("Failed to unmap region object!");
-    return 1;
-}
-
 MappedRegion* AddressSpace::MapVMO(FancyRefPtr<VMObject> obj, uintptr_t base, bool fixed) {
     assert(!(obj->Size() & (PAGE_SIZE_4K - 1)));
     assert(!(base & (PAGE_SIZE_4K - 1)));
 
     MappedRegion* region;
     
-    ScopedSpinLock acquired(m_lock);
+    ScopedWriteLock acquired(m_lock);
     if (base && (region = AllocateRegionAt(base, obj->Size()))) {
         region->vmObject = nullptr;
     } else if (fixed) { // Could not create region at base
@@ -147,7 +111,7 @@ MappedRegion* AddressSpace::AllocateAnonymousVMObject(size_t size, uintptr_t bas
     assert(!(base & (PAGE_SIZE_4K - 1)));
 
     MappedRegion* region;
-    ScopedSpinLock acquired(m_lock);
+    ScopedWriteLock acquired(m_lock);
 
     if (base && (region = AllocateRegionAt(base, size))) {
         region->vmObject = nullptr;
@@ -174,7 +138,7 @@ MappedRegion* AddressSpace::AllocateAnonymousVMObject(size_t size, uintptr_t bas
 }
 
 AddressSpace* AddressSpace::Fork() {
-    ScopedSpinLock acquired(m_lock);
+    ScopedWriteLock acquired(m_lock);
 
     AddressSpace* fork = new AddressSpace(Memory::ClonePageMap(m_pageMap));
     for (auto it = m_regions.begin(); it != m_regions.end(); it++) {
@@ -200,7 +164,7 @@ AddressSpace* AddressSpace::Fork() {
 
 long AddressSpace::UnmapMemory(uintptr_t base, size_t size) {
     uintptr_t end = base + size;
-    ScopedSpinLock acquired(m_lock);
+    ScopedWriteLock acquired(m_lock);
 
 retry:
     for (auto it = m_regions.begin(); it != m_regions.end(); it++) {
@@ -255,6 +219,20 @@ void AddressSpace::DumpRegions() {
     }
 }
 
+MappedRegion* AddressSpace::FindRegion(uintptr_t address) {
+    for (MappedRegion& region : m_regions) {
+        if (!region.vmObject.get()) {
+            continue;
+        }
+
+        if (address >= region.Base() && address < region.End()) {
+            return &region;
+        }
+    }
+
+    return nullptr;
+}
+
 MappedRegion* AddressSpace::FindAvailableRegion(size_t size) {
     uintptr_t base = PAGE_SIZE_4K; // We do not want zero addresses
     uintptr_t end = base + size;
@@ -3,6 +3,7 @@
 #include <Assert.h>
 #include <Errno.h>
 #include <Logging.h>
+#include <Math.h>
 #include <Scheduler.h>
 
 int Socket::CreateSocket(int domain, int type, int protocol, Socket** sock) {
@@ -93,6 +94,88 @@ int64_t Socket::SendTo(void* buffer, size_t len, int flags, const sockaddr* src,
     return -1; // We should not return but get the compiler to shut up
 }
 
+ssize_t Socket::ReadV(size_t offset, const iovec* iov, int iovcnt) {
+    if (iovcnt == 1) {
+        return Receive(iov[0].iov_base, iov[0].iov_len, 0);
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+    }
+
+    if (!total) {
+        return 0;
+    }
+
+    size_t size = MIN(total, SOCKET_IOV_BUFFER_MAX);
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(kmalloc(size));
+
+    int64_t ret = Receive(buffer, size, 0);
+    if (ret > 0) {
+        // Scatter what was received
+        size_t pos = 0;
+        for (int i = 0; i < iovcnt && pos < static_cast<size_t>(ret); i++) {
+            size_t len = MIN(iov[i].iov_len, ret - pos);
+            memcpy(iov[i].iov_base, buffer + pos, len);
+            pos += len;
+        }
+    }
+
+    kfree(buffer);
+    return ret;
+}
+
+ssize_t Socket::WriteV(size_t offset, const iovec* iov, int iovcnt) {
+    if (iovcnt == 1) {
+        return Send(iov[0].iov_base, iov[0].iov_len, 0);
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+    }
+
+    if (type != StreamSocket && total > SOCKET_IOV_BUFFER_MAX) {
+        return -EMSGSIZE; // Messages have to be sent with a single call
+    }
+
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(kmalloc(MIN(total, SOCKET_IOV_BUFFER_MAX)));
+
+    // Gather the buffers into chunks, stream sockets may need more than one
+    int index = 0;
+    size_t indexOffset = 0;
+    ssize_t sent = 0;
+    while (sent < static_cast<ssize_t>(total)) {
+        size_t chunk = 0;
+        while (index < iovcnt && chunk < SOCKET_IOV_BUFFER_MAX) {
+            size_t len = MIN(iov[index].iov_len - indexOffset, SOCKET_IOV_BUFFER_MAX - chunk);
+            memcpy(buffer + chunk, reinterpret_cast<uint8_t*>(iov[index].iov_base) + indexOffset, len);
+
+            chunk += len;
+            indexOffset += len;
+            if (indexOffset == iov[index].iov_len) {
+                index++;
+                indexOffset = 0;
+            }
+        }
+
+        int64_t ret = Send(buffer, chunk, 0);
+        if (ret < 0) {
+            kfree(buffer);
+            return sent ? sent : ret;
+        }
+
+        sent += ret;
+        if (static_cast<size_t>(ret) < chunk) {
+            break;
+        }
+    }
+
+    kfree(buffer);
+    return sent;
+}
+
 int Socket::GetSocketOptions(int level, int opt, void* optValue, socklen_t* optLength) {
     if (level == SOL_SOCKET) {
         switch (opt) {
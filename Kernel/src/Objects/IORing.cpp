@@ -0,0 +1,595 @@
+#include <Objects/IORing.h>
+
+#include <Assert.h>
+#include <CString.h>
+#include <Errno.h>
+#include <Fs/PageCache.h>
+#include <Fs/Pipe.h>
+#include <Logging.h>
+#include <Math.h>
+#include <Memory.h>
+#include <Net/Socket.h>
+#include <Objects/Process.h>
+#include <Scheduler.h>
+#include <Timer.h>
+
+// The SQE and CQE arrays start on a cache line after the header
+#define IORING_ARRAY_ALIGN 64
+
+IORingVMObject::IORingVMObject(size_t size) : PhysicalVMObject(size, false, true) {
+    size_t pageCount = PAGE_COUNT_4K(size);
+
+    m_kernelMapping = Memory::KernelAllocate4KPages(pageCount);
+    for (unsigned i = 0; i < pageCount; i++) {
+        Memory::KernelMapVirtualMemory4K(static_cast<uintptr_t>(physicalBlocks[i]) << PAGE_SHIFT_4K,
+                                         reinterpret_cast<uintptr_t>(m_kernelMapping) + i * PAGE_SIZE_4K, 1);
+    }
+}
+
+IORingVMObject::~IORingVMObject() { Memory::KernelFree4KPages(m_kernelMapping, PAGE_COUNT_4K(size)); }
+
+struct IORingWork {
+    FancyRefPtr<IORing> ring; // Keeps the ring alive until the work is done
+    IORingRequest* req;
+};
+
+static lock_t workLock = 0;
+static List<IORingWork> workQueue;
+static Semaphore workSemaphore(0);
+static FancyRefPtr<Process> workers[IORING_WORKER_COUNT];
+static bool workersStarted = false;
+
+static ALWAYS_INLINE size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+ErrorOr<FancyRefPtr<IORing>> IORing::Create(Process* proc, unsigned entries) {
+    if (!entries || entries > IORING_MAX_ENTRIES) {
+        return Error{EINVAL};
+    }
+
+    unsigned sqEntries = 1;
+    while (sqEntries < entries) {
+        sqEntries <<= 1;
+    }
+    unsigned cqEntries = sqEntries * 2; // Leave room for completions which are not reaped straight away
+
+    size_t sqeOffset = AlignUp(sizeof(ioring_shared), IORING_ARRAY_ALIGN);
+    size_t cqeOffset = AlignUp(sqeOffset + sizeof(ioring_sqe) * sqEntries, IORING_ARRAY_ALIGN);
+    size_t size = AlignUp(cqeOffset + sizeof(ioring_cqe) * cqEntries, PAGE_SIZE_4K);
+
+    bool started = false;
+    if (__atomic_compare_exchange_n(&workersStarted, &started, true, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        for (unsigned i = 0; i < IORING_WORKER_COUNT; i++) {
+            workers[i] = Process::CreateKernelProcess((void*)WorkerThread, "IORing Worker", nullptr);
+            workers[i]->Start();
+        }
+    }
+
+    FancyRefPtr<IORing> ring = new IORing();
+    ring->m_vmo = new IORingVMObject(size);
+    ring->m_size = size;
+    ring->m_sqEntries = sqEntries;
+    ring->m_cqEntries = cqEntries;
+
+    uint8_t* base = reinterpret_cast<uint8_t*>(ring->m_vmo->KernelMapping());
+    ring->m_shared = reinterpret_cast<ioring_shared*>(base);
+    ring->m_sqes = reinterpret_cast<ioring_sqe*>(base + sqeOffset);
+    ring->m_cqes = reinterpret_cast<ioring_cqe*>(base + cqeOffset);
+
+    ioring_shared* shared = ring->m_shared;
+    shared->sqMask = sqEntries - 1;
+    shared->sqEntries = sqEntries;
+    shared->cqMask = cqEntries - 1;
+    shared->cqEntries = cqEntries;
+    shared->sqeOffset = sqeOffset;
+    shared->cqeOffset = cqeOffset;
+
+    MappedRegion* region = proc->addressSpace->MapVMO(static_pointer_cast<VMObject>(ring->m_vmo), 0, false);
+    if (!region || !region->Base()) {
+        return Error{ENOMEM};
+    }
+
+    ring->m_userBase = region->Base();
+    return ring;
+}
+
+IORing::~IORing() {
+    // Parked operations are cancelled, work handed to workers keeps a reference to us
+    for (IORingRequest* req : m_pending) {
+        delete req;
+    }
+    m_pending.clear();
+}
+
+long IORing::Enter(const FancyRefPtr<IORing>& ring, Process* proc, unsigned toSubmit, unsigned minComplete,
+                   unsigned flags) {
+    if (flags & ~IORING_ENTER_GETEVENTS) {
+        return -EINVAL;
+    }
+
+    if (minComplete > ring->m_cqEntries) {
+        minComplete = ring->m_cqEntries;
+    }
+
+    ring->m_enterLock.AcquireWrite();
+    long submitted = ring->Submit(ring, proc, toSubmit);
+    ring->RunPending(proc, nullptr, nullptr);
+    ring->m_enterLock.ReleaseWrite();
+
+    if (!(flags & IORING_ENTER_GETEVENTS)) {
+        return submitted;
+    }
+
+    while (ring->CompletionsReady() < minComplete) {
+        FilesystemWatcher watcher;
+        uint64_t deadline = 0;
+
+        acquireLock(&ring->m_lock);
+        ring->m_waiters.add_back(&watcher);
+        releaseLock(&ring->m_lock);
+
+        ring->m_enterLock.AcquireWrite();
+        ring->RunPending(proc, &watcher, &deadline);
+        ring->m_enterLock.ReleaseWrite();
+
+        bool interrupted = false;
+        if (ring->CompletionsReady() < minComplete) {
+            if (deadline) {
+                uint64_t now = Timer::UsecondsSinceBoot();
+                long timeout = deadline > now ? deadline - now : 0;
+                if (timeout > 0) {
+                    interrupted = watcher.WaitTimeout(timeout);
+                }
+            } else {
+                interrupted = watcher.Wait();
+            }
+        }
+
+        acquireLock(&ring->m_lock);
+        ring->m_waiters.remove(&watcher);
+        releaseLock(&ring->m_lock);
+
+        if (interrupted) {
+            return submitted ? submitted : -EINTR;
+        }
+    }
+
+    return submitted;
+}
+
+long IORing::Submit(const FancyRefPtr<IORing>& self, Process* proc, unsigned count) {
+    uint32_t tail = __atomic_load_n(&m_shared->sqTail, __ATOMIC_ACQUIRE);
+    uint32_t available = tail - m_sqHead;
+    if (available > m_sqEntries) {
+        return -EINVAL; // Userspace corrupted the queue
+    }
+
+    if (count > available) {
+        count = available;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        ioring_sqe sqe;
+        memcpy(&sqe, &m_sqes[m_sqHead & (m_sqEntries - 1)], sizeof(ioring_sqe));
+
+        // Let userspace reuse the entry before we start on the operation
+        m_sqHead++;
+        __atomic_store_n(&m_shared->sqHead, m_sqHead, __ATOMIC_RELEASE);
+
+        Dispatch(self, proc, sqe);
+    }
+
+    return count;
+}
+
+// Copy the path and look up the directory of an IORING_OP_OPENAT, the worker cannot touch the process
+static long PrepareOpenAt(Process* proc, IORingRequest* req) {
+    const ioring_sqe& sqe = req->sqe;
+
+    size_t length;
+    if (strlenSafe(reinterpret_cast<const char*>(sqe.addr), length, proc->addressSpace)) {
+        return -EFAULT;
+    } else if (length > PATH_MAX) {
+        return -ENAMETOOLONG;
+    }
+
+    if (sqe.fd == AT_FDCWD) {
+        req->handle = proc->workingDir;
+    } else {
+        auto dirHandle = proc->GetHandleAs<UNIXOpenFile>(sqe.fd);
+        if (dirHandle.HasError()) {
+            return -dirHandle.Err().code;
+        }
+
+        req->handle = std::move(dirHandle.Value());
+        if (!req->handle->node || !req->handle->node->IsDirectory()) {
+            return -ENOTDIR;
+        }
+    }
+
+    req->buffer = new uint8_t[length + 1];
+    strncpy(reinterpret_cast<char*>(req->buffer), reinterpret_cast<const char*>(sqe.addr), length);
+    req->buffer[length] = 0;
+    return 0;
+}
+
+// Open path relative to dir, see SysOpen
+static ErrorOr<FancyRefPtr<UNIXOpenFile>> OpenAt(FsNode* dir, const char* path, uint32_t flags) {
+    FsNode* node = fs::ResolvePath(path, dir, !(flags & O_NOFOLLOW));
+    if (!node && (flags & O_CREAT)) {
+        FsNode* parent = fs::ResolveParent(path, dir);
+        if (!parent) {
+            return Error{ENOENT};
+        }
+
+        DirectoryEntry ent;
+        strncpy(ent.name, fs::BaseName(path).c_str(), NAME_MAX - 1);
+        if (int e = fs::Create(parent, &ent, flags); e < 0) {
+            return Error{-e};
+        }
+
+        node = fs::ResolvePath(path, dir, !(flags & O_NOFOLLOW));
+    }
+
+    if (!node) {
+        return Error{ENOENT};
+    } else if (node->IsSymlink()) {
+        return Error{ELOOP};
+    } else if ((flags & O_DIRECTORY) && !node->IsDirectory()) {
+        return Error{ENOTDIR};
+    }
+
+    if ((flags & O_TRUNC) && ((flags & O_ACCESS) == O_RDWR || (flags & O_ACCESS) == O_WRONLY)) {
+        fs::Truncate(node, 0);
+    }
+
+    auto result = fs::Open(node, flags & ~O_CREAT);
+    if (result.HasError()) {
+        return result.Err();
+    }
+
+    FancyRefPtr<UNIXOpenFile> handle = result.Value();
+    if (flags & O_APPEND) {
+        handle->pos = node->size;
+    }
+
+    return handle;
+}
+
+void IORing::Dispatch(const FancyRefPtr<IORing>& self, Process* proc, const ioring_sqe& sqe) {
+    if (sqe.opcode > IORING_OP_LAST || sqe.flags) {
+        Complete(sqe.userData, -EINVAL);
+        return;
+    }
+
+    if (sqe.opcode == IORING_OP_NOP) {
+        Complete(sqe.userData, 0);
+        return;
+    } else if (sqe.opcode == IORING_OP_TIMEOUT) {
+        if (sqe.offset <= 0) {
+            Complete(sqe.userData, -ETIME);
+            return;
+        }
+
+        IORingRequest* req = new IORingRequest{sqe};
+        req->deadline = Timer::UsecondsSinceBoot() + (sqe.offset + 999) / 1000;
+        Park(req);
+        return;
+    }
+
+    IORingRequest* req = new IORingRequest{sqe};
+    if (sqe.opcode == IORING_OP_OPENAT) {
+        // Opening may wait on the disk, have a worker open the file
+        if (long e = PrepareOpenAt(proc, req); e < 0) {
+            Complete(sqe.userData, e);
+            delete req;
+            return;
+        }
+
+        QueueWork(self, req);
+        return;
+    }
+
+    auto handle = proc->GetHandleAs<UNIXOpenFile>(sqe.fd);
+    if (handle.HasError()) {
+        Complete(sqe.userData, -handle.Err().code);
+        delete req;
+        return;
+    }
+
+    req->handle = std::move(handle.Value());
+    if (!req->handle->node) {
+        Complete(sqe.userData, -EBADF);
+        delete req;
+        return;
+    }
+
+    FsNode* node = req->handle->node;
+    if (sqe.opcode == IORING_OP_FSYNC) {
+        QueueWork(self, req);
+        return;
+    } else if (sqe.opcode == IORING_OP_WRITE && (node->IsFile() || node->IsBlockDevice())) {
+        if (!Memory::CheckUsermodePointer(sqe.addr, sqe.len, proc->addressSpace)) {
+            Complete(sqe.userData, -EFAULT);
+            delete req;
+            return;
+        }
+
+        // Give the worker a copy of the payload, userspace may reuse the buffer once the write is submitted
+        req->sqe.len = MIN(sqe.len, IORING_MAX_WRITE_COPY);
+        req->buffer = new uint8_t[req->sqe.len];
+        memcpy(req->buffer, reinterpret_cast<void*>(sqe.addr), req->sqe.len);
+
+        QueueWork(self, req);
+        return;
+    } else if (sqe.opcode == IORING_OP_READ && node->pageCached) {
+        size_t offset = (sqe.offset < 0) ? req->handle->pos : sqe.offset;
+        if (!fs::PageCache::IsCached(node, offset, sqe.len)) {
+            QueueWork(self, req); // Have a worker wait on the disk instead of the caller
+            return;
+        }
+    }
+
+    long result = Execute(proc, req);
+    if (result == -EAGAIN) {
+        Park(req);
+        return;
+    }
+
+    Complete(sqe.userData, result);
+    delete req;
+}
+
+long IORing::Execute(Process* proc, IORingRequest* req) {
+    const ioring_sqe& sqe = req->sqe;
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(sqe.addr);
+
+    switch (sqe.opcode) {
+    case IORING_OP_OPENAT:
+        // A worker has opened the file, the handle has to be allocated in the owning process
+        if (req->workResult < 0) {
+            return req->workResult;
+        }
+
+        return proc->AllocateHandle(std::move(req->handle));
+    case IORING_OP_ACCEPT: {
+        FsNode* node = req->handle->node;
+        if (!node->IsSocket()) {
+            return -ENOTSOCK;
+        }
+
+        Socket* sock = reinterpret_cast<Socket*>(node);
+        if (!sock->IsListening()) {
+            return -EINVAL;
+        }
+
+        sockaddr* addr = reinterpret_cast<sockaddr*>(sqe.addr);
+        socklen_t addrLength = sqe.len;
+        if (addr && !Memory::CheckUsermodePointer(sqe.addr, addrLength, proc->addressSpace)) {
+            return -EFAULT;
+        }
+
+        Socket* newSock = sock->Accept(addr, addr ? &addrLength : nullptr, req->handle->mode | O_NONBLOCK);
+        if (!newSock) {
+            return -EAGAIN;
+        }
+
+        auto newHandle = fs::Open(newSock);
+        if (newHandle.HasError()) {
+            return -newHandle.Err().code;
+        }
+
+        return proc->AllocateHandle(FancyRefPtr<UNIXOpenFile>(newHandle.Value()));
+    }
+    default:
+        break;
+    }
+
+    // Everything else transfers to or from a user buffer
+    if (!Memory::CheckUsermodePointer(sqe.addr, sqe.len, proc->addressSpace)) {
+        return -EFAULT;
+    }
+
+    FsNode* node = req->handle->node;
+    if (sqe.opcode == IORING_OP_SEND || sqe.opcode == IORING_OP_RECV) {
+        if (!node->IsSocket()) {
+            return -ENOTSOCK;
+        }
+
+        Socket* sock = reinterpret_cast<Socket*>(node);
+        int flags = sqe.opFlags | MSG_DONTWAIT;
+        if (sqe.opcode == IORING_OP_SEND) {
+            return sock->Send(buffer, sqe.len, flags);
+        } else {
+            return sock->Receive(buffer, sqe.len, flags);
+        }
+    }
+
+    bool write = sqe.opcode == IORING_OP_WRITE;
+    if (node->IsSocket()) {
+        Socket* sock = reinterpret_cast<Socket*>(node);
+        return write ? sock->Send(buffer, sqe.len, MSG_DONTWAIT) : sock->Receive(buffer, sqe.len, MSG_DONTWAIT);
+    }
+
+    size_t len = sqe.len;
+    if (!node->IsFile() && !node->IsBlockDevice()) {
+        // Pipes and devices may block, only go ahead once they are ready
+        if (write ? !node->CanWrite() : !node->CanRead()) {
+            return -EAGAIN;
+        }
+
+        if (!write && node->IsPipe()) {
+            // Pipe reads wait until the whole buffer can be filled
+            size_t available = reinterpret_cast<UNIXPipe*>(node)->Available();
+            if (len > available) {
+                len = available;
+            }
+        }
+
+        return write ? fs::Write(req->handle, len, buffer) : fs::Read(req->handle, len, buffer);
+    }
+
+    if (sqe.offset < 0) {
+        return write ? fs::Write(req->handle, len, buffer) : fs::Read(req->handle, len, buffer);
+    }
+
+    return write ? fs::Write(node, sqe.offset, len, buffer) : fs::Read(node, sqe.offset, len, buffer);
+}
+
+void IORing::RunPending(Process* proc, FilesystemWatcher* watcher, uint64_t* deadline) {
+    List<IORingRequest*> pending;
+    acquireLock(&m_lock);
+    pending = std::move(m_pending);
+    releaseLock(&m_lock);
+
+    uint64_t now = Timer::UsecondsSinceBoot();
+    for (IORingRequest* req : pending) {
+        long result;
+        if (req->sqe.opcode == IORING_OP_TIMEOUT) {
+            if (req->deadline > now) {
+                if (deadline && (!*deadline || req->deadline < *deadline)) {
+                    *deadline = req->deadline;
+                }
+
+                Park(req);
+                continue;
+            }
+
+            result = -ETIME;
+        } else {
+            if (watcher && !req->workDone) {
+                // Watch before retrying so readiness signalled in between is not missed
+                bool output = req->sqe.opcode == IORING_OP_WRITE || req->sqe.opcode == IORING_OP_SEND;
+                watcher->WatchNode(req->handle->node, output ? POLLOUT : POLLIN);
+            }
+
+            if ((result = Execute(proc, req)) == -EAGAIN) {
+                Park(req);
+                continue;
+            }
+        }
+
+        Complete(req->sqe.userData, result);
+        delete req;
+    }
+}
+
+void IORing::Park(IORingRequest* req) {
+    acquireLock(&m_lock);
+    m_pending.add_back(req);
+    releaseLock(&m_lock);
+}
+
+void IORing::Complete(uint64_t userData, long result) {
+    acquireLock(&m_cqLock);
+
+    uint32_t head = __atomic_load_n(&m_shared->cqHead, __ATOMIC_ACQUIRE);
+    if (m_cqTail - head >= m_cqEntries) {
+        __atomic_fetch_add(&m_shared->cqOverflow, 1, __ATOMIC_RELAXED);
+        releaseLock(&m_cqLock);
+        return;
+    }
+
+    ioring_cqe& cqe = m_cqes[m_cqTail & (m_cqEntries - 1)];
+    cqe.userData = userData;
+    cqe.result = result;
+    cqe.flags = 0;
+
+    m_cqTail++;
+    __atomic_store_n(&m_shared->cqTail, m_cqTail, __ATOMIC_RELEASE);
+
+    releaseLock(&m_cqLock);
+}
+
+unsigned IORing::CompletionsReady() {
+    uint32_t ready = __atomic_load_n(&m_cqTail, __ATOMIC_ACQUIRE) - __atomic_load_n(&m_shared->cqHead, __ATOMIC_ACQUIRE);
+    return (ready > m_cqEntries) ? m_cqEntries : ready;
+}
+
+void IORing::WakeWaiters() {
+    acquireLock(&m_lock);
+    for (FilesystemWatcher* watcher : m_waiters) {
+        watcher->Signal();
+    }
+    releaseLock(&m_lock);
+}
+
+void IORing::QueueWork(const FancyRefPtr<IORing>& ring, IORingRequest* req) {
+    acquireLock(&workLock);
+    workQueue.add_back(IORingWork{ring, req});
+    releaseLock(&workLock);
+
+    workSemaphore.Signal();
+}
+
+void IORing::WorkerThread() {
+    for (;;) {
+        if (workSemaphore.Wait()) {
+            continue; // Interrupted
+        }
+
+        acquireLock(&workLock);
+        if (!workQueue.get_length()) {
+            releaseLock(&workLock);
+            continue;
+        }
+
+        IORingWork work = workQueue.remove_at(0);
+        releaseLock(&workLock);
+
+        IORing* ring = work.ring.get();
+        IORingRequest* req = work.req;
+        FsNode* node = req->handle->node;
+
+        if (req->sqe.opcode == IORING_OP_FSYNC) {
+            node->Sync();
+
+            ring->Complete(req->sqe.userData, 0);
+            delete req;
+        } else if (req->sqe.opcode == IORING_OP_WRITE) {
+            long result;
+            if (req->sqe.offset < 0) {
+                result = fs::Write(req->handle, req->sqe.len, req->buffer);
+            } else {
+                result = fs::Write(node, req->sqe.offset, req->sqe.len, req->buffer);
+            }
+
+            ring->Complete(req->sqe.userData, result);
+            delete req;
+        } else if (req->sqe.opcode == IORING_OP_OPENAT) {
+            auto result = OpenAt(node, reinterpret_cast<const char*>(req->buffer), req->sqe.opFlags);
+            if (result.HasError()) {
+                req->workResult = -result.Err().code;
+            } else {
+                req->handle = std::move(result.Value());
+            }
+
+            req->workDone = true;
+            ring->Park(req);
+        } else {
+            // Read the pages in, the copy to the user buffer has to happen in the owning process
+            size_t offset = (req->sqe.offset < 0) ? req->handle->pos : req->sqe.offset;
+            if (req->sqe.len && (!node->IsFile() || offset < node->size)) {
+                uint64_t last = (offset + req->sqe.len - 1) >> PAGE_SHIFT_4K;
+                if (node->IsFile()) {
+                    last = MIN(last, (node->size - 1) >> PAGE_SHIFT_4K);
+                }
+
+                for (uint64_t index = offset >> PAGE_SHIFT_4K; index <= last; index++) {
+                    fs::PageCache::CachedPage* page = fs::PageCache::GetPage(node, index);
+                    if (!page) {
+                        break; // The read will go to the disk directly and report the error
+                    }
+
+                    fs::PageCache::ReleasePage(page);
+                }
+            }
+
+            req->workDone = true;
+            ring->Park(req);
+        }
+
+        ring->WakeWaiters();
+    }
+}
@@ -127,6 +127,7 @@ Process::Process(pid_t pid, const char* _name, const char* _workingDir, Process*
     }
 
     strncpy(name, _name, NAME_MAX);
+    execPath[0] = 0;
 
     addressSpace = new AddressSpace(Memory::CreatePageMap());
 
@@ -163,18 +164,27 @@ uintptr_t Process::LoadELF(uintptr_t* stackPointer, elf_info_t elfInfo, const Ve
             KernelPanic("Failed to load dynamic linker!");
         }
 
-        void* linkerElf = kmalloc(node->size);
-        fs::Read(node, 0, node->size, (uint8_t*)linkerElf); // Load Dynamic Linker
+        void* linkerElf = const_cast<uint8_t*>(node->ResidentData());
+        bool resident = linkerElf;
+        if (!resident) {
+            linkerElf = kmalloc(node->size);
+            fs::Read(node, 0, node->size, (uint8_t*)linkerElf); // Load Dynamic Linker
+        }
 
         if (!VerifyELF(linkerElf)) {
             Log::Warning("Invalid Dynamic Linker ELF");
+            if (!resident) {
+                kfree(linkerElf);
+            }
             return 0;
         }
 
         elf_info_t linkerELFInfo = LoadELFSegments(this, linkerElf, linkerBaseAddress);
         rip = linkerELFInfo.entry;
 
-        kfree(linkerElf);
+        if (!resident) {
+            kfree(linkerElf);
+        }
     }
 
     char* tempArgv[argv.size()];
@@ -576,6 +586,7 @@ FancyRefPtr<Process> Process::Fork() {
     FancyRefPtr<Process> newProcess = new Process(Scheduler::GetNextPID(), name, workingDirPath, this);
     delete newProcess->addressSpace; // TODO: Do not create address space in first place
     newProcess->addressSpace = addressSpace->Fork();
+    strcpy(newProcess->execPath, execPath);
 
     newProcess->euid = euid;
     newProcess->uid = uid;
@@ -0,0 +1,83 @@
+#include <RCU.h>
+
+#include <Assert.h>
+#include <Scheduler.h>
+#include <Spinlock.h>
+
+namespace RCU {
+
+ReaderSlot readers[RCU_READER_SLOTS];
+volatile unsigned epoch = 0;
+
+// Only one grace period may be in progress at a time
+lock_t synchronizeLock = 0;
+
+struct RetiredCallback {
+    RetiredCallback* next;
+
+    void (*callback)(void*);
+    void* data;
+};
+
+lock_t retiredLock = 0;
+RetiredCallback* retired = nullptr;
+
+static void WaitForReaders(unsigned parity) {
+    for (unsigned i = 0; i < RCU_READER_SLOTS; i++) {
+        while (__atomic_load_n(&readers[i].count[parity], __ATOMIC_SEQ_CST)) {
+            if (CheckInterrupts()) {
+                Scheduler::Yield();
+            } else {
+                asm volatile("pause");
+            }
+        }
+    }
+}
+
+void Synchronize() {
+    assert(CheckInterrupts());
+
+    while (acquireTestLock(&synchronizeLock)) {
+        Scheduler::Yield();
+    }
+
+    // New readers will count themselves against the new epoch,
+    // so we only need to wait for readers of the old one.
+    unsigned old = __atomic_fetch_add(&epoch, 1, __ATOMIC_SEQ_CST) & 1;
+    WaitForReaders(old);
+
+    releaseLock(&synchronizeLock);
+}
+
+void Retire(void (*callback)(void*), void* data) {
+    RetiredCallback* cb = new RetiredCallback{nullptr, callback, data};
+
+    ScopedSpinLock<true> lockRetired(retiredLock);
+    cb->next = retired;
+    retired = cb;
+}
+
+void Reclaim() {
+    RetiredCallback* list;
+    {
+        ScopedSpinLock<true> lockRetired(retiredLock);
+        list = retired;
+        retired = nullptr;
+    }
+
+    if (!list) {
+        return;
+    }
+
+    Synchronize();
+
+    while (list) {
+        RetiredCallback* next = list->next;
+        list->callback(list->data);
+
+        delete list;
+        list = next;
+    }
+}
+
+} // namespace RCU
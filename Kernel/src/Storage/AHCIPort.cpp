@@ -13,6 +13,11 @@
 
 #define HBA_PxIS_TFES (1 << 30)
 
+// Maximum amount of sectors in one direct transfer (64KB)
+#define AHCI_DIRECT_MAX_SECTORS 128
+// A 64KB transfer can span at most 17 pages
+#define AHCI_DIRECT_MAX_REGIONS (AHCI_DIRECT_MAX_SECTORS * 512 / PAGE_SIZE_4K + 1)
+
 namespace AHCI {
 Port::Port(int num, hba_port_t* portStructure, hba_mem_t* hbaMem) {
     registers = portStructure;
@@ -196,10 +201,64 @@ void Port::ReleaseBuffer(int index) {
     bufferSemaphore.Signal();
 }
 
+int Port::AccessDirect(uint64_t lba, uint32_t count, uint8_t* buffer, int write) {
+    uintptr_t virt = reinterpret_cast<uintptr_t>(buffer);
+    if ((count % blocksize) || (virt & 1)) {
+        return 1; // PRDT entries must be word aligned
+    }
+
+    // Make sure the whole buffer can be used before starting
+    for (uintptr_t page = virt & ~(PAGE_SIZE_4K - 1); page < virt + count; page += PAGE_SIZE_4K) {
+        if (!Memory::KernelHeapVirtualToPhysical(page)) {
+            return 1;
+        }
+    }
+
+    while (count) {
+        uint32_t size = (count > AHCI_DIRECT_MAX_SECTORS * 512) ? AHCI_DIRECT_MAX_SECTORS * 512 : count;
+
+        // Merge physically contiguous pages into one region
+        DMARegion regions[AHCI_DIRECT_MAX_REGIONS];
+        unsigned regionCount = 0;
+        for (uint32_t done = 0; done < size;) {
+            uintptr_t phys = Memory::KernelHeapVirtualToPhysical(virt + done);
+            uint32_t length = PAGE_SIZE_4K - ((virt + done) & (PAGE_SIZE_4K - 1));
+            if (length > size - done) {
+                length = size - done;
+            }
+
+            if (regionCount && regions[regionCount - 1].phys + regions[regionCount - 1].size == phys) {
+                regions[regionCount - 1].size += length;
+            } else {
+                assert(regionCount < AHCI_DIRECT_MAX_REGIONS);
+                regions[regionCount++] = {phys, length};
+            }
+
+            done += length;
+        }
+
+        if (int e = Access(lba, size / 512, regions, regionCount, write); e) {
+            return e;
+        }
+
+        virt += size;
+        lba += size / 512;
+        count -= size;
+    }
+
+    return 0;
+}
+
 int Port::ReadDiskBlock(uint64_t lba, uint32_t count, void* _buffer) {
     uint64_t blockCount = ((count + (blocksize - 1)) / blocksize);
     uint8_t* buffer = reinterpret_cast<uint8_t*>(_buffer);
 
+    // Large reads into kernel buffers skip the bounce buffers
+    // and are issued as few large commands
+    if (int e = AccessDirect(lba, count, buffer, 0); e != 1) {
+        return e;
+    }
+
     // Log::Info("LBA: %x, count: %u, blcount: %u", lba, count, blockCount);
 
     int buf = AcquireBuffer();
@@ -279,6 +338,10 @@ int Port::WriteDiskBlock(uint64_t lba, uint32_t count, void* _buffer) {
     uint64_t blockCount = ((count + (blocksize - 1)) / blocksize);
     uint8_t* buffer = reinterpret_cast<uint8_t*>(_buffer);
 
+    if (int e = AccessDirect(lba, count, buffer, 1); e != 1) {
+        return e;
+    }
+
     unsigned buf = AcquireBuffer();
     if (buf >= 8) {
         return 4; // Should not happen
@@ -310,7 +373,13 @@ int Port::WriteDiskBlock(uint64_t lba, uint32_t count, void* _buffer) {
 }
 
 int Port::Access(uint64_t lba, uint32_t count, uintptr_t physBuffer, int write) {
+    DMARegion region = {physBuffer, 512 * count}; // 512 bytes per sector
+    return Access(lba, count, &region, 1, write);
+}
+
+int Port::Access(uint64_t lba, uint32_t count, const DMARegion* regions, unsigned regionCount, int write) {
     assert(CheckInterrupts());
+    assert(regionCount > 0);
 
     if (portLock.Wait()) {
         return -EINTR;
@@ -341,14 +410,17 @@ int Port::Access(uint64_t lba, uint32_t count, uintptr_t physBuffer, int write)
 
     commandHeader->prdbc = 0;
     commandHeader->pmp = 0;
+    commandHeader->prdtl = regionCount;
 
     hba_cmd_tbl_t* commandTable = commandTables[slot];
-    memset(commandTable, 0, sizeof(hba_cmd_tbl_t));
+    memset(commandTable, 0, sizeof(hba_cmd_tbl_t) + (regionCount - 1) * sizeof(hba_prdt_entry_t));
 
-    commandTable->prdt_entry[0].dba = physBuffer & 0xFFFFFFFF;
-    commandTable->prdt_entry[0].dbau = (physBuffer >> 32) & 0xFFFFFFFF;
-    commandTable->prdt_entry[0].dbc = 512 * count - 1; // 512 bytes per sector
-    commandTable->prdt_entry[0].i = 1;
+    for (unsigned i = 0; i < regionCount; i++) {
+        commandTable->prdt_entry[i].dba = regions[i].phys & 0xFFFFFFFF;
+        commandTable->prdt_entry[i].dbau = (regions[i].phys >> 32) & 0xFFFFFFFF;
+        commandTable->prdt_entry[i].dbc = regions[i].size - 1;
+    }
+    commandTable->prdt_entry[regionCount - 1].i = 1;
 
     fis_reg_h2d_t* cmdfis = (fis_reg_h2d_t*)(commandTable->cfis);
     memset(commandTable->cfis, 0, sizeof(fis_reg_h2d_t));
@@ -470,6 +542,7 @@ void Port::Identify() {
 
     commandHeader->prdbc = 0;
     commandHeader->pmp = 0;
+    commandHeader->prdtl = 1;
 
     hba_cmd_tbl_t* commandTable = commandTables[slot];
     memset(commandTable, 0, sizeof(hba_cmd_tbl_t));
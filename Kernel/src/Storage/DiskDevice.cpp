@@ -9,6 +9,7 @@ static int nextDeviceNumber = 0;
 
 DiskDevice::DiskDevice() : Device(DeviceTypeStorageDevice) {
     flags = FS_NODE_CHARDEVICE;
+    pageCached = true;
 
     char buf[16];
     strcpy(buf, "hd");
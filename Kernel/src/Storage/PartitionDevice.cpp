@@ -2,6 +2,7 @@
 
 #include <CString.h>
 #include <Errno.h>
+#include <Fs/PageCache.h>
 
 PartitionDevice::PartitionDevice(uint64_t startLBA, uint64_t endLBA, DiskDevice* disk)
     : Device(DeviceTypeStoragePartition) {
@@ -10,6 +11,7 @@ PartitionDevice::PartitionDevice(uint64_t startLBA, uint64_t endLBA, DiskDevice*
     this->parentDisk = disk;
 
     flags = FS_NODE_CHARDEVICE;
+    pageCached = true;
 
     char buf[18];
     strcpy(buf, parentDisk->InstanceName().c_str());
@@ -50,9 +52,16 @@ int PartitionDevice::WriteBlock(uint64_t lba, uint32_t count, void* buffer) {
     if (lba * parentDisk->blocksize + count > (m_endLBA - m_startLBA) * parentDisk->blocksize)
         return 2;
 
+    InvalidateCachedBlocks(lba, count);
     return parentDisk->WriteDiskBlock(lba + m_startLBA, count, buffer);
 }
 
+void PartitionDevice::InvalidateCachedBlocks(uint64_t lba, uint32_t count) {
+    // Both the partition and the disk may have the blocks cached
+    fs::PageCache::Invalidate(this, lba * parentDisk->blocksize, count);
+    fs::PageCache::Invalidate(parentDisk, (lba + m_startLBA) * parentDisk->blocksize, count);
+}
+
 ssize_t PartitionDevice::Read(size_t off, size_t size, uint8_t* buffer) {
     if (off & (parentDisk->blocksize - 1)) {
         Log::Warning("PartitionDevice::Read: Unaligned offset %d!", off);
@@ -74,6 +83,7 @@ ssize_t PartitionDevice::Write(size_t off, size_t size, uint8_t* buffer) {
         return -EINVAL; // Block aligned writes only
     }
 
+    InvalidateCachedBlocks(off / parentDisk->blocksize, size);
     int e = parentDisk->WriteDiskBlock(m_startLBA + off / parentDisk->blocksize, size, buffer);
 
     if (e) {
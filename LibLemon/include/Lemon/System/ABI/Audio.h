@@ -20,6 +20,7 @@ enum AudioOutputIoCtl {
     IoCtlOutputSetNumberOfChannels = 0x1004,
     IoCtlOutputGetNumberOfChannels = 0x1005,
     IoCtlOutputSetAsync = 0x1006,
+    IoCtlOutputGetUnderruns = 0x1007, // Number of times the output ran out of samples
 };
 
 #define LEMON_ABI_AUDIO_ENCODING_COUNT 2
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Records returned by getdents64
+//
+// Records are packed one after the other, each is padded to a multiple of 8 bytes
+// and d_reclen is the offset of the next record.
+// d_off is an opaque cursor which can be passed to lseek to continue reading after the record.
+
+struct lemon_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    uint16_t d_reclen;
+    uint8_t d_type; // DT_* type of the file
+    char d_name[];  // Null terminated
+};
+
+#define LEMON_DIRENT64_RECLEN(nameLength) ((offsetof(struct lemon_dirent64, d_name) + (nameLength) + 1 + 7) & ~7UL)
+
+// Records returned by getdents_plus, a directory entry followed by the attributes of the file
+// as returned by fstatat with AT_SYMLINK_NOFOLLOW.
+// d_error is 0 if the attributes are valid, otherwise a negative error code
+// (e.g. the entry was removed after it was read).
+struct lemon_dirent_plus {
+    int64_t d_off;
+    uint16_t d_reclen;
+    uint8_t d_type;
+    uint8_t d_reserved;
+    int32_t d_error;
+
+    uint64_t st_dev;
+    int64_t st_ino;
+    int32_t st_mode;
+    int32_t st_nlink;
+    uint32_t st_uid;
+    uint32_t st_gid;
+    uint64_t st_rdev;
+    int64_t st_size;
+    int64_t st_blksize;
+    int64_t st_blocks;
+
+    char d_name[]; // Null terminated
+};
+
+#define LEMON_DIRENT_PLUS_RECLEN(nameLength)                                                                           \
+    ((offsetof(struct lemon_dirent_plus, d_name) + (nameLength) + 1 + 7) & ~7UL)
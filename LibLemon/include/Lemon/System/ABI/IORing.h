@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+// Asynchronous I/O rings
+//
+// A ring is a single shared memory region containing a header (ioring_shared),
+// the submission queue entries and the completion queue entries.
+// Userspace fills SQEs at sqTail and advances it, the kernel consumes them from sqHead.
+// The kernel posts CQEs at cqTail, userspace consumes them from cqHead.
+
+#define IORING_OP_NOP 0
+#define IORING_OP_READ 1    // fd, addr = buffer, len, offset (-1 to use and advance the file position)
+#define IORING_OP_WRITE 2   // fd, addr = buffer, len, offset (-1 to use and advance the file position)
+#define IORING_OP_SEND 3    // fd, addr = buffer, len, opFlags = MSG_* flags
+#define IORING_OP_RECV 4    // fd, addr = buffer, len, opFlags = MSG_* flags
+#define IORING_OP_ACCEPT 5  // fd, addr = sockaddr buffer (optional), len = size of addr
+#define IORING_OP_OPENAT 6  // fd = directory (or AT_FDCWD), addr = path, opFlags = open flags
+#define IORING_OP_FSYNC 7   // fd
+#define IORING_OP_TIMEOUT 8 // offset = timeout in nanoseconds, completes with -ETIME
+#define IORING_OP_LAST IORING_OP_TIMEOUT
+
+#define IORING_MAX_ENTRIES 4096
+
+// Wait for minComplete completions after submitting
+#define IORING_ENTER_GETEVENTS 1
+
+struct ioring_sqe {
+    uint8_t opcode;
+    uint8_t flags; // Reserved, must be 0
+    uint16_t reserved;
+    int32_t fd;
+    int64_t offset;
+    uint64_t addr;
+    uint32_t len;
+    uint32_t opFlags;
+    uint64_t userData; // Passed back in the completion
+};
+
+struct ioring_cqe {
+    uint64_t userData;
+    int32_t result; // Result of the operation, negative error code on failure
+    uint32_t flags;
+};
+
+struct ioring_shared {
+    volatile uint32_t sqHead; // Written by the kernel
+    volatile uint32_t sqTail; // Written by userspace
+    volatile uint32_t cqHead; // Written by userspace
+    volatile uint32_t cqTail; // Written by the kernel
+
+    uint32_t sqMask;
+    uint32_t sqEntries;
+    uint32_t cqMask;
+    uint32_t cqEntries;
+
+    volatile uint32_t cqOverflow; // Completions dropped as the completion queue was full
+
+    uint32_t sqeOffset; // Offset of the SQE array from the start of the ring
+    uint32_t cqeOffset; // Offset of the CQE array from the start of the ring
+};
+
+struct ioring_params {
+    uint32_t sqEntries; // Rounded up to a power of two
+    uint32_t cqEntries; // Twice sqEntries
+
+    uint64_t ringBase; // Address of the ring in the caller's address space
+    uint64_t ringSize;
+};
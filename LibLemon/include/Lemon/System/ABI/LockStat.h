@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+#define LOCKSTAT_FILE_NAME_MAX 64
+#define LOCKSTAT_SYMBOL_NAME_MAX 128
+
+// Spinlock contention statistics for one lock call site,
+// read as an array from /dev/lockstat (kernel must be built with KERNEL_LOCK_PROFILING)
+typedef struct LockStatEntry {
+    uint64_t address; // Address of the call site
+    uint64_t acquisitions;
+    uint64_t contended; // Acquisitions where the lock was already held
+    uint64_t spinCycles; // Total TSC cycles spent waiting for the lock
+    uint64_t holdCycles; // Total TSC cycles the lock was held for
+    uint64_t maxHoldCycles;
+    uint32_t line;
+    char file[LOCKSTAT_FILE_NAME_MAX];
+    char symbol[LOCKSTAT_SYMBOL_NAME_MAX]; // Mangled name of the function containing the call site
+} lockstat_entry_t;
+
+enum LockStatIoCtl {
+    IoCtlLockStatReset = 0x1000, // Zero all counters
+};
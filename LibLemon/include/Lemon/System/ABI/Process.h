@@ -2,6 +2,14 @@
 
 #include <abi-bits/pid_t.h>
 
+// Thread scheduling policies, values match POSIX SCHED_OTHER, SCHED_FIFO and SCHED_RR
+#define LEMON_SCHED_NORMAL 0
+#define LEMON_SCHED_FIFO 1 // Real-time, runs until it blocks, yields or is preempted by a higher priority thread
+#define LEMON_SCHED_RR 2   // Real-time, round robin between threads of the same priority
+
+#define LEMON_SCHED_RT_PRIORITY_MIN 1
+#define LEMON_SCHED_RT_PRIORITY_MAX 99
+
 typedef struct LemonProcessInfo {
     pid_t pid; // Process ID
 
@@ -19,4 +27,6 @@ typedef struct LemonProcessInfo {
     bool isCPUIdle = false; // Whether or not the process is an idle process
 
     uint64_t usedMem; // Used memory in KB
+
+    char execPath[256]; // Absolute path of the executable, empty for kernel processes
 } lemon_process_info_t;
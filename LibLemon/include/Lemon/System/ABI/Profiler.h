@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <abi-bits/pid_t.h>
+
+#define PROFILER_MAX_FRAMES 32
+
+#define PROFILER_SAMPLE_USER 0x1 // The CPU was running user code when the sample was taken
+
+// A single sample from the CPU profiler, read as an array from /dev/profiler.
+// frames[0] is the interrupted instruction pointer followed by the return addresses of each stack frame
+typedef struct ProfilerSample {
+    pid_t pid;
+    pid_t tid;
+    uint16_t cpu;
+    uint16_t flags;
+    uint32_t frameCount;
+    uint64_t frames[PROFILER_MAX_FRAMES];
+} profiler_sample_t;
+
+#define PROFILER_SYMBOL_NAME_MAX 128
+
+// Used with IoCtlProfilerResolveSymbol to look up a kernel address
+typedef struct ProfilerSymbol {
+    uint64_t address; // Address to resolve
+    uint64_t base; // Filled with the address of the symbol containing address
+    char name[PROFILER_SYMBOL_NAME_MAX]; // Filled with the mangled name of the symbol
+} profiler_symbol_t;
+
+enum ProfilerIoCtl {
+    IoCtlProfilerStart = 0x1000, // arg is the amount of timer ticks between samples (0 for every tick)
+    IoCtlProfilerStop = 0x1001,
+    IoCtlProfilerGetDropped = 0x1002, // Amount of samples lost because the buffers were full
+    IoCtlProfilerResolveSymbol = 0x1003, // arg is a pointer to profiler_symbol_t, returns -ENOENT if not found
+};
@@ -109,3 +109,17 @@
 #define SYS_EPOLL_CREATE 108
 #define SYS_EPOLL_CTL 109
 #define SYS_EPOLL_WAIT 110
+#define SYS_SCHED_SET_SCHEDULER 112
+#define SYS_SCHED_GET_SCHEDULER 113
+#define SYS_FSYNC 114
+#define SYS_READV 115
+#define SYS_WRITEV 116
+#define SYS_PREADV 117
+#define SYS_PWRITEV 118
+#define SYS_SENDFILE 119
+#define SYS_SPLICE 120
+#define SYS_COPY_FILE_RANGE 121
+#define SYS_IORING_SETUP 122
+#define SYS_IORING_ENTER 123
+#define SYS_GETDENTS64 124
+#define SYS_GETDENTS_PLUS 125
@@ -24,6 +24,20 @@ namespace Lemon{
     /////////////////////////////
     long InterruptThread(pid_t tid);
 
+    /////////////////////////////
+    /// \brief Set scheduling policy of a thread
+    ///
+    /// Only root may use LEMON_SCHED_FIFO and LEMON_SCHED_RR (EPERM).
+    ///
+    /// \param tid Thread ID, 0 for the calling thread
+    /// \param policy LEMON_SCHED_NORMAL, LEMON_SCHED_FIFO or LEMON_SCHED_RR
+    /// \param priority Real-time priority (LEMON_SCHED_RT_PRIORITY_MIN to LEMON_SCHED_RT_PRIORITY_MAX),
+    /// must be 0 for LEMON_SCHED_NORMAL
+    ///
+    /// \return 0 on success, -1 on failure (errno is set)
+    /////////////////////////////
+    int SetScheduler(pid_t tid, int policy, int priority);
+
     /////////////////////////////
     /// \brief Get information about process
     ///
@@ -39,6 +39,15 @@ long InterruptThread(pid_t tid) {
     return 0;
 }
 
+int SetScheduler(pid_t tid, int policy, int priority) {
+    if (long e = syscall(SYS_SCHED_SET_SCHEDULER, tid, policy, priority); e < 0) {
+        errno = -e;
+        return -1;
+    }
+
+    return 0;
+}
+
 int GetProcessInfo(pid_t pid, lemon_process_info_t& pInfo) {
     long ret = -1;
     if ((ret = syscall(SYS_GET_PROCESS_INFO, pid, &pInfo))) {
@@ -23,3 +23,16 @@ nm Build/packages/lemon-kernel/system/lemon/kernel.sys > Initrd/kernel.map
 cd Initrd
 tar -cf ../Build/sysroot/system/lemon/initrd.tar *
 cd ..
+
+if [ "$INITRD_COMPRESS" != "0" ]; then # The kernel detects and decompresses LZ4 frames at boot
+	LZ4C="Build/lz4compress"
+	LZ4C_SRC="Scripts/lz4compress.cpp"
+
+	if ! [ -f "$LZ4C" ] || [ "$LZ4C_SRC" -nt "$LZ4C" ]; then
+		echo "Rebuilding $LZ4C_SRC"
+		${CXX:-c++} -O2 -o "$LZ4C" "$LZ4C_SRC"
+	fi
+
+	"$LZ4C" Build/sysroot/system/lemon/initrd.tar Build/sysroot/system/lemon/initrd.tar.lz4
+	mv Build/sysroot/system/lemon/initrd.tar.lz4 Build/sysroot/system/lemon/initrd.tar
+fi
@@ -0,0 +1,205 @@
+// Compress a file into an LZ4 frame for the kernel to decompress at boot (used for the initrd)
+//
+// Blocks are independent and the frame header always includes the content size,
+// so the kernel can allocate the output up front and decompress blocks in parallel.
+//
+// Usage: lz4compress <input> <output>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define LZ4_FRAME_MAGIC 0x184D2204U
+#define LZ4_BLOCK_UNCOMPRESSED 0x80000000U
+
+#define BLOCK_SIZE_ID 7 // 4MB blocks
+#define BLOCK_SIZE (1U << (8 + 2 * BLOCK_SIZE_ID))
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5 // The last 5 bytes of a block are always literals
+#define MF_LIMIT 12     // A match cannot start within the last 12 bytes of a block
+#define MAX_OFFSET 65535
+
+#define HASH_BITS 16
+
+static uint32_t Read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static void Write32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((v >> (i * 8)) & 0xFF);
+    }
+}
+
+static void WriteLength(std::vector<uint8_t>& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(length);
+}
+
+// xxHash32, used for the frame header checksum
+static uint32_t XXH32(const uint8_t* p, size_t length, uint32_t seed) {
+    const uint32_t prime1 = 2654435761U, prime2 = 2246822519U, prime3 = 3266489917U, prime4 = 668265263U,
+                   prime5 = 374761393U;
+    auto rotl = [](uint32_t x, int r) { return (x << r) | (x >> (32 - r)); };
+    auto round = [&](uint32_t acc, uint32_t input) { return rotl(acc + input * prime2, 13) * prime1; };
+
+    const uint8_t* end = p + length;
+    uint32_t h;
+    if (length >= 16) {
+        uint32_t v1 = seed + prime1 + prime2, v2 = seed + prime2, v3 = seed, v4 = seed - prime1;
+        for (; p + 16 <= end; p += 16) {
+            v1 = round(v1, Read32(p));
+            v2 = round(v2, Read32(p + 4));
+            v3 = round(v3, Read32(p + 8));
+            v4 = round(v4, Read32(p + 12));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    } else {
+        h = seed + prime5;
+    }
+
+    h += length;
+    for (; p + 4 <= end; p += 4) {
+        h = rotl(h + Read32(p) * prime3, 17) * prime4;
+    }
+    for (; p < end; p++) {
+        h = rotl(h + *p * prime5, 11) * prime1;
+    }
+
+    h ^= h >> 15;
+    h *= prime2;
+    h ^= h >> 13;
+    h *= prime3;
+    h ^= h >> 16;
+    return h;
+}
+
+static uint32_t Hash(uint32_t sequence) { return (sequence * 2654435761U) >> (32 - HASH_BITS); }
+
+static void WriteSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount, size_t offset,
+                          size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+
+    out.push_back(((literalCount >= 15 ? 15 : literalCount) << 4) | (matchCode >= 15 ? 15 : matchCode));
+    if (literalCount >= 15) {
+        WriteLength(out, literalCount - 15);
+    }
+    out.insert(out.end(), literals, literals + literalCount);
+
+    if (matchLength) {
+        out.push_back(offset & 0xFF);
+        out.push_back(offset >> 8);
+        if (matchCode >= 15) {
+            WriteLength(out, matchCode - 15);
+        }
+    }
+}
+
+// Greedy compression of a single block, each block starts with an empty hash table
+static std::vector<uint8_t> CompressBlock(const uint8_t* src, size_t size) {
+    std::vector<uint8_t> out;
+    std::vector<uint32_t> table(1 << HASH_BITS, UINT32_MAX);
+
+    size_t anchor = 0; // Start of pending literals
+    size_t pos = 0;
+    while (size >= MF_LIMIT && pos < size - MF_LIMIT) {
+        uint32_t sequence = Read32(src + pos);
+        uint32_t h = Hash(sequence);
+        uint32_t candidate = table[h];
+        table[h] = pos;
+
+        if (candidate == UINT32_MAX || pos - candidate > MAX_OFFSET || Read32(src + candidate) != sequence) {
+            pos++;
+            continue;
+        }
+
+        // Extend the match backwards over pending literals and forwards up to the end limit
+        size_t start = pos;
+        while (start > anchor && candidate > 0 && src[start - 1] == src[candidate - 1]) {
+            start--;
+            candidate--;
+        }
+
+        size_t length = pos - start + MIN_MATCH;
+        while (start + length < size - LAST_LITERALS && src[start + length] == src[candidate + length]) {
+            length++;
+        }
+
+        WriteSequence(out, src + anchor, start - anchor, start - candidate, length);
+
+        pos = start + length;
+        anchor = pos;
+    }
+
+    WriteSequence(out, src + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <input> <output>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    std::vector<uint8_t> input;
+    uint8_t buffer[65536];
+    size_t r;
+    while ((r = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        input.insert(input.end(), buffer, buffer + r);
+    }
+    fclose(in);
+
+    std::vector<uint8_t> out;
+    Write32(out, LZ4_FRAME_MAGIC);
+
+    // Version 01, independent blocks, content size present, no checksums
+    size_t descriptor = out.size();
+    out.push_back(0x40 | 0x20 | 0x08);
+    out.push_back(BLOCK_SIZE_ID << 4);
+    uint64_t contentSize = input.size();
+    Write32(out, contentSize & 0xFFFFFFFF);
+    Write32(out, contentSize >> 32);
+
+    // Header checksum is the second byte of xxh32 of the descriptor
+    out.push_back((XXH32(out.data() + descriptor, out.size() - descriptor, 0) >> 8) & 0xFF);
+
+    for (size_t offset = 0; offset < input.size(); offset += BLOCK_SIZE) {
+        size_t size = input.size() - offset < BLOCK_SIZE ? input.size() - offset : BLOCK_SIZE;
+
+        std::vector<uint8_t> block = CompressBlock(input.data() + offset, size);
+        if (block.size() >= size) {
+            // Incompressible, store as is
+            Write32(out, size | LZ4_BLOCK_UNCOMPRESSED);
+            out.insert(out.end(), input.begin() + offset, input.begin() + offset + size);
+        } else {
+            Write32(out, block.size());
+            out.insert(out.end(), block.begin(), block.end());
+        }
+    }
+
+    Write32(out, 0); // End mark
+
+    FILE* f = fopen(argv[2], "wb");
+    if (!f || fwrite(out.data(), 1, out.size(), f) != out.size()) {
+        perror(argv[2]);
+        return 1;
+    }
+    fclose(f);
+
+    printf("%s: %zu -> %zu bytes (%.1f%%)\n", argv[2], input.size(), out.size(),
+           input.size() ? 100.0 * out.size() / input.size() : 100.0);
+    return 0;
+}
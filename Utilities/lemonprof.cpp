@@ -0,0 +1,287 @@
+#include <Lemon/System/ABI/Profiler.h>
+#include <Lemon/System/Util.h>
+
+#include <cxxabi.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#define KERNEL_ADDRESS_BASE 0xFFFF800000000000
+
+struct Symbol {
+    uint64_t address;
+    uint64_t size;
+    std::string name;
+};
+
+// Function symbols of a (non PIE) executable, sorted by address
+struct SymbolTable {
+    std::vector<Symbol> symbols;
+
+    const Symbol* Find(uint64_t address) const {
+        auto it = std::upper_bound(symbols.begin(), symbols.end(), address,
+                                   [](uint64_t addr, const Symbol& sym) { return addr < sym.address; });
+        if (it == symbols.begin()) {
+            return nullptr;
+        }
+
+        --it;
+        if (it->size && address >= it->address + it->size) {
+            return nullptr;
+        }
+
+        return &(*it);
+    }
+};
+
+static int profilerFd = -1;
+
+static std::map<pid_t, std::string> processNames;
+static std::map<pid_t, std::string> processPaths; // Executable of each process for symbol lookup
+static std::map<std::string, SymbolTable> symbolTables;
+static std::map<uint64_t, std::string> kernelSymbols;
+
+static std::string Demangle(const char* name) {
+    int status;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status || !demangled) {
+        return name;
+    }
+
+    std::string ret = demangled;
+    free(demangled);
+    return ret;
+}
+
+static void LoadSymbolTable(const std::string& path, SymbolTable& table) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    std::vector<uint8_t> elf(size);
+    if (size < (long)sizeof(Elf64_Ehdr) || fread(elf.data(), 1, size, f) != (size_t)size) {
+        fclose(f);
+        return;
+    }
+    fclose(f);
+
+    Elf64_Ehdr* header = (Elf64_Ehdr*)elf.data();
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) || header->e_type != ET_EXEC ||
+        header->e_shoff + header->e_shnum * sizeof(Elf64_Shdr) > (uint64_t)size) {
+        return; // Only executables loaded at a fixed address can be symbolized
+    }
+
+    Elf64_Shdr* sections = (Elf64_Shdr*)(elf.data() + header->e_shoff);
+    for (unsigned i = 0; i < header->e_shnum; i++) {
+        if (sections[i].sh_type != SHT_SYMTAB || sections[i].sh_link >= header->e_shnum) {
+            continue;
+        }
+
+        Elf64_Shdr& strtab = sections[sections[i].sh_link];
+        if (sections[i].sh_offset + sections[i].sh_size > (uint64_t)size ||
+            strtab.sh_offset + strtab.sh_size > (uint64_t)size) {
+            continue;
+        }
+
+        Elf64_Sym* syms = (Elf64_Sym*)(elf.data() + sections[i].sh_offset);
+        const char* strings = (const char*)(elf.data() + strtab.sh_offset);
+        for (unsigned j = 0; j < sections[i].sh_size / sizeof(Elf64_Sym); j++) {
+            if (ELF64_ST_TYPE(syms[j].st_info) != STT_FUNC || !syms[j].st_value ||
+                syms[j].st_name >= strtab.sh_size) {
+                continue;
+            }
+
+            table.symbols.push_back({syms[j].st_value, syms[j].st_size, Demangle(strings + syms[j].st_name)});
+        }
+    }
+
+    std::sort(table.symbols.begin(), table.symbols.end(),
+              [](const Symbol& l, const Symbol& r) { return l.address < r.address; });
+}
+
+static std::string FormatAddress(uint64_t address) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "0x%lx", address);
+    return buf;
+}
+
+static std::string ResolveKernel(uint64_t address) {
+    profiler_symbol_t sym;
+    memset(&sym, 0, sizeof(sym));
+    sym.address = address;
+
+    if (ioctl(profilerFd, IoCtlProfilerResolveSymbol, &sym)) {
+        return FormatAddress(address) + "_[k]";
+    }
+
+    // Cache by symbol base so each function is only demangled once
+    auto it = kernelSymbols.find(sym.base);
+    if (it == kernelSymbols.end()) {
+        it = kernelSymbols.insert({sym.base, Demangle(sym.name) + "_[k]"}).first;
+    }
+
+    return it->second;
+}
+
+static std::string ResolveUser(const std::string& executable, uint64_t address) {
+    auto it = symbolTables.find(executable);
+    if (it == symbolTables.end()) {
+        it = symbolTables.insert({executable, SymbolTable{}}).first;
+        LoadSymbolTable(executable, it->second);
+    }
+
+    if (const Symbol* sym = it->second.Find(address)) {
+        return sym->name;
+    }
+
+    return FormatAddress(address);
+}
+
+static void NoteProcess(pid_t pid) {
+    if (processNames.find(pid) != processNames.end()) {
+        return;
+    }
+
+    lemon_process_info_t info;
+    if (Lemon::GetProcessInfo(pid, info)) {
+        processNames[pid] = "pid " + std::to_string(pid);
+        processPaths[pid] = "";
+    } else {
+        processNames[pid] = info.name;
+        processPaths[pid] = info.execPath;
+    }
+}
+
+static void Drain(std::vector<profiler_sample_t>& samples) {
+    profiler_sample_t buffer[64];
+
+    ssize_t len;
+    while ((len = read(profilerFd, buffer, sizeof(buffer))) > 0) {
+        for (unsigned i = 0; i < len / sizeof(profiler_sample_t); i++) {
+            NoteProcess(buffer[i].pid);
+            samples.push_back(buffer[i]);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    long duration = 5;
+    long interval = 1;
+    const char* outputPath = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:i:o:")) >= 0) {
+        switch (opt) {
+        case 'd':
+            duration = strtol(optarg, NULL, 10);
+            break;
+        case 'i':
+            interval = strtol(optarg, NULL, 10);
+            break;
+        case 'o':
+            outputPath = optarg;
+            break;
+        case '?':
+            printf("Usage: %s [-d seconds] [-i ticks between samples] [-o output]\n"
+                   "Writes folded stacks, suitable for flamegraph.pl\n",
+                   argv[0]);
+            return 2;
+        }
+    }
+
+    profilerFd = open("/dev/profiler", O_RDONLY);
+    if (profilerFd < 0) {
+        fprintf(stderr, "Failed to open /dev/profiler: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (ioctl(profilerFd, IoCtlProfilerStart, interval)) {
+        fprintf(stderr, "Failed to start profiler: %s\n", strerror(errno));
+        return 1;
+    }
+
+    std::vector<profiler_sample_t> samples;
+
+    // Keep draining the per-CPU buffers so they do not fill up
+    timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        usleep(100000);
+        Drain(samples);
+
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec - start.tv_sec >= duration) {
+            break;
+        }
+    }
+
+    ioctl(profilerFd, IoCtlProfilerStop);
+    Drain(samples);
+
+    int dropped = ioctl(profilerFd, IoCtlProfilerGetDropped);
+    if (dropped > 0) {
+        fprintf(stderr, "Warning: %d samples were dropped\n", dropped);
+    }
+
+    std::map<std::string, unsigned long> folded;
+    for (const profiler_sample_t& sample : samples) {
+        const std::string& process = processNames[sample.pid];
+        const std::string& executable = processPaths[sample.pid];
+
+        // Folded stacks go from the outermost frame to the innermost
+        std::string stack = process;
+        for (int i = (int)sample.frameCount - 1; i >= 0; i--) {
+            uint64_t address = sample.frames[i];
+            if (i > 0 && address) {
+                address--; // Return addresses point after the call
+            }
+
+            stack += ";";
+            if (address >= KERNEL_ADDRESS_BASE) {
+                stack += ResolveKernel(address);
+            } else {
+                stack += ResolveUser(executable, address);
+            }
+        }
+
+        folded[stack]++;
+    }
+
+    FILE* out = stdout;
+    if (outputPath && !(out = fopen(outputPath, "w"))) {
+        fprintf(stderr, "Failed to open %s: %s\n", outputPath, strerror(errno));
+        return 1;
+    }
+
+    for (auto& stack : folded) {
+        fprintf(out, "%s %lu\n", stack.first.c_str(), stack.second);
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    fprintf(stderr, "%lu samples\n", samples.size());
+
+    close(profilerFd);
+    return 0;
+}
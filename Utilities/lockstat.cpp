@@ -0,0 +1,120 @@
+#include <Lemon/System/ABI/LockStat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+
+#include <algorithm>
+#include <vector>
+
+enum SortKey {
+    SortContended,
+    SortSpin,
+    SortHold,
+    SortMaxHold,
+    SortAcquisitions,
+};
+
+static uint64_t Key(const lockstat_entry_t& e, SortKey key) {
+    switch (key) {
+    case SortSpin:
+        return e.spinCycles;
+    case SortHold:
+        return e.holdCycles;
+    case SortMaxHold:
+        return e.maxHoldCycles;
+    case SortAcquisitions:
+        return e.acquisitions;
+    case SortContended:
+    default:
+        return e.contended;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t count = 20;
+    SortKey sortKey = SortContended;
+    bool reset = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:r")) >= 0) {
+        switch (opt) {
+        case 'n':
+            count = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            if (!strcmp(optarg, "contended")) {
+                sortKey = SortContended;
+            } else if (!strcmp(optarg, "spin")) {
+                sortKey = SortSpin;
+            } else if (!strcmp(optarg, "hold")) {
+                sortKey = SortHold;
+            } else if (!strcmp(optarg, "maxhold")) {
+                sortKey = SortMaxHold;
+            } else if (!strcmp(optarg, "acquisitions")) {
+                sortKey = SortAcquisitions;
+            } else {
+                fprintf(stderr, "Invalid sort key '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        case 'r':
+            reset = true;
+            break;
+        case '?':
+            printf("Usage: %s [-n count] [-s contended|spin|hold|maxhold|acquisitions] [-r]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int fd = open("/dev/lockstat", O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open /dev/lockstat: %s (was the kernel built with KERNEL_LOCK_PROFILING?)\n",
+                strerror(errno));
+        return 1;
+    }
+
+    if (reset) {
+        if (ioctl(fd, IoCtlLockStatReset)) {
+            fprintf(stderr, "Failed to reset lock statistics: %s\n", strerror(errno));
+            return 1;
+        }
+
+        close(fd);
+        return 0;
+    }
+
+    std::vector<lockstat_entry_t> entries;
+    lockstat_entry_t buffer[64];
+
+    ssize_t len;
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+        entries.insert(entries.end(), buffer, buffer + len / sizeof(lockstat_entry_t));
+    }
+    close(fd);
+
+    if (len < 0) {
+        fprintf(stderr, "Failed to read /dev/lockstat: %s\n", strerror(errno));
+        return 1;
+    }
+
+    std::sort(entries.begin(), entries.end(), [sortKey](const lockstat_entry_t& l, const lockstat_entry_t& r) {
+        return Key(l, sortKey) > Key(r, sortKey);
+    });
+
+    printf("%12s %12s %14s %14s %12s  %s\n", "Acquired", "Contended", "Spin Cycles", "Hold Cycles", "Max Hold",
+           "Call Site");
+    for (size_t i = 0; i < entries.size() && i < count; i++) {
+        const lockstat_entry_t& e = entries[i];
+        printf("%12lu %12lu %14lu %14lu %12lu  %s (%s:%u)\n", e.acquisitions, e.contended, e.spinCycles, e.holdCycles,
+               e.maxHoldCycles, e.symbol[0] ? e.symbol : "?", e.file, e.line);
+    }
+
+    return 0;
+}